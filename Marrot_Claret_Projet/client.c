@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,10 +7,22 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include "protocol.h"
 
 #define BUFFER_SIZE 1024
 #define PORT 12345
 #define ADRESSE_IP "127.0.0.1"
+#define BENCH_MARKER "#bench "  // Début de la charge utile d'un message de bench
+#define BENCH_MAX_EVENTS 256
+#define SCREEN_LINES 1000 // Lignes gardées pour redessiner l'écran
+#define PROMPT "Envoyer un message : "
+#define MAX_SUBSCRIPTIONS 32 // Channels suivis en même temps (limite du serveur)
+
+int server_port = PORT; // --port : instance du serveur à contacter
 
 /**
  * Convertit une string en minuscules.
@@ -36,28 +49,370 @@ void format_current_time(char *buffer, size_t buffer_size)
 }
 
 /**
- * Affiche l'historique et le prompt.
- * @param history L'historique des messages.
+ * Ligne gardée à l'écran (tampon réutilisé quand la ligne est recyclée).
+ */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} ScreenLine;
+
+/**
+ * Affichage du chat : les dernières lignes reçues dans un anneau borné, pour
+ * pouvoir redessiner l'écran, et un affichage incrémental sur le terminal.
+ * Un nouveau message ne fait qu'effacer la ligne du prompt, écrire ses lignes
+ * puis réécrire le prompt : le coût ne dépend pas de la taille de l'historique.
+ */
+typedef struct
+{
+    ScreenLine lines[SCREEN_LINES];
+    int start; // Slot de la ligne la plus ancienne
+    int count;
+    int interactive; // Terminal en entrée et en sortie : séquences ANSI et effacement de la saisie
+} Screen;
+
+/**
+ * Ajoute une ligne à l'anneau de l'écran, en recyclant la plus ancienne s'il est plein.
+ * @param screen L'écran.
+ * @param text La ligne (sans saut de ligne).
+ * @param length La taille de la ligne.
+ */
+void screen_store_line(Screen *screen, const char *text, size_t length)
+{
+    ScreenLine *line;
+    if (screen->count < SCREEN_LINES)
+    {
+        line = &screen->lines[(screen->start + screen->count) % SCREEN_LINES];
+        screen->count++;
+    }
+    else
+    {
+        line = &screen->lines[screen->start];
+        screen->start = (screen->start + 1) % SCREEN_LINES;
+    }
+
+    if (line->capacity < length)
+    {
+        char *data = realloc(line->data, length);
+        if (data == NULL)
+        {
+            line->length = 0;
+            return;
+        }
+        line->data = data;
+        line->capacity = length;
+    }
+    memcpy(line->data, text, length);
+    line->length = length;
+}
+
+/**
+ * Affiche le prompt sur la dernière ligne.
  */
-void display_history_and_prompt(const char *history)
+void screen_prompt(void)
 {
-    system("clear");
-    printf("%s", history);
-    printf("\n%s", "Envoyer un message : ");
+    fputs(PROMPT, stdout);
     fflush(stdout);
 }
 
+/**
+ * Ajoute du texte à l'écran : efface le prompt, écrit les nouvelles lignes à la
+ * suite de celles déjà affichées puis réécrit le prompt.
+ * @param screen L'écran.
+ * @param text Le texte (une ou plusieurs lignes).
+ * @param length La taille du texte.
+ */
+void screen_append(Screen *screen, const char *text, size_t length)
+{
+    if (screen->interactive)
+    {
+        fputs("\r\033[2K", stdout); // Retour en début de ligne, ligne effacée
+    }
+    else
+    {
+        fputc('\n', stdout);
+    }
+
+    while (length > 0)
+    {
+        const char *end = memchr(text, '\n', length);
+        size_t line_length = end != NULL ? (size_t)(end - text) : length;
+        screen_store_line(screen, text, line_length);
+        fwrite(text, 1, line_length, stdout);
+        fputc('\n', stdout);
+
+        size_t consumed = end != NULL ? line_length + 1 : line_length;
+        text += consumed;
+        length -= consumed;
+    }
+    screen_prompt();
+}
+
+/**
+ * Efface la ligne que le terminal vient d'afficher en écho de la saisie : le
+ * message envoyé est réaffiché, formaté, par screen_append.
+ * @param screen L'écran.
+ */
+void screen_erase_input(Screen *screen)
+{
+    if (screen->interactive)
+    {
+        fputs("\033[A\r\033[2K", stdout); // Ligne précédente, effacée
+    }
+}
+
+/**
+ * Redessine tout l'écran depuis l'anneau (après /help par exemple). Rare : le
+ * coût est borné par SCREEN_LINES, pas par la taille de l'historique.
+ * @param screen L'écran.
+ */
+void screen_redraw(Screen *screen)
+{
+    if (screen->interactive)
+    {
+        fputs("\033[H\033[2J", stdout); // Curseur en haut à gauche, écran effacé
+    }
+    for (int i = 0; i < screen->count; ++i)
+    {
+        ScreenLine *line = &screen->lines[(screen->start + i) % SCREEN_LINES];
+        fwrite(line->data, 1, line->length, stdout);
+        fputc('\n', stdout);
+    }
+    screen_prompt();
+}
+
+/**
+ * Vide l'écran et l'anneau (changement de channel).
+ * @param screen L'écran.
+ */
+void screen_clear(Screen *screen)
+{
+    screen->start = 0;
+    screen->count = 0;
+    if (screen->interactive)
+    {
+        fputs("\033[H\033[2J", stdout);
+    }
+}
+
+/**
+ * Libère les lignes de l'écran.
+ * @param screen L'écran.
+ */
+void screen_free(Screen *screen)
+{
+    for (int i = 0; i < SCREEN_LINES; ++i)
+    {
+        free(screen->lines[i].data);
+    }
+}
+
+/**
+ * Envoie une trame au serveur (en-tête et données en un seul envoi).
+ * @param client_socket Le socket du client.
+ * @param type Le type de la trame.
+ * @param data Les données.
+ * @param length La taille des données.
+ * @return 0 en cas de succès, -1 en cas d'erreur.
+ */
+int send_frame(int client_socket, FrameType type, const char *data, size_t length)
+{
+    char frame[FRAME_HEADER_SIZE + BUFFER_SIZE];
+    if (length > FRAME_MAX_CLIENT_PAYLOAD)
+    {
+        length = FRAME_MAX_CLIENT_PAYLOAD;
+    }
+    frame_encode_header((unsigned char *)frame, type, 0, 0, (uint32_t)length);
+    memcpy(frame + FRAME_HEADER_SIZE, data, length);
+    return send(client_socket, frame, FRAME_HEADER_SIZE + length, 0) == (ssize_t)(FRAME_HEADER_SIZE + length) ? 0 : -1;
+}
+
+/**
+ * Négocie le protocole tramé avec le serveur (préface et version).
+ * @param client_socket Le socket du client.
+ * @return 0 en cas de succès, -1 si le serveur ne l'accepte pas.
+ */
+int negotiate_protocol(int client_socket)
+{
+    char preface[PROTOCOL_PREFACE_SIZE + 1];
+    memcpy(preface, PROTOCOL_PREFACE, PROTOCOL_PREFACE_SIZE);
+    preface[PROTOCOL_PREFACE_SIZE] = PROTOCOL_VERSION;
+    if (send(client_socket, preface, sizeof(preface), 0) != (ssize_t)sizeof(preface))
+    {
+        return -1;
+    }
+
+    char reply[PROTOCOL_PREFACE_SIZE + 1];
+    size_t received = 0;
+    while (received < sizeof(reply))
+    {
+        ssize_t read_size = recv(client_socket, reply + received, sizeof(reply) - received, 0);
+        if (read_size <= 0)
+        {
+            return -1;
+        }
+        received += (size_t)read_size;
+    }
+    return memcmp(reply, PROTOCOL_PREFACE, PROTOCOL_PREFACE_SIZE) == 0 && reply[PROTOCOL_PREFACE_SIZE] == PROTOCOL_VERSION ? 0 : -1;
+}
+
+/**
+ * Channels suivis, tenus comme le serveur : le courant en premier, puis du plus
+ * récent au plus ancien.
+ */
+typedef struct
+{
+    char names[MAX_SUBSCRIPTIONS][50];
+    int count;
+} ChannelList;
+
+/**
+ * Cherche un channel dans la liste.
+ * @param list La liste.
+ * @param name Le nom du channel.
+ * @return Sa position, ou -1 s'il n'est pas suivi.
+ */
+int channel_list_find(ChannelList *list, const char *name)
+{
+    for (int i = 0; i < list->count; ++i)
+    {
+        if (strcmp(list->names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Retire un channel de la liste.
+ * @param list La liste.
+ * @param index Sa position.
+ */
+void channel_list_remove(ChannelList *list, int index)
+{
+    memmove(list->names[index], list->names[index + 1], (size_t)(list->count - index - 1) * sizeof(list->names[0]));
+    list->count--;
+}
+
+/**
+ * Place un channel en tête de la liste (channel courant), en l'ajoutant s'il
+ * n'est pas suivi et qu'il reste de la place.
+ * @param list La liste.
+ * @param name Le nom du channel.
+ */
+void channel_list_join(ChannelList *list, const char *name)
+{
+    int index = channel_list_find(list, name);
+    if (index == -1 && list->count == MAX_SUBSCRIPTIONS)
+    {
+        return;
+    }
+    if (index != -1)
+    {
+        channel_list_remove(list, index);
+    }
+    memmove(list->names[1], list->names[0], (size_t)list->count * sizeof(list->names[0]));
+    snprintf(list->names[0], sizeof(list->names[0]), "%s", name);
+    list->count++;
+}
+
+/**
+ * Applique un /switch à la liste : le channel rejoint remplace le channel courant.
+ * @param list La liste.
+ * @param name Le nom du channel.
+ */
+void channel_list_switch(ChannelList *list, const char *name)
+{
+    int index = channel_list_find(list, name);
+    if (index == -1)
+    {
+        snprintf(list->names[0], sizeof(list->names[0]), "%s", name);
+    }
+    else if (index > 0)
+    {
+        channel_list_remove(list, 0);
+        channel_list_join(list, name);
+    }
+}
+
+/**
+ * Applique un /join ou un /leave à la liste pour chaque channel nommé. Le
+ * dernier channel suivi n'est jamais retiré, comme sur le serveur.
+ * @param list La liste.
+ * @param names Les noms des channels, séparés par des espaces.
+ * @param join 1 pour /join, 0 pour /leave.
+ */
+void channel_list_update(ChannelList *list, const char *names, int join)
+{
+    char copy[BUFFER_SIZE];
+    snprintf(copy, sizeof(copy), "%s", names);
+    char *saveptr = NULL;
+    for (char *name = strtok_r(copy, " ", &saveptr); name != NULL; name = strtok_r(NULL, " ", &saveptr))
+    {
+        char channel_name[50];
+        snprintf(channel_name, sizeof(channel_name), "%s", name);
+        int index = channel_list_find(list, channel_name);
+        if (join)
+        {
+            channel_list_join(list, channel_name);
+        }
+        else if (index != -1 && list->count > 1)
+        {
+            channel_list_remove(list, index);
+        }
+    }
+}
+
+/**
+ * Agrandit un buffer de réception, sans le perdre si la mémoire manque.
+ * @param input Le buffer (remplacé en cas de succès).
+ * @param capacity Sa capacité (mise à jour en cas de succès).
+ * @param new_capacity La capacité voulue.
+ * @return 0 en cas de succès, -1 si la mémoire manque (buffer inchangé).
+ */
+int grow_input(char **input, size_t *capacity, size_t new_capacity)
+{
+    char *grown = realloc(*input, new_capacity);
+    if (grown == NULL)
+    {
+        return -1;
+    }
+    *input = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
 /**
  * Gère la communication avec le serveur.
  * @param client_socket Le socket du client.
- * @param channel_name Le nom du channel.
+ * @param channel_name Le nom du premier channel.
  */
-void chat(int client_socket, char *channel_name)
+void chat(int client_socket, const char *channel_name)
 {
+    ChannelList channels = {.count = 0};
+    channel_list_join(&channels, channel_name);
+
     char buffer[BUFFER_SIZE];
-    char history[BUFFER_SIZE * 10] = "";
     fd_set read_fds;
 
+    // Écran alloué une fois : les lignes sont recyclées, sans jamais grossir
+    Screen *screen = calloc(1, sizeof(Screen));
+    if (screen == NULL)
+    {
+        perror("Erreur lors de l'allocation de l'écran");
+        return;
+    }
+    screen->interactive = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+    screen_clear(screen);
+    screen_prompt();
+
+    // Octets reçus du serveur pas encore découpés en trames (un bloc d'historique peut être long)
+    char *input = NULL;
+    size_t input_length = 0;
+    size_t input_capacity = 0;
+
     while (1)
     {
         // ÉTAPE 8 : Initialiser le set de descripteurs de fichiers
@@ -75,16 +430,41 @@ void chat(int client_socket, char *channel_name)
         // ÉTAPE 10 : Vérifier si le serveur a envoyé un message
         if (FD_ISSET(client_socket, &read_fds))
         {
-            // ÉTAPE 11 : Recevoir le message du serveur
-            int read_size = recv(client_socket, buffer, sizeof(buffer), 0);
+            // ÉTAPE 11 : Recevoir les trames du serveur
+            if (input_capacity - input_length < BUFFER_SIZE &&
+                grow_input(&input, &input_capacity, input_capacity ? input_capacity * 2 : BUFFER_SIZE * 4) == -1)
+            {
+                perror("Erreur lors de l'allocation du buffer de réception");
+                break;
+            }
+            int read_size = recv(client_socket, input + input_length, input_capacity - input_length, 0);
             if (read_size <= 0)
             {
                 printf("Déconnecté du serveur\n");
                 break;
             }
-            buffer[read_size] = '\0';
-            strcat(history, buffer);
-            display_history_and_prompt(history);
+            input_length += (size_t)read_size;
+
+            size_t consumed = 0;
+            FrameHeader header;
+            while (input_length - consumed >= FRAME_HEADER_SIZE &&
+                   frame_decode_header((unsigned char *)input + consumed, &header) == 0 &&
+                   input_length - consumed >= FRAME_HEADER_SIZE + header.length)
+            {
+                screen_append(screen, input + consumed + FRAME_HEADER_SIZE, header.length);
+                consumed += FRAME_HEADER_SIZE + header.length;
+            }
+            memmove(input, input + consumed, input_length - consumed);
+            input_length -= consumed;
+
+            // Une trame plus grande que le buffer : l'agrandir pour la recevoir en entier
+            if (input_length >= FRAME_HEADER_SIZE && frame_decode_header((unsigned char *)input, &header) == 0 &&
+                FRAME_HEADER_SIZE + header.length > input_capacity &&
+                grow_input(&input, &input_capacity, FRAME_HEADER_SIZE + header.length + BUFFER_SIZE) == -1)
+            {
+                perror("Erreur lors de l'allocation du buffer de réception");
+                break;
+            }
         }
 
         // ÉTAPE 12 : Vérifier si l'utilisateur a tapé quelque chose
@@ -102,7 +482,7 @@ void chat(int client_socket, char *channel_name)
                 // ÉTAPE 14a : Commande /quit - quitter le chat
                 if (strcmp(buffer, "/quit") == 0)
                 {
-                    system("clear");
+                    screen_clear(screen);
                     printf("Déconnexion...\n");
                     break;
                 }
@@ -110,46 +490,76 @@ void chat(int client_socket, char *channel_name)
                 // ÉTAPE 14b : Commande /switch - changer de channel
                 else if (strncmp(buffer, "/switch ", 8) == 0)
                 {
-                    char new_channel[BUFFER_SIZE];
-                    sscanf(buffer + 8, "%s", new_channel);
-
-                    send(client_socket, buffer, strlen(buffer), 0);
-                    strncpy(channel_name, new_channel, sizeof(channel_name) - 1);
-                    channel_name[sizeof(channel_name) - 1] = '\0';
-                    snprintf(history, sizeof(history), "Changement vers le channel '%s'\n", channel_name);
-                    display_history_and_prompt(history);
+                    char new_channel[50];
+                    if (sscanf(buffer + 8, "%49s", new_channel) != 1)
+                    {
+                        continue;
+                    }
+
+                    send_frame(client_socket, FRAME_TEXT, buffer, strlen(buffer));
+                    channel_list_switch(&channels, new_channel);
+                    char switch_message[BUFFER_SIZE];
+                    int length = snprintf(switch_message, sizeof(switch_message), "Changement vers le channel '%s'\n", channels.names[0]);
+                    screen_clear(screen);
+                    screen_append(screen, switch_message, (size_t)length);
+                    continue;
+                }
+
+                // Commandes /join et /leave - suivre ou quitter d'autres channels sur la même connexion
+                else if (strncmp(buffer, "/join ", 6) == 0 || strncmp(buffer, "/leave ", 7) == 0)
+                {
+                    send_frame(client_socket, FRAME_TEXT, buffer, strlen(buffer));
+                    channel_list_update(&channels, strchr(buffer, ' ') + 1, buffer[1] == 'j');
+                    screen_erase_input(screen);
+                    screen_prompt();
+                    continue;
+                }
+
+                // Commandes /history [N|#K], /more, /search, /stats et /channels - demander au serveur
+                else if (strcmp(buffer, "/history") == 0 || strncmp(buffer, "/history ", 9) == 0 || strcmp(buffer, "/more") == 0 ||
+                         strcmp(buffer, "/search") == 0 || strncmp(buffer, "/search ", 8) == 0 ||
+                         strcmp(buffer, "/stats") == 0 || strcmp(buffer, "/channels") == 0)
+                {
+                    send_frame(client_socket, FRAME_TEXT, buffer, strlen(buffer));
+                    screen_erase_input(screen);
+                    screen_prompt();
                     continue;
                 }
 
                 // ÉTAPE 14c : Commande /help - afficher l'aide
                 else if (strcmp(buffer, "/help") == 0)
                 {
-                    system("clear");
+                    screen_clear(screen);
                     printf("\n\nCommandes disponibles :\n");
                     printf("-------------------------\n");
                     printf("/quit             : Quitter le chat\n");
                     printf("/switch [channel] : Changer de channel\n");
+                    printf("/join [channels]  : Suivre aussi ces channels, le dernier devient le courant\n");
+                    printf("/leave [channels] : Ne plus suivre ces channels\n");
+                    printf("/channels         : Channels suivis et channel courant\n");
+                    printf("/history [N|#K]   : Historique du channel (tout, N derniers, depuis le n°K)\n");
+                    printf("/more             : Page de messages précédant les plus anciens affichés\n");
+                    printf("/search [mots]    : Derniers messages du channel contenant tous ces mots\n");
+                    printf("/stats            : Métriques du serveur et du channel\n");
                     printf("/help             : Afficher cette aide\n\n");
                     printf("Appuyez sur Entrée pour revenir au chat...\n");
                     getchar();
-                    display_history_and_prompt(history);
+                    screen_redraw(screen);
                     continue;
                 }
 
                 // ÉTAPE 14d : Commande inconnue
                 else
                 {
-                    char formatted_message[BUFFER_SIZE];
-                    snprintf(formatted_message, sizeof(formatted_message), "Commande inconnue. Tapez /help pour la liste des commandes.\n");
-                    strcat(history, formatted_message);
-
-                    display_history_and_prompt(history);
+                    const char *unknown = "Commande inconnue. Tapez /help pour la liste des commandes.\n";
+                    screen_erase_input(screen);
+                    screen_append(screen, unknown, strlen(unknown));
                     continue;
                 }
             }
 
             // ÉTAPE 15 : Envoyer le message au serveur (pas une commande)
-            if (send(client_socket, buffer, strlen(buffer), 0) == -1)
+            if (send_frame(client_socket, FRAME_TEXT, buffer, strlen(buffer)) == -1)
             {
                 perror("Erreur lors de l'envoi du message");
                 break;
@@ -159,22 +569,503 @@ void chat(int client_socket, char *channel_name)
             char time_buffer[26];
             format_current_time(time_buffer, sizeof(time_buffer));
 
-            char formatted_message[BUFFER_SIZE];
-            snprintf(formatted_message, sizeof(formatted_message), "[%s] (%s) Moi : %s\n", channel_name, time_buffer, buffer);
+            char formatted_message[BUFFER_SIZE + 128];
+            int length = snprintf(formatted_message, sizeof(formatted_message), "[%s] (%s) Moi : %s\n", channels.names[0], time_buffer, buffer);
 
-            strcat(history, formatted_message);
-            display_history_and_prompt(history);
+            screen_erase_input(screen);
+            screen_append(screen, formatted_message, (size_t)length < sizeof(formatted_message) ? (size_t)length : sizeof(formatted_message) - 1);
         }
     }
+    free(input);
+    screen_free(screen);
+    free(screen);
 }
 
-int main()
+/**
+ * Paramètres du mode bench (--bench).
+ */
+typedef struct
+{
+    int connections;  // Connexions ouvertes
+    int channels;     // Channels sur lesquels elles sont réparties
+    double rate;      // Messages envoyés par seconde, toutes connexions confondues
+    int duration;     // Durée de la phase d'envoi (secondes)
+    int message_size; // Taille de la charge utile d'un message (octets)
+} BenchConfig;
+
+/**
+ * Connexion du mode bench : trames reçues pas encore découpées, numéro du
+ * prochain message envoyé.
+ */
+typedef struct
+{
+    int socket;
+    int channel;
+    uint64_t next_sequence;
+    uint64_t received;        // Messages de bench des autres membres reçus
+    uint64_t replay_start_ns; // Envoi de la poignée de main
+    int replayed;             // Historique du channel reçu
+    char *input;
+    size_t input_length;
+    size_t input_capacity;
+} BenchConnection;
+
+/**
+ * Channel du mode bench : connexions ouvertes et messages envoyés.
+ */
+typedef struct
+{
+    int members;
+    uint64_t sent;
+} BenchChannel;
+
+/**
+ * Mesures d'une série (microsecondes), triées pour le calcul des centiles.
+ */
+typedef struct
+{
+    uint64_t *values;
+    size_t count;
+    size_t capacity;
+} BenchSamples;
+
+/**
+ * Donne l'heure monotone en nanosecondes.
+ * @return L'heure.
+ */
+uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Ajoute une mesure à une série.
+ * @param samples La série.
+ * @param value La mesure (microsecondes).
+ */
+void add_sample(BenchSamples *samples, uint64_t value)
+{
+    if (samples->count == samples->capacity)
+    {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 1024;
+        uint64_t *values = realloc(samples->values, capacity * sizeof(uint64_t));
+        if (values == NULL)
+        {
+            return;
+        }
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = value;
+}
+
+int compare_samples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Donne un centile d'une série triée.
+ * @param samples La série.
+ * @param percentile Le centile (0 à 100).
+ * @return La mesure, 0 si la série est vide.
+ */
+uint64_t sample_percentile(const BenchSamples *samples, double percentile)
+{
+    if (samples->count == 0)
+    {
+        return 0;
+    }
+    size_t rank = (size_t)(percentile / 100.0 * (double)(samples->count - 1) + 0.5);
+    return samples->values[rank];
+}
+
+/**
+ * Affiche les centiles d'une série (en millisecondes).
+ * @param label Le nom de la série (complété à la largeur des autres lignes du rapport).
+ * @param samples La série.
+ */
+void print_samples(const char *label, BenchSamples *samples)
+{
+    qsort(samples->values, samples->count, sizeof(uint64_t), compare_samples);
+    printf("%s : n=%zu p50=%.3f ms p99=%.3f ms p99.9=%.3f ms max=%.3f ms\n", label, samples->count,
+           sample_percentile(samples, 50) / 1000.0, sample_percentile(samples, 99) / 1000.0,
+           sample_percentile(samples, 99.9) / 1000.0, sample_percentile(samples, 100) / 1000.0);
+}
+
+/**
+ * Ouvre une connexion de bench : connexion, négociation du protocole tramé et
+ * poignée de main dans son channel (bench-<n>).
+ * @param conn La connexion à remplir.
+ * @param index Le numéro de la connexion.
+ * @param config Les paramètres du bench.
+ * @return 0 en cas de succès, -1 en cas d'erreur.
+ */
+int open_bench_connection(BenchConnection *conn, int index, const BenchConfig *config)
+{
+    struct sockaddr_in server_addr;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr(ADRESSE_IP);
+    server_addr.sin_port = htons(server_port);
+
+    memset(conn, 0, sizeof(*conn));
+    conn->channel = index % config->channels;
+    conn->socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->socket == -1)
+    {
+        return -1;
+    }
+    if (connect(conn->socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1 ||
+        negotiate_protocol(conn->socket) == -1)
+    {
+        close(conn->socket);
+        return -1;
+    }
+
+    char handshake[64];
+    int length = snprintf(handshake, sizeof(handshake), "bench%d", index) + 1;
+    length += snprintf(handshake + length, sizeof(handshake) - (size_t)length, "bench-%d", conn->channel);
+    conn->replay_start_ns = monotonic_ns();
+    if (send_frame(conn->socket, FRAME_HANDSHAKE, handshake, (size_t)length) == -1)
+    {
+        close(conn->socket);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Lit et découpe les trames reçues par une connexion de bench : la première
+ * trame d'historique mesure le rejeu, chaque message de bench d'un autre membre
+ * mesure la latence de diffusion (horodatage de l'expéditeur inclus dans le texte).
+ * @param conn La connexion.
+ * @param replay Reçoit les durées de rejeu.
+ * @param latency Reçoit les latences de diffusion.
+ * @param received Compteur de messages de bench reçus.
+ * @return 0 si la connexion reste ouverte, -1 si le serveur l'a fermée (ou si la mémoire manque).
+ */
+int read_bench_connection(BenchConnection *conn, BenchSamples *replay, BenchSamples *latency, uint64_t *received)
+{
+    while (1)
+    {
+        if (conn->input_capacity - conn->input_length < BUFFER_SIZE &&
+            grow_input(&conn->input, &conn->input_capacity, conn->input_capacity ? conn->input_capacity * 2 : BUFFER_SIZE * 4) == -1)
+        {
+            return -1;
+        }
+        ssize_t read_size = recv(conn->socket, conn->input + conn->input_length, conn->input_capacity - conn->input_length, MSG_DONTWAIT);
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        if (read_size <= 0)
+        {
+            return -1;
+        }
+        conn->input_length += (size_t)read_size;
+
+        uint64_t now = monotonic_ns();
+        size_t consumed = 0;
+        FrameHeader header;
+        while (conn->input_length - consumed >= FRAME_HEADER_SIZE &&
+               frame_decode_header((unsigned char *)conn->input + consumed, &header) == 0 &&
+               conn->input_length - consumed >= FRAME_HEADER_SIZE + header.length)
+        {
+            const char *text = conn->input + consumed + FRAME_HEADER_SIZE;
+            if (header.type == FRAME_HISTORY && !conn->replayed)
+            {
+                conn->replayed = 1;
+                add_sample(replay, (now - conn->replay_start_ns) / 1000);
+            }
+            else if (header.type == FRAME_CHAT)
+            {
+                // "[channel] (heure) nom : #bench <expéditeur> <séquence> <horodatage ns>"
+                const char *marker = memmem(text, header.length, BENCH_MARKER, strlen(BENCH_MARKER));
+                unsigned long long sender, sequence, sent_ns;
+                if (marker != NULL && sscanf(marker + strlen(BENCH_MARKER), "%llu %llu %llu", &sender, &sequence, &sent_ns) == 3)
+                {
+                    add_sample(latency, now > sent_ns ? (now - sent_ns) / 1000 : 0);
+                    (*received)++;
+                    conn->received++;
+                }
+            }
+            consumed += FRAME_HEADER_SIZE + header.length;
+        }
+        memmove(conn->input, conn->input + consumed, conn->input_length - consumed);
+        conn->input_length -= consumed;
+
+        // Une trame plus grande que le buffer (long historique) : l'agrandir
+        if (conn->input_length >= FRAME_HEADER_SIZE && frame_decode_header((unsigned char *)conn->input, &header) == 0 &&
+            FRAME_HEADER_SIZE + header.length > conn->input_capacity &&
+            grow_input(&conn->input, &conn->input_capacity, FRAME_HEADER_SIZE + header.length + BUFFER_SIZE) == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+/**
+ * Traite les événements des connexions de bench pendant au plus timeout_ms.
+ * Une connexion fermée par le serveur ne compte plus parmi les membres de son
+ * channel, et les messages qu'elle n'a pas reçus ne sont plus attendus.
+ * @param epoll_fd L'instance epoll.
+ * @param timeout_ms L'attente maximale (millisecondes).
+ * @param replay Reçoit les durées de rejeu.
+ * @param latency Reçoit les latences de diffusion.
+ * @param received Compteur de messages de bench reçus.
+ * @param closed Compteur de connexions fermées par le serveur.
+ * @param channels Les channels du bench.
+ * @param expected Compteur de messages de bench attendus.
+ */
+void poll_bench_connections(int epoll_fd, int timeout_ms, BenchSamples *replay, BenchSamples *latency, uint64_t *received, int *closed,
+                            BenchChannel *channels, uint64_t *expected)
+{
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, BENCH_MAX_EVENTS, timeout_ms);
+    for (int i = 0; i < count; ++i)
+    {
+        BenchConnection *conn = events[i].data.ptr;
+        if (conn->socket != -1 && read_bench_connection(conn, replay, latency, received) == -1)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
+            close(conn->socket);
+            conn->socket = -1;
+            (*closed)++;
+
+            // Messages des autres membres envoyés jusqu'ici et jamais reçus
+            BenchChannel *channel = &channels[conn->channel];
+            uint64_t missing = channel->sent - conn->next_sequence - conn->received;
+            *expected -= missing < *expected ? missing : *expected;
+            channel->members--;
+        }
+    }
+}
+
+/**
+ * Mode bench : ouvre config->connections connexions réparties sur
+ * config->channels channels, attend l'historique de chacune, puis envoie
+ * config->rate messages par seconde pendant config->duration secondes, chacun
+ * portant l'identifiant de l'expéditeur, son numéro et son heure d'envoi.
+ * Affiche ensuite le rapport (temps d'établissement, de rejeu, latence de
+ * diffusion de bout en bout, débits). Les envois sont bloquants : si le serveur
+ * ne suit plus, le débit obtenu est inférieur au débit demandé.
+ * @param config Les paramètres du bench.
+ * @return 0 en cas de succès, -1 en cas d'erreur.
+ */
+int run_bench(const BenchConfig *config)
+{
+    BenchConnection *connections = calloc((size_t)config->connections, sizeof(BenchConnection));
+    BenchChannel *channels = calloc((size_t)config->channels, sizeof(BenchChannel));
+    int epoll_fd = epoll_create1(0);
+    if (connections == NULL || channels == NULL || epoll_fd == -1)
+    {
+        perror("Erreur lors de l'initialisation du bench");
+        return -1;
+    }
+
+    BenchSamples setup = {0}, replay = {0}, latency = {0};
+    uint64_t received = 0, expected = 0;
+    int closed = 0;
+
+    // Phase 1 : établissement des connexions (connexion, négociation, poignée de main)
+    printf("Bench : %d connexions sur %d channels, %.0f messages/s pendant %d s\n",
+           config->connections, config->channels, config->rate, config->duration);
+    uint64_t setup_start = monotonic_ns();
+    int opened = 0;
+    for (int i = 0; i < config->connections; ++i)
+    {
+        uint64_t start = monotonic_ns();
+        if (open_bench_connection(&connections[i], i, config) == -1)
+        {
+            fprintf(stderr, "Connexion %d impossible : %s\n", i, strerror(errno));
+            connections[i].socket = -1;
+            continue;
+        }
+        add_sample(&setup, (monotonic_ns() - start) / 1000);
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = &connections[i]};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].socket, &event);
+        channels[connections[i].channel].members++;
+        opened++;
+
+        // Vider au fur et à mesure les historiques déjà reçus
+        poll_bench_connections(epoll_fd, 0, &replay, &latency, &received, &closed, channels, &expected);
+    }
+    double setup_seconds = (monotonic_ns() - setup_start) / 1e9;
+
+    // Phase 2 : attendre l'historique de toutes les connexions (10 s au plus)
+    uint64_t replay_deadline = monotonic_ns() + 10000000000ull;
+    while (replay.count + (size_t)closed < (size_t)opened && monotonic_ns() < replay_deadline)
+    {
+        poll_bench_connections(epoll_fd, 100, &replay, &latency, &received, &closed, channels, &expected);
+    }
+
+    // Phase 3 : envoi au rythme demandé, réparti tour à tour sur les connexions
+    char *payload = malloc((size_t)config->message_size + 64);
+    uint64_t sent = 0, send_failures = 0;
+    received = 0;
+    latency.count = 0;
+    int next = 0;
+    uint64_t send_start = monotonic_ns();
+    uint64_t send_end = send_start + (uint64_t)config->duration * 1000000000ull;
+    uint64_t now;
+    while ((now = monotonic_ns()) < send_end)
+    {
+        uint64_t due = (uint64_t)(config->rate * (double)(now - send_start) / 1e9);
+        for (int attempts = 0; sent + send_failures < due && attempts < config->connections; ++attempts)
+        {
+            BenchConnection *conn = &connections[next];
+            next = (next + 1) % config->connections;
+            if (conn->socket == -1)
+            {
+                continue;
+            }
+            int length = snprintf(payload, (size_t)config->message_size + 64, BENCH_MARKER "%d %llu %llu ",
+                                  (int)(conn - connections), (unsigned long long)conn->next_sequence, (unsigned long long)monotonic_ns());
+            while (length < config->message_size)
+            {
+                payload[length++] = 'x';
+            }
+            if (send_frame(conn->socket, FRAME_TEXT, payload, (size_t)length) == 0)
+            {
+                conn->next_sequence++;
+                sent++;
+                channels[conn->channel].sent++;
+                expected += (uint64_t)(channels[conn->channel].members - 1);
+            }
+            else
+            {
+                send_failures++;
+            }
+        }
+        poll_bench_connections(epoll_fd, 1, &replay, &latency, &received, &closed, channels, &expected);
+    }
+    double send_seconds = (monotonic_ns() - send_start) / 1e9;
+
+    // Phase 4 : laisser arriver les derniers messages (2 s au plus)
+    uint64_t drain_deadline = monotonic_ns() + 2000000000ull;
+    while (received < expected && monotonic_ns() < drain_deadline)
+    {
+        poll_bench_connections(epoll_fd, 10, &replay, &latency, &received, &closed, channels, &expected);
+    }
+
+    // Rapport
+    printf("\n--- Rapport ---\n");
+    printf("Connexions ouvertes  : %d/%d en %.3f s (%.0f/s), %d fermées par le serveur\n",
+           opened, config->connections, setup_seconds, setup_seconds > 0 ? opened / setup_seconds : 0.0, closed);
+    print_samples("Établissement       ", &setup);
+    print_samples("Rejeu d'historique  ", &replay);
+    printf("Messages envoyés     : %llu (%.0f/s), %llu échecs d'envoi\n",
+           (unsigned long long)sent, sent / send_seconds, (unsigned long long)send_failures);
+    printf("Messages reçus       : %llu/%llu attendus (%.0f/s)\n",
+           (unsigned long long)received, (unsigned long long)expected, received / send_seconds);
+    print_samples("Latence de diffusion", &latency);
+
+    for (int i = 0; i < config->connections; ++i)
+    {
+        if (connections[i].socket != -1)
+        {
+            close(connections[i].socket);
+        }
+        free(connections[i].input);
+    }
+    close(epoll_fd);
+    free(payload);
+    free(setup.values);
+    free(replay.values);
+    free(latency.values);
+    free(channels);
+    free(connections);
+    return 0;
+}
+
+/**
+ * Affiche l'aide de la ligne de commande du client.
+ * @param program_name Le nom de l'exécutable.
+ */
+void print_usage(const char *program_name)
+{
+    printf("Usage : %s [--port N] [--bench [--connections N] [--channels M] [--rate R] [--duration S] [--size B]]\n", program_name);
+    printf("  Sans option : client de chat interactif\n");
+    printf("  --port N        : port du serveur (défaut %d)\n", PORT);
+    printf("  --bench         : générateur de charge sans interface, affiche un rapport de latence\n");
+    printf("  --connections N : connexions ouvertes (défaut 100)\n");
+    printf("  --channels M    : channels sur lesquels elles sont réparties (défaut 10)\n");
+    printf("  --rate R        : messages envoyés par seconde, au total (défaut 1000)\n");
+    printf("  --duration S    : durée de l'envoi en secondes (défaut 10)\n");
+    printf("  --size B        : taille de la charge utile d'un message (défaut 64, 1000 au plus)\n");
+}
+
+int main(int argc, char *argv[])
 {
     int client_socket;
     struct sockaddr_in server_addr;
     char user_name[50];
     char channel_name[50];
 
+    static struct option long_options[] = {
+        {"bench", no_argument, NULL, 'b'},
+        {"connections", required_argument, NULL, 'c'},
+        {"channels", required_argument, NULL, 'm'},
+        {"rate", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 'd'},
+        {"size", required_argument, NULL, 's'},
+        {"port", required_argument, NULL, 'p'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    BenchConfig bench = {.connections = 100, .channels = 10, .rate = 1000, .duration = 10, .message_size = 64};
+    int bench_mode = 0;
+    int option;
+    while ((option = getopt_long(argc, argv, "bc:m:r:d:s:p:h", long_options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 'b':
+            bench_mode = 1;
+            break;
+        case 'c':
+            bench.connections = atoi(optarg);
+            break;
+        case 'm':
+            bench.channels = atoi(optarg);
+            break;
+        case 'r':
+            bench.rate = atof(optarg);
+            break;
+        case 'd':
+            bench.duration = atoi(optarg);
+            break;
+        case 's':
+            bench.message_size = atoi(optarg);
+            break;
+        case 'p':
+            server_port = atoi(optarg);
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench_mode)
+    {
+        if (bench.connections < 1 || bench.channels < 1 || bench.rate <= 0 || bench.duration < 1 ||
+            bench.message_size < 1 || bench.message_size > 1000)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return run_bench(&bench) == 0 ? 0 : 1;
+    }
+
     // ÉTAPE 1 : Créer un socket client
     client_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (client_socket == -1)
@@ -183,10 +1074,10 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    // ÉTAPE 2 : Configurer l'adresse du serveur (IP: 127.0.0.1, PORT: 12345)
+    // ÉTAPE 2 : Configurer l'adresse du serveur (IP: 127.0.0.1, PORT: 12345 ou --port)
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = inet_addr(ADRESSE_IP);
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(server_port);
 
     // ÉTAPE 3 : Se connecter au serveur
     if (connect(client_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1)
@@ -195,18 +1086,29 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    // ÉTAPE 4 : Demander et envoyer le nom d'utilisateur au serveur
+    // Passer au protocole tramé (le serveur accepte aussi les anciens clients texte)
+    if (negotiate_protocol(client_socket) == -1)
+    {
+        fprintf(stderr, "Erreur : le serveur ne gère pas le protocole tramé\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // ÉTAPE 4 : Demander le nom d'utilisateur
     printf("Entrez votre nom : ");
     fgets(user_name, sizeof(user_name), stdin);
     user_name[strcspn(user_name, "\n")] = '\0';
-    send(client_socket, user_name, strlen(user_name), 0);
 
-    // ÉTAPE 5 : Demander et envoyer le nom du channel au serveur
+    // ÉTAPE 5 : Demander le nom du channel, puis envoyer les deux dans une seule trame ("nom\0channel")
     printf("Entrez le nom du channel : ");
     fgets(channel_name, sizeof(channel_name), stdin);
     to_lowercase(channel_name);
     channel_name[strcspn(channel_name, "\n")] = '\0';
-    send(client_socket, channel_name, strlen(channel_name), 0);
+
+    char handshake[sizeof(user_name) + sizeof(channel_name)];
+    size_t name_length = strlen(user_name);
+    memcpy(handshake, user_name, name_length + 1);
+    memcpy(handshake + name_length + 1, channel_name, strlen(channel_name));
+    send_frame(client_socket, FRAME_HANDSHAKE, handshake, name_length + 1 + strlen(channel_name));
 
     // ÉTAPE 6 : Lancer la boucle de chat
     chat(client_socket, channel_name);
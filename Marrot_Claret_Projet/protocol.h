@@ -0,0 +1,97 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+/*
+ * Protocole tramé, partagé par server.c et client.c.
+ *
+ * Négociation : le client commence par PROTOCOL_PREFACE suivi de la version
+ * demandée (1 octet). Un client texte commence par son nom, jamais par un octet
+ * nul : le serveur le traite alors comme avant (un recv() = un message). Le
+ * serveur répond par la même préface suivie de la version retenue.
+ *
+ * Ensuite chaque message est une trame : un en-tête de FRAME_HEADER_SIZE octets
+ * (entiers en ordre réseau) suivi des données.
+ *
+ *   longueur (4) | version (1) | type (1) | réservé (2) | channel (4) | séquence (8)
+ *
+ * La longueur est celle des données seules. Le channel vaut 0 hors channel. La
+ * séquence d'un FRAME_CHAT est le numéro du message dans l'historique du channel
+ * (celui de /history #K), 0 pour les autres types.
+ */
+
+#define PROTOCOL_PREFACE "\0MCP"
+#define PROTOCOL_PREFACE_SIZE 4
+#define PROTOCOL_VERSION 1
+#define FRAME_HEADER_SIZE 20
+#define FRAME_MAX_CLIENT_PAYLOAD 1023 // Un message client tient dans BUFFER_SIZE avec son '\0'
+#define FRAME_MAX_PAYLOAD (1u << 30)  // Au-delà, un bloc d'historique est découpé en plusieurs trames
+
+typedef enum
+{
+    FRAME_HANDSHAKE = 1, // Client -> serveur : "nom\0channel"
+    FRAME_TEXT = 2,      // Client -> serveur : message ou commande, comme en mode texte
+    FRAME_CHAT = 3,      // Serveur -> client : message journalisé
+    FRAME_NOTICE = 4,    // Serveur -> client : arrivée, départ, confirmation, erreur
+    FRAME_HISTORY = 5    // Serveur -> client : bloc de lignes d'historique
+} FrameType;
+
+typedef struct
+{
+    uint32_t length;
+    uint8_t version;
+    uint8_t type;
+    uint32_t channel_id;
+    uint64_t sequence;
+} FrameHeader;
+
+/**
+ * Écrit un en-tête de trame.
+ * @param out Le buffer (au moins FRAME_HEADER_SIZE octets).
+ * @param type Le type de la trame.
+ * @param channel_id Le channel concerné (0 si aucun).
+ * @param sequence Le numéro de séquence.
+ * @param length La taille des données qui suivent.
+ */
+static inline void frame_encode_header(unsigned char *out, uint8_t type, uint32_t channel_id, uint64_t sequence, uint32_t length)
+{
+    out[0] = (unsigned char)(length >> 24);
+    out[1] = (unsigned char)(length >> 16);
+    out[2] = (unsigned char)(length >> 8);
+    out[3] = (unsigned char)length;
+    out[4] = PROTOCOL_VERSION;
+    out[5] = type;
+    out[6] = 0;
+    out[7] = 0;
+    out[8] = (unsigned char)(channel_id >> 24);
+    out[9] = (unsigned char)(channel_id >> 16);
+    out[10] = (unsigned char)(channel_id >> 8);
+    out[11] = (unsigned char)channel_id;
+    for (int i = 0; i < 8; ++i)
+    {
+        out[12 + i] = (unsigned char)(sequence >> (56 - 8 * i));
+    }
+}
+
+/**
+ * Lit un en-tête de trame.
+ * @param in Le buffer (au moins FRAME_HEADER_SIZE octets).
+ * @param header Reçoit l'en-tête.
+ * @return 0 en cas de succès, -1 si la version est inconnue.
+ */
+static inline int frame_decode_header(const unsigned char *in, FrameHeader *header)
+{
+    header->length = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+    header->version = in[4];
+    header->type = in[5];
+    header->channel_id = ((uint32_t)in[8] << 24) | ((uint32_t)in[9] << 16) | ((uint32_t)in[10] << 8) | in[11];
+    header->sequence = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        header->sequence = (header->sequence << 8) | in[12 + i];
+    }
+    return header->version == PROTOCOL_VERSION ? 0 : -1;
+}
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,480 +11,11449 @@
 #include <time.h>
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "protocol.h"
 
 #define PORT 12345
 #define BUFFER_SIZE 1024
+#ifndef MAX_CLIENTS
 #define MAX_CLIENTS 100
-#define MAX_CHANNELS 100
+#endif
+#define CHANNEL_TABLE_INITIAL_CAPACITY 64 // Puissance de 2 ; la table double à mi-remplissage
+#define MAX_EVENTS 256
+#define MAX_REACTORS 64
+#define SHARD_QUEUE_CAPACITY 1024 // Puissance de 2
+#define METRIC_SHARDS 16          // Copies des métriques, une par groupe de threads (pas de ligne de cache partagée)
+#define HISTOGRAM_SUB_BITS 4      // 16 sous-intervalles par puissance de 2 : précision relative de 6 %
+#define HISTOGRAM_MAX_BITS 40     // Durées plafonnées à 2^40 ns (environ 18 minutes)
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+#define SEGMENT_INDEX_INTERVAL 64      // Une entrée d'index clairsemé tous les 64 messages d'un segment
+#define RECORD_MAX_TEXT (16 * 1024)    // Texte d'un enregistrement plafonné (les anciennes lignes importées sont coupées)
+#define HISTORY_BLOCK_SIZE (64 * 1024) // Lecture des segments par blocs (contient toujours un enregistrement entier)
+#define HISTORY_CHUNK_SIZE (64 * 1024) // Tranche d'historique formatée puis envoyée
+#define RETENTION_INTERVAL_MS 1000     // Période d'application de la rétention par le thread écrivain
+#define RECOVERY_THREADS_MAX 8            // Threads de reprise des channels au démarrage
+#define RECOVERY_CHANNELS_PER_THREAD 4096 // Un thread de reprise de plus par tranche de channels
+#define URING_ENTRIES 4096           // Entrées de la file de soumission d'un réacteur (io_uring)
+#define URING_RECV_BUFFERS 1024      // Buffers de réception fournis au noyau par réacteur (puissance de 2)
+#define URING_RECV_BUFFER_SIZE 2048
+#define URING_LOG_WRITES 64          // Écritures de channels soumises ensemble par l'écrivain du journal
+#define FEDERATION_MAX_NODES 64      // Identifiants d'instance de 0 à 63 (un bit par instance dans la table d'intérêt)
+#define FEDERATION_MAX_LINKS 32      // Liaisons ouvertes en même temps avec les instances pairs
+#define FEDERATION_RETRY_MS 1000     // Délai avant de retenter la connexion à un pair
+#define FEDERATION_CONNECT_MS 5000   // Connexion à un pair abandonnée si elle n'aboutit pas dans ce délai
+#define PEER_MAX_PAYLOAD (50 + 50 + BUFFER_SIZE) // Channel, expéditeur et texte d'un message relayé
+#define POOL_SLAB_OBJECTS 64         // Objets découpés dans chaque bloc d'un pool
+#define MAX_SUBSCRIPTIONS 32         // Channels suivis en même temps par une connexion
+#define CACHE_LINE_SIZE 64
+#define BLOCK_CLASS_COUNT 4          // Classes de taille du cache de blocs (messages, arènes)
+#define BLOCK_BATCH 32               // Blocs passés d'un coup entre un thread et la réserve commune
+#define BLOCK_DEPOT_BLOCKS 2048      // Blocs gardés par classe dans la réserve commune, les suivants sont rendus
+#define ARENA_CHUNK_SIZE 8192        // Bloc d'arène d'une connexion (plus grande classe du cache)
+#define HANDOVER_VERSION 2                // Version du protocole de mise à jour à chaud
+#define HANDOVER_CHUNK_SIZE (32 * 1024)   // Octets au plus par paquet de reprise
+#define HANDOVER_MAX_ROUNDS 64            // Tours d'échanges entre réacteurs avant l'arrêt pour la reprise
+#define SEARCH_TERM_MIN 2             // Termes plus courts ni indexés ni cherchés
+#define SEARCH_TERM_MAX 32            // Termes coupés à 32 octets
+#define SEARCH_MAX_TERMS 8            // Termes d'une recherche (tous doivent être présents)
+#define SEARCH_MAX_RESULTS 20         // Messages rendus par /search, les plus récents
+#define SEARCH_INITIAL_BUCKETS 1024   // Puissance de 2 ; la table double quand elle est pleine
+#define SEARCH_CATCH_UP_BATCH 256     // Messages relus sous search_lock par le thread d'indexation
+#define SEARCH_SCAN_LIMIT 65536       // Messages lus au plus par /search dans les plages sans index
+#define SEARCH_SEGMENT_LIMIT 64       // Segments fermés lus au plus par /search, les plus récents
+#define SEARCH_FILE_VERSION 1
+#define TRACE_RING_SPANS 65536       // Puissance de 2 ; les plus anciennes étapes tracées sont écrasées
 
-typedef struct
+struct Connection;
+
+typedef enum
 {
-    char name[50];
-    int clients[MAX_CLIENTS];
-    int client_count;
-} Channel;
+    SLOW_CONSUMER_DROP_OLDEST, // Jeter les plus anciens messages en attente
+    SLOW_CONSUMER_DISCONNECT   // Déconnecter le client avec un avertissement
+} SlowConsumerPolicy;
 
-Channel channels[MAX_CHANNELS];
-int channel_count = 0;
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+#define OUTBOUND_IOV_BATCH 64 // Messages en file regroupés par écriture vectorisée
 
 /**
- * Compte le nombre total de clients connectés au serveur.
- * @return Le nombre total de clients.
+ * Pool d'objets de même taille, découpés par blocs de POOL_SLAB_OBJECTS dans une
+ * mémoire alignée sur les lignes de cache (deux objets ne partagent jamais une
+ * ligne). Un objet libéré est gardé dans la liste libre pour la prochaine
+ * connexion ; les blocs ne sont jamais rendus. Le pool n'est pas synchronisé :
+ * il appartient à un réacteur, ou son propriétaire le protège par un verrou.
  */
-int count_total_clients()
+typedef struct
 {
-    int total = 0;
-    for (int i = 0; i < channel_count; ++i)
-    {
-        total += channels[i].client_count;
-    }
-    return total;
-}
+    size_t object_size;      // Taille arrondie à la ligne de cache
+    void *free_list;         // Objets libres, chaînés par leur premier mot
+    atomic_size_t allocated; // Objets découpés dans les blocs (lus par les métriques)
+    atomic_size_t in_use;
+} ObjectPool;
 
 /**
- * Obtient le chemin du fichier de stockage pour un channel.
- * @param channel_name Le nom du channel.
- * @param buffer Le buffer où le chemin sera stocké.
- * @param buffer_size La taille du buffer.
+ * En-tête d'un bloc du cache de blocs : les messages (files de sortie, entre
+ * réacteurs, journal, fédération) sont pris dans des classes de taille fixe.
+ * Chaque thread garde ses blocs libres sans verrou ; au-delà de 2 × BLOCK_BATCH,
+ * un lot part dans une réserve commune où puisent les threads à court. Un bloc
+ * peut donc être libéré par un autre thread que celui qui l'a pris.
  */
-void get_storage_file_path(const char *channel_name, char *buffer, size_t buffer_size)
+typedef struct BlockHeader
 {
-    snprintf(buffer, buffer_size, "storage_server/storage_%s/history_channel_file_%s.txt", channel_name, channel_name);
-}
+    _Alignas(16) struct BlockHeader *next; // Dans une liste libre
+    int size_class;                        // -1 : trop grand pour les classes, rendu par free()
+} BlockHeader;
 
 /**
- * Assure la création du répertoire et du fichier de stockage pour un channel.
- * @param channel_name Le nom du channel.
+ * Lot de la réserve commune, écrit dans le premier de ses blocs (après l'en-tête).
  */
-void ensure_channel_directory_and_file(const char *channel_name)
+typedef struct BlockBatch
 {
-    char dir_path[256];
-    snprintf(dir_path, sizeof(dir_path), "storage_server/storage_%s", channel_name);
+    struct BlockHeader *next_batch;
+    int count;
+} BlockBatch;
 
-    // Crée le répertoire pour le channel s'il n'existe pas
-    if (mkdir("storage_server", 0777) == -1 && errno != EEXIST)
-    {
-        perror("Erreur lors de la création du dossier 'storage_server'");
-        return;
-    }
+/**
+ * Blocs libres d'un thread, par classe.
+ */
+typedef struct
+{
+    BlockHeader *free_blocks[BLOCK_CLASS_COUNT];
+    int free_count[BLOCK_CLASS_COUNT];
+    int registered; // Blocs rendus à la réserve à la fin du thread
+} BlockCache;
 
-    if (mkdir(dir_path, 0777) == -1 && errno != EEXIST)
-    {
-        perror("Erreur lors de la création du dossier du channel");
-        return;
-    }
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t capacity;
+    _Alignas(16) char data[];
+} ArenaChunk;
 
-    char file_path[256];
-    snprintf(file_path, sizeof(file_path), "%s/history_channel_file_%s.txt", dir_path, channel_name);
+/**
+ * Arène d'une connexion pour les textes construits le temps d'une commande
+ * (/stats, /search) : remplie à la suite dans des blocs du cache, vidée d'un
+ * coup par arena_reset. Une connexion inactive ne garde aucun bloc.
+ */
+typedef struct
+{
+    ArenaChunk *chunks; // Bloc courant en tête
+    size_t used;        // Octets pris dans le bloc courant
+} Arena;
 
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL)
-    {
-        // Si le fichier n'existe pas, le créer
-        file = fopen(file_path, "a");
-        if (file == NULL)
-        {
-            perror("Erreur lors de la création du fichier de stockage");
-            return;
-        }
-        fclose(file);
-    }
-}
+/**
+ * Limite de débit : rate messages (ou connexions) par seconde en régime
+ * établi, burst d'affilée au plus. Un débit nul désactive la limite.
+ */
+typedef struct
+{
+    unsigned long rate;
+    unsigned long burst;
+    uint64_t interval_ns; // Délai entre deux jetons (1 s / rate)
+} RateLimit;
 
 /**
- * Log un message dans le fichier de stockage d'un channel et l'envoie à tous les clients.
- * @param channel_name Le nom du channel.
- * @param sender Le nom de l'expéditeur.
- * @param message Le message à logger.
- * @param channel Le channel auquel envoyer le message.
- * @param sender_socket Le socket de l'expéditeur.
+ * Seau à jetons sous la forme GCRA : seule l'heure théorique du prochain jeton
+ * est gardée, avancée par compare-and-swap. Plusieurs réacteurs ou threads
+ * peuvent puiser dans le même seau (celui d'un channel) sans verrou.
  */
-void log_and_broadcast_message(const char *channel_name, const char *sender, const char *message, Channel *channel, int sender_socket)
+typedef struct
 {
-    char file_path[256];
-    get_storage_file_path(channel_name, file_path, sizeof(file_path));
+    atomic_ulong next_token_ns; // 0 : seau plein
+} TokenBucket;
 
-    FILE *file = fopen(file_path, "a");
-    if (file == NULL)
-    {
-        perror("Erreur lors de l'ouverture du fichier de stockage");
-        return;
-    }
+/**
+ * Message diffusé, préparé une seule fois et partagé (compteur de références)
+ * par les files de tous ses destinataires, sur tous les réacteurs. L'en-tête de
+ * trame précède le texte : un client tramé reçoit data, un client texte data + FRAME_HEADER_SIZE.
+ */
+typedef struct
+{
+    atomic_int refcount;
+    uint64_t trace_id;      // Trace du message échantillonné, 0 sinon
+    uint64_t trace_origin;  // Début de sa réception
+    uint64_t trace_created; // Début de sa diffusion
+    size_t length; // Taille du texte seul
+    char data[];
+} BroadcastBuffer;
 
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    char time_buffer[26];
-    strftime(time_buffer, sizeof(time_buffer), "%d/%m/%Y %H:%M:%S", tm_info);
+/**
+ * Message en attente d'envoi (offset : octets déjà écrits sur le socket).
+ */
+typedef struct OutboundMessage
+{
+    struct OutboundMessage *next;
+    const char *data;        // Dans buffer (message partagé) ou dans inline_data (copie)
+    BroadcastBuffer *buffer; // Référence tenue sur le message partagé, ou NULL
+    size_t length;
+    size_t offset;
+    struct HistoryCursor *cursor; // Historique lu sur disque tranche par tranche au fil de l'envoi, ou NULL
+    char inline_data[];
+} OutboundMessage;
 
-    char formatted_message[BUFFER_SIZE];
-    snprintf(formatted_message, sizeof(formatted_message), "[%s] (%s) %s : %s\n", channel_name, time_buffer, sender, message);
+/**
+ * File de sortie bornée d'un client, vidée par écritures non bloquantes. Les
+ * compteurs sont lus par le thread de supervision (SIGUSR1), d'où les atomiques.
+ */
+typedef struct OutboundQueue
+{
+    OutboundMessage *head;
+    OutboundMessage *tail;
+    atomic_size_t queued_bytes;
+    atomic_size_t queued_messages;
+    atomic_size_t peak_bytes;
+    atomic_ulong dropped_messages;
+    int socket;
+    int framed; // Le client parle le protocole tramé : même les avertissements de la file sont tramés
+    char client_name[50];
+    struct OutboundQueue *prev_registered; // Registre global des files
+    struct OutboundQueue *next_registered;
 
-    fprintf(file, "%s", formatted_message);
-    fclose(file);
+    // io_uring : les envois sont faits par le réacteur en fin d'itération, jamais directement
+    struct OutboundQueue **submit_list; // Files à envoyer du réacteur, NULL pour écrire directement
+    struct OutboundQueue *submit_next;
+    int submitting; // Dans submit_list, ou envoi en cours
+    int pinned;     // Messages de tête lus par l'envoi en cours : ni jetés ni libérés
 
-    // Envoyer le message formaté à tous les clients du channel sauf l'expéditeur
-    pthread_mutex_lock(&mutex);
-    for (int i = 0; i < channel->client_count; ++i)
-    {
-        if (channel->clients[i] != sender_socket)
-        {
-            send(channel->clients[i], formatted_message, strlen(formatted_message), 0);
-        }
-    }
-    pthread_mutex_unlock(&mutex);
-}
+    // epoll : écritures regroupées par le réacteur en fin de fenêtre (--coalesce-bytes)
+    struct OutboundQueue **flush_list; // Files à écrire du réacteur, NULL pour écrire directement
+    struct OutboundQueue *flush_next;
+    int flush_pending;      // Dans flush_list
+    size_t coalesced_bytes; // Octets mis en file depuis la dernière écriture
+} OutboundQueue;
 
 /**
- * Écrit le message de bienvenue dans le fichier de stockage d'un channel.
- * @param channel_name Le nom du channel.
+ * Référence partagée vers le socket d'un client en mode thread. Le socket n'est
+ * fermé qu'à la libération de la dernière référence : un diffuseur qui parcourt
+ * un ancien instantané ne peut donc jamais écrire sur un numéro de socket réutilisé.
  */
-void write_welcome_message(const char *channel_name)
+typedef struct ClientHandle
 {
-    char file_path[256];
-    get_storage_file_path(channel_name, file_path, sizeof(file_path));
-
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL)
-    {
-        perror("Erreur lors de l'ouverture du fichier de stockage");
-        return;
-    }
+    atomic_int refcount;
+    int socket;
+    int wake_fd;          // eventfd : réveille le thread du client quand sa file a besoin d'EPOLLOUT
+    int evicted;          // Client lent déconnecté, plus rien n'est mis en file
+    struct Subscription *subscriptions; // Channels suivis, le courant en tête (thread du client seulement)
+    int subscription_count;
+    pthread_mutex_t lock; // Protège la file de sortie (diffuseurs concurrents)
+    OutboundQueue queue;
+    TokenBucket send_bucket; // Débit des messages du client (thread du client seulement)
+    int throttled;           // Messages refusés depuis le dernier accepté : avis déjà envoyé
+    Arena arena;             // Réponses aux commandes (thread du client seulement)
+} ClientHandle;
 
-    // Vérifie si le fichier est vide
-    fseek(file, 0, SEEK_END);
-    if (ftell(file) == 0)
-    {
-        fclose(file);
+/**
+ * Abonnement d'une connexion à un channel. Une connexion peut suivre plusieurs
+ * channels : ses abonnements sont chaînés du plus récent au plus ancien, et le
+ * premier est le channel courant, celui où partent ses messages.
+ */
+typedef struct Subscription
+{
+    struct Channel *channel;
+    struct Subscription *next; // Abonnement suivant de la même connexion
+    uint64_t history_cursor;   // Plus ancien message reçu dans ce channel (/more), 0 si aucun
+    int notify;                // Confirmer l'arrivée au client (/join, /switch), pas à la poignée de main
 
-        // Écrit le message de bienvenue si le fichier est vide
-        file = fopen(file_path, "a");
-        if (file == NULL)
-        {
-            perror("Erreur lors de l'écriture du message de bienvenue");
-            return;
-        }
+    // Mode thread : position dans member_set du channel (channel->lock)
+    ClientHandle *client;
+    int member_slot;
 
-        fprintf(file, "Bienvenue dans le channel '%s' !\n", channel_name);
-    }
-    fclose(file);
-}
+    // Mode epoll : membre local du channel une fois l'historique reçu (SHARD_REPLAY)
+    struct Connection *conn;
+    int joined;
+    struct Subscription *prev_member; // Liste des membres locaux du channel sur le réacteur
+    struct Subscription *next_member;
+} Subscription;
 
 /**
- * Envoie le contenu du fichier de stockage d'un channel à un client.
- * @param client_socket Le socket du client.
- * @param channel_name Le nom du channel.
+ * Instantané immuable des membres d'un channel (mode thread). Les diffuseurs le
+ * parcourent sans verrou. Un join/leave ne fait que retirer l'instantané courant ;
+ * le premier diffuseur suivant en reconstruit un depuis member_set.
  */
-void send_storage_to_client(int client_socket, const char *channel_name)
+typedef struct
 {
-    char file_path[256], line[BUFFER_SIZE];
-    get_storage_file_path(channel_name, file_path, sizeof(file_path));
-
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL)
-    {
-        perror("Erreur lors de l'ouverture du fichier de stockage");
-        return;
-    }
+    atomic_int refcount;
+    int count;
+    ClientHandle *clients[];
+} MemberSnapshot;
 
-    while (fgets(line, sizeof(line), file))
-    {
-        send(client_socket, line, strlen(line), 0);
-    }
-    fclose(file);
-}
+typedef enum
+{
+    LOG_SYNC_NONE,     // Jamais de fdatasync (le noyau écrit quand il veut)
+    LOG_SYNC_PERIODIC, // fdatasync des fichiers modifiés toutes les log_sync_interval_ms
+    LOG_SYNC_BATCH     // fdatasync après chaque lot écrit (validation groupée)
+} LogSyncMode;
 
 /**
- * Trouve ou crée un channel.
- * @param channel_name Le nom du channel.
- * @return Le pointeur vers le channel trouvé ou créé.
+ * En-tête d'un enregistrement binaire du journal, suivi du nom de l'expéditeur
+ * puis du texte (ni '\0' ni '\n'). Sans expéditeur, l'enregistrement est une
+ * notification rejouée telle quelle (message de bienvenue, ancienne ligne importée).
+ * Les champs sont dans l'ordre d'octets de la machine : les segments ne quittent pas le serveur.
  */
-Channel *find_or_create_channel(const char *channel_name)
+typedef struct
 {
-    pthread_mutex_lock(&mutex);
-
-    for (int i = 0; i < channel_count; ++i)
-    {
-        if (strcmp(channels[i].name, channel_name) == 0)
-        {
-            pthread_mutex_unlock(&mutex);
-            return &channels[i];
-        }
-    }
+    uint32_t length;        // Taille du texte
+    uint16_t sender_length; // Taille du nom de l'expéditeur, 0 pour une notification
+    uint16_t reserved;
+    uint64_t sequence;      // Numéro du message dans le channel
+    int64_t timestamp;      // Secondes depuis l'époque UNIX
+} RecordHeader;
 
-    if (channel_count >= MAX_CHANNELS)
-    {
-        pthread_mutex_unlock(&mutex);
-        return NULL;
-    }
+/**
+ * Entrée de l'index clairsemé d'un segment : un message sur SEGMENT_INDEX_INTERVAL.
+ */
+typedef struct
+{
+    uint64_t sequence;
+    int64_t timestamp;
+    uint64_t offset; // Position de l'enregistrement dans le segment
+} SegmentIndexEntry;
 
-    strncpy(channels[channel_count].name, channel_name, sizeof(channels[channel_count].name) - 1);
-    channels[channel_count].name[sizeof(channels[channel_count].name) - 1] = '\0';
-    channels[channel_count].client_count = 0;
-    ensure_channel_directory_and_file(channel_name); // Crée le dossier et le fichier du channel
-    write_welcome_message(channel_name);             // Écrit le message de bienvenue si nécessaire
-    channel_count++;
+/**
+ * Segment du journal d'un channel : segment_<base>.log et son index segment_<base>.idx.
+ */
+typedef struct
+{
+    uint64_t base;     // Numéro du premier message du segment
+    off_t size;        // Taille du fichier .log
+    int64_t last_time; // Horodatage du dernier message, 0 si pas encore lu (rétention par âge)
+} SegmentInfo;
 
-    pthread_mutex_unlock(&mutex);
-    return &channels[channel_count - 1];
-}
+/**
+ * Lecture séquentielle de l'historique d'un channel, du message next au message
+ * last, à travers ses segments. Le descripteur ouvert garde le segment lisible
+ * même si la rétention l'efface entre-temps.
+ */
+typedef struct HistoryCursor
+{
+    struct Channel *channel;
+    uint64_t next;             // Prochain message à rendre
+    uint64_t last;             // Dernier message à rendre (inclus)
+    int fd;                    // Segment en cours, -1 s'il faut chercher celui de next
+    uint64_t segment_base;
+    uint64_t segment_end;      // Base du segment suivant, UINT64_MAX pour le segment actif
+    off_t position;            // Position du prochain enregistrement du segment
+    uint64_t position_sequence; // Son numéro attendu (les numéros se suivent dans un segment)
+    off_t block_position;      // Position de block dans le segment
+    size_t block_length;
+    char block[HISTORY_BLOCK_SIZE];
+} HistoryCursor;
 
 /**
- * Diffuse un message à tous les clients d'un channel.
- * @param channel Le channel.
- * @param message Le message à diffuser.
- * @param sender_socket Le socket de l'expéditeur.
+ * Enregistrement (RecordHeader puis expéditeur et texte) en attente d'écriture par le thread écrivain.
  */
-void broadcast_message(Channel *channel, const char *message, int sender_socket)
+typedef struct LogRecord
 {
-    pthread_mutex_lock(&mutex);
+    struct LogRecord *next;
+    struct Channel *channel;
+    uint64_t trace_id;     // Trace du message échantillonné, 0 sinon
+    uint64_t submitted_ns; // Mise en file pour l'écrivain (messages tracés)
+    size_t length;
+    char data[];
+} LogRecord;
 
-    for (int i = 0; i < channel->client_count; ++i)
-    {
-        if (channel->clients[i] != sender_socket)
-        {
-            send(channel->clients[i], message, strlen(message), 0);
-        }
-    }
+/**
+ * Écriture préparée d'enregistrements consécutifs d'un channel dans son segment
+ * actif : les iovec restent en place jusqu'à la fin de l'écriture (io_uring).
+ */
+typedef struct
+{
+    struct Channel *channel;
+    LogRecord *record;  // Premier enregistrement écrit
+    int count;          // Nombre d'enregistrements (et d'iovec)
+    int entry_count;    // Entrées à ajouter à l'index une fois écrits
+    size_t total;       // Octets à écrire
+    uint64_t started_ns; // Début de l'écriture (messages tracés)
+    RecordHeader last;  // En-tête du dernier enregistrement
+    struct iovec iov[IOV_MAX];
+    SegmentIndexEntry entries[IOV_MAX];
+} LogWrite;
 
-    pthread_mutex_unlock(&mutex);
-}
+/**
+ * Terme de l'index de recherche d'un segment : les messages qui le contiennent,
+ * en numéros croissants codés par écarts en varint (le premier par écart à la
+ * base du segment).
+ */
+typedef struct SearchTerm
+{
+    struct SearchTerm *next; // Terme suivant du même seau
+    uint64_t last_sequence;  // Dernier message ajouté
+    uint32_t count;          // Messages de la liste
+    uint32_t length;         // Octets de la liste
+    uint32_t capacity;
+    uint8_t *postings;
+    uint16_t term_length;
+    char term[];
+} SearchTerm;
 
 /**
- * Supprime un client d'un channel.
- * @param channel Le channel.
- * @param client_socket Le socket du client à supprimer.
+ * Index de recherche en mémoire d'un segment : celui du segment actif, complété
+ * par le thread écrivain à chaque écriture, est écrit dans segment_<base>.fts
+ * quand le segment est fermé. Il contient les messages base à next - 1.
  */
-void remove_client_from_channel(Channel *channel, int client_socket)
+typedef struct
 {
-    pthread_mutex_lock(&mutex);
-    for (int i = 0; i < channel->client_count; ++i)
-    {
-        if (channel->clients[i] == client_socket)
-        {
-            for (int j = i; j < channel->client_count - 1; ++j)
-            {
-                channel->clients[j] = channel->clients[j + 1];
-            }
-            channel->client_count--;
-            break;
-        }
-    }
-    pthread_mutex_unlock(&mutex);
-}
+    uint64_t base;
+    uint64_t next;
+    SearchTerm **buckets;
+    size_t bucket_count; // Puissance de 2
+    size_t term_count;
+} SearchIndex;
 
 /**
- * Gère les connexions des clients.
- * @param args Les arguments passés à la fonction.
- * @return NULL.
+ * En-tête d'un fichier segment_<base>.fts, suivi des termes triés
+ * (SearchFileTerm), de leurs noms, puis de leurs listes de messages.
  */
-void *handle_client(void *args)
+typedef struct
 {
-    int client_socket = *((int *)args);
-    free(args);
+    char magic[4]; // "MCPS"
+    uint32_t version;
+    uint64_t base;
+    uint64_t next; // Messages base à next - 1 indexés
+    uint32_t term_count;
+    uint32_t reserved;
+} SearchFileHeader;
 
-    char buffer[BUFFER_SIZE];
-    char client_name[50];
-    char channel_name[50];
+typedef struct
+{
+    uint64_t postings_offset; // Depuis le début du fichier
+    uint32_t postings_length;
+    uint32_t count;
+    uint32_t term_offset; // Depuis le début du fichier
+    uint16_t term_length;
+    uint16_t reserved;
+} SearchFileTerm;
 
-    // ÉTAPE 8 : Recevoir le nom du client depuis la connexion
-    recv(client_socket, client_name, sizeof(client_name), 0);
-    // ÉTAPE 9 : Recevoir le nom du channel depuis la connexion
-    recv(client_socket, channel_name, sizeof(channel_name), 0);
+/**
+ * Travail du thread d'indexation : écrire l'index d'un segment fermé (le
+ * reconstruire depuis le journal s'il n'est pas fourni), ou compléter l'index
+ * du segment actif depuis le journal.
+ */
+typedef struct SearchJob
+{
+    struct SearchJob *next;
+    struct Channel *channel;
+    int catch_up;        // Compléter l'index du segment actif
+    uint64_t base;       // Segment fermé à indexer
+    SearchIndex *index;  // Son index complet, NULL pour le reconstruire
+} SearchJob;
 
-    // ÉTAPE 10 : Vérifier si le nombre maximum de clients est dépassé
-    pthread_mutex_lock(&mutex);
-    int total_clients = count_total_clients();
-    pthread_mutex_unlock(&mutex);
+/**
+ * Recherche en cours : ses termes (tous doivent être présents) et les messages
+ * trouvés, du plus récent au plus ancien.
+ */
+typedef struct
+{
+    char terms[SEARCH_MAX_TERMS][SEARCH_TERM_MAX];
+    size_t lengths[SEARCH_MAX_TERMS];
+    int term_count;
+    uint64_t results[SEARCH_MAX_RESULTS];
+    int result_count;
+    size_t scan_budget; // Messages qui peuvent encore être lus hors index
+    int partial;        // Une plage sans index n'a pas été lue en entier
+    int truncated;      // Des segments plus anciens que les SEARCH_SEGMENT_LIMIT derniers n'ont pas été lus
+} SearchQuery;
 
-    if (total_clients >= MAX_CLIENTS)
-    {
-        send(client_socket, "Erreur : Le serveur est plein. Connexion refusée.\n", 51, 0);
-        close(client_socket);
-        return NULL;
-    }
+/**
+ * Ligne de l'historique récent d'un channel (tampon réutilisé quand le slot est recyclé).
+ */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint64_t sequence; // Numéro du message dans le journal (0 si inconnu)
+} HistoryLine;
 
-    // ÉTAPE 11 : Trouver ou créer le channel demandé
-    Channel *channel = find_or_create_channel(channel_name);
+typedef struct Channel
+{
+    uint32_t id; // Identifiant dans les trames (1 pour le premier channel créé)
+    char name[50];
+    uint32_t name_hash;
+    struct Channel *next_created; // Liste de tous les channels, du plus récent au plus ancien
+    _Atomic(MemberSnapshot *) members; // Membres en mode thread (publication RCU), NULL si à reconstruire
+    pthread_mutex_t lock;               // Sérialise les join/leave du channel (mode thread)
+    Subscription **member_set;          // Membres en mode thread, ajout et retrait en O(1) (lock)
+    int member_capacity;
+    atomic_int client_count;
+    TokenBucket send_bucket; // Débit des messages de tous les expéditeurs du channel
 
-    if (channel == NULL)
-    {
-        close(client_socket);
-        return NULL;
-    }
+    // Mode epoll : le channel appartient à un seul réacteur, qui journalise ses
+    // messages et tient les compteurs. Chaque réacteur garde la liste de ses
+    // propres connexions membres du channel (tableaux de reactor_count entrées).
+    int owner;
+    int *shard_counts;
+    Subscription **local_members;
 
-    // ÉTAPE 12 : Ajouter le client au channel
-    pthread_mutex_lock(&mutex);
-    channel->clients[channel->client_count++] = client_socket;
-    int current_count = channel->client_count;
-    pthread_mutex_unlock(&mutex);
+    // Journal segmenté : segments du plus ancien au plus récent, le dernier est le
+    // segment actif. Seul le thread écrivain ajoute (rotation) ou retire (rétention)
+    // des segments et écrit dans log_fd et log_index_fd, les lecteurs d'historique
+    // consultent le tableau sous segments_lock.
+    pthread_mutex_t load_lock; // Chargement paresseux du journal et de l'historique récent (load_channel)
+    atomic_int loaded;         // Journal repris et historique récent chargé
+    pthread_mutex_t segments_lock;
+    SegmentInfo *segments;
+    int segment_count;
+    int segment_capacity;
+    int log_fd;           // Segment actif, en ajout
+    int log_index_fd;     // Son index clairsemé
+    int log_roll_pending; // Écriture échouée : le prochain message ouvre un nouveau segment
+    atomic_ulong last_stored; // Numéro du dernier message écrit
+    LogRecord *log_batch_head; // Lignes du lot en cours pour ce channel (thread écrivain)
+    LogRecord *log_batch_tail;
+    struct Channel *log_batch_next; // Channels touchés par le lot en cours (thread écrivain)
+    unsigned long log_batch_stored; // Enregistrements du lot déjà traités (thread écrivain, io_uring)
+    int log_dirty;                // Écrit depuis le dernier fdatasync
+    atomic_ulong log_submitted;   // Messages soumis à l'écrivain
+    atomic_ulong log_written;     // Messages écrits dans le journal
+    atomic_ulong message_count;   // Messages journalisés depuis le démarrage (métriques)
+    uint64_t last_sequence;       // Numéro du dernier message soumis (log_queue_mutex)
 
-    // ÉTAPE 13 : Envoyer l'historique du channel au client
-    send_storage_to_client(client_socket, channel_name);
+    // Recherche : index du segment actif, les segments fermés ont leur fichier .fts
+    pthread_mutex_t search_lock;
+    SearchIndex *search; // NULL avant le chargement du channel
+    int search_catch_up; // Rattrapage demandé au thread d'indexation (search_lock)
 
-    // ÉTAPE 14 : Notifier les autres clients que le nouveau client a rejoint le channel
-    char join_message[BUFFER_SIZE];
-    snprintf(join_message, sizeof(join_message), "%s a rejoint le channel '%s'... (%d/%d)\n", client_name, channel_name, current_count, MAX_CLIENTS);
-    broadcast_message(channel, join_message, client_socket);
+    // Fédération : table d'intérêt des instances pairs pour ce channel
+    atomic_ulong peer_interest; // Bit n : l'instance n a des membres dans ce channel (thread de fédération)
+    int peer_advertised;        // Nos membres annoncés aux pairs (thread de fédération)
 
-    // ÉTAPE 15 : Boucle principale de gestion des messages du client
-    while (1)
-    {
-        // ÉTAPE 16 : Recevoir un message du client
-        int read_size = recv(client_socket, buffer, sizeof(buffer), 0);
-        if (read_size <= 0)
-        {
-            // Connexion fermée ou erreur de réception
-            break;
-        }
+    // Historique récent : anneau des history_lines dernières lignes, rejoué aux join
+    pthread_mutex_t history_lock;
+    HistoryLine *history;  // Alloué au premier ajout
+    int history_start;     // Slot de la ligne la plus ancienne
+    int history_count;
+    size_t history_bytes;  // Taille cumulée des lignes présentes
+} Channel;
 
-        buffer[read_size] = '\0';
+typedef enum
+{
+    METRIC_ACCEPTED,          // Connexions acceptées
+    METRIC_HANDSHAKES,        // Poignées de main terminées (client entré dans un channel)
+    METRIC_MESSAGES,          // Messages journalisés et diffusés
+    METRIC_DELIVERIES,        // Messages mis en file pour un destinataire
+    METRIC_HISTORY_REQUESTS,  // Envois d'historique (arrivée dans un channel, /history)
+    METRIC_DROPPED,           // Messages jetés par la politique client lent
+    METRIC_EVICTIONS,         // Clients lents déconnectés
+    METRIC_PEER_RELAYS,       // Messages relayés à une instance paire
+    METRIC_PEER_RECEIVED,     // Messages reçus des instances pairs
+    METRIC_SOCKET_WRITES,     // Écritures sur les sockets des clients et des pairs (send, sendmsg)
+    METRIC_CLIENT_THROTTLED,  // Messages refusés : débit du client dépassé
+    METRIC_CHANNEL_THROTTLED, // Messages refusés : débit du channel dépassé
+    METRIC_ACCEPT_THROTTLED,  // Connexions refusées : débit d'acceptation dépassé
+    METRIC_CONNECTIONS_FULL,  // Connexions refusées : trop de connexions ouvertes
+    METRIC_SERVER_FULL,       // Connexions refusées après la poignée de main : trop de clients
+    METRIC_BLOCK_MALLOCS,     // Blocs du cache de blocs alloués par malloc (nul en régime établi)
+    METRIC_COUNTER_COUNT
+} MetricCounter;
 
-        // ÉTAPE 17 : Vérifier si le client demande de changer de channel
-        if (strncmp(buffer, "/switch ", 8) == 0)
-        {
-            // ÉTAPE 18 : Extraire le nouveau nom de channel
-            char new_channel_name[50];
-            sscanf(buffer + 8, "%s", new_channel_name);
+typedef enum
+{
+    HISTOGRAM_HANDSHAKE,         // Connexion -> entrée dans le channel
+    HISTOGRAM_LOG_AND_BROADCAST, // Journalisation puis diffusion d'un message
+    HISTOGRAM_BROADCAST,         // Diffusion seule (fan-out)
+    HISTOGRAM_HISTORY,           // Envoi de l'historique
+    HISTOGRAM_SEARCH,            // Recherche dans l'historique (/search)
+    HISTOGRAM_COUNT
+} MetricHistogram;
 
-            // ÉTAPE 19 : Trouver ou créer le nouveau channel
-            Channel *new_channel = find_or_create_channel(new_channel_name);
+/**
+ * Copie des métriques, écrite sans verrou par les threads qui lui sont
+ * attribués (incréments relâchés, en pratique sans contention) et sommée à la
+ * lecture. Les histogrammes sont log-linéaires (type HDR) en nanosecondes.
+ */
+typedef struct
+{
+    _Alignas(64) atomic_ulong counters[METRIC_COUNTER_COUNT];
+    atomic_ulong histogram_sums[HISTOGRAM_COUNT];
+    atomic_ulong histograms[HISTOGRAM_COUNT][HISTOGRAM_BUCKETS];
+} MetricShard;
 
-            if (new_channel == NULL)
-            {
-                send(client_socket, "Erreur : Impossible de rejoindre le nouveau channel\n", 55, 0);
-                close(client_socket);
-                return NULL;
-            }
+/**
+ * Étape tracée d'un message échantillonné : réception, journalisation,
+ * diffusion, livraison à un membre... Les étapes d'un même message partagent
+ * son identifiant de trace, quel que soit le thread qui les a parcourues.
+ */
+typedef struct
+{
+    const char *name;              // Nom de l'étape (chaîne constante)
+    uint64_t trace_id;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t wait_ns;              // Attente d'un verrou pendant l'étape
+    uint64_t sequence;             // Numéro du message, 0 s'il n'est pas encore connu
+    const Channel *channel;        // Channel du message, ou NULL (les channels ne sont jamais libérés)
+    int socket;                    // Client concerné, -1 si aucun
+    int thread;                    // Identifiant noyau du thread
+} TraceSpan;
 
-            // ÉTAPE 20 : Notifier l'ancien channel que le client a quitté
-            pthread_mutex_lock(&mutex);
-            int remaining_clients = channel->client_count - 1;
-            pthread_mutex_unlock(&mutex);
+/**
+ * Emplacement de l'anneau des étapes tracées, écrit sans verrou par qui le
+ * réserve. stamp vaut 0 pendant l'écriture puis le numéro de réservation + 1 :
+ * la lecture garde l'étape si stamp n'a pas changé pendant la copie (seqlock).
+ */
+typedef struct
+{
+    atomic_ulong stamp;
+    TraceSpan span;
+} TraceSlot;
 
-            char leave_message[BUFFER_SIZE];
-            snprintf(leave_message, sizeof(leave_message), "%s a quitter le channel '%s'... (%d/%d)\n", client_name, channel_name, remaining_clients, MAX_CLIENTS);
-            broadcast_message(channel, leave_message, client_socket);
+/**
+ * Trace du message en cours de traitement par un thread.
+ */
+typedef struct
+{
+    uint64_t id;         // Trace du message en cours, 0 s'il n'est pas échantillonné
+    uint64_t origin;     // Début de sa réception
+    uint64_t recv_start; // Dernière réception du thread
+    uint64_t recv_end;
+    int countdown;       // Messages à laisser passer avant le prochain échantillon
+    int thread;          // Identifiant noyau du thread, 0 s'il n'est pas encore lu
+} TraceContext;
 
-            // ÉTAPE 21 : Supprimer le client de l'ancien channel
-            remove_client_from_channel(channel, client_socket);
+typedef enum
+{
+    MODE_THREADS, // Un thread par client (mode historique)
+    MODE_EPOLL    // Boucle(s) d'événements epoll (edge-triggered)
+} ServerMode;
 
-            // ÉTAPE 22 : Ajouter le client au nouveau channel
-            pthread_mutex_lock(&mutex);
-            new_channel->clients[new_channel->client_count++] = client_socket;
-            int new_count = new_channel->client_count;
-            pthread_mutex_unlock(&mutex);
+typedef enum
+{
+    CONN_NEGOTIATING,       // Client tramé : préface incomplète
+    CONN_HANDSHAKE_NAME,    // Attente du nom du client (ou de la trame de poignée de main)
+    CONN_HANDSHAKE_CHANNEL, // Attente du nom du channel
+    CONN_CHAT               // Client dans au moins un channel (historique peut-être encore attendu)
+} ConnectionState;
 
-            // ÉTAPE 23 : Envoyer l'historique du nouveau channel au client
-            send_storage_to_client(client_socket, new_channel_name);
+/**
+ * État d'une connexion en mode epoll. Les données que le socket n'a pas pu
+ * accepter immédiatement sont conservées dans sa file de sortie jusqu'à EPOLLOUT.
+ */
+typedef struct Connection
+{
+    uint64_t id; // Identifiant unique (le numéro de socket peut être réutilisé)
+    uint64_t accepted_ns; // Heure d'acceptation (durée de la poignée de main)
+    int socket;
+    ConnectionState state;
+    char client_name[50];
+    Subscription *subscriptions; // Channels suivis, le courant en tête
+    int subscription_count;
+    int handshake_pending; // Poignée de main mesurée à la réception du premier historique
+    struct Reactor *reactor;
+    int evicted; // Client lent déconnecté, fermeture signalée par epoll
+    struct FrameReader *input; // Octets reçus pas encore découpés en trames (clients tramés seulement)
+    OutboundQueue queue;
 
-            // ÉTAPE 24 : Notifier les clients du nouveau channel que ce client a rejoint
-            char join_message[BUFFER_SIZE];
-            snprintf(join_message, sizeof(join_message), "%s a rejoint le channel '%s'... (%d/%d)\n", client_name, new_channel_name, new_count, MAX_CLIENTS);
-            broadcast_message(new_channel, join_message, client_socket);
+    // io_uring : la connexion n'est libérée qu'une fois toutes ses opérations terminées
+    int uring_pending;         // Réception multishot armée, envoi en cours
+    int closing;               // Fermée, en attente des dernières complétions
+    int evict_deferred;        // Client lent à déconnecter à la fin de l'envoi en cours
+    struct UringSend *send;    // Envoi en cours
 
-            // ÉTAPE 25 : Mettre à jour le channel actuel du client
-            channel = new_channel;
-            strncpy(channel_name, new_channel_name, sizeof(channel_name) - 1);
-            channel_name[sizeof(channel_name) - 1] = '\0';
+    TokenBucket send_bucket; // Débit des messages du client
+    int throttled;           // Messages refusés depuis le dernier accepté : avis déjà envoyé
+    Arena arena;             // Réponses aux commandes
+} Connection;
 
-            // ÉTAPE 26 : Confirmer au client qu'il a rejoint le nouveau channel
-            char switch_message[BUFFER_SIZE];
-            snprintf(switch_message, sizeof(switch_message), "Vous avez rejoint le channel '%s'\n", new_channel_name);
-            send(client_socket, switch_message, strlen(switch_message), 0);
+typedef enum
+{
+    SHARD_JOIN,    // Réacteur du client -> propriétaire : le client rejoint le channel
+    SHARD_LEAVE,   // Réacteur du client -> propriétaire : le client quitte le channel
+    SHARD_CHAT,    // Réacteur du client -> propriétaire : message à journaliser et diffuser
+    SHARD_DELIVER, // Propriétaire -> réacteurs membres : message à livrer aux membres locaux
+    SHARD_REPLAY,  // Propriétaire -> réacteur du client : historique, fin du join
+    SHARD_REMOTE_CHAT,  // Fédération -> propriétaire : message d'une instance paire, à journaliser et diffuser
+    SHARD_REMOTE_NOTICE // Fédération -> propriétaire : notification d'une instance paire, à diffuser
+} ShardMessageType;
 
-            continue;
+/**
+ * Message échangé entre réacteurs. Le texte (message, historique) suit la structure.
+ */
+typedef struct ShardMessage
+{
+    ShardMessageType type;
+    int source;
+    Channel *channel;
+    uint64_t connection_id; // Client concerné (ou exclu de la diffusion pour DELIVER)
+    int client_socket;
+    char client_name[50];
+    struct ShardMessage *next; // File de débordement du producteur
+    BroadcastBuffer *buffer;   // DELIVER : référence sur le message partagé (pas de copie)
+    uint64_t sequence;         // REPLAY : plus ancien message de l'historique rejoué
+    uint64_t trace_id;         // CHAT : trace du message échantillonné, 0 sinon
+    uint64_t trace_origin;     // CHAT : début de sa réception
+    uint64_t posted_ns;        // CHAT, DELIVER : envoi au réacteur cible (messages tracés)
+    size_t length;
+    char data[];
+} ShardMessage;
+
+/**
+ * File sans verrou à un producteur et un consommateur entre deux réacteurs.
+ */
+typedef struct
+{
+    _Alignas(64) atomic_size_t head; // Avancé par le consommateur
+    _Alignas(64) atomic_size_t tail; // Avancé par le producteur
+    _Alignas(64) ShardMessage *slots[SHARD_QUEUE_CAPACITY];
+} ShardQueue;
+
+/**
+ * Anneau io_uring piloté par appels système directs : files de soumission et de
+ * complétion partagées avec le noyau.
+ */
+typedef struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail; // SQE préparées, publiées au prochain io_ring_submit
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *ring_memory;
+    size_t ring_size;
+    size_t sqes_size;
+} IoRing;
+
+/**
+ * Buffers de réception fournis au noyau (IORING_REGISTER_PBUF_RING) : une
+ * réception multishot choisit elle-même un buffer libre, rendu après traitement.
+ */
+typedef struct
+{
+    struct io_uring_buf_ring *ring;
+    size_t ring_bytes;
+    char *buffers;
+    unsigned tail;
+} IoBufferRing;
+
+/**
+ * Envoi vectorisé en cours sur une connexion : l'en-tête et les iovec doivent
+ * rester en place jusqu'à la complétion.
+ */
+typedef struct UringSend
+{
+    struct msghdr header;
+    struct iovec iov[OUTBOUND_IOV_BATCH];
+    struct UringSend *next; // Liste des envois libres du réacteur
+} UringSend;
+
+typedef enum
+{
+    URING_ACCEPT = 1, // Acceptation multishot sur le socket d'écoute
+    URING_WAKE,       // Poll multishot sur l'eventfd du réacteur
+    URING_RECV,       // Réception multishot d'une connexion
+    URING_SEND        // Envoi vectorisé d'une connexion
+} UringOperation;
+
+#define URING_OPERATION_MASK 7 // user_data : adresse de la connexion | opération
+
+/**
+ * Un réacteur : un thread, une instance epoll (ou un anneau io_uring), un socket
+ * d'écoute SO_REUSEPORT et les connexions qu'il a acceptées.
+ */
+typedef struct Reactor
+{
+    int id;
+    pthread_t thread;
+    int epoll_fd;
+    IoRing *ring;                // io_uring si activé (--io-uring), NULL pour epoll
+    IoBufferRing recv_buffers;
+    OutboundQueue *send_pending; // Files à envoyer en fin d'itération (io_uring)
+    OutboundQueue *flush_queues; // Files à écrire en fin de fenêtre de regroupement (epoll)
+    uint64_t window_started;     // Début de la fenêtre de regroupement en cours (ns), 0 si aucune
+    UringSend *free_sends;
+    int listen_socket;
+    int wake_fd; // eventfd signalé quand une autre file lui est destinée
+    Connection **connections; // Indexé par descripteur de socket
+    int connections_capacity;
+    uint64_t next_connection_id;
+    ObjectPool connection_pool; // Connexions du réacteur
+    ObjectPool reader_pool;     // Lecteurs de trames, tenus seulement pendant une trame partielle
+    ObjectPool subscription_pool;
+    ShardMessage *overflow_head[MAX_REACTORS]; // Messages en attente de place dans une file
+    ShardMessage *overflow_tail[MAX_REACTORS];
+    uint64_t pending_wakeups; // Bit i : réveiller le réacteur i en fin d'itération
+    pthread_mutex_t remote_lock; // Messages des instances pairs, déposés par le thread de fédération
+    ShardMessage *remote_head;
+    ShardMessage *remote_tail;
+} Reactor;
+
+typedef enum
+{
+    PEER_HELLO = 16,  // Présentation : la séquence porte l'identifiant de l'instance
+    PEER_SUBSCRIBE,   // "channel" : l'instance a maintenant des membres dans ce channel
+    PEER_UNSUBSCRIBE, // "channel" : elle n'en a plus
+    PEER_CHAT,        // "channel\0expéditeur\0texte" : message à journaliser et diffuser
+    PEER_NOTICE       // "channel\0\0texte" : notification à diffuser
+} PeerFrameType;
+
+/**
+ * Liaison avec une instance paire : mêmes en-têtes de trame que les clients
+ * tramés, file de sortie bornée par --peer-queue-bytes, sans trame jetée.
+ */
+typedef struct
+{
+    int socket;  // -1 : emplacement libre
+    int node_id; // Instance paire, -1 tant qu'elle ne s'est pas présentée
+    int connect_node;             // Instance jointe par une connexion non bloquante en cours, -1 sinon
+    uint64_t connect_deadline_ns; // Abandon de cette connexion
+    OutboundQueue queue;
+    size_t input_length;
+    char input[FRAME_HEADER_SIZE + PEER_MAX_PAYLOAD];
+} PeerLink;
+
+/**
+ * Instance paire donnée par --peer. La connexion est ouverte par l'instance
+ * d'identifiant le plus grand, l'autre l'accepte.
+ */
+typedef struct
+{
+    int node_id;
+    char address[108];
+    uint64_t next_attempt_ns; // Prochaine tentative de connexion
+} PeerConfig;
+
+/**
+ * Message pour le thread de fédération : trame à relayer aux pairs intéressés
+ * par le channel, ou (length nul) membres locaux du channel à annoncer.
+ */
+typedef struct FederationEvent
+{
+    struct FederationEvent *next;
+    Channel *channel;
+    size_t length;
+    char data[];
+} FederationEvent;
+
+/**
+ * Message relayé par une instance paire, en attente du thread de livraison :
+ * le chargement du channel et la journalisation ne bloquent pas le thread de fédération.
+ */
+typedef struct PeerDelivery
+{
+    struct PeerDelivery *next;
+    int type; // PEER_CHAT ou PEER_NOTICE
+    char channel_name[50];
+    char sender[50];
+    size_t length;
+    char text[];
+} PeerDelivery;
+
+typedef enum
+{
+    HANDOVER_HELLO,       // Nouveau processus -> ancien : demande de reprise (first : version)
+    HANDOVER_LISTEN,      // Socket d'écoute d'un réacteur
+    HANDOVER_PEER_LISTEN, // Socket d'écoute des instances pairs
+    HANDOVER_CONNECTION,  // Socket d'un client avec son état et son nom
+    HANDOVER_SUBSCRIPTION, // Channel suivi par le client, du plus ancien au courant
+    HANDOVER_INPUT,       // Octets reçus du client pas encore découpés en trames
+    HANDOVER_PENDING,     // Octets en attente d'envoi au client
+    HANDOVER_HISTORY,     // Historique pas encore lu sur disque pour le client (first à last)
+    HANDOVER_END,         // Tout est transmis
+    HANDOVER_ACK,         // Nouveau processus -> ancien : tout est reçu, l'ancien peut s'arrêter
+    HANDOVER_PEER_MESSAGE // Message d'une instance paire pas encore livré (first : PeerFrameType)
+} HandoverType;
+
+/**
+ * En-tête d'un paquet de reprise (socket Unix SOCK_SEQPACKET) : un socket peut
+ * l'accompagner (SCM_RIGHTS), length octets de données le suivent.
+ */
+typedef struct
+{
+    uint32_t type;
+    uint32_t state;     // CONNECTION : état de la connexion ; SUBSCRIPTION : historique reçu (membre local)
+    uint32_t framed;    // CONNECTION : client tramé
+    uint32_t notify;    // CONNECTION : poignée de main à mesurer ; SUBSCRIPTION : arrivée à confirmer
+    uint64_t first;     // SUBSCRIPTION : curseur /more ; HISTORY : premier message
+    uint64_t last;      // HISTORY : dernier message
+    uint32_t length;
+    char client_name[50];
+    char channel_name[50];
+} HandoverHeader;
+
+/**
+ * Paquet reçu de l'ancien processus, gardé jusqu'au démarrage des réacteurs.
+ */
+typedef struct HandoverItem
+{
+    struct HandoverItem *next;
+    HandoverHeader header;
+    int fd; // Socket reçu, -1 si aucun
+    char data[];
+} HandoverItem;
+
+/**
+ * Octets reçus d'un client tramé, en attente d'une trame complète.
+ */
+typedef struct FrameReader
+{
+    size_t start;  // Début des octets pas encore consommés
+    size_t length; // Fin des octets reçus
+    char data[FRAME_HEADER_SIZE + BUFFER_SIZE];
+} FrameReader;
+
+// Table des channels : adressage ouvert (sondage linéaire) sur le hachage du nom,
+// agrandie à mi-remplissage. Les channels ne sont jamais supprimés et ne bougent
+// pas en mémoire : seule la table des pointeurs est réallouée. Protégée par mutex.
+Channel **channel_table = NULL;
+size_t channel_table_capacity = 0;
+int channel_count = 0;
+_Atomic(Channel *) channel_list = NULL; // Parcours sans verrou de tous les channels
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Lecteur RCU : un par thread client. epoch vaut 0 hors section critique, sinon
+ * l'époque globale observée à l'entrée.
+ */
+typedef struct RcuReader
+{
+    atomic_ulong epoch;
+    atomic_int in_use;
+    struct RcuReader *next;
+} RcuReader;
+
+/**
+ * Objet retiré, libéré quand plus aucun lecteur entré avant son retrait n'est actif.
+ */
+typedef struct RcuRetired
+{
+    void *ptr;
+    void (*release)(void *);
+    unsigned long epoch;
+    struct RcuRetired *next;
+} RcuRetired;
+
+atomic_ulong rcu_global_epoch = 1;
+_Atomic(RcuReader *) rcu_readers = NULL;
+RcuRetired *rcu_retired = NULL;
+pthread_mutex_t rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
+__thread RcuReader *rcu_self = NULL;
+
+ServerMode server_mode = MODE_THREADS;
+int history_lines = 100; // Lignes gardées en mémoire par channel pour le rejeu
+LogSyncMode log_sync_mode = LOG_SYNC_NONE;
+int log_sync_interval_ms = 100;
+LogRecord *log_queue_head = NULL; // Lignes soumises, pas encore prises par l'écrivain
+LogRecord *log_queue_tail = NULL;
+int log_writer_sleeping = 0;
+pthread_mutex_t log_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t log_queue_cond = PTHREAD_COND_INITIALIZER;   // Nouvelles lignes pour l'écrivain
+pthread_cond_t log_written_cond = PTHREAD_COND_INITIALIZER; // Un lot vient d'être écrit
+size_t high_watermark = 256 * 1024; // Au-delà, la politique client lent s'applique
+size_t low_watermark = 64 * 1024;   // Niveau visé après avoir jeté des messages
+SlowConsumerPolicy slow_consumer_policy = SLOW_CONSUMER_DROP_OLDEST;
+size_t coalesce_bytes = 16 * 1024; // Une file est écrite dès que ce volume attend (mode epoll), 0 : sans regroupement
+long coalesce_window_us = 200;     // Durée maximale d'une fenêtre de regroupement sous charge
+OutboundQueue *registered_queues = NULL;
+pthread_mutex_t registered_queues_mutex = PTHREAD_MUTEX_INITIALIZER;
+int reactor_count = 1;
+Reactor *reactors = NULL;
+ShardQueue *shard_queues = NULL; // shard_queues[source * reactor_count + cible]
+atomic_int reactor_client_count = 0;
+atomic_int thread_client_count = 0; // Clients dans au moins un channel en mode thread
+int max_clients = MAX_CLIENTS;
+int max_connections = 0;              // Connexions ouvertes au plus, poignées de main comprises (0 : 2 × max_clients)
+atomic_int open_connections = 0;      // Sockets clients acceptés et pas encore fermés
+RateLimit client_rate_limit = {50, 100, 0};  // Messages d'un client (--client-rate)
+RateLimit channel_rate_limit = {0, 0, 0};    // Messages d'un channel, tous expéditeurs confondus (--channel-rate)
+RateLimit accept_rate_limit = {0, 0, 0};     // Nouvelles connexions (--accept-rate)
+TokenBucket accept_bucket;
+MetricShard metric_shards[METRIC_SHARDS];
+atomic_int next_metric_shard = 0;
+__thread MetricShard *metric_self = NULL;
+static const size_t block_class_sizes[BLOCK_CLASS_COUNT] = {256, 512, 2048, ARENA_CHUNK_SIZE};
+__thread BlockCache block_cache;
+BlockHeader *block_depot[BLOCK_CLASS_COUNT]; // Lots de blocs, chaînés par leur premier bloc (BlockBatch)
+int block_depot_count[BLOCK_CLASS_COUNT];
+pthread_mutex_t block_depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t block_cache_key;
+pthread_once_t block_cache_once = PTHREAD_ONCE_INIT;
+int trace_sample_rate = 0;                  // Un message sur N tracé (--trace-sample), 0 : traçage désactivé
+const char *trace_file_path = "trace_server.json"; // Fichier des traces (--trace-file)
+TraceSlot *trace_ring = NULL;               // TRACE_RING_SPANS étapes, NULL si le traçage est désactivé
+atomic_ulong trace_head = 0;                // Réservations faites dans l'anneau
+atomic_ulong next_trace_id = 1;
+pthread_mutex_t trace_dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+__thread TraceContext trace_self;
+struct timespec server_start_time;
+const char *admin_socket_path = NULL; // Socket Unix d'administration (--admin-socket), désactivé si NULL
+off_t segment_bytes = 4 * 1024 * 1024; // Taille à partir de laquelle un segment est fermé et un nouveau ouvert
+long retention_age = 0;                  // Âge (secondes) au-delà duquel un segment est effacé, 0 : illimité
+off_t retention_bytes = 0;               // Taille maximale du journal d'un channel, 0 : illimitée
+int use_io_uring = 0;                    // --io-uring : réacteurs et écrivain du journal passent par io_uring
+IoRing *log_ring = NULL;                 // Anneau de l'écrivain du journal, NULL : writev
+int server_port = PORT;
+int node_id = -1;                        // Identifiant dans la fédération (--node-id), -1 : instance seule
+const char *peer_listen_address = NULL;  // unix:CHEMIN ou HÔTE:PORT, où les pairs se connectent
+PeerConfig peer_configs[FEDERATION_MAX_NODES];
+int peer_config_count = 0;
+int federation_enabled = 0;
+size_t peer_queue_bytes = 4 * 1024 * 1024; // Au-delà, la liaison avec une instance paire est coupée puis rouverte
+PeerLink peer_links[FEDERATION_MAX_LINKS];
+PeerLink *links_by_node[FEDERATION_MAX_NODES];
+FederationEvent *federation_head = NULL; // Événements pas encore pris par le thread de fédération
+FederationEvent *federation_tail = NULL;
+pthread_mutex_t federation_mutex = PTHREAD_MUTEX_INITIALIZER;
+int federation_wake_fd = -1;
+PeerDelivery *peer_delivery_head = NULL; // Messages des pairs pas encore livrés
+PeerDelivery *peer_delivery_tail = NULL;
+pthread_mutex_t peer_delivery_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t peer_delivery_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t peer_delivery_idle = PTHREAD_COND_INITIALIZER; // Signalé quand le thread de livraison a fini un lot
+int peer_delivery_paused = 0; // Mise à jour à chaud : les messages des pairs restent en file
+int peer_delivery_busy = 0;   // Le thread de livraison a un lot en main
+ObjectPool client_pool;       // Clients du mode thread (client_pool_mutex)
+ObjectPool subscription_pool; // Abonnements du mode thread (client_pool_mutex)
+pthread_mutex_t client_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+int peer_listen_socket = -1;            // Socket d'écoute des pairs, transmis lors d'une mise à jour à chaud
+const char *upgrade_socket_path = NULL; // Socket Unix de mise à jour à chaud (--upgrade-socket), désactivé si NULL
+int inherited_listen_sockets[MAX_REACTORS]; // Sockets d'écoute repris de l'ancien processus
+int inherited_listen_count = 0;
+HandoverItem *handover_items = NULL;    // Connexions reprises, restaurées au démarrage des réacteurs
+atomic_int upgrade_requested = 0;       // Les réacteurs doivent s'arrêter pour une mise à jour à chaud
+int upgrade_quiet = 0;                  // Plus aucun message entre réacteurs : fin des tours d'arrêt
+pthread_barrier_t upgrade_barrier;      // Réacteurs et thread de mise à jour
+SearchJob *search_jobs_head = NULL;     // Travaux du thread d'indexation
+SearchJob *search_jobs_tail = NULL;
+pthread_mutex_t search_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t search_jobs_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Donne la copie des métriques du thread courant (attribuée au premier appel).
+ * @return La copie.
+ */
+static inline MetricShard *metric_shard()
+{
+    if (metric_self == NULL)
+    {
+        metric_self = &metric_shards[(unsigned)atomic_fetch_add_explicit(&next_metric_shard, 1, memory_order_relaxed) % METRIC_SHARDS];
+    }
+    return metric_self;
+}
+
+/**
+ * Incrémente un compteur.
+ * @param counter Le compteur.
+ * @param value La valeur à ajouter.
+ */
+static inline void metric_add(MetricCounter counter, unsigned long value)
+{
+    atomic_fetch_add_explicit(&metric_shard()->counters[counter], value, memory_order_relaxed);
+}
+
+/**
+ * Donne l'heure monotone en nanosecondes (horodatage des métriques).
+ * @return L'heure.
+ */
+static inline uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Donne l'intervalle d'histogramme d'une durée : exact sous 16 ns, puis 16
+ * intervalles par puissance de 2.
+ * @param value La durée (ns).
+ * @return L'intervalle.
+ */
+static inline int histogram_bucket(uint64_t value)
+{
+    if (value >= (1ull << HISTOGRAM_MAX_BITS))
+    {
+        value = (1ull << HISTOGRAM_MAX_BITS) - 1;
+    }
+    if (value < (1u << HISTOGRAM_SUB_BITS))
+    {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)((value >> shift) - (1u << HISTOGRAM_SUB_BITS));
+}
+
+/**
+ * Donne la borne basse d'un intervalle d'histogramme.
+ * @param bucket L'intervalle.
+ * @return La plus petite durée (ns) de l'intervalle.
+ */
+uint64_t histogram_bucket_low(int bucket)
+{
+    if (bucket < (1 << HISTOGRAM_SUB_BITS))
+    {
+        return (uint64_t)bucket;
+    }
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t mantissa = (1u << HISTOGRAM_SUB_BITS) + (bucket & ((1 << HISTOGRAM_SUB_BITS) - 1));
+    return mantissa << shift;
+}
+
+/**
+ * Enregistre la durée écoulée depuis start dans un histogramme.
+ * @param histogram L'histogramme.
+ * @param start Le début de l'opération (monotonic_ns).
+ */
+static inline void metric_record_since(MetricHistogram histogram, uint64_t start)
+{
+    uint64_t elapsed = monotonic_ns() - start;
+    MetricShard *shard = metric_shard();
+    atomic_fetch_add_explicit(&shard->histograms[histogram][histogram_bucket(elapsed)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->histogram_sums[histogram], elapsed, memory_order_relaxed);
+}
+
+/**
+ * Donne l'heure monotone si le traçage est activé : les réceptions ne sont
+ * horodatées que dans ce cas.
+ * @return L'heure (ns), 0 si le traçage est désactivé.
+ */
+static inline uint64_t trace_clock()
+{
+    return trace_ring != NULL ? monotonic_ns() : 0;
+}
+
+/**
+ * Retient la réception qui vient de se terminer, première étape des messages
+ * qu'elle contient.
+ * @param start Le début de la réception (trace_clock), 0 si le traçage est désactivé.
+ */
+static inline void trace_received(uint64_t start)
+{
+    if (start != 0)
+    {
+        trace_self.recv_start = start;
+        trace_self.recv_end = monotonic_ns();
+    }
+}
+
+/**
+ * Ajoute une étape à l'anneau des traces, sans verrou : l'emplacement est
+ * réservé par un incrément atomique, et le plus ancien est écrasé quand l'anneau est plein.
+ * @param name Le nom de l'étape (chaîne constante).
+ * @param trace_id La trace du message.
+ * @param start Le début de l'étape (ns).
+ * @param end La fin de l'étape (ns).
+ * @param channel Le channel du message, ou NULL.
+ * @param sequence Le numéro du message, 0 s'il n'est pas connu.
+ * @param socket Le client concerné, -1 si aucun.
+ * @param wait_ns L'attente d'un verrou pendant l'étape.
+ */
+void trace_record(const char *name, uint64_t trace_id, uint64_t start, uint64_t end, const Channel *channel, uint64_t sequence, int socket, uint64_t wait_ns)
+{
+    if (trace_self.thread == 0)
+    {
+        trace_self.thread = (int)syscall(SYS_gettid);
+    }
+    unsigned long ticket = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    TraceSlot *slot = &trace_ring[ticket & (TRACE_RING_SPANS - 1)];
+    atomic_store_explicit(&slot->stamp, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->span = (TraceSpan){name, trace_id, start, end, wait_ns, sequence, channel, socket, trace_self.thread};
+    atomic_store_explicit(&slot->stamp, ticket + 1, memory_order_release);
+}
+
+/**
+ * Termine une étape du message en cours de traitement par le thread, s'il est tracé.
+ * @param name Le nom de l'étape.
+ * @param start Le début de l'étape (monotonic_ns).
+ * @param channel Le channel du message.
+ * @param sequence Le numéro du message, 0 s'il n'est pas connu.
+ */
+static inline void trace_span(const char *name, uint64_t start, const Channel *channel, uint64_t sequence)
+{
+    if (trace_self.id != 0)
+    {
+        trace_record(name, trace_self.id, start, monotonic_ns(), channel, sequence, -1, 0);
+    }
+}
+
+/**
+ * Décide si le message reçu par le thread est tracé (un sur trace_sample_rate,
+ * compté par thread pour ne partager aucun compteur) ; s'il l'est, lui attribue
+ * une trace et enregistre sa réception.
+ * @param channel Le channel du message.
+ * @param socket Le socket de l'expéditeur.
+ */
+void trace_begin_message(const Channel *channel, int socket)
+{
+    if (trace_ring == NULL || trace_self.recv_start == 0 || --trace_self.countdown > 0)
+    {
+        return;
+    }
+    trace_self.countdown = trace_sample_rate;
+    trace_self.id = atomic_fetch_add_explicit(&next_trace_id, 1, memory_order_relaxed);
+    trace_self.origin = trace_self.recv_start;
+    trace_record("recv", trace_self.id, trace_self.recv_start, trace_self.recv_end, channel, 0, socket, 0);
+}
+
+/**
+ * Termine le traitement du message en cours par le thread.
+ */
+static inline void trace_end_message()
+{
+    trace_self.id = 0;
+}
+
+/**
+ * Crée un anneau io_uring et projette ses files en mémoire.
+ * @param ring L'anneau.
+ * @param entries Le nombre d'entrées de la file de soumission (la file de complétion en a quatre fois plus).
+ * @return 0 en cas de succès, -1 si le noyau ne le permet pas (errno renseigné).
+ */
+int io_ring_init(IoRing *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN; // Créé par le thread principal, utilisé par un autre : pas de SINGLE_ISSUER
+    params.cq_entries = entries * 4;
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd == -1 && errno == EINVAL)
+    {
+        // Noyau plus ancien : sans les options facultatives
+        memset(&params, 0, sizeof(params));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (fd == -1)
+    {
+        return -1;
+    }
+    // Une seule projection pour les deux files, complétions jamais perdues, attente bornée
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required)
+    {
+        close(fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->ring_memory = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->ring_memory == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        int saved_errno = errno;
+        if (ring->ring_memory != MAP_FAILED)
+        {
+            munmap(ring->ring_memory, ring->ring_size);
+        }
+        if (ring->sqes != MAP_FAILED)
+        {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    char *base = ring->ring_memory;
+    ring->fd = fd;
+    ring->sq_head = (unsigned *)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->sq_array = (unsigned *)(base + params.sq_off.array);
+    ring->sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+    // Les SQE sont utilisées dans l'ordre de la file : l'indirection est fixée une fois pour toutes
+    for (unsigned i = 0; i < params.sq_entries; ++i)
+    {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+}
+
+/**
+ * Détruit un anneau io_uring (les opérations en cours sont annulées par le noyau).
+ * @param ring L'anneau.
+ */
+void io_ring_destroy(IoRing *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_memory, ring->ring_size);
+    close(ring->fd);
+}
+
+/**
+ * Publie les SQE préparées et les soumet, en attendant éventuellement des complétions.
+ * @param ring L'anneau.
+ * @param wait_count Le nombre de complétions à attendre (0 : ne pas attendre).
+ * @param timeout_ns L'attente maximale en nanosecondes, -1 pour attendre sans limite.
+ * @return 0 en cas de succès (ou d'attente écoulée, ou interrompue), -1 en cas d'erreur.
+ */
+int io_ring_submit(IoRing *ring, unsigned wait_count, long timeout_ns)
+{
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, ring->sq_local_tail, memory_order_release);
+    unsigned to_submit = ring->sq_local_tail - atomic_load_explicit((_Atomic unsigned *)ring->sq_head, memory_order_acquire);
+
+    unsigned flags = wait_count > 0 ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec timeout = {.tv_sec = timeout_ns / 1000000000L, .tv_nsec = timeout_ns % 1000000000L};
+    struct io_uring_getevents_arg arg = {.ts = (uint64_t)(uintptr_t)&timeout};
+    void *argument = NULL;
+    size_t argument_size = 0;
+    if (wait_count > 0 && timeout_ns >= 0)
+    {
+        flags |= IORING_ENTER_EXT_ARG;
+        argument = &arg;
+        argument_size = sizeof(arg);
+    }
+
+    if (syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_count, flags, argument, argument_size) == -1)
+    {
+        // Attente écoulée, signal, ou file de complétion à vider d'abord : l'appelant lit ce qui est arrivé
+        return (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) ? 0 : -1;
+    }
+    return 0;
+}
+
+/**
+ * Réserve la prochaine SQE de l'anneau, remise à zéro. Si la file de soumission
+ * est pleine, ce qui est déjà préparé est soumis d'abord.
+ * @param ring L'anneau.
+ * @return La SQE, ou NULL si la file reste pleine.
+ */
+struct io_uring_sqe *io_ring_get_sqe(IoRing *ring)
+{
+    if (ring->sq_local_tail - atomic_load_explicit((_Atomic unsigned *)ring->sq_head, memory_order_acquire) == ring->sq_entries)
+    {
+        io_ring_submit(ring, 0, -1);
+        if (ring->sq_local_tail - atomic_load_explicit((_Atomic unsigned *)ring->sq_head, memory_order_acquire) == ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    ring->sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/**
+ * Retire la prochaine complétion de l'anneau.
+ * @param ring L'anneau.
+ * @param cqe Reçoit une copie de la complétion (son slot est aussitôt rendu au noyau).
+ * @return 1 si une complétion a été lue, 0 si la file est vide.
+ */
+int io_ring_next_cqe(IoRing *ring, struct io_uring_cqe *cqe)
+{
+    unsigned head = *ring->cq_head;
+    if (head == atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire))
+    {
+        return 0;
+    }
+    *cqe = ring->cqes[head & ring->cq_mask];
+    atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * Rend un buffer de réception au noyau.
+ * @param pool Les buffers.
+ * @param id Le numéro du buffer.
+ */
+void io_buffer_recycle(IoBufferRing *pool, unsigned id)
+{
+    struct io_uring_buf *buffer = &pool->ring->bufs[pool->tail & (URING_RECV_BUFFERS - 1)];
+    buffer->addr = (uint64_t)(uintptr_t)(pool->buffers + (size_t)id * URING_RECV_BUFFER_SIZE);
+    buffer->len = URING_RECV_BUFFER_SIZE;
+    buffer->bid = (uint16_t)id;
+    pool->tail++;
+    atomic_store_explicit((_Atomic uint16_t *)&pool->ring->tail, (uint16_t)pool->tail, memory_order_release);
+}
+
+/**
+ * Alloue les buffers de réception d'un anneau et les enregistre auprès du noyau (groupe 0).
+ * @param ring L'anneau.
+ * @param pool Les buffers.
+ * @return 0 en cas de succès, -1 si le noyau ne gère pas les buffers fournis.
+ */
+int io_buffer_ring_init(IoRing *ring, IoBufferRing *pool)
+{
+    pool->ring_bytes = URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+    pool->ring = mmap(NULL, pool->ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pool->buffers = malloc((size_t)URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE);
+    if (pool->ring == MAP_FAILED || pool->buffers == NULL)
+    {
+        if (pool->ring != MAP_FAILED)
+        {
+            munmap(pool->ring, pool->ring_bytes);
+        }
+        free(pool->buffers);
+        return -1;
+    }
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)pool->ring;
+    registration.ring_entries = URING_RECV_BUFFERS;
+    registration.bgid = 0;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) == -1)
+    {
+        munmap(pool->ring, pool->ring_bytes);
+        free(pool->buffers);
+        return -1;
+    }
+    pool->tail = 0;
+    for (unsigned id = 0; id < URING_RECV_BUFFERS; ++id)
+    {
+        io_buffer_recycle(pool, id);
+    }
+    return 0;
+}
+
+/**
+ * Prépare un pool vide.
+ * @param pool Le pool.
+ * @param object_size La taille d'un objet.
+ */
+void pool_init(ObjectPool *pool, size_t object_size)
+{
+    pool->object_size = (object_size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    pool->free_list = NULL;
+    atomic_init(&pool->allocated, 0);
+    atomic_init(&pool->in_use, 0);
+}
+
+/**
+ * Prend un objet du pool, mis à zéro. Un nouveau bloc n'est alloué que si la
+ * liste libre est vide.
+ * @param pool Le pool.
+ * @return L'objet, ou NULL si la mémoire manque.
+ */
+void *pool_alloc(ObjectPool *pool)
+{
+    if (pool->free_list == NULL)
+    {
+        char *slab = aligned_alloc(CACHE_LINE_SIZE, pool->object_size * POOL_SLAB_OBJECTS);
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+        for (int i = POOL_SLAB_OBJECTS - 1; i >= 0; --i)
+        {
+            void *object = slab + (size_t)i * pool->object_size;
+            *(void **)object = pool->free_list;
+            pool->free_list = object;
+        }
+        atomic_fetch_add_explicit(&pool->allocated, POOL_SLAB_OBJECTS, memory_order_relaxed);
+    }
+    void *object = pool->free_list;
+    pool->free_list = *(void **)object;
+    atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed);
+    memset(object, 0, pool->object_size);
+    return object;
+}
+
+/**
+ * Rend un objet au pool.
+ * @param pool Le pool.
+ * @param object L'objet (peut être NULL).
+ */
+void pool_free(ObjectPool *pool, void *object)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+    atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+}
+
+/**
+ * Passe un lot de blocs libres d'une classe du thread à la réserve commune
+ * (rendus à free() si la réserve est pleine).
+ * @param cache Les blocs du thread.
+ * @param size_class La classe.
+ * @param count La taille du lot (au plus les blocs libres du thread, au moins 1).
+ */
+void spill_block_cache(BlockCache *cache, int size_class, int count)
+{
+    BlockHeader *batch = cache->free_blocks[size_class];
+    BlockHeader *last = batch;
+    for (int i = 1; i < count; ++i)
+    {
+        last = last->next;
+    }
+    cache->free_blocks[size_class] = last->next;
+    cache->free_count[size_class] -= count;
+    last->next = NULL;
+
+    pthread_mutex_lock(&block_depot_mutex);
+    if (block_depot_count[size_class] + count <= BLOCK_DEPOT_BLOCKS)
+    {
+        BlockBatch *header = (BlockBatch *)(batch + 1);
+        header->next_batch = block_depot[size_class];
+        header->count = count;
+        block_depot[size_class] = batch;
+        block_depot_count[size_class] += count;
+        batch = NULL;
+    }
+    pthread_mutex_unlock(&block_depot_mutex);
+
+    while (batch != NULL)
+    {
+        BlockHeader *next = batch->next;
+        free(batch);
+        batch = next;
+    }
+}
+
+/**
+ * Rend à la réserve commune les blocs libres d'un thread qui se termine.
+ * @param args Les blocs du thread (BlockCache *).
+ */
+void release_block_cache(void *args)
+{
+    BlockCache *cache = args;
+    for (int size_class = 0; size_class < BLOCK_CLASS_COUNT; ++size_class)
+    {
+        while (cache->free_count[size_class] > 0)
+        {
+            spill_block_cache(cache, size_class, cache->free_count[size_class] < BLOCK_BATCH ? cache->free_count[size_class] : BLOCK_BATCH);
+        }
+    }
+}
+
+void create_block_cache_key()
+{
+    pthread_key_create(&block_cache_key, release_block_cache);
+}
+
+/**
+ * Donne les blocs libres du thread courant, rendus à la réserve à la fin du thread.
+ * @return Les blocs du thread.
+ */
+static inline BlockCache *get_block_cache()
+{
+    BlockCache *cache = &block_cache;
+    if (!cache->registered)
+    {
+        pthread_once(&block_cache_once, create_block_cache_key);
+        pthread_setspecific(block_cache_key, cache);
+        cache->registered = 1;
+    }
+    return cache;
+}
+
+/**
+ * Prend un bloc d'au moins size octets : dans les blocs libres du thread, sinon
+ * un lot de la réserve commune, sinon malloc. Au-delà de la plus grande classe,
+ * le bloc vient directement de malloc.
+ * @param size La taille demandée.
+ * @return Le bloc (aligné sur 16 octets, non initialisé), ou NULL si la mémoire manque.
+ */
+void *block_alloc(size_t size)
+{
+    int size_class = 0;
+    while (size_class < BLOCK_CLASS_COUNT && size > block_class_sizes[size_class])
+    {
+        size_class++;
+    }
+    if (size_class == BLOCK_CLASS_COUNT)
+    {
+        BlockHeader *block = malloc(sizeof(BlockHeader) + size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->size_class = -1;
+        return block + 1;
+    }
+
+    BlockCache *cache = get_block_cache();
+    if (cache->free_blocks[size_class] == NULL && block_depot[size_class] != NULL)
+    {
+        pthread_mutex_lock(&block_depot_mutex);
+        BlockHeader *batch = block_depot[size_class];
+        if (batch != NULL)
+        {
+            BlockBatch *header = (BlockBatch *)(batch + 1);
+            block_depot[size_class] = header->next_batch;
+            block_depot_count[size_class] -= header->count;
+            cache->free_blocks[size_class] = batch;
+            cache->free_count[size_class] = header->count;
+        }
+        pthread_mutex_unlock(&block_depot_mutex);
+    }
+
+    BlockHeader *block = cache->free_blocks[size_class];
+    if (block != NULL)
+    {
+        cache->free_blocks[size_class] = block->next;
+        cache->free_count[size_class]--;
+    }
+    else
+    {
+        block = malloc(sizeof(BlockHeader) + block_class_sizes[size_class]);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        metric_add(METRIC_BLOCK_MALLOCS, 1);
+    }
+    block->size_class = size_class;
+    return block + 1;
+}
+
+/**
+ * Rend un bloc pris par block_alloc, depuis n'importe quel thread.
+ * @param object Le bloc (peut être NULL).
+ */
+void block_free(void *object)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+    BlockHeader *block = (BlockHeader *)object - 1;
+    int size_class = block->size_class;
+    if (size_class < 0)
+    {
+        free(block);
+        return;
+    }
+    BlockCache *cache = get_block_cache();
+    block->next = cache->free_blocks[size_class];
+    cache->free_blocks[size_class] = block;
+    if (++cache->free_count[size_class] >= 2 * BLOCK_BATCH)
+    {
+        spill_block_cache(cache, size_class, BLOCK_BATCH);
+    }
+}
+
+/**
+ * Réserve size octets dans l'arène (alignés sur 16), dans un nouveau bloc si le
+ * bloc courant est plein.
+ * @param arena L'arène.
+ * @param size La taille.
+ * @return La zone, ou NULL si la mémoire manque.
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + 15) & ~(size_t)15;
+    ArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL || arena->used + size > chunk->capacity)
+    {
+        size_t capacity = ARENA_CHUNK_SIZE - sizeof(ArenaChunk);
+        chunk = block_alloc(sizeof(ArenaChunk) + (size > capacity ? size : capacity));
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        chunk->capacity = size > capacity ? size : capacity;
+        arena->chunks = chunk;
+        arena->used = 0;
+    }
+    void *data = chunk->data + arena->used;
+    arena->used += size;
+    return data;
+}
+
+/**
+ * Vide l'arène : tous ses blocs retournent au cache de blocs.
+ * @param arena L'arène.
+ */
+void arena_reset(Arena *arena)
+{
+    while (arena->chunks != NULL)
+    {
+        ArenaChunk *next = arena->chunks->next;
+        block_free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->used = 0;
+}
+
+/**
+ * Initialise une file de sortie.
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ */
+void init_outbound_queue(OutboundQueue *queue, int client_socket)
+{
+    memset(queue, 0, sizeof(OutboundQueue));
+    queue->socket = client_socket;
+}
+
+/**
+ * Ajoute une file de sortie au registre consulté par le thread de supervision.
+ * @param queue La file.
+ * @param client_name Le nom du client.
+ */
+void register_outbound_queue(OutboundQueue *queue, const char *client_name)
+{
+    pthread_mutex_lock(&registered_queues_mutex);
+    snprintf(queue->client_name, sizeof(queue->client_name), "%s", client_name);
+    queue->prev_registered = NULL;
+    queue->next_registered = registered_queues;
+    if (registered_queues != NULL)
+    {
+        registered_queues->prev_registered = queue;
+    }
+    registered_queues = queue;
+    pthread_mutex_unlock(&registered_queues_mutex);
+}
+
+/**
+ * Retire une file de sortie du registre (sans effet si elle n'y est pas).
+ * @param queue La file.
+ */
+void unregister_outbound_queue(OutboundQueue *queue)
+{
+    pthread_mutex_lock(&registered_queues_mutex);
+    if (queue->prev_registered != NULL)
+    {
+        queue->prev_registered->next_registered = queue->next_registered;
+    }
+    else if (registered_queues == queue)
+    {
+        registered_queues = queue->next_registered;
+    }
+    if (queue->next_registered != NULL)
+    {
+        queue->next_registered->prev_registered = queue->prev_registered;
+    }
+    queue->prev_registered = queue->next_registered = NULL;
+    pthread_mutex_unlock(&registered_queues_mutex);
+}
+
+/**
+ * Met à jour les compteurs d'une file après ajout ou retrait d'octets.
+ * @param queue La file.
+ * @param bytes La variation du nombre d'octets.
+ * @param messages La variation du nombre de messages.
+ */
+void update_outbound_counters(OutboundQueue *queue, ssize_t bytes, int messages)
+{
+    size_t queued = atomic_load_explicit(&queue->queued_bytes, memory_order_relaxed) + bytes;
+    atomic_store_explicit(&queue->queued_bytes, queued, memory_order_relaxed);
+    atomic_store_explicit(&queue->queued_messages, atomic_load_explicit(&queue->queued_messages, memory_order_relaxed) + messages, memory_order_relaxed);
+    if (queued > atomic_load_explicit(&queue->peak_bytes, memory_order_relaxed))
+    {
+        atomic_store_explicit(&queue->peak_bytes, queued, memory_order_relaxed);
+    }
+}
+
+/**
+ * Passe un socket en mode non bloquant.
+ * @param socket_fd Le socket.
+ * @return 0 en cas de succès, -1 sinon.
+ */
+int set_nonblocking(int socket_fd)
+{
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    if (flags == -1)
+    {
+        return -1;
+    }
+    return fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+HistoryCursor *open_history_cursor(Channel *channel, uint64_t first, uint64_t last);
+void close_history_cursor(HistoryCursor *cursor);
+size_t fill_history_chunk(HistoryCursor *cursor, char *out, size_t capacity);
+
+/**
+ * Taille en mémoire d'un message en file : un historique lu sur disque n'a
+ * qu'une tranche en mémoire à la fois et ne compte donc pas dans les seuils.
+ * @param msg Le message.
+ * @return Le nombre d'octets comptés dans queued_bytes.
+ */
+size_t outbound_message_bytes(const OutboundMessage *msg)
+{
+    return msg->cursor == NULL ? msg->length : 0;
+}
+
+/**
+ * Libère une référence sur un message partagé ; le dernier détenteur le libère.
+ * Pour un message tracé, c'est la fin de sa livraison au dernier destinataire.
+ * @param buffer Le message.
+ */
+void release_broadcast_buffer(BroadcastBuffer *buffer)
+{
+    if (buffer != NULL && atomic_fetch_sub_explicit(&buffer->refcount, 1, memory_order_acq_rel) == 1)
+    {
+        if (buffer->trace_id != 0)
+        {
+            trace_record("message", buffer->trace_id, buffer->trace_origin, monotonic_ns(), NULL, 0, -1, 0);
+        }
+        block_free(buffer);
+    }
+}
+
+/**
+ * Libère un message retiré d'une file de sortie (et sa référence éventuelle).
+ * @param msg Le message.
+ */
+void free_outbound_message(OutboundMessage *msg)
+{
+    release_broadcast_buffer(msg->buffer);
+    if (msg->cursor != NULL)
+    {
+        close_history_cursor(msg->cursor);
+    }
+    block_free(msg);
+}
+
+/**
+ * Prépare la tranche suivante d'un historique en file, précédée de son en-tête
+ * FRAME_HISTORY pour un client tramé. Les lignes sont reconstituées depuis les
+ * enregistrements binaires du journal : elles ne peuvent plus partir du disque
+ * par sendfile(), au prix d'une copie par tranche de HISTORY_CHUNK_SIZE octets.
+ * @param queue La file.
+ * @param msg Le message d'historique.
+ * @return 1 si une tranche est prête, 0 si l'historique est épuisé.
+ */
+int refill_history_message(OutboundQueue *queue, OutboundMessage *msg)
+{
+    size_t length = fill_history_chunk(msg->cursor, msg->inline_data + FRAME_HEADER_SIZE, HISTORY_CHUNK_SIZE);
+    if (length == 0)
+    {
+        return 0;
+    }
+    if (queue->framed)
+    {
+        frame_encode_header((unsigned char *)msg->inline_data, FRAME_HISTORY, msg->cursor->channel->id, 0, (uint32_t)length);
+        msg->data = msg->inline_data;
+        msg->length = FRAME_HEADER_SIZE + length;
+    }
+    else
+    {
+        msg->data = msg->inline_data + FRAME_HEADER_SIZE;
+        msg->length = length;
+    }
+    msg->offset = 0;
+    return 1;
+}
+
+/**
+ * Jette les plus anciens messages jamais commencés jusqu'à ce que la file,
+ * augmentée de incoming octets, redescende sous le seuil bas. Un message
+ * partiellement envoyé est conservé pour ne pas couper le flux en son milieu.
+ * @param queue La file.
+ * @param incoming La taille du message sur le point d'être ajouté.
+ */
+void drop_oldest_messages(OutboundQueue *queue, size_t incoming)
+{
+    OutboundMessage **link = &queue->head;
+    OutboundMessage *previous = NULL;
+    int position = 0;
+    while (*link != NULL && atomic_load_explicit(&queue->queued_bytes, memory_order_relaxed) + incoming > low_watermark)
+    {
+        OutboundMessage *msg = *link;
+        if (msg->offset > 0 || msg->cursor != NULL || position++ < queue->pinned)
+        {
+            previous = msg;
+            link = &msg->next;
+            continue;
+        }
+        *link = msg->next;
+        if (queue->tail == msg)
+        {
+            queue->tail = previous;
+        }
+        update_outbound_counters(queue, -(ssize_t)outbound_message_bytes(msg), -1);
+        atomic_fetch_add_explicit(&queue->dropped_messages, 1, memory_order_relaxed);
+        metric_add(METRIC_DROPPED, 1);
+        free_outbound_message(msg);
+    }
+}
+
+/**
+ * Retire de la tête d'une file les messages couverts par sent octets écrits.
+ * @param queue La file.
+ * @param sent Le nombre d'octets écrits sur le socket.
+ * @return 1 si le dernier message touché n'est que partiellement envoyé (socket plein), 0 sinon.
+ */
+int consume_outbound_bytes(OutboundQueue *queue, size_t sent)
+{
+    while (queue->head != NULL)
+    {
+        OutboundMessage *msg = queue->head;
+        size_t remaining = msg->length - msg->offset;
+        if (sent < remaining)
+        {
+            msg->offset += sent;
+            return sent > 0 || msg->offset > 0;
+        }
+        sent -= remaining;
+        if (msg->cursor != NULL && refill_history_message(queue, msg))
+        {
+            continue; // Envoyé seul : sent vaut 0, la tranche suivante attend le prochain envoi
+        }
+        queue->head = msg->next;
+        if (queue->head == NULL)
+        {
+            queue->tail = NULL;
+        }
+        update_outbound_counters(queue, -(ssize_t)outbound_message_bytes(msg), -1);
+        if (msg->buffer != NULL && msg->buffer->trace_id != 0)
+        {
+            // Message tracé resté en file : de sa diffusion à son dernier octet écrit pour ce client
+            trace_record("send", msg->buffer->trace_id, msg->buffer->trace_created, monotonic_ns(), NULL, 0, queue->socket, 0);
+        }
+        free_outbound_message(msg);
+        if (sent == 0)
+        {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Prépare l'écriture vectorisée des messages en tête de file : les messages en
+ * mémoire consécutifs partent ensemble, la tranche courante d'un historique part seule.
+ * @param queue La file (non vide).
+ * @param iov Reçoit les morceaux (OUTBOUND_IOV_BATCH au plus).
+ * @param requested Reçoit le nombre total d'octets.
+ * @return Le nombre de morceaux.
+ */
+int gather_outbound_iov(OutboundQueue *queue, struct iovec *iov, size_t *requested)
+{
+    OutboundMessage *msg = queue->head;
+    int count = 0;
+    *requested = 0;
+    for (OutboundMessage *m = msg; m != NULL && count < OUTBOUND_IOV_BATCH && (m->cursor == NULL || m == msg); m = m->next)
+    {
+        iov[count].iov_base = (void *)(m->data + m->offset);
+        iov[count].iov_len = m->length - m->offset;
+        *requested += iov[count].iov_len;
+        count++;
+        if (m->cursor != NULL)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * Confie une file au réacteur io_uring qui l'envoie en fin d'itération (sans
+ * effet si elle y est déjà, ou si un envoi est en cours : il reprendra à sa complétion).
+ * @param queue La file.
+ */
+void schedule_outbound_submit(OutboundQueue *queue)
+{
+    if (!queue->submitting)
+    {
+        queue->submitting = 1;
+        queue->submit_next = *queue->submit_list;
+        *queue->submit_list = queue;
+    }
+}
+
+/**
+ * Pose ou retire TCP_CORK sur le socket d'un client : tant qu'il est posé, le
+ * noyau n'émet que des segments pleins.
+ * @param client_socket Le socket du client.
+ * @param corked 1 pour poser, 0 pour retirer (ce qui reste part aussitôt).
+ */
+void set_socket_cork(int client_socket, int corked)
+{
+    setsockopt(client_socket, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
+}
+
+/**
+ * Vide autant que possible une file de sortie sans bloquer. Les messages en
+ * mémoire consécutifs partent ensemble en une écriture vectorisée (sendmsg) ; la
+ * tranche courante d'un historique part seule, la suivante est lue une fois
+ * celle-ci envoyée. Quand il faut plusieurs écritures, le socket est bouché
+ * (TCP_CORK) entre elles pour qu'elles partent en segments pleins. Avec
+ * io_uring, l'envoi est confié au réacteur.
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ * @return 0 si le socket est toujours valide, -1 en cas d'erreur d'écriture.
+ */
+int flush_outbound_queue(OutboundQueue *queue, int client_socket)
+{
+    if (queue->submit_list != NULL)
+    {
+        schedule_outbound_submit(queue);
+        return 0;
+    }
+    queue->coalesced_bytes = 0;
+    int corked = 0;
+    int result = 0;
+    while (queue->head != NULL)
+    {
+        struct iovec iov[OUTBOUND_IOV_BATCH];
+        size_t requested;
+        int count = gather_outbound_iov(queue, iov, &requested);
+        struct msghdr header = {.msg_iov = iov, .msg_iovlen = (size_t)count};
+        ssize_t sent = sendmsg(client_socket, &header, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            result = (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            break;
+        }
+        metric_add(METRIC_SOCKET_WRITES, 1);
+
+        consume_outbound_bytes(queue, (size_t)sent);
+        if ((size_t)sent < requested)
+        {
+            break; // Le socket est plein : la suite attendra POLLOUT/EPOLLOUT
+        }
+        if (!corked && queue->head != NULL && coalesce_bytes > 0)
+        {
+            set_socket_cork(client_socket, 1);
+            corked = 1;
+        }
+    }
+    if (corked)
+    {
+        set_socket_cork(client_socket, 0);
+    }
+    return result;
+}
+
+/**
+ * Confie une file au réacteur epoll qui l'écrira en fin de fenêtre de
+ * regroupement, ou l'écrit tout de suite si coalesce_bytes octets l'attendent.
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ * @return 0 si le socket est toujours valide, -1 en cas d'erreur d'écriture.
+ */
+int schedule_outbound_flush(OutboundQueue *queue, int client_socket)
+{
+    if (!queue->flush_pending)
+    {
+        queue->flush_pending = 1;
+        queue->flush_next = *queue->flush_list;
+        *queue->flush_list = queue;
+    }
+    if (queue->coalesced_bytes >= coalesce_bytes)
+    {
+        return flush_outbound_queue(queue, client_socket);
+    }
+    return 0;
+}
+
+/**
+ * Retire une file de la liste des écritures en attente de son réacteur (connexion fermée).
+ * @param queue La file.
+ */
+void cancel_outbound_flush(OutboundQueue *queue)
+{
+    for (OutboundQueue **link = queue->flush_list; queue->flush_pending && *link != NULL; link = &(*link)->flush_next)
+    {
+        if (*link == queue)
+        {
+            *link = queue->flush_next;
+            queue->flush_next = NULL;
+            queue->flush_pending = 0;
+        }
+    }
+}
+
+/**
+ * Envoie des données via la file de sortie : écriture directe si la file est
+ * vide, sinon mise en file derrière les messages en attente. En mode epoll avec
+ * regroupement, tout passe par la file, écrite par le réacteur en fin de
+ * fenêtre. Les données d'un message partagé ne sont pas copiées : la file
+ * garde une référence.
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ * @param data Les données.
+ * @param length La taille des données.
+ * @param buffer Le message partagé contenant data, ou NULL pour copier les données si besoin.
+ * @param enforce_limits 1 pour appliquer les seuils (diffusions), 0 pour un envoi ponctuel (historique).
+ * @return 0 en cas de succès, -1 en cas d'erreur, 1 si le client doit être déconnecté.
+ */
+int enqueue_outbound(OutboundQueue *queue, int client_socket, const char *data, size_t length, BroadcastBuffer *buffer, int enforce_limits)
+{
+    size_t sent_directly = 0;
+    if (queue->head == NULL && queue->submit_list == NULL && queue->flush_list == NULL)
+    {
+        ssize_t sent = send(client_socket, data, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent >= 0)
+        {
+            metric_add(METRIC_SOCKET_WRITES, 1);
+        }
+        if (sent == (ssize_t)length)
+        {
+            return 0;
+        }
+        if (sent < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                return -1;
+            }
+            sent = 0;
+        }
+        sent_directly = (size_t)sent;
+    }
+
+    // Un message déjà commencé sur le socket doit être fini : la politique s'appliquera au suivant
+    if (enforce_limits && sent_directly == 0 && atomic_load_explicit(&queue->queued_bytes, memory_order_relaxed) + length > high_watermark)
+    {
+        if (slow_consumer_policy == SLOW_CONSUMER_DISCONNECT)
+        {
+            return 1;
+        }
+        drop_oldest_messages(queue, length);
+    }
+
+    OutboundMessage *msg = block_alloc(sizeof(OutboundMessage) + (buffer != NULL ? 0 : length));
+    if (msg == NULL)
+    {
+        return -1;
+    }
+    msg->next = NULL;
+    msg->length = length;
+    // Un message déjà commencé sur le socket garde son décalage : la politique client lent ne doit pas le jeter
+    msg->offset = sent_directly;
+    msg->cursor = NULL;
+    msg->buffer = buffer;
+    if (buffer != NULL)
+    {
+        atomic_fetch_add_explicit(&buffer->refcount, 1, memory_order_relaxed);
+        msg->data = data;
+    }
+    else
+    {
+        memcpy(msg->inline_data, data, length);
+        msg->data = msg->inline_data;
+    }
+    if (queue->tail != NULL)
+    {
+        queue->tail->next = msg;
+    }
+    else
+    {
+        queue->head = msg;
+    }
+    queue->tail = msg;
+    update_outbound_counters(queue, (ssize_t)length, 1);
+    if (queue->submit_list != NULL)
+    {
+        schedule_outbound_submit(queue);
+    }
+    else if (queue->flush_list != NULL)
+    {
+        queue->coalesced_bytes += length;
+        return schedule_outbound_flush(queue, client_socket);
+    }
+    return 0;
+}
+
+/**
+ * Envoie des données ponctuelles via la file de sortie (copiées si elles doivent attendre).
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ * @param data Les données.
+ * @param length La taille des données.
+ * @param enforce_limits 1 pour appliquer les seuils (diffusions), 0 pour un envoi ponctuel (historique).
+ * @return 0 en cas de succès, -1 en cas d'erreur, 1 si le client doit être déconnecté.
+ */
+int outbound_send(OutboundQueue *queue, int client_socket, const char *data, size_t length, int enforce_limits)
+{
+    return enqueue_outbound(queue, client_socket, data, length, NULL, enforce_limits);
+}
+
+/**
+ * Envoie un message partagé via la file de sortie, dans le protocole du client.
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ * @param buffer Le message partagé.
+ * @return 0 en cas de succès, -1 en cas d'erreur, 1 si le client doit être déconnecté.
+ */
+int outbound_send_buffer(OutboundQueue *queue, int client_socket, BroadcastBuffer *buffer)
+{
+    size_t start = queue->framed ? 0 : FRAME_HEADER_SIZE;
+    return enqueue_outbound(queue, client_socket, buffer->data + start, FRAME_HEADER_SIZE + buffer->length - start, buffer, 1);
+}
+
+/**
+ * Met en file les messages first à last de l'historique d'un channel, dans l'ordre
+ * des autres messages. Ils sont lus sur disque et formatés une tranche à la fois,
+ * au rythme où le client les reçoit, et ne sont pas soumis aux seuils.
+ * @param queue La file.
+ * @param client_socket Le socket du client.
+ * @param channel Le channel.
+ * @param first Le premier message.
+ * @param last Le dernier message (inclus).
+ * @return 0 en cas de succès, -1 en cas d'erreur.
+ */
+int outbound_send_history(OutboundQueue *queue, int client_socket, Channel *channel, uint64_t first, uint64_t last)
+{
+    OutboundMessage *msg = block_alloc(sizeof(OutboundMessage) + FRAME_HEADER_SIZE + HISTORY_CHUNK_SIZE);
+    if (msg == NULL)
+    {
+        return -1;
+    }
+    msg->next = NULL;
+    msg->buffer = NULL;
+    msg->cursor = open_history_cursor(channel, first, last);
+    if (msg->cursor == NULL)
+    {
+        block_free(msg);
+        return -1;
+    }
+    if (!refill_history_message(queue, msg))
+    {
+        free_outbound_message(msg);
+        return 0;
+    }
+    if (queue->tail != NULL)
+    {
+        queue->tail->next = msg;
+    }
+    else
+    {
+        queue->head = msg;
+    }
+    queue->tail = msg;
+    update_outbound_counters(queue, 0, 1);
+
+    // Rien devant l'historique : commencer l'envoi tout de suite
+    return queue->head == msg ? flush_outbound_queue(queue, client_socket) : 0;
+}
+
+/**
+ * Prépare un message pour un client : le texte tel quel pour un client texte,
+ * précédé d'un en-tête de trame pour un client tramé.
+ * @param out Le buffer (au moins FRAME_HEADER_SIZE + length octets).
+ * @param framed 1 si le client utilise le protocole tramé.
+ * @param type Le type de trame.
+ * @param channel Le channel concerné, ou NULL.
+ * @param sequence Le numéro du message (FRAME_CHAT), 0 sinon.
+ * @param text Le texte.
+ * @param length La taille du texte.
+ * @return La taille du message préparé.
+ */
+size_t encode_message(char *out, int framed, FrameType type, const Channel *channel, uint64_t sequence, const char *text, size_t length)
+{
+    size_t header = 0;
+    if (framed)
+    {
+        frame_encode_header((unsigned char *)out, type, channel != NULL ? channel->id : 0, sequence, (uint32_t)length);
+        header = FRAME_HEADER_SIZE;
+    }
+    memcpy(out + header, text, length);
+    return header + length;
+}
+
+/**
+ * Prépare un message à diffuser, une seule fois pour tous ses destinataires :
+ * en-tête de trame puis texte. L'appelant détient la première référence. Le
+ * message reprend la trace de celui que traite le thread, s'il est tracé.
+ * @param type Le type de trame.
+ * @param channel Le channel concerné.
+ * @param sequence Le numéro du message (FRAME_CHAT), 0 sinon.
+ * @param text Le texte.
+ * @param length La taille du texte.
+ * @return Le message, ou NULL si l'allocation échoue.
+ */
+BroadcastBuffer *create_broadcast_buffer(FrameType type, const Channel *channel, uint64_t sequence, const char *text, size_t length)
+{
+    BroadcastBuffer *buffer = block_alloc(sizeof(BroadcastBuffer) + FRAME_HEADER_SIZE + length);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&buffer->refcount, 1);
+    buffer->trace_id = trace_self.id;
+    buffer->trace_origin = trace_self.origin;
+    buffer->trace_created = trace_self.id != 0 ? monotonic_ns() : 0;
+    buffer->length = length;
+    encode_message(buffer->data, 1, type, channel, sequence, text, length);
+    return buffer;
+}
+
+/**
+ * Libère tous les messages d'une file de sortie.
+ * @param queue La file.
+ */
+void clear_outbound_queue(OutboundQueue *queue)
+{
+    while (queue->head != NULL)
+    {
+        OutboundMessage *msg = queue->head;
+        queue->head = msg->next;
+        free_outbound_message(msg);
+    }
+    queue->tail = NULL;
+    atomic_store_explicit(&queue->queued_bytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->queued_messages, 0, memory_order_relaxed);
+}
+
+/**
+ * Déconnecte un client trop lent : sa file est abandonnée, un avertissement est
+ * tenté sans bloquer, puis le socket est fermé dans les deux sens. Le thread ou
+ * le réacteur du client voit alors la fin de connexion et fait le ménage habituel.
+ * L'avertissement n'est pas tenté derrière un message à moitié écrit : il
+ * arriverait au milieu d'une trame.
+ * @param queue La file du client.
+ * @param client_socket Le socket du client.
+ */
+void evict_slow_consumer(OutboundQueue *queue, int client_socket)
+{
+    printf("Client '%s' déconnecté : trop lent (%zu octets en attente)\n", queue->client_name, atomic_load_explicit(&queue->queued_bytes, memory_order_relaxed));
+    metric_add(METRIC_EVICTIONS, 1);
+    int interrupted = queue->head != NULL && queue->head->offset > 0;
+    clear_outbound_queue(queue);
+
+    if (!interrupted)
+    {
+        const char *notice = "Erreur : Vous recevez les messages trop lentement, déconnexion.\n";
+        char message[FRAME_HEADER_SIZE + BUFFER_SIZE];
+        size_t length = encode_message(message, queue->framed, FRAME_NOTICE, NULL, 0, notice, strlen(notice));
+        send(client_socket, message, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+    shutdown(client_socket, SHUT_RDWR);
+}
+
+/**
+ * Affiche la profondeur de toutes les files de sortie (déclenché par SIGUSR1).
+ */
+void dump_outbound_queues()
+{
+    pthread_mutex_lock(&registered_queues_mutex);
+    printf("%-8s %-20s %12s %10s %12s %10s\n", "Socket", "Client", "Octets", "Messages", "Pic", "Jetés");
+    for (OutboundQueue *queue = registered_queues; queue != NULL; queue = queue->next_registered)
+    {
+        printf("%-8d %-20s %12zu %10zu %12zu %10lu\n", queue->socket, queue->client_name,
+               atomic_load_explicit(&queue->queued_bytes, memory_order_relaxed),
+               atomic_load_explicit(&queue->queued_messages, memory_order_relaxed),
+               atomic_load_explicit(&queue->peak_bytes, memory_order_relaxed),
+               atomic_load_explicit(&queue->dropped_messages, memory_order_relaxed));
+    }
+    pthread_mutex_unlock(&registered_queues_mutex);
+    fflush(stdout);
+}
+
+/**
+ * Compare deux étapes tracées : par trace, puis par début.
+ * @param a La première étape.
+ * @param b La seconde étape.
+ * @return Négatif, nul ou positif comme strcmp.
+ */
+int compare_trace_spans(const void *a, const void *b)
+{
+    const TraceSpan *x = a;
+    const TraceSpan *y = b;
+    if (x->trace_id != y->trace_id)
+    {
+        return x->trace_id < y->trace_id ? -1 : 1;
+    }
+    return x->start_ns < y->start_ns ? -1 : x->start_ns > y->start_ns;
+}
+
+/**
+ * Écrit une chaîne JSON (guillemets compris), caractères spéciaux échappés.
+ * @param file Le fichier.
+ * @param text La chaîne.
+ */
+void write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(file, "\\%c", *c);
+        }
+        else if (*c < 0x20)
+        {
+            fprintf(file, "\\u%04x", *c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * Écrit les étapes tracées encore dans l'anneau au format Chrome trace (JSON),
+ * lisible par Perfetto ou chrome://tracing : une tranche par étape sur le
+ * thread qui l'a parcourue, reliées par des flèches (flow) dans l'ordre de leur
+ * début. L'anneau n'est ni vidé ni arrêté : les étapes écrites pendant la copie sont sautées.
+ * @param path Le fichier à écrire.
+ * @return Le nombre d'étapes écrites, -1 en cas d'erreur.
+ */
+int dump_trace_spans(const char *path)
+{
+    if (trace_ring == NULL)
+    {
+        return -1;
+    }
+    TraceSpan *spans = malloc(TRACE_RING_SPANS * sizeof(TraceSpan));
+    if (spans == NULL)
+    {
+        return -1;
+    }
+    int count = 0;
+    for (int i = 0; i < TRACE_RING_SPANS; ++i)
+    {
+        TraceSlot *slot = &trace_ring[i];
+        unsigned long stamp = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+        if (stamp == 0)
+        {
+            continue;
+        }
+        spans[count] = slot->span;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->stamp, memory_order_relaxed) == stamp)
+        {
+            count++;
+        }
+    }
+    qsort(spans, (size_t)count, sizeof(TraceSpan), compare_trace_spans);
+
+    pthread_mutex_lock(&trace_dump_mutex);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        pthread_mutex_unlock(&trace_dump_mutex);
+        free(spans);
+        return -1;
+    }
+    int pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (int i = 0; i < count; ++i)
+    {
+        TraceSpan *span = &spans[i];
+        uint64_t duration = span->end_ns > span->start_ns ? span->end_ns - span->start_ns : 0;
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"message\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"trace\":%llu",
+                i > 0 ? ",\n" : "", span->name, pid, span->thread, span->start_ns / 1000.0, duration / 1000.0, (unsigned long long)span->trace_id);
+        if (span->channel != NULL)
+        {
+            fprintf(file, ",\"channel\":");
+            write_json_string(file, span->channel->name);
+        }
+        if (span->sequence != 0)
+        {
+            fprintf(file, ",\"sequence\":%llu", (unsigned long long)span->sequence);
+        }
+        if (span->socket != -1)
+        {
+            fprintf(file, ",\"socket\":%d", span->socket);
+        }
+        if (span->wait_ns != 0)
+        {
+            fprintf(file, ",\"lock_wait_us\":%.3f", span->wait_ns / 1000.0);
+        }
+        fprintf(file, "}}");
+
+        // Flèche de l'étape précédente du même message vers celle-ci
+        int first = i == 0 || spans[i - 1].trace_id != span->trace_id;
+        int last = i == count - 1 || spans[i + 1].trace_id != span->trace_id;
+        if (!(first && last))
+        {
+            fprintf(file, ",\n{\"name\":\"message\",\"cat\":\"message\",\"ph\":\"%s\",%s\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+                    first ? "s" : last ? "f" : "t", last ? "\"bp\":\"e\"," : "", (unsigned long long)span->trace_id, pid, span->thread, span->start_ns / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    int result = fclose(file) == 0 ? count : -1;
+    pthread_mutex_unlock(&trace_dump_mutex);
+    free(spans);
+    return result;
+}
+
+/**
+ * Écrit les traces dans trace_file_path (SIGUSR2, commande "trace" du socket
+ * d'administration) et rédige le compte rendu.
+ * @param buffer Le buffer où le compte rendu sera stocké.
+ * @param buffer_size La taille du buffer.
+ */
+void write_trace_file(char *buffer, size_t buffer_size)
+{
+    if (trace_ring == NULL)
+    {
+        snprintf(buffer, buffer_size, "Traçage désactivé (--trace-sample N pour l'activer)\n");
+        return;
+    }
+    int count = dump_trace_spans(trace_file_path);
+    if (count == -1)
+    {
+        snprintf(buffer, buffer_size, "Erreur lors de l'écriture des traces dans '%s' : %s\n", trace_file_path, strerror(errno));
+        return;
+    }
+    snprintf(buffer, buffer_size, "%d étapes tracées écrites dans '%s'\n", count, trace_file_path);
+}
+
+/**
+ * Retire du port les sockets d'écoute des réacteurs io_uring avant l'arrêt du
+ * processus. L'acceptation multishot en cours garde une référence sur le socket
+ * jusqu'à la destruction de l'anneau, faite par le noyau après la fin du
+ * processus : sans shutdown(), SO_REUSEPORT confierait encore des connexions à
+ * ce socket mourant, au détriment du serveur qui redémarre sur le même port.
+ */
+void stop_uring_listeners()
+{
+    for (int i = 0; reactors != NULL && i < reactor_count; ++i)
+    {
+        if (reactors[i].ring != NULL)
+        {
+            shutdown(reactors[i].listen_socket, SHUT_RDWR);
+        }
+    }
+}
+
+/**
+ * Thread de supervision : attend SIGUSR1 et SIGUSR2 (bloqués dans tous les
+ * autres threads), puis affiche l'état des files de sortie (SIGUSR1) ou écrit
+ * les traces (SIGUSR2). Avec io_uring, il reçoit aussi SIGTERM et SIGINT pour
+ * retirer les sockets d'écoute avant de laisser le signal arrêter le processus.
+ * @param args Le masque des signaux attendus.
+ * @return NULL.
+ */
+void *run_signal_thread(void *args)
+{
+    sigset_t *signals = args;
+    int signal_number;
+    while (sigwait(signals, &signal_number) == 0)
+    {
+        if (signal_number == SIGTERM || signal_number == SIGINT)
+        {
+            stop_uring_listeners();
+            sigset_t stopping;
+            sigemptyset(&stopping);
+            sigaddset(&stopping, signal_number);
+            signal(signal_number, SIG_DFL);
+            pthread_sigmask(SIG_UNBLOCK, &stopping, NULL);
+            raise(signal_number);
+        }
+        else if (signal_number == SIGUSR1)
+        {
+            dump_outbound_queues();
+        }
+        else if (signal_number == SIGUSR2)
+        {
+            char report[PATH_MAX + 128];
+            write_trace_file(report, sizeof(report));
+            fputs(report, stdout);
+            fflush(stdout);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Texte construit par morceaux (rapports de métriques). Les FRAME_HEADER_SIZE
+ * premiers octets sont réservés à l'en-tête de trame, comme pour l'historique.
+ * Avec une arène, le texte y est pris et disparaît avec arena_reset ; sans
+ * arène, l'appelant libère data.
+ */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    Arena *arena;
+} TextBuffer;
+
+/**
+ * Agrandit la zone d'un TextBuffer, dans son arène ou par realloc.
+ * @param text Le texte.
+ * @param capacity La nouvelle capacité.
+ * @return La nouvelle zone (contenu conservé), ou NULL si la mémoire manque.
+ */
+char *grow_text_buffer(TextBuffer *text, size_t capacity)
+{
+    if (text->arena == NULL)
+    {
+        return realloc(text->data, capacity);
+    }
+    char *data = arena_alloc(text->arena, capacity);
+    if (data != NULL && text->data != NULL)
+    {
+        memcpy(data, text->data, text->length);
+    }
+    return data;
+}
+
+/**
+ * Ajoute du texte formaté à la fin d'un TextBuffer (agrandi au besoin).
+ * @param text Le texte.
+ * @param format Le format (printf).
+ */
+void text_printf(TextBuffer *text, const char *format, ...)
+{
+    if (text->data == NULL)
+    {
+        text->capacity = 4096;
+        text->data = grow_text_buffer(text, text->capacity);
+        if (text->data == NULL)
+        {
+            return;
+        }
+        text->length = FRAME_HEADER_SIZE;
+    }
+    while (1)
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(text->data + text->length, text->capacity - text->length, format, args);
+        va_end(args);
+        if (written < 0)
+        {
+            return;
+        }
+        if ((size_t)written < text->capacity - text->length)
+        {
+            text->length += (size_t)written;
+            return;
+        }
+        char *data = grow_text_buffer(text, text->capacity * 2 + (size_t)written);
+        if (data == NULL)
+        {
+            return;
+        }
+        text->data = data;
+        text->capacity = text->capacity * 2 + (size_t)written;
+    }
+}
+
+/**
+ * Termine un texte à envoyer comme notification : en-tête de trame écrit dans
+ * la réserve pour un client tramé, sauté pour un client texte.
+ * @param text Le texte.
+ * @param framed 1 si le client parle le protocole tramé.
+ * @param channel Le channel concerné, ou NULL.
+ * @param length Reçoit la taille à envoyer.
+ * @return Le début des données à envoyer.
+ */
+const char *finish_notice(TextBuffer *text, int framed, const Channel *channel, size_t *length)
+{
+    size_t text_length = text->length - FRAME_HEADER_SIZE;
+    if (!framed)
+    {
+        *length = text_length;
+        return text->data + FRAME_HEADER_SIZE;
+    }
+    frame_encode_header((unsigned char *)text->data, FRAME_NOTICE, channel ? channel->id : 0, 0, (uint32_t)text_length);
+    *length = text->length;
+    return text->data;
+}
+
+/**
+ * Métriques sommées sur toutes les copies.
+ */
+typedef struct
+{
+    unsigned long counters[METRIC_COUNTER_COUNT];
+    unsigned long histogram_counts[HISTOGRAM_COUNT];
+    unsigned long histogram_sums[HISTOGRAM_COUNT];
+    unsigned long histograms[HISTOGRAM_COUNT][HISTOGRAM_BUCKETS];
+    size_t queued_bytes;     // Files de sortie : total en attente
+    size_t queued_messages;
+    size_t max_queued_bytes; // File la plus profonde
+    size_t max_peak_bytes;   // Pic le plus haut depuis l'ouverture des files actuelles
+    int queues;
+    size_t connections_in_use; // Pools de connexions (mode epoll) ou de clients (mode thread)
+    size_t connections_pooled; // Objets découpés, utilisés ou libres
+    size_t connection_bytes;   // Taille d'un objet connexion dans son pool
+    size_t readers_in_use;     // Lecteurs de trames tenus (trame partielle en cours)
+    size_t reader_bytes;
+} MetricsSnapshot;
+
+static const char *const metric_counter_names[METRIC_COUNTER_COUNT] = {
+    "connections_accepted", "handshakes", "messages", "deliveries", "history_sends", "dropped_messages", "slow_consumer_evictions", "peer_relays", "peer_received", "socket_writes",
+    "client_throttled", "channel_throttled", "accept_throttled", "connections_full", "server_full", "block_mallocs"};
+static const char *const metric_counter_labels[METRIC_COUNTER_COUNT] = {
+    "Connexions acceptées", "Poignées de main", "Messages", "Livraisons", "Envois d'historique", "Messages jetés", "Clients lents déconnectés", "Relais vers les pairs", "Reçus des pairs", "Écritures sur les sockets",
+    "Messages refusés (débit du client)", "Messages refusés (débit du channel)", "Connexions refusées (débit d'acceptation)",
+    "Connexions refusées (trop de connexions ouvertes)", "Connexions refusées (serveur plein)", "Blocs de messages alloués par malloc"};
+static const char *const metric_histogram_names[HISTOGRAM_COUNT] = {
+    "handshake", "log_and_broadcast", "broadcast", "history_send", "search"};
+
+/**
+ * Somme les copies des métriques et relève la profondeur des files de sortie.
+ * @param snapshot Reçoit les métriques.
+ */
+void collect_metrics(MetricsSnapshot *snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+    for (int shard = 0; shard < METRIC_SHARDS; ++shard)
+    {
+        for (int i = 0; i < METRIC_COUNTER_COUNT; ++i)
+        {
+            snapshot->counters[i] += atomic_load_explicit(&metric_shards[shard].counters[i], memory_order_relaxed);
+        }
+        for (int h = 0; h < HISTOGRAM_COUNT; ++h)
+        {
+            snapshot->histogram_sums[h] += atomic_load_explicit(&metric_shards[shard].histogram_sums[h], memory_order_relaxed);
+            for (int b = 0; b < HISTOGRAM_BUCKETS; ++b)
+            {
+                unsigned long count = atomic_load_explicit(&metric_shards[shard].histograms[h][b], memory_order_relaxed);
+                snapshot->histograms[h][b] += count;
+                snapshot->histogram_counts[h] += count;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&registered_queues_mutex);
+    for (OutboundQueue *queue = registered_queues; queue != NULL; queue = queue->next_registered)
+    {
+        size_t bytes = atomic_load_explicit(&queue->queued_bytes, memory_order_relaxed);
+        size_t peak = atomic_load_explicit(&queue->peak_bytes, memory_order_relaxed);
+        snapshot->queued_bytes += bytes;
+        snapshot->queued_messages += atomic_load_explicit(&queue->queued_messages, memory_order_relaxed);
+        snapshot->max_queued_bytes = bytes > snapshot->max_queued_bytes ? bytes : snapshot->max_queued_bytes;
+        snapshot->max_peak_bytes = peak > snapshot->max_peak_bytes ? peak : snapshot->max_peak_bytes;
+        snapshot->queues++;
+    }
+    pthread_mutex_unlock(&registered_queues_mutex);
+
+    const ObjectPool *pools[1 + MAX_REACTORS];
+    int pool_count = 0;
+    pools[pool_count++] = &client_pool;
+    for (int i = 0; reactors != NULL && i < reactor_count; ++i)
+    {
+        pools[pool_count++] = &reactors[i].connection_pool;
+        snapshot->readers_in_use += atomic_load_explicit(&reactors[i].reader_pool.in_use, memory_order_relaxed);
+        snapshot->reader_bytes = reactors[i].reader_pool.object_size;
+    }
+    for (int i = 0; i < pool_count; ++i)
+    {
+        snapshot->connections_in_use += atomic_load_explicit(&pools[i]->in_use, memory_order_relaxed);
+        snapshot->connections_pooled += atomic_load_explicit(&pools[i]->allocated, memory_order_relaxed);
+    }
+    snapshot->connection_bytes = reactors != NULL ? reactors[0].connection_pool.object_size : client_pool.object_size;
+}
+
+/**
+ * Donne un centile d'un histogramme (borne haute de l'intervalle qui le contient).
+ * @param snapshot Les métriques.
+ * @param histogram L'histogramme.
+ * @param percentile Le centile (0 à 100).
+ * @return La durée (ns), 0 si l'histogramme est vide.
+ */
+uint64_t histogram_percentile(const MetricsSnapshot *snapshot, MetricHistogram histogram, double percentile)
+{
+    unsigned long total = snapshot->histogram_counts[histogram];
+    if (total == 0)
+    {
+        return 0;
+    }
+    unsigned long rank = (unsigned long)(percentile / 100.0 * (double)total + 0.5);
+    rank = rank < 1 ? 1 : rank;
+    unsigned long seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; ++b)
+    {
+        seen += snapshot->histograms[histogram][b];
+        if (seen >= rank)
+        {
+            return b + 1 < HISTOGRAM_BUCKETS ? histogram_bucket_low(b + 1) - 1 : histogram_bucket_low(b);
+        }
+    }
+    return histogram_bucket_low(HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * Écrit une ligne de compteur par channel (messages, membres, débit moyen).
+ * @param text Le texte.
+ * @param channel Le channel.
+ * @param uptime Le temps écoulé depuis le démarrage (s).
+ */
+void format_channel_stats(TextBuffer *text, Channel *channel, double uptime)
+{
+    unsigned long messages = atomic_load_explicit(&channel->message_count, memory_order_relaxed);
+    text_printf(text, "  %-20s %6d membres %10lu messages %10.1f msg/s\n", channel->name,
+                atomic_load(&channel->client_count), messages, uptime > 0 ? messages / uptime : 0.0);
+}
+
+/**
+ * Écrit le rapport des métriques en texte lisible.
+ * @param text Le texte.
+ * @param channel Le seul channel à détailler (commande /stats), ou NULL pour tous.
+ */
+void format_metrics_text(TextBuffer *text, Channel *channel)
+{
+    MetricsSnapshot *snapshot = malloc(sizeof(MetricsSnapshot));
+    if (snapshot == NULL)
+    {
+        return;
+    }
+    collect_metrics(snapshot);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double uptime = (now.tv_sec - server_start_time.tv_sec) + (now.tv_nsec - server_start_time.tv_nsec) / 1e9;
+
+    text_printf(text, "Serveur actif depuis %.0f s, %d clients (%d connexions ouvertes), %d channels\n", uptime,
+                atomic_load(&thread_client_count) + atomic_load(&reactor_client_count), atomic_load(&open_connections), channel_count);
+    for (int i = 0; i < METRIC_COUNTER_COUNT; ++i)
+    {
+        text_printf(text, "%s : %lu\n", metric_counter_labels[i], snapshot->counters[i]);
+    }
+    text_printf(text, "Files de sortie : %d, %zu octets et %zu messages en attente, la plus profonde %zu octets (pic %zu)\n",
+                snapshot->queues, snapshot->queued_bytes, snapshot->queued_messages, snapshot->max_queued_bytes, snapshot->max_peak_bytes);
+    text_printf(text, "Connexions : %zu utilisées sur %zu en pool, %zu octets chacune (+%zu par lecteur de trames, %zu tenus)\n",
+                snapshot->connections_in_use, snapshot->connections_pooled, snapshot->connection_bytes, snapshot->reader_bytes, snapshot->readers_in_use);
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h)
+    {
+        text_printf(text, "%s : n=%lu p50=%.1f µs p99=%.1f µs p99.9=%.1f µs\n", metric_histogram_names[h], snapshot->histogram_counts[h],
+                    histogram_percentile(snapshot, h, 50) / 1000.0, histogram_percentile(snapshot, h, 99) / 1000.0,
+                    histogram_percentile(snapshot, h, 99.9) / 1000.0);
+    }
+    text_printf(text, "Channels :\n");
+    if (channel != NULL)
+    {
+        format_channel_stats(text, channel, uptime);
+    }
+    else
+    {
+        for (Channel *c = atomic_load_explicit(&channel_list, memory_order_acquire); c != NULL; c = c->next_created)
+        {
+            format_channel_stats(text, c, uptime);
+        }
+    }
+    free(snapshot);
+}
+
+/**
+ * Écrit le nom d'un channel comme valeur d'étiquette Prometheus (guillemets et antislashs échappés).
+ * @param text Le texte.
+ * @param name Le nom.
+ */
+void format_prometheus_label(TextBuffer *text, const char *name)
+{
+    for (const char *c = name; *c != '\0'; ++c)
+    {
+        text_printf(text, (*c == '"' || *c == '\\') ? "\\%c" : "%c", *c);
+    }
+}
+
+/**
+ * Écrit les métriques au format texte de Prometheus.
+ * @param text Le texte.
+ */
+void format_metrics_prometheus(TextBuffer *text)
+{
+    MetricsSnapshot *snapshot = malloc(sizeof(MetricsSnapshot));
+    if (snapshot == NULL)
+    {
+        return;
+    }
+    collect_metrics(snapshot);
+
+    for (int i = 0; i < METRIC_COUNTER_COUNT; ++i)
+    {
+        text_printf(text, "# TYPE chat_%s_total counter\nchat_%s_total %lu\n", metric_counter_names[i], metric_counter_names[i], snapshot->counters[i]);
+    }
+    text_printf(text, "# TYPE chat_clients gauge\nchat_clients %d\n", atomic_load(&thread_client_count) + atomic_load(&reactor_client_count));
+    text_printf(text, "# TYPE chat_open_connections gauge\nchat_open_connections %d\n", atomic_load(&open_connections));
+    text_printf(text, "# TYPE chat_channels gauge\nchat_channels %d\n", channel_count);
+    text_printf(text, "# TYPE chat_outbound_queued_bytes gauge\nchat_outbound_queued_bytes %zu\n", snapshot->queued_bytes);
+    text_printf(text, "# TYPE chat_outbound_queued_messages gauge\nchat_outbound_queued_messages %zu\n", snapshot->queued_messages);
+    text_printf(text, "# TYPE chat_outbound_max_queued_bytes gauge\nchat_outbound_max_queued_bytes %zu\n", snapshot->max_queued_bytes);
+    text_printf(text, "# TYPE chat_connection_objects gauge\nchat_connection_objects{state=\"in_use\"} %zu\nchat_connection_objects{state=\"pooled\"} %zu\n",
+                snapshot->connections_in_use, snapshot->connections_pooled);
+    text_printf(text, "# TYPE chat_connection_object_bytes gauge\nchat_connection_object_bytes %zu\n", snapshot->connection_bytes);
+    text_printf(text, "# TYPE chat_frame_readers_in_use gauge\nchat_frame_readers_in_use %zu\n", snapshot->readers_in_use);
+
+    // Intervalles regroupés par puissance de 2, de 1 µs (2^10 ns) à 2^40 ns
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h)
+    {
+        const char *name = metric_histogram_names[h];
+        text_printf(text, "# TYPE chat_%s_seconds histogram\n", name);
+        unsigned long cumulative = 0;
+        int b = 0;
+        for (int bits = 10; bits <= HISTOGRAM_MAX_BITS; ++bits)
+        {
+            while (b < HISTOGRAM_BUCKETS && histogram_bucket_low(b) < (1ull << bits))
+            {
+                cumulative += snapshot->histograms[h][b++];
+            }
+            text_printf(text, "chat_%s_seconds_bucket{le=\"%.9g\"} %lu\n", name, (double)(1ull << bits) / 1e9, cumulative);
+        }
+        text_printf(text, "chat_%s_seconds_bucket{le=\"+Inf\"} %lu\n", name, snapshot->histogram_counts[h]);
+        text_printf(text, "chat_%s_seconds_sum %.9f\n", name, snapshot->histogram_sums[h] / 1e9);
+        text_printf(text, "chat_%s_seconds_count %lu\n", name, snapshot->histogram_counts[h]);
+    }
+
+    text_printf(text, "# TYPE chat_channel_messages_total counter\n");
+    for (Channel *c = atomic_load_explicit(&channel_list, memory_order_acquire); c != NULL; c = c->next_created)
+    {
+        text_printf(text, "chat_channel_messages_total{channel=\"");
+        format_prometheus_label(text, c->name);
+        text_printf(text, "\"} %lu\n", atomic_load_explicit(&c->message_count, memory_order_relaxed));
+    }
+    text_printf(text, "# TYPE chat_channel_members gauge\n");
+    for (Channel *c = atomic_load_explicit(&channel_list, memory_order_acquire); c != NULL; c = c->next_created)
+    {
+        text_printf(text, "chat_channel_members{channel=\"");
+        format_prometheus_label(text, c->name);
+        text_printf(text, "\"} %d\n", atomic_load(&c->client_count));
+    }
+    free(snapshot);
+}
+
+/**
+ * Thread du socket Unix d'administration : chaque connexion envoie une commande
+ * ("stats" ou "prometheus", une ligne) et reçoit le rapport avant fermeture.
+ * @param args Non utilisé.
+ * @return NULL.
+ */
+void *run_admin_server(void *args)
+{
+    (void)args;
+    int admin_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, admin_socket_path, sizeof(address.sun_path) - 1);
+    unlink(admin_socket_path);
+    if (admin_socket == -1 || bind(admin_socket, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(admin_socket, 16) == -1)
+    {
+        perror("Erreur lors de la création du socket d'administration");
+        return NULL;
+    }
+
+    while (1)
+    {
+        int admin_client = accept4(admin_socket, NULL, NULL, SOCK_CLOEXEC);
+        if (admin_client == -1)
+        {
+            continue;
+        }
+        // Une commande absente ou trop lente donne le rapport texte
+        struct timeval timeout = {.tv_sec = 1};
+        setsockopt(admin_client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char command[64] = "";
+        ssize_t read_size = recv(admin_client, command, sizeof(command) - 1, 0);
+        command[read_size > 0 ? read_size : 0] = '\0';
+        command[strcspn(command, "\r\n")] = '\0';
+
+        TextBuffer text = {0};
+        if (strcmp(command, "prometheus") == 0 || strcmp(command, "metrics") == 0)
+        {
+            format_metrics_prometheus(&text);
+        }
+        else if (strcmp(command, "trace") == 0)
+        {
+            char report[PATH_MAX + 128];
+            write_trace_file(report, sizeof(report));
+            text_printf(&text, "%s", report);
+        }
+        else
+        {
+            format_metrics_text(&text, NULL);
+        }
+        for (size_t sent = FRAME_HEADER_SIZE; text.data != NULL && sent < text.length;)
+        {
+            ssize_t written = send(admin_client, text.data + sent, text.length - sent, MSG_NOSIGNAL);
+            if (written <= 0)
+            {
+                break;
+            }
+            sent += (size_t)written;
+        }
+        free(text.data);
+        close(admin_client);
+    }
+    return NULL;
+}
+
+/**
+ * Enregistre le thread courant comme lecteur RCU (réutilise un emplacement libéré si possible).
+ */
+void rcu_register_thread()
+{
+    for (RcuReader *reader = atomic_load(&rcu_readers); reader != NULL; reader = reader->next)
+    {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&reader->in_use, &expected, 1))
+        {
+            rcu_self = reader;
+            return;
+        }
+    }
+
+    RcuReader *reader = calloc(1, sizeof(RcuReader));
+    if (reader == NULL)
+    {
+        perror("Erreur lors de l'allocation d'un lecteur RCU");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&reader->in_use, 1);
+    reader->next = atomic_load(&rcu_readers);
+    while (!atomic_compare_exchange_weak(&rcu_readers, &reader->next, reader))
+    {
+    }
+    rcu_self = reader;
+}
+
+/**
+ * Libère l'emplacement de lecteur RCU du thread courant (fin du thread client).
+ */
+void rcu_unregister_thread()
+{
+    if (rcu_self != NULL)
+    {
+        atomic_store(&rcu_self->epoch, 0);
+        atomic_store(&rcu_self->in_use, 0);
+        rcu_self = NULL;
+    }
+}
+
+/**
+ * Entre en section critique RCU : les objets visibles ne seront pas libérés avant la sortie.
+ */
+void rcu_read_lock()
+{
+    if (rcu_self == NULL)
+    {
+        rcu_register_thread();
+    }
+    atomic_store(&rcu_self->epoch, atomic_load(&rcu_global_epoch));
+}
+
+/**
+ * Sort de la section critique RCU.
+ */
+void rcu_read_unlock()
+{
+    atomic_store_explicit(&rcu_self->epoch, 0, memory_order_release);
+}
+
+/**
+ * Libère les objets retirés que plus aucun lecteur ne peut voir.
+ * Doit être appelé avec rcu_mutex verrouillé.
+ */
+void rcu_reclaim_locked()
+{
+    unsigned long oldest_active = ULONG_MAX;
+    for (RcuReader *reader = atomic_load(&rcu_readers); reader != NULL; reader = reader->next)
+    {
+        unsigned long epoch = atomic_load(&reader->epoch);
+        if (epoch != 0 && epoch < oldest_active)
+        {
+            oldest_active = epoch;
+        }
+    }
+
+    RcuRetired **link = &rcu_retired;
+    while (*link != NULL)
+    {
+        RcuRetired *retired = *link;
+        // Un lecteur entré à une époque <= celle du retrait a pu voir l'objet
+        if (retired->epoch < oldest_active)
+        {
+            *link = retired->next;
+            retired->release(retired->ptr);
+            free(retired);
+        }
+        else
+        {
+            link = &retired->next;
+        }
+    }
+}
+
+/**
+ * Retire un objet dépublié : release sera appelée après la période de grâce.
+ * @param ptr L'objet retiré.
+ * @param release La fonction de libération.
+ */
+void rcu_retire(void *ptr, void (*release)(void *))
+{
+    RcuRetired *retired = malloc(sizeof(RcuRetired));
+    pthread_mutex_lock(&rcu_mutex);
+    if (retired == NULL)
+    {
+        // Sans mémoire pour différer, on attend la fin des lecteurs courants
+        unsigned long epoch = atomic_fetch_add(&rcu_global_epoch, 1);
+        for (RcuReader *reader = atomic_load(&rcu_readers); reader != NULL; reader = reader->next)
+        {
+            unsigned long reader_epoch;
+            while ((reader_epoch = atomic_load(&reader->epoch)) != 0 && reader_epoch <= epoch)
+            {
+                sched_yield();
+            }
+        }
+        release(ptr);
+    }
+    else
+    {
+        retired->ptr = ptr;
+        retired->release = release;
+        retired->epoch = atomic_fetch_add(&rcu_global_epoch, 1);
+        retired->next = rcu_retired;
+        rcu_retired = retired;
+    }
+    rcu_reclaim_locked();
+    pthread_mutex_unlock(&rcu_mutex);
+}
+
+/**
+ * Rend un client au pool.
+ * @param client Le client.
+ */
+void free_client_handle(ClientHandle *client)
+{
+    pthread_mutex_lock(&client_pool_mutex);
+    pool_free(&client_pool, client);
+    pthread_mutex_unlock(&client_pool_mutex);
+}
+
+/**
+ * Crée la référence partagée vers le socket d'un client (mode thread).
+ * @param client_socket Le socket du client.
+ * @param client_name Le nom du client (affiché avec sa file de sortie).
+ * @return La référence (compteur à 1, détenue par le thread du client), ou NULL.
+ */
+ClientHandle *create_client_handle(int client_socket, const char *client_name)
+{
+    pthread_mutex_lock(&client_pool_mutex);
+    ClientHandle *client = pool_alloc(&client_pool);
+    pthread_mutex_unlock(&client_pool_mutex);
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    client->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (client->wake_fd == -1)
+    {
+        free_client_handle(client);
+        return NULL;
+    }
+    atomic_init(&client->refcount, 1);
+    client->socket = client_socket;
+    client->evicted = 0;
+    client->subscriptions = NULL;
+    client->subscription_count = 0;
+    pthread_mutex_init(&client->lock, NULL);
+    init_outbound_queue(&client->queue, client_socket);
+    register_outbound_queue(&client->queue, client_name);
+    return client;
+}
+
+/**
+ * Libère une référence vers un client ; la dernière ferme le socket.
+ * @param client Le client.
+ */
+void release_client_handle(ClientHandle *client)
+{
+    if (atomic_fetch_sub(&client->refcount, 1) == 1)
+    {
+        unregister_outbound_queue(&client->queue);
+        clear_outbound_queue(&client->queue);
+        close(client->wake_fd);
+        close(client->socket);
+        pthread_mutex_destroy(&client->lock);
+        free_client_handle(client);
+    }
+}
+
+/**
+ * Libère une référence vers un instantané de membres ; la dernière libère
+ * l'instantané et les références qu'il détient sur ses clients.
+ * @param snapshot L'instantané.
+ */
+void release_member_snapshot(MemberSnapshot *snapshot)
+{
+    if (snapshot != NULL && atomic_fetch_sub(&snapshot->refcount, 1) == 1)
+    {
+        for (int i = 0; i < snapshot->count; ++i)
+        {
+            release_client_handle(snapshot->clients[i]);
+        }
+        free(snapshot);
+    }
+}
+
+/**
+ * Adaptateur pour rcu_retire : libère la référence de publication d'un instantané.
+ * @param snapshot L'instantané retiré.
+ */
+void retire_member_snapshot(void *snapshot)
+{
+    release_member_snapshot(snapshot);
+}
+
+/**
+ * Construit et publie l'instantané des membres d'un channel depuis member_set.
+ * Doit être appelé avec channel->lock verrouillé.
+ * @param channel Le channel.
+ * @return L'instantané publié, ou NULL si le channel est vide ou si l'allocation échoue.
+ */
+MemberSnapshot *build_member_snapshot(Channel *channel)
+{
+    int count = atomic_load(&channel->client_count);
+    if (count == 0)
+    {
+        return NULL;
+    }
+    MemberSnapshot *snapshot = malloc(sizeof(MemberSnapshot) + (size_t)count * sizeof(ClientHandle *));
+    if (snapshot == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&snapshot->refcount, 1); // Référence de publication
+    snapshot->count = count;
+    for (int i = 0; i < count; ++i)
+    {
+        snapshot->clients[i] = channel->member_set[i]->client;
+        atomic_fetch_add(&snapshot->clients[i]->refcount, 1);
+    }
+    atomic_store_explicit(&channel->members, snapshot, memory_order_release);
+    return snapshot;
+}
+
+/**
+ * Obtient une référence sur l'instantané courant des membres d'un channel.
+ * Aucun verrou n'est pris tant qu'un instantané est publié : la section RCU
+ * garantit qu'il n'est pas libéré avant que sa référence soit prise. Après un
+ * join/leave, le premier diffuseur reconstruit l'instantané sous channel->lock.
+ * @param channel Le channel.
+ * @return L'instantané (à libérer avec release_member_snapshot), ou NULL si vide.
+ */
+MemberSnapshot *acquire_member_snapshot(Channel *channel)
+{
+    rcu_read_lock();
+    MemberSnapshot *snapshot = atomic_load_explicit(&channel->members, memory_order_acquire);
+    if (snapshot != NULL)
+    {
+        atomic_fetch_add(&snapshot->refcount, 1);
+    }
+    rcu_read_unlock();
+    if (snapshot != NULL || atomic_load(&channel->client_count) == 0)
+    {
+        return snapshot;
+    }
+
+    pthread_mutex_lock(&channel->lock);
+    snapshot = atomic_load_explicit(&channel->members, memory_order_relaxed);
+    if (snapshot == NULL)
+    {
+        snapshot = build_member_snapshot(channel);
+    }
+    if (snapshot != NULL)
+    {
+        atomic_fetch_add(&snapshot->refcount, 1);
+    }
+    pthread_mutex_unlock(&channel->lock);
+    return snapshot;
+}
+
+/**
+ * Retire l'instantané publié d'un channel après un changement de membres (O(1)) :
+ * il est libéré après les lecteurs en cours, ce qui relâche ses références sur
+ * les clients. Doit être appelé avec channel->lock verrouillé.
+ * @param channel Le channel.
+ */
+void invalidate_member_snapshot(Channel *channel)
+{
+    MemberSnapshot *old = atomic_exchange_explicit(&channel->members, NULL, memory_order_acq_rel);
+    if (old != NULL)
+    {
+        rcu_retire(old, retire_member_snapshot);
+    }
+}
+
+void federation_interest_changed(Channel *channel);
+void relay_to_peers(Channel *channel, PeerFrameType type, const char *sender, const char *text);
+
+/**
+ * Ajoute l'abonnement d'un client à l'ensemble des membres d'un channel en O(1).
+ * Doit être appelé avec channel->lock verrouillé.
+ * @param channel Le channel.
+ * @param sub L'abonnement.
+ * @return 0 en cas de succès, -1 si l'allocation échoue.
+ */
+int insert_channel_member(Channel *channel, Subscription *sub)
+{
+    int count = atomic_load(&channel->client_count);
+    if (count == channel->member_capacity)
+    {
+        int capacity = channel->member_capacity ? channel->member_capacity * 2 : 8;
+        Subscription **member_set = realloc(channel->member_set, (size_t)capacity * sizeof(Subscription *));
+        if (member_set == NULL)
+        {
+            return -1;
+        }
+        channel->member_set = member_set;
+        channel->member_capacity = capacity;
+    }
+    channel->member_set[count] = sub;
+    sub->member_slot = count;
+    if (atomic_fetch_add(&channel->client_count, 1) == 0)
+    {
+        federation_interest_changed(channel); // Premier membre local : les pairs nous relaieront ce channel
+    }
+    invalidate_member_snapshot(channel);
+    return 0;
+}
+
+/**
+ * Retire l'abonnement d'un client de l'ensemble des membres d'un channel en O(1) :
+ * le dernier membre prend sa place. Doit être appelé avec channel->lock verrouillé.
+ * @param channel Le channel.
+ * @param sub L'abonnement.
+ */
+void erase_channel_member(Channel *channel, Subscription *sub)
+{
+    int slot = sub->member_slot;
+    if (slot < 0)
+    {
+        return;
+    }
+    int last = atomic_fetch_sub(&channel->client_count, 1) - 1;
+    channel->member_set[slot] = channel->member_set[last];
+    channel->member_set[slot]->member_slot = slot;
+    sub->member_slot = -1;
+    if (last == 0)
+    {
+        federation_interest_changed(channel);
+    }
+    invalidate_member_snapshot(channel);
+}
+
+/**
+ * Compte le nombre total de clients connectés au serveur.
+ * @return Le nombre total de clients.
+ */
+int count_total_clients()
+{
+    return atomic_load(&thread_client_count);
+}
+
+/**
+ * Prend un jeton dans un seau. Le seau se remplit d'un jeton tous les
+ * interval_ns et en contient au plus burst.
+ * @param bucket Le seau.
+ * @param limit La limite appliquée.
+ * @return 1 si un jeton a été pris (ou si la limite est désactivée), 0 sinon.
+ */
+int take_token(TokenBucket *bucket, const RateLimit *limit)
+{
+    if (limit->interval_ns == 0)
+    {
+        return 1;
+    }
+    uint64_t now = monotonic_ns();
+    uint64_t tolerance = (limit->burst - 1) * limit->interval_ns;
+    unsigned long next = atomic_load_explicit(&bucket->next_token_ns, memory_order_relaxed);
+    while (1)
+    {
+        uint64_t base = next > now ? next : now;
+        if (base - now > tolerance)
+        {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(&bucket->next_token_ns, &next, base + limit->interval_ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        {
+            return 1;
+        }
+    }
+}
+
+/**
+ * Contrôle d'admission d'une connexion, juste après accept() et avant d'allouer
+ * quoi que ce soit pour elle (thread, objet connexion) : nombre de connexions
+ * ouvertes puis débit d'acceptation. Une connexion refusée est fermée sans
+ * message, le protocole du client (texte ou tramé) n'étant pas encore connu.
+ * @return 0 si la connexion est admise, -1 si elle doit être fermée.
+ */
+int admit_connection()
+{
+    if (atomic_load(&open_connections) >= max_connections)
+    {
+        metric_add(METRIC_CONNECTIONS_FULL, 1);
+        return -1;
+    }
+    if (!take_token(&accept_bucket, &accept_rate_limit))
+    {
+        metric_add(METRIC_ACCEPT_THROTTLED, 1);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Compte un message refusé par une limite de débit et donne l'avis à renvoyer
+ * à l'expéditeur. L'avis n'est envoyé qu'au premier refus d'une série : un
+ * client qui insiste ne reçoit pas un avis par message envoyé.
+ * @param throttled L'indicateur de série de l'expéditeur, remis à 0 par son prochain message accepté.
+ * @param counter METRIC_CLIENT_THROTTLED ou METRIC_CHANNEL_THROTTLED.
+ * @return L'avis, ou NULL s'il a déjà été envoyé.
+ */
+const char *throttle_notice(int *throttled, MetricCounter counter)
+{
+    metric_add(counter, 1);
+    if (*throttled)
+    {
+        return NULL;
+    }
+    *throttled = 1;
+    return counter == METRIC_CLIENT_THROTTLED ? "Erreur : Trop de messages envoyés, message ignoré.\n"
+                                              : "Erreur : Trop de messages dans ce channel, message ignoré.\n";
+}
+
+void send_to_client_queue(ClientHandle *client, const char *data, size_t length, BroadcastBuffer *buffer);
+
+/**
+ * Envoie des données à un client (mode thread) sans bloquer : ce que le socket
+ * ne prend pas tout de suite va dans la file de sortie du client, vidée par son
+ * thread. Un client trop lent subit la politique client lent.
+ * @param client Le client.
+ * @param data Les données à envoyer.
+ * @param length La taille des données.
+ */
+void send_to_client(ClientHandle *client, const char *data, size_t length)
+{
+    send_to_client_queue(client, data, length, NULL);
+}
+
+/**
+ * Envoie un message partagé à un client (mode thread), dans son protocole.
+ * @param client Le client.
+ * @param buffer Le message partagé.
+ */
+void send_broadcast_to_client(ClientHandle *client, BroadcastBuffer *buffer)
+{
+    send_to_client_queue(client, NULL, 0, buffer);
+}
+
+/**
+ * Envoie des données ou un message partagé à un client (mode thread) via sa
+ * file de sortie, et réveille son thread si la file n'est pas vide. La livraison
+ * d'un message tracé est enregistrée avec l'attente du verrou du client.
+ * @param client Le client.
+ * @param data Les données à envoyer (si buffer vaut NULL).
+ * @param length La taille des données.
+ * @param buffer Le message partagé, ou NULL.
+ */
+void send_to_client_queue(ClientHandle *client, const char *data, size_t length, BroadcastBuffer *buffer)
+{
+    uint64_t start = buffer != NULL && buffer->trace_id != 0 ? monotonic_ns() : 0;
+    pthread_mutex_lock(&client->lock);
+    uint64_t locked = start != 0 ? monotonic_ns() : 0;
+    if (!client->evicted)
+    {
+        int result = buffer != NULL ? outbound_send_buffer(&client->queue, client->socket, buffer)
+                                    : outbound_send(&client->queue, client->socket, data, length, 1);
+        if (result == 1)
+        {
+            client->evicted = 1;
+            evict_slow_consumer(&client->queue, client->socket);
+        }
+        else if (result == 0 && client->queue.head != NULL)
+        {
+            // Le thread du client doit surveiller POLLOUT pour vider la file
+            uint64_t one = 1;
+            if (write(client->wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            {
+                perror("Erreur lors du réveil d'un client");
+            }
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    if (start != 0)
+    {
+        trace_record("deliver", buffer->trace_id, start, monotonic_ns(), NULL, 0, client->socket, locked - start);
+    }
+}
+
+/**
+ * Envoie une notification ou un message à un client, tramé ou non selon son protocole.
+ * @param client Le client.
+ * @param type Le type de trame.
+ * @param channel Le channel concerné, ou NULL.
+ * @param text Le texte.
+ */
+void send_message_to_client(ClientHandle *client, FrameType type, Channel *channel, const char *text)
+{
+    char message[FRAME_HEADER_SIZE + BUFFER_SIZE];
+    size_t length = encode_message(message, client->queue.framed, type, channel, 0, text, strlen(text));
+    send_to_client(client, message, length);
+}
+
+/**
+ * Envoie des données à un client depuis son propre thread (historique) : attend
+ * d'abord que la file soit redescendue sous le seuil bas, pour qu'un long
+ * historique ne déclenche pas la politique client lent.
+ * @param client Le client.
+ * @param data Les données à envoyer.
+ * @param length La taille des données.
+ */
+void send_to_own_client(ClientHandle *client, const char *data, size_t length)
+{
+    pthread_mutex_lock(&client->lock);
+    while (!client->evicted && atomic_load_explicit(&client->queue.queued_bytes, memory_order_relaxed) > low_watermark)
+    {
+        if (flush_outbound_queue(&client->queue, client->socket) == -1)
+        {
+            break;
+        }
+        if (atomic_load_explicit(&client->queue.queued_bytes, memory_order_relaxed) > low_watermark)
+        {
+            pthread_mutex_unlock(&client->lock);
+            struct pollfd pfd = {.fd = client->socket, .events = POLLOUT};
+            poll(&pfd, 1, 100);
+            pthread_mutex_lock(&client->lock);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    send_to_client(client, data, length);
+}
+
+void send_to_connection_queue(Connection *conn, const char *data, size_t length, BroadcastBuffer *buffer);
+
+/**
+ * Envoie des données à une connexion epoll sans bloquer : ce qui ne peut pas
+ * partir tout de suite est mis en attente dans la file de sortie.
+ * @param conn La connexion.
+ * @param data Les données à envoyer.
+ * @param length La taille des données.
+ */
+void send_to_connection(Connection *conn, const char *data, size_t length)
+{
+    send_to_connection_queue(conn, data, length, NULL);
+}
+
+/**
+ * Envoie un message partagé à une connexion epoll, dans son protocole.
+ * @param conn La connexion.
+ * @param buffer Le message partagé.
+ */
+void send_broadcast_to_connection(Connection *conn, BroadcastBuffer *buffer)
+{
+    send_to_connection_queue(conn, NULL, 0, buffer);
+}
+
+/**
+ * Envoie des données ou un message partagé à une connexion epoll via sa file de
+ * sortie. La livraison d'un message tracé est enregistrée.
+ * @param conn La connexion.
+ * @param data Les données à envoyer (si buffer vaut NULL).
+ * @param length La taille des données.
+ * @param buffer Le message partagé, ou NULL.
+ */
+void send_to_connection_queue(Connection *conn, const char *data, size_t length, BroadcastBuffer *buffer)
+{
+    if (conn->evicted)
+    {
+        return;
+    }
+    // Une erreur d'écriture sera signalée par epoll (EPOLLERR/EPOLLHUP) et traitée dans la boucle
+    uint64_t start = buffer != NULL && buffer->trace_id != 0 ? monotonic_ns() : 0;
+    int result = buffer != NULL ? outbound_send_buffer(&conn->queue, conn->socket, buffer)
+                                : outbound_send(&conn->queue, conn->socket, data, length, 1);
+    if (start != 0)
+    {
+        trace_record("deliver", buffer->trace_id, start, monotonic_ns(), NULL, 0, conn->socket, 0);
+    }
+    if (result == 1)
+    {
+        // shutdown() réveille epoll : la connexion sera fermée par la boucle du réacteur
+        conn->evicted = 1;
+        if (conn->send != NULL)
+        {
+            // io_uring : l'envoi en cours lit encore la file, elle sera vidée à sa complétion.
+            // Il attend un client qui ne lit plus : shutdown(SHUT_WR) l'interrompt aussitôt
+            conn->evict_deferred = 1;
+            shutdown(conn->socket, SHUT_WR);
+            return;
+        }
+        evict_slow_consumer(&conn->queue, conn->socket);
+    }
+}
+
+/**
+ * Envoie une notification à une connexion epoll, tramée ou non selon son protocole.
+ * @param conn La connexion.
+ * @param type Le type de trame.
+ * @param channel Le channel concerné, ou NULL.
+ * @param text Le texte.
+ */
+void send_message_to_connection(Connection *conn, FrameType type, Channel *channel, const char *text)
+{
+    char message[FRAME_HEADER_SIZE + BUFFER_SIZE];
+    size_t length = encode_message(message, conn->queue.framed, type, channel, 0, text, strlen(text));
+    send_to_connection(conn, message, length);
+}
+
+/**
+ * Obtient le chemin du dossier de stockage d'un channel.
+ * @param channel_name Le nom du channel.
+ * @param buffer Le buffer où le chemin sera stocké.
+ * @param buffer_size La taille du buffer.
+ */
+void get_channel_directory_path(const char *channel_name, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "storage_server/storage_%s", channel_name);
+}
+
+/**
+ * Obtient le chemin d'un fichier de segment du journal d'un channel. Le numéro
+ * est complété de zéros pour que l'ordre des noms soit celui des segments.
+ * @param channel_name Le nom du channel.
+ * @param base Le numéro du premier message du segment.
+ * @param extension "log" (enregistrements) ou "idx" (index clairsemé).
+ * @param buffer Le buffer où le chemin sera stocké.
+ * @param buffer_size La taille du buffer.
+ */
+void get_segment_file_path(const char *channel_name, uint64_t base, const char *extension, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "storage_server/storage_%s/segment_%020llu.%s", channel_name, (unsigned long long)base, extension);
+}
+
+/**
+ * Obtient le chemin de l'ancien fichier texte d'un channel (importé dans un segment au démarrage).
+ * @param channel_name Le nom du channel.
+ * @param buffer Le buffer où le chemin sera stocké.
+ * @param buffer_size La taille du buffer.
+ */
+void get_storage_file_path(const char *channel_name, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "storage_server/storage_%s/history_channel_file_%s.txt", channel_name, channel_name);
+}
+
+/**
+ * Obtient le chemin de l'ancien index (position de chaque ligne) d'un channel.
+ * @param channel_name Le nom du channel.
+ * @param buffer Le buffer où le chemin sera stocké.
+ * @param buffer_size La taille du buffer.
+ */
+void get_index_file_path(const char *channel_name, char *buffer, size_t buffer_size)
+{
+    snprintf(buffer, buffer_size, "storage_server/storage_%s/history_channel_index_%s.idx", channel_name, channel_name);
+}
+
+/**
+ * Assure la création du répertoire de stockage d'un channel.
+ * @param channel_name Le nom du channel.
+ */
+void ensure_channel_directory(const char *channel_name)
+{
+    char dir_path[256];
+    get_channel_directory_path(channel_name, dir_path, sizeof(dir_path));
+
+    // Crée le répertoire pour le channel s'il n'existe pas
+    if (mkdir("storage_server", 0777) == -1 && errno != EEXIST)
+    {
+        perror("Erreur lors de la création du dossier 'storage_server'");
+        return;
+    }
+
+    if (mkdir(dir_path, 0777) == -1 && errno != EEXIST)
+    {
+        perror("Erreur lors de la création du dossier du channel");
+    }
+}
+
+/**
+ * Prépare un enregistrement binaire du journal.
+ * @param channel Le channel.
+ * @param sequence Le numéro du message (0 s'il est attribué à la soumission).
+ * @param timestamp L'horodatage.
+ * @param sender L'expéditeur, "" pour une notification.
+ * @param text Le texte.
+ * @param text_length La taille du texte (plafonnée à RECORD_MAX_TEXT).
+ * @return L'enregistrement alloué, ou NULL si la mémoire manque.
+ */
+LogRecord *create_log_record(Channel *channel, uint64_t sequence, int64_t timestamp, const char *sender, const char *text, size_t text_length)
+{
+    RecordHeader header = {0};
+    size_t sender_length = strlen(sender);
+    if (text_length > RECORD_MAX_TEXT)
+    {
+        text_length = RECORD_MAX_TEXT;
+    }
+    header.length = (uint32_t)text_length;
+    header.sender_length = (uint16_t)sender_length;
+    header.sequence = sequence;
+    header.timestamp = timestamp;
+
+    size_t length = sizeof(RecordHeader) + sender_length + text_length;
+    LogRecord *record = block_alloc(sizeof(LogRecord) + length);
+    if (record == NULL)
+    {
+        return NULL;
+    }
+    record->next = NULL;
+    record->channel = channel;
+    record->trace_id = 0;
+    record->length = length;
+    memcpy(record->data, &header, sizeof(header));
+    memcpy(record->data + sizeof(header), sender, sender_length);
+    memcpy(record->data + sizeof(header) + sender_length, text, text_length);
+    return record;
+}
+
+/**
+ * Confie un message au thread écrivain du journal. Ne fait aucun appel système :
+ * l'écrivain regroupe les enregistrements de tous les expéditeurs en écritures writev.
+ * Un message tracé garde sa trace jusqu'à l'écrivain ; l'attente du verrou de la file est mesurée.
+ * @param channel Le channel.
+ * @param timestamp L'horodatage du message.
+ * @param sender Le nom de l'expéditeur.
+ * @param text Le message.
+ * @param sequence Reçoit le numéro du message, ou NULL.
+ * @return 0 en cas de succès, -1 si l'allocation échoue.
+ */
+int submit_log_record(Channel *channel, int64_t timestamp, const char *sender, const char *text, uint64_t *sequence)
+{
+    LogRecord *record = create_log_record(channel, 0, timestamp, sender, text, strlen(text));
+    if (record == NULL)
+    {
+        return -1;
+    }
+    record->trace_id = trace_self.id;
+    uint64_t start = trace_self.id != 0 ? monotonic_ns() : 0;
+
+    pthread_mutex_lock(&log_queue_mutex);
+    uint64_t locked = start != 0 ? monotonic_ns() : 0;
+    record->submitted_ns = locked;
+    atomic_fetch_add_explicit(&channel->log_submitted, 1, memory_order_relaxed);
+    // Numéroté dans l'ordre de la file : c'est aussi l'ordre d'écriture dans le journal
+    uint64_t number = ++channel->last_sequence;
+    memcpy(record->data + offsetof(RecordHeader, sequence), &number, sizeof(number));
+    if (log_queue_tail != NULL)
+    {
+        log_queue_tail->next = record;
+    }
+    else
+    {
+        log_queue_head = record;
+    }
+    log_queue_tail = record;
+    int wake_writer = log_writer_sleeping;
+    log_writer_sleeping = 0;
+    pthread_mutex_unlock(&log_queue_mutex);
+
+    if (wake_writer)
+    {
+        pthread_cond_signal(&log_queue_cond);
+    }
+    if (start != 0)
+    {
+        trace_record("log_submit", trace_self.id, start, monotonic_ns(), channel, number, -1, locked - start);
+    }
+    if (sequence != NULL)
+    {
+        *sequence = number;
+    }
+    return 0;
+}
+
+/**
+ * Attend que tous les messages déjà soumis pour un channel soient écrits,
+ * pour qu'une relecture de l'historique n'en oublie aucun.
+ * @param channel Le channel.
+ */
+void wait_for_log_flush(Channel *channel)
+{
+    unsigned long target = atomic_load(&channel->log_submitted);
+    if (atomic_load(&channel->log_written) >= target)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&log_queue_mutex);
+    while (atomic_load(&channel->log_written) < target)
+    {
+        pthread_cond_wait(&log_written_cond, &log_queue_mutex);
+    }
+    pthread_mutex_unlock(&log_queue_mutex);
+}
+
+/**
+ * Cherche dans l'index clairsemé d'un segment la dernière entrée dont le numéro
+ * est inférieur ou égal à sequence (recherche dichotomique lue dans le fichier).
+ * @param channel Le channel.
+ * @param base La base du segment.
+ * @param sequence Le numéro cherché.
+ * @param entry Reçoit l'entrée, ou le début du segment si aucune ne convient.
+ */
+void find_segment_index_entry(Channel *channel, uint64_t base, uint64_t sequence, SegmentIndexEntry *entry)
+{
+    entry->sequence = base;
+    entry->timestamp = 0;
+    entry->offset = 0;
+
+    char path[256];
+    get_segment_file_path(channel->name, base, "idx", path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return; // Index absent : le segment sera lu depuis le début
+    }
+    struct stat st;
+    off_t low = 0;
+    off_t high = fstat(fd, &st) == 0 ? st.st_size / (off_t)sizeof(SegmentIndexEntry) : 0;
+    while (low < high)
+    {
+        off_t middle = low + (high - low) / 2;
+        SegmentIndexEntry candidate;
+        if (pread(fd, &candidate, sizeof(candidate), middle * (off_t)sizeof(candidate)) != (ssize_t)sizeof(candidate))
+        {
+            break;
+        }
+        if (candidate.sequence <= sequence)
+        {
+            *entry = candidate;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    close(fd);
+}
+
+/**
+ * Prépare la lecture des messages first à last de l'historique d'un channel.
+ * @param channel Le channel.
+ * @param first Le premier message.
+ * @param last Le dernier message (inclus).
+ * @return Le curseur alloué, ou NULL si la mémoire manque.
+ */
+HistoryCursor *open_history_cursor(Channel *channel, uint64_t first, uint64_t last)
+{
+    HistoryCursor *cursor = malloc(sizeof(HistoryCursor));
+    if (cursor == NULL)
+    {
+        return NULL;
+    }
+    cursor->channel = channel;
+    cursor->next = first;
+    cursor->last = last;
+    cursor->fd = -1;
+    return cursor;
+}
+
+/**
+ * Libère un curseur d'historique.
+ * @param cursor Le curseur.
+ */
+void close_history_cursor(HistoryCursor *cursor)
+{
+    if (cursor->fd != -1)
+    {
+        close(cursor->fd);
+    }
+    free(cursor);
+}
+
+/**
+ * Ouvre le segment qui contient le prochain message du curseur (le plus ancien
+ * segment restant si la rétention a effacé ce message) et s'y place grâce à
+ * l'index clairsemé.
+ * @param cursor Le curseur.
+ * @return 0 en cas de succès, -1 si aucun segment n'est lisible.
+ */
+int locate_history_cursor(HistoryCursor *cursor)
+{
+    Channel *channel = cursor->channel;
+    // La rétention peut effacer le segment entre la recherche et l'ouverture : chercher à nouveau
+    for (int attempt = 0; attempt < 3; ++attempt)
+    {
+        pthread_mutex_lock(&channel->segments_lock);
+        if (channel->segment_count == 0)
+        {
+            pthread_mutex_unlock(&channel->segments_lock);
+            return -1;
+        }
+        if (cursor->next < channel->segments[0].base)
+        {
+            cursor->next = channel->segments[0].base;
+        }
+        int low = 0;
+        int high = channel->segment_count - 1;
+        while (low < high)
+        {
+            int middle = (low + high + 1) / 2;
+            if (channel->segments[middle].base <= cursor->next)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle - 1;
+            }
+        }
+        cursor->segment_base = channel->segments[low].base;
+        cursor->segment_end = low + 1 < channel->segment_count ? channel->segments[low + 1].base : UINT64_MAX;
+        pthread_mutex_unlock(&channel->segments_lock);
+
+        char path[256];
+        get_segment_file_path(channel->name, cursor->segment_base, "log", path, sizeof(path));
+        cursor->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (cursor->fd != -1)
+        {
+            SegmentIndexEntry entry;
+            find_segment_index_entry(channel, cursor->segment_base, cursor->next, &entry);
+            cursor->position = (off_t)entry.offset;
+            cursor->position_sequence = entry.sequence;
+            cursor->block_position = 0;
+            cursor->block_length = 0;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Donne length octets du segment courant à la position du curseur, en relisant
+ * un bloc si ils n'y sont pas déjà.
+ * @param cursor Le curseur.
+ * @param length Le nombre d'octets (au plus HISTORY_BLOCK_SIZE).
+ * @return Les octets, ou NULL s'ils dépassent la fin du segment.
+ */
+const char *read_history_cursor(HistoryCursor *cursor, size_t length)
+{
+    if (cursor->position < cursor->block_position ||
+        cursor->position + (off_t)length > cursor->block_position + (off_t)cursor->block_length)
+    {
+        ssize_t read_size = pread(cursor->fd, cursor->block, sizeof(cursor->block), cursor->position);
+        cursor->block_position = cursor->position;
+        cursor->block_length = read_size > 0 ? (size_t)read_size : 0;
+        if (length > cursor->block_length)
+        {
+            return NULL;
+        }
+    }
+    return cursor->block + (cursor->position - cursor->block_position);
+}
+
+/**
+ * Lit le message suivant d'un curseur d'historique, en passant d'un segment au
+ * suivant. Un enregistrement incomplet ou dont le numéro ne suit pas marque la
+ * fin de son segment.
+ * @param cursor Le curseur.
+ * @param header Reçoit l'en-tête de l'enregistrement.
+ * @param sender Reçoit l'expéditeur (header->sender_length octets).
+ * @param text Reçoit le texte (header->length octets).
+ * @return 1 si un message est lu, 0 à la fin de la plage ou du journal, -1 si le journal est illisible.
+ */
+int next_history_record(HistoryCursor *cursor, RecordHeader *header, const char **sender, const char **text)
+{
+    while (cursor->next <= cursor->last)
+    {
+        if (cursor->fd == -1)
+        {
+            if (locate_history_cursor(cursor) == -1)
+            {
+                return -1;
+            }
+            if (cursor->next > cursor->last)
+            {
+                return 0;
+            }
+        }
+
+        const char *data = read_history_cursor(cursor, sizeof(RecordHeader));
+        if (data != NULL)
+        {
+            memcpy(header, data, sizeof(RecordHeader));
+            size_t size = sizeof(RecordHeader) + header->sender_length + header->length;
+            if (header->sequence == cursor->position_sequence && header->length <= RECORD_MAX_TEXT &&
+                (data = read_history_cursor(cursor, size)) != NULL)
+            {
+                cursor->position += (off_t)size;
+                cursor->position_sequence++;
+                if (header->sequence < cursor->next)
+                {
+                    continue; // Entre l'entrée d'index et le message demandé
+                }
+                cursor->next = header->sequence + 1;
+                *sender = data + sizeof(RecordHeader);
+                *text = *sender + header->sender_length;
+                return 1;
+            }
+        }
+
+        // Fin du segment. S'il était le segment actif, une rotation a pu en ouvrir un autre depuis.
+        if (cursor->segment_end == UINT64_MAX)
+        {
+            Channel *channel = cursor->channel;
+            pthread_mutex_lock(&channel->segments_lock);
+            for (int i = channel->segment_count - 1; i >= 0 && channel->segments[i].base > cursor->segment_base; --i)
+            {
+                cursor->segment_end = channel->segments[i].base;
+            }
+            pthread_mutex_unlock(&channel->segments_lock);
+            if (cursor->segment_end == UINT64_MAX)
+            {
+                return 0;
+            }
+        }
+        if (cursor->next < cursor->segment_end)
+        {
+            cursor->next = cursor->segment_end; // Messages perdus par une écriture interrompue
+        }
+        close(cursor->fd);
+        cursor->fd = -1;
+    }
+    return 0;
+}
+
+/**
+ * Formate un message de chat tel qu'il est diffusé et rejoué : une seule ligne
+ * (les retours à la ligne du message deviennent des espaces), coupée à size - 1 octets.
+ * @param channel Le channel.
+ * @param timestamp L'horodatage du message.
+ * @param sender L'expéditeur.
+ * @param sender_length La taille de l'expéditeur.
+ * @param message Le message.
+ * @param message_length La taille du message.
+ * @param out Le buffer qui reçoit la ligne.
+ * @param size La taille du buffer.
+ * @return La taille de la ligne.
+ */
+size_t format_chat_line(const Channel *channel, time_t timestamp, const char *sender, size_t sender_length, const char *message, size_t message_length, char *out, size_t size)
+{
+    struct tm tm_info;
+    localtime_r(&timestamp, &tm_info);
+    char time_buffer[26];
+    strftime(time_buffer, sizeof(time_buffer), "%d/%m/%Y %H:%M:%S", &tm_info);
+
+    int length = snprintf(out, size, "[%s] (%s) %.*s : %.*s\n", channel->name, time_buffer, (int)sender_length, sender, (int)message_length, message);
+    if (length >= (int)size)
+    {
+        length = (int)size - 1;
+        out[length - 1] = '\n';
+    }
+    // Un message = une ligne de l'historique rejoué
+    for (int i = 0; i < length - 1; ++i)
+    {
+        if (out[i] == '\n')
+        {
+            out[i] = ' ';
+        }
+    }
+    return (size_t)length;
+}
+
+/**
+ * Formate un enregistrement du journal en ligne d'historique : la ligne de chat
+ * d'origine, ou le texte d'une notification suivi d'un retour à la ligne.
+ * @param channel Le channel.
+ * @param header L'en-tête de l'enregistrement.
+ * @param sender L'expéditeur.
+ * @param text Le texte.
+ * @param out Le buffer qui reçoit la ligne.
+ * @param size La taille du buffer (au moins RECORD_MAX_TEXT + 1 octets).
+ * @return La taille de la ligne.
+ */
+size_t format_history_record(const Channel *channel, const RecordHeader *header, const char *sender, const char *text, char *out, size_t size)
+{
+    if (header->sender_length > 0)
+    {
+        return format_chat_line(channel, (time_t)header->timestamp, sender, header->sender_length, text, header->length,
+                                out, size < BUFFER_SIZE ? size : BUFFER_SIZE);
+    }
+    memcpy(out, text, header->length);
+    out[header->length] = '\n';
+    return header->length + 1;
+}
+
+/**
+ * Formate les messages suivants d'un curseur, tant qu'un enregistrement entier
+ * tient encore dans le buffer.
+ * @param cursor Le curseur.
+ * @param out Le buffer.
+ * @param capacity La taille du buffer.
+ * @return La taille du texte formaté, 0 si l'historique est épuisé.
+ */
+size_t fill_history_chunk(HistoryCursor *cursor, char *out, size_t capacity)
+{
+    size_t length = 0;
+    RecordHeader header;
+    const char *sender;
+    const char *text;
+    while (capacity - length > RECORD_MAX_TEXT + 1 && next_history_record(cursor, &header, &sender, &text) == 1)
+    {
+        length += format_history_record(cursor->channel, &header, sender, text, out + length, capacity - length);
+    }
+    return length;
+}
+
+/**
+ * Indique si un octet fait partie d'un terme de recherche : lettres et
+ * chiffres ASCII, et tous les octets UTF-8 non ASCII (lettres accentuées...).
+ * @param c L'octet.
+ * @return 1 s'il fait partie d'un terme, 0 sinon.
+ */
+static inline int is_search_term_byte(unsigned char c)
+{
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/**
+ * Découpe le terme suivant d'un texte, en minuscules ASCII et coupé à
+ * SEARCH_TERM_MAX octets. Les termes de moins de SEARCH_TERM_MIN octets sont sautés.
+ * @param text Le texte, avancé après le terme.
+ * @param end La fin du texte.
+ * @param term Reçoit le terme (SEARCH_TERM_MAX octets).
+ * @return La taille du terme, 0 à la fin du texte.
+ */
+size_t next_search_term(const char **text, const char *end, char *term)
+{
+    while (*text < end)
+    {
+        size_t length = 0;
+        while (*text < end && !is_search_term_byte((unsigned char)**text))
+        {
+            (*text)++;
+        }
+        while (*text < end && is_search_term_byte((unsigned char)**text))
+        {
+            if (length < SEARCH_TERM_MAX)
+            {
+                unsigned char c = (unsigned char)**text;
+                term[length++] = (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+            }
+            (*text)++;
+        }
+        if (length >= SEARCH_TERM_MIN)
+        {
+            return length;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Calcule le hachage d'un terme (FNV-1a).
+ * @param term Le terme.
+ * @param length Sa taille.
+ * @return Le hachage.
+ */
+uint64_t hash_search_term(const char *term, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = (hash ^ (unsigned char)term[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Crée l'index de recherche vide d'un segment.
+ * @param base Le numéro du premier message du segment.
+ * @return L'index, ou NULL si la mémoire manque.
+ */
+SearchIndex *create_search_index(uint64_t base)
+{
+    SearchIndex *index = calloc(1, sizeof(SearchIndex));
+    if (index != NULL)
+    {
+        index->buckets = calloc(SEARCH_INITIAL_BUCKETS, sizeof(SearchTerm *));
+        if (index->buckets == NULL)
+        {
+            free(index);
+            return NULL;
+        }
+        index->bucket_count = SEARCH_INITIAL_BUCKETS;
+        index->base = base;
+        index->next = base;
+    }
+    return index;
+}
+
+/**
+ * Libère un index de recherche en mémoire.
+ * @param index L'index (NULL accepté).
+ */
+void free_search_index(SearchIndex *index)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < index->bucket_count; ++i)
+    {
+        SearchTerm *term = index->buckets[i];
+        while (term != NULL)
+        {
+            SearchTerm *next = term->next;
+            free(term->postings);
+            free(term);
+            term = next;
+        }
+    }
+    free(index->buckets);
+    free(index);
+}
+
+/**
+ * Cherche un terme dans un index en mémoire.
+ * @param index L'index.
+ * @param term Le terme.
+ * @param length Sa taille.
+ * @return Le terme, ou NULL s'il n'apparaît dans aucun message.
+ */
+SearchTerm *find_search_term(const SearchIndex *index, const char *term, size_t length)
+{
+    SearchTerm *entry = index->buckets[hash_search_term(term, length) & (index->bucket_count - 1)];
+    while (entry != NULL && (entry->term_length != length || memcmp(entry->term, term, length) != 0))
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+/**
+ * Double la table des termes d'un index quand elle est pleine.
+ * @param index L'index.
+ */
+void grow_search_index(SearchIndex *index)
+{
+    size_t bucket_count = index->bucket_count * 2;
+    SearchTerm **buckets = calloc(bucket_count, sizeof(SearchTerm *));
+    if (buckets == NULL)
+    {
+        return; // Les seaux s'allongent, l'index reste correct
+    }
+    for (size_t i = 0; i < index->bucket_count; ++i)
+    {
+        SearchTerm *term = index->buckets[i];
+        while (term != NULL)
+        {
+            SearchTerm *next = term->next;
+            size_t slot = hash_search_term(term->term, term->term_length) & (bucket_count - 1);
+            term->next = buckets[slot];
+            buckets[slot] = term;
+            term = next;
+        }
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucket_count = bucket_count;
+}
+
+/**
+ * Ajoute un message à la liste d'un terme (une seule fois par message).
+ * @param index L'index.
+ * @param term Le terme.
+ * @param length Sa taille.
+ * @param sequence Le numéro du message (croissant).
+ */
+void add_search_posting(SearchIndex *index, const char *term, size_t length, uint64_t sequence)
+{
+    SearchTerm *entry = find_search_term(index, term, length);
+    if (entry == NULL)
+    {
+        entry = calloc(1, sizeof(SearchTerm) + length);
+        if (entry == NULL)
+        {
+            return;
+        }
+        memcpy(entry->term, term, length);
+        entry->term_length = (uint16_t)length;
+        size_t slot = hash_search_term(term, length) & (index->bucket_count - 1);
+        entry->next = index->buckets[slot];
+        index->buckets[slot] = entry;
+        if (++index->term_count > index->bucket_count)
+        {
+            grow_search_index(index);
+        }
+    }
+    else if (entry->last_sequence == sequence)
+    {
+        return; // Terme répété dans le même message
+    }
+
+    if (entry->capacity - entry->length < 10)
+    {
+        uint32_t capacity = entry->capacity ? entry->capacity * 2 : 16;
+        uint8_t *postings = realloc(entry->postings, capacity);
+        if (postings == NULL)
+        {
+            return;
+        }
+        entry->postings = postings;
+        entry->capacity = capacity;
+    }
+    uint64_t gap = sequence - (entry->count > 0 ? entry->last_sequence : index->base);
+    do
+    {
+        entry->postings[entry->length++] = (uint8_t)((gap & 0x7f) | (gap >= 0x80 ? 0x80 : 0));
+        gap >>= 7;
+    } while (gap != 0);
+    entry->last_sequence = sequence;
+    entry->count++;
+}
+
+/**
+ * Ajoute un message du journal à un index, s'il est le suivant attendu. Seuls
+ * les messages de chat sont indexés, pas les notifications.
+ * @param index L'index.
+ * @param header L'en-tête de l'enregistrement.
+ * @param text Le texte (header->length octets).
+ * @return 1 si l'index couvre le message, 0 s'il manque des messages avant lui.
+ */
+int index_search_record(SearchIndex *index, const RecordHeader *header, const char *text)
+{
+    if (header->sequence < index->next)
+    {
+        return 1;
+    }
+    if (header->sequence > index->next)
+    {
+        return 0;
+    }
+    if (header->sender_length > 0)
+    {
+        char term[SEARCH_TERM_MAX];
+        const char *end = text + header->length;
+        size_t length;
+        while ((length = next_search_term(&text, end, term)) > 0)
+        {
+            add_search_posting(index, term, length, header->sequence);
+        }
+    }
+    index->next = header->sequence + 1;
+    return 1;
+}
+
+/**
+ * Confie un travail au thread d'indexation.
+ * @param channel Le channel.
+ * @param catch_up 1 pour compléter l'index du segment actif depuis le journal.
+ * @param base Le segment fermé à indexer (catch_up à 0).
+ * @param index Son index complet, ou NULL pour le reconstruire.
+ */
+void post_search_job(Channel *channel, int catch_up, uint64_t base, SearchIndex *index)
+{
+    SearchJob *job = calloc(1, sizeof(SearchJob));
+    if (job == NULL)
+    {
+        free_search_index(index);
+        return;
+    }
+    job->channel = channel;
+    job->catch_up = catch_up;
+    job->base = base;
+    job->index = index;
+    pthread_mutex_lock(&search_jobs_mutex);
+    if (search_jobs_tail != NULL)
+    {
+        search_jobs_tail->next = job;
+    }
+    else
+    {
+        search_jobs_head = job;
+    }
+    search_jobs_tail = job;
+    pthread_cond_signal(&search_jobs_cond);
+    pthread_mutex_unlock(&search_jobs_mutex);
+}
+
+/**
+ * Ajoute à l'index du segment actif les messages qui viennent d'être écrits
+ * (thread écrivain). S'il lui en manque d'autres avant eux (index rebâti au
+ * chargement du channel, messages perdus), le thread d'indexation les relit
+ * dans le journal.
+ * @param log_write L'écriture terminée.
+ */
+void index_log_write(LogWrite *log_write)
+{
+    Channel *channel = log_write->channel;
+    pthread_mutex_lock(&channel->search_lock);
+    if (channel->search != NULL)
+    {
+        LogRecord *record = log_write->record;
+        int complete = 1;
+        for (int i = 0; i < log_write->count && complete; ++i, record = record->next)
+        {
+            RecordHeader header;
+            memcpy(&header, record->data, sizeof(header));
+            complete = index_search_record(channel->search, &header, record->data + sizeof(RecordHeader) + header.sender_length);
+        }
+        if (!complete && !channel->search_catch_up)
+        {
+            channel->search_catch_up = 1;
+            post_search_job(channel, 1, 0, NULL);
+        }
+    }
+    pthread_mutex_unlock(&channel->search_lock);
+}
+
+/**
+ * Ferme l'index du segment actif à l'ouverture du segment suivant (thread
+ * écrivain) : il part au thread d'indexation pour être écrit sur disque, ou
+ * reconstruit depuis le journal s'il n'était pas complet.
+ * @param channel Le channel.
+ * @param base Le numéro du premier message du nouveau segment.
+ */
+void seal_search_index(Channel *channel, uint64_t base)
+{
+    pthread_mutex_lock(&channel->search_lock);
+    SearchIndex *sealed = channel->search;
+    if (sealed == NULL || sealed->base == base)
+    {
+        pthread_mutex_unlock(&channel->search_lock);
+        return;
+    }
+    channel->search = create_search_index(base);
+    pthread_mutex_unlock(&channel->search_lock);
+
+    uint64_t sealed_base = sealed->base;
+    if (sealed->next != base)
+    {
+        free_search_index(sealed);
+        sealed = NULL;
+    }
+    post_search_job(channel, 0, sealed_base, sealed);
+}
+
+/**
+ * Ferme le segment actif d'un channel et en ouvre un nouveau, dont le premier
+ * message sera base. Appelé par le thread écrivain (ou à l'ouverture du channel,
+ * avant que l'écrivain ne le voie).
+ * @param channel Le channel.
+ * @param base Le numéro du premier message du nouveau segment.
+ * @return 0 en cas de succès, -1 sinon.
+ */
+int open_new_segment(Channel *channel, uint64_t base)
+{
+    if (channel->log_fd != -1)
+    {
+        // Le segment fermé ne sera plus vu par sync_dirty_logs
+        if (log_sync_mode != LOG_SYNC_NONE)
+        {
+            fdatasync(channel->log_fd);
+        }
+        close(channel->log_fd);
+        channel->log_fd = -1;
+    }
+    if (channel->log_index_fd != -1)
+    {
+        close(channel->log_index_fd);
+        channel->log_index_fd = -1;
+    }
+    channel->log_dirty = 0;
+
+    pthread_mutex_lock(&channel->segments_lock);
+    if (channel->segment_count == channel->segment_capacity)
+    {
+        int capacity = channel->segment_capacity ? channel->segment_capacity * 2 : 8;
+        SegmentInfo *segments = realloc(channel->segments, (size_t)capacity * sizeof(SegmentInfo));
+        if (segments == NULL)
+        {
+            pthread_mutex_unlock(&channel->segments_lock);
+            return -1;
+        }
+        channel->segments = segments;
+        channel->segment_capacity = capacity;
+    }
+    pthread_mutex_unlock(&channel->segments_lock);
+
+    char path[256];
+    get_segment_file_path(channel->name, base, "log", path, sizeof(path));
+    channel->log_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    get_segment_file_path(channel->name, base, "idx", path, sizeof(path));
+    channel->log_index_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (channel->log_fd == -1 || channel->log_index_fd == -1)
+    {
+        perror("Erreur lors de la création d'un segment du journal");
+        if (channel->log_fd != -1)
+        {
+            close(channel->log_fd);
+            channel->log_fd = -1;
+        }
+        if (channel->log_index_fd != -1)
+        {
+            close(channel->log_index_fd);
+            channel->log_index_fd = -1;
+        }
+        return -1;
+    }
+
+    pthread_mutex_lock(&channel->segments_lock);
+    channel->segments[channel->segment_count++] = (SegmentInfo){.base = base, .size = 0, .last_time = 0};
+    pthread_mutex_unlock(&channel->segments_lock);
+    channel->log_roll_pending = 0;
+    seal_search_index(channel, base);
+    return 0;
+}
+
+/**
+ * Prépare l'écriture des prochains enregistrements d'un channel (numéros
+ * croissants, IOV_MAX au plus) : ceux qui tiennent dans le segment actif, en
+ * ouvrant un nouveau segment quand l'actif atteint segment_bytes.
+ * @param channel Le channel.
+ * @param record Le premier enregistrement à écrire, avancé après ceux préparés.
+ * @param log_write Reçoit l'écriture (count à 0 s'il ne reste rien à écrire).
+ * @return Le nombre d'enregistrements perdus faute de segment (libérés).
+ */
+unsigned long prepare_log_write(Channel *channel, LogRecord **record, LogWrite *log_write)
+{
+    unsigned long dropped = 0;
+    log_write->channel = channel;
+    log_write->count = 0;
+    log_write->entry_count = 0;
+    log_write->total = 0;
+    SegmentInfo *active = NULL;
+    while (*record != NULL)
+    {
+        RecordHeader header;
+        memcpy(&header, (*record)->data, sizeof(header));
+        active = channel->segment_count > 0 ? &channel->segments[channel->segment_count - 1] : NULL;
+        if (channel->log_fd != -1 && !channel->log_roll_pending && active != NULL &&
+            (active->size == 0 || active->size + (off_t)(*record)->length <= segment_bytes))
+        {
+            break;
+        }
+        if (open_new_segment(channel, header.sequence) == 0)
+        {
+            active = &channel->segments[channel->segment_count - 1];
+            break;
+        }
+        // Aucun segment où écrire : le message est perdu, le suivant réessaiera
+        LogRecord *next = (*record)->next;
+        block_free(*record);
+        *record = next;
+        dropped++;
+    }
+
+    log_write->record = *record;
+    LogRecord *r = *record;
+    for (; r != NULL && log_write->count < IOV_MAX; r = r->next)
+    {
+        if (log_write->count > 0 && active->size + (off_t)(log_write->total + r->length) > segment_bytes)
+        {
+            break; // La suite ira dans le segment suivant
+        }
+        memcpy(&log_write->last, r->data, sizeof(log_write->last));
+        if ((log_write->last.sequence - active->base) % SEGMENT_INDEX_INTERVAL == 0)
+        {
+            log_write->entries[log_write->entry_count++] = (SegmentIndexEntry){log_write->last.sequence, log_write->last.timestamp, (uint64_t)active->size + log_write->total};
+        }
+        log_write->iov[log_write->count].iov_base = r->data;
+        log_write->iov[log_write->count].iov_len = r->length;
+        log_write->total += r->length;
+        log_write->count++;
+    }
+    *record = r;
+    log_write->started_ns = trace_clock();
+    return dropped;
+}
+
+/**
+ * Termine une écriture préparée avec writev, à partir de l'octet done.
+ * @param log_write L'écriture.
+ * @param done Le nombre d'octets déjà écrits.
+ * @return Le nombre d'octets écrits au total (log_write->total sauf erreur).
+ */
+size_t write_log_iov(LogWrite *log_write, size_t done)
+{
+    struct iovec *iov = log_write->iov;
+    int count = log_write->count;
+    int first = 0;
+    size_t skip = done;
+    while (first < count && skip >= iov[first].iov_len)
+    {
+        skip -= iov[first].iov_len;
+        first++;
+    }
+    if (first < count)
+    {
+        iov[first].iov_base = (char *)iov[first].iov_base + skip;
+        iov[first].iov_len -= skip;
+    }
+
+    // Un writev sur un fichier régulier écrit tout, sauf erreur (disque plein...)
+    while (done < log_write->total)
+    {
+        ssize_t result = writev(log_write->channel->log_fd, iov + first, count - first);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Erreur lors de l'écriture du journal");
+            break;
+        }
+        done += (size_t)result;
+        while (first < count && (size_t)result >= iov[first].iov_len)
+        {
+            result -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count)
+        {
+            iov[first].iov_base = (char *)iov[first].iov_base + result;
+            iov[first].iov_len -= (size_t)result;
+        }
+    }
+    return done;
+}
+
+/**
+ * Conclut une écriture : complète l'index clairsemé si tout a été écrit, retire
+ * sinon l'écriture partielle du segment. Libère les enregistrements.
+ * @param log_write L'écriture.
+ * @param done Le nombre d'octets écrits.
+ * @return Le nombre d'enregistrements traités.
+ */
+unsigned long finish_log_write(LogWrite *log_write, size_t done)
+{
+    Channel *channel = log_write->channel;
+    SegmentInfo *active = &channel->segments[channel->segment_count - 1];
+    if (done == log_write->total)
+    {
+        // L'index n'est complété qu'une fois les enregistrements écrits
+        size_t entry_bytes = (size_t)log_write->entry_count * sizeof(SegmentIndexEntry);
+        if (log_write->entry_count > 0 && write(channel->log_index_fd, log_write->entries, entry_bytes) != (ssize_t)entry_bytes)
+        {
+            perror("Erreur lors de l'écriture de l'index");
+        }
+        pthread_mutex_lock(&channel->segments_lock);
+        active->size += (off_t)log_write->total;
+        active->last_time = log_write->last.timestamp;
+        pthread_mutex_unlock(&channel->segments_lock);
+        // last_stored avant l'index : le rattrapage ne s'arrête qu'une fois l'index au niveau de last_stored
+        atomic_store(&channel->last_stored, log_write->last.sequence);
+        index_log_write(log_write);
+    }
+    else
+    {
+        // Pas d'enregistrement coupé dans un segment : les numéros doivent s'y suivre
+        if (ftruncate(channel->log_fd, active->size) == -1)
+        {
+            perror("Erreur lors de la reprise du journal");
+        }
+        channel->log_roll_pending = 1;
+    }
+
+    LogRecord *record = log_write->record;
+    uint64_t now = 0;
+    for (int i = 0; i < log_write->count; ++i)
+    {
+        LogRecord *next = record->next;
+        if (record->trace_id != 0)
+        {
+            // Attente dans la file de l'écrivain, puis écriture du lot qui contient le message
+            RecordHeader header;
+            memcpy(&header, record->data, sizeof(header));
+            now = now != 0 ? now : monotonic_ns();
+            trace_record("log_queue", record->trace_id, record->submitted_ns, log_write->started_ns, channel, header.sequence, -1, 0);
+            trace_record("log_write", record->trace_id, log_write->started_ns, now, channel, header.sequence, -1, 0);
+        }
+        block_free(record);
+        record = next;
+    }
+    return (unsigned long)log_write->count;
+}
+
+/**
+ * Écrit une suite d'enregistrements (numéros croissants) dans le journal d'un
+ * channel avec writev (IOV_MAX par appel), en ouvrant un nouveau segment quand
+ * l'actif atteint segment_bytes, puis complète l'index clairsemé. Libère les
+ * enregistrements.
+ * @param channel Le channel.
+ * @param record Le premier enregistrement.
+ * @return Le nombre d'enregistrements traités.
+ */
+unsigned long store_log_records(Channel *channel, LogRecord *record)
+{
+    LogWrite log_write;
+    unsigned long stored = 0;
+    while (record != NULL)
+    {
+        stored += prepare_log_write(channel, &record, &log_write);
+        if (log_write.count > 0)
+        {
+            stored += finish_log_write(&log_write, write_log_iov(&log_write, 0));
+        }
+    }
+    return stored;
+}
+
+/**
+ * Termine le lot d'un channel une fois ses enregistrements écrits.
+ * @param channel Le channel.
+ * @param written Le nombre d'enregistrements traités.
+ */
+void finish_channel_batch(Channel *channel, unsigned long written)
+{
+    channel->log_batch_head = channel->log_batch_tail = NULL;
+    channel->log_dirty = 1;
+    if (log_sync_mode == LOG_SYNC_BATCH && channel->log_fd != -1)
+    {
+        fdatasync(channel->log_fd);
+        channel->log_dirty = 0;
+    }
+    atomic_fetch_add(&channel->log_written, written);
+}
+
+/**
+ * Écrit tous les messages du lot d'un channel.
+ * @param channel Le channel.
+ */
+void write_channel_batch(Channel *channel)
+{
+    finish_channel_batch(channel, store_log_records(channel, channel->log_batch_head));
+}
+
+/**
+ * Écrit les lots de tous les channels touchés par io_uring : une écriture
+ * vectorisée (IORING_OP_WRITEV) par channel, jusqu'à URING_LOG_WRITES channels
+ * soumis et attendus en un seul io_uring_enter. Un channel n'a qu'une écriture en
+ * cours à la fois, ce qui garde l'ordre de ses enregistrements ; ce qui ne tient
+ * pas dans une écriture (segment plein, plus de IOV_MAX messages) part au tour suivant.
+ * @param touched Les channels touchés par le lot.
+ * @param writes URING_LOG_WRITES écritures.
+ */
+void write_channel_batches_uring(Channel *touched, LogWrite *writes)
+{
+    Channel *next_channel = touched;
+    while (1)
+    {
+        unsigned count = 0;
+        for (Channel *channel = next_channel; channel != NULL; channel = channel->log_batch_next)
+        {
+            if (channel->log_batch_head == NULL)
+            {
+                continue;
+            }
+            if (count == URING_LOG_WRITES)
+            {
+                break;
+            }
+            LogWrite *log_write = &writes[count];
+            channel->log_batch_stored += prepare_log_write(channel, &channel->log_batch_head, log_write);
+            if (log_write->count == 0)
+            {
+                continue;
+            }
+            struct io_uring_sqe *sqe = io_ring_get_sqe(log_ring);
+            if (sqe == NULL)
+            {
+                channel->log_batch_stored += finish_log_write(log_write, write_log_iov(log_write, 0));
+                continue;
+            }
+            // O_APPEND : le noyau écrit en fin de segment quelle que soit la position
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = channel->log_fd;
+            sqe->addr = (uint64_t)(uintptr_t)log_write->iov;
+            sqe->len = (unsigned)log_write->count;
+            sqe->user_data = count;
+            count++;
+        }
+        // Les channels déjà vidés ne sont plus parcourus
+        while (next_channel != NULL && next_channel->log_batch_head == NULL)
+        {
+            next_channel = next_channel->log_batch_next;
+        }
+
+        unsigned completed = 0;
+        while (completed < count)
+        {
+            if (io_ring_submit(log_ring, count - completed, -1) == -1)
+            {
+                perror("Erreur lors de io_uring_enter (journal)");
+                exit(EXIT_FAILURE);
+            }
+            struct io_uring_cqe cqe;
+            while (io_ring_next_cqe(log_ring, &cqe))
+            {
+                LogWrite *log_write = &writes[cqe.user_data];
+                size_t done = cqe.res > 0 ? (size_t)cqe.res : 0;
+                if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+                {
+                    fprintf(stderr, "Erreur lors de l'écriture du journal : %s\n", strerror(-cqe.res));
+                }
+                else if (done < log_write->total)
+                {
+                    done = write_log_iov(log_write, done); // Écriture partielle : le reste en synchrone
+                }
+                log_write->channel->log_batch_stored += finish_log_write(log_write, done);
+                completed++;
+            }
+        }
+        if (next_channel == NULL)
+        {
+            break;
+        }
+    }
+
+    for (Channel *channel = touched; channel != NULL; channel = channel->log_batch_next)
+    {
+        finish_channel_batch(channel, channel->log_batch_stored);
+        channel->log_batch_stored = 0;
+    }
+}
+
+/**
+ * Synchronise sur disque les segments actifs modifiés depuis la dernière synchronisation.
+ */
+void sync_dirty_logs()
+{
+    for (Channel *channel = atomic_load_explicit(&channel_list, memory_order_acquire); channel != NULL; channel = channel->next_created)
+    {
+        if (channel->log_dirty && channel->log_fd != -1)
+        {
+            fdatasync(channel->log_fd);
+            channel->log_dirty = 0;
+        }
+    }
+}
+
+/**
+ * Donne l'horodatage du dernier message d'un segment fermé, lu une seule fois en
+ * parcourant le segment depuis sa dernière entrée d'index (thread écrivain).
+ * @param channel Le channel.
+ * @param index La position du segment (pas le segment actif).
+ * @return L'horodatage, 0 si le segment est vide, -1 s'il est illisible (âge inconnu, relu au prochain passage).
+ */
+int64_t segment_last_time(Channel *channel, int index)
+{
+    SegmentInfo *segment = &channel->segments[index];
+    if (segment->last_time == 0 && segment->size > 0)
+    {
+        SegmentIndexEntry entry;
+        find_segment_index_entry(channel, segment->base, UINT64_MAX, &entry);
+        HistoryCursor *cursor = open_history_cursor(channel, entry.sequence, channel->segments[index + 1].base - 1);
+        if (cursor == NULL)
+        {
+            return -1;
+        }
+        RecordHeader header;
+        const char *sender;
+        const char *text;
+        int64_t last_time = 0;
+        int result;
+        while ((result = next_history_record(cursor, &header, &sender, &text)) == 1)
+        {
+            last_time = header.timestamp;
+        }
+        close_history_cursor(cursor);
+        if (result == -1 || last_time == 0)
+        {
+            return -1;
+        }
+        segment->last_time = last_time;
+    }
+    return segment->last_time;
+}
+
+/**
+ * Efface un segment fermé du journal d'un channel, avec son index et son index de recherche.
+ * @param channel Le channel.
+ * @param index La position du segment (pas le segment actif).
+ * @return La taille du segment effacé.
+ */
+off_t remove_segment(Channel *channel, int index)
+{
+    pthread_mutex_lock(&channel->segments_lock);
+    SegmentInfo removed = channel->segments[index];
+    memmove(channel->segments + index, channel->segments + index + 1, (size_t)(channel->segment_count - index - 1) * sizeof(SegmentInfo));
+    channel->segment_count--;
+    pthread_mutex_unlock(&channel->segments_lock);
+
+    // Un envoi d'historique en cours garde le segment ouvert : il reste lisible
+    char path[256];
+    get_segment_file_path(channel->name, removed.base, "log", path, sizeof(path));
+    unlink(path);
+    get_segment_file_path(channel->name, removed.base, "idx", path, sizeof(path));
+    unlink(path);
+    get_segment_file_path(channel->name, removed.base, "fts", path, sizeof(path));
+    unlink(path);
+    return removed.size;
+}
+
+/**
+ * Applique la rétention à tous les channels (thread écrivain) : tant que le
+ * journal d'un channel dépasse retention_bytes, son plus ancien segment est
+ * effacé ; puis chaque segment qui ne contient que des messages plus vieux que
+ * retention_age l'est aussi. Le segment actif n'est jamais effacé, ni par âge
+ * un segment illisible : il est gardé sans retenir les segments suivants, que
+ * les lectures d'historique atteignent en sautant les numéros manquants.
+ */
+void enforce_retention()
+{
+    time_t now = time(NULL);
+    for (Channel *channel = atomic_load_explicit(&channel_list, memory_order_acquire); channel != NULL; channel = channel->next_created)
+    {
+        off_t total = 0;
+        for (int i = 0; i < channel->segment_count; ++i)
+        {
+            total += channel->segments[i].size;
+        }
+        while (retention_bytes > 0 && total > retention_bytes && channel->segment_count > 1)
+        {
+            total -= remove_segment(channel, 0);
+        }
+
+        // Les segments sont dans l'ordre des messages : le premier assez récent arrête le parcours
+        int index = 0;
+        while (retention_age > 0 && index < channel->segment_count - 1)
+        {
+            int64_t last_time = segment_last_time(channel, index);
+            if (last_time == -1)
+            {
+                index++;
+                continue;
+            }
+            if (now - last_time <= retention_age)
+            {
+                break;
+            }
+            remove_segment(channel, index);
+        }
+    }
+}
+
+/**
+ * Thread écrivain du journal : prend d'un coup tous les messages soumis, les
+ * regroupe par channel et les écrit avec un writev par channel (ou ensemble par
+ * io_uring si log_ring est créé). Applique aussi
+ * la rétention, toutes les RETENTION_INTERVAL_MS.
+ * @param args Non utilisé.
+ * @return NULL.
+ */
+void *run_log_writer(void *args)
+{
+    (void)args;
+    struct timespec last_sync;
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+    struct timespec last_retention = last_sync;
+    int retention = retention_age > 0 || retention_bytes > 0;
+    long wake_interval_ms = log_sync_mode == LOG_SYNC_PERIODIC ? log_sync_interval_ms : 0;
+    if (retention && (wake_interval_ms == 0 || wake_interval_ms > RETENTION_INTERVAL_MS))
+    {
+        wake_interval_ms = RETENTION_INTERVAL_MS;
+    }
+    LogWrite *writes = NULL;
+    if (log_ring != NULL)
+    {
+        writes = malloc(URING_LOG_WRITES * sizeof(LogWrite));
+        if (writes == NULL)
+        {
+            // Sans mémoire pour les écritures en vol, le journal reste écrit par writev
+            io_ring_destroy(log_ring);
+            free(log_ring);
+            log_ring = NULL;
+        }
+    }
+
+    while (1)
+    {
+        pthread_mutex_lock(&log_queue_mutex);
+        while (log_queue_head == NULL)
+        {
+            log_writer_sleeping = 1;
+            if (wake_interval_ms > 0)
+            {
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += wake_interval_ms * 1000000L;
+                deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+                deadline.tv_nsec %= 1000000000L;
+                if (pthread_cond_timedwait(&log_queue_cond, &log_queue_mutex, &deadline) == ETIMEDOUT)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                pthread_cond_wait(&log_queue_cond, &log_queue_mutex);
+            }
+        }
+        log_writer_sleeping = 0;
+        LogRecord *record = log_queue_head;
+        log_queue_head = log_queue_tail = NULL;
+        pthread_mutex_unlock(&log_queue_mutex);
+
+        // Regrouper le lot par channel en conservant l'ordre de soumission
+        Channel *touched = NULL;
+        while (record != NULL)
+        {
+            LogRecord *next = record->next;
+            Channel *channel = record->channel;
+            record->next = NULL;
+            if (channel->log_batch_head == NULL)
+            {
+                channel->log_batch_head = record;
+                channel->log_batch_next = touched;
+                touched = channel;
+            }
+            else
+            {
+                channel->log_batch_tail->next = record;
+            }
+            channel->log_batch_tail = record;
+            record = next;
+        }
+
+        if (log_ring != NULL)
+        {
+            write_channel_batches_uring(touched, writes);
+        }
+        else
+        {
+            for (Channel *channel = touched; channel != NULL; channel = channel->log_batch_next)
+            {
+                write_channel_batch(channel);
+            }
+        }
+        if (touched != NULL)
+        {
+            pthread_mutex_lock(&log_queue_mutex);
+            pthread_cond_broadcast(&log_written_cond);
+            pthread_mutex_unlock(&log_queue_mutex);
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (log_sync_mode == LOG_SYNC_PERIODIC)
+        {
+            long elapsed_ms = (now.tv_sec - last_sync.tv_sec) * 1000L + (now.tv_nsec - last_sync.tv_nsec) / 1000000L;
+            if (elapsed_ms >= log_sync_interval_ms)
+            {
+                sync_dirty_logs();
+                last_sync = now;
+            }
+        }
+        if (retention)
+        {
+            long elapsed_ms = (now.tv_sec - last_retention.tv_sec) * 1000L + (now.tv_nsec - last_retention.tv_nsec) / 1000000L;
+            if (elapsed_ms >= RETENTION_INTERVAL_MS)
+            {
+                enforce_retention();
+                last_retention = now;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Compare deux segments par numéro de premier message (qsort).
+ * @param a Le premier segment.
+ * @param b Le second segment.
+ * @return Négatif, nul ou positif selon l'ordre.
+ */
+int compare_segments(const void *a, const void *b)
+{
+    uint64_t left = ((const SegmentInfo *)a)->base;
+    uint64_t right = ((const SegmentInfo *)b)->base;
+    return left < right ? -1 : left > right;
+}
+
+/**
+ * Liste les segments présents dans le dossier d'un channel, triés, avec leur taille.
+ * @param channel Le channel.
+ */
+void list_channel_segments(Channel *channel)
+{
+    char path[256];
+    get_channel_directory_path(channel->name, path, sizeof(path));
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        perror("Erreur lors de l'ouverture du dossier du channel");
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        unsigned long long base;
+        int consumed = 0;
+        if (sscanf(entry->d_name, "segment_%llu.log%n", &base, &consumed) != 1 || consumed != (int)strlen(entry->d_name))
+        {
+            continue;
+        }
+        if (channel->segment_count == channel->segment_capacity)
+        {
+            int capacity = channel->segment_capacity ? channel->segment_capacity * 2 : 8;
+            SegmentInfo *segments = realloc(channel->segments, (size_t)capacity * sizeof(SegmentInfo));
+            if (segments == NULL)
+            {
+                break;
+            }
+            channel->segments = segments;
+            channel->segment_capacity = capacity;
+        }
+        struct stat st;
+        get_segment_file_path(channel->name, base, "log", path, sizeof(path));
+        channel->segments[channel->segment_count++] = (SegmentInfo){.base = base, .size = stat(path, &st) == 0 ? st.st_size : 0, .last_time = 0};
+    }
+    closedir(dir);
+    qsort(channel->segments, (size_t)channel->segment_count, sizeof(SegmentInfo), compare_segments);
+}
+
+/**
+ * Reprend le segment actif d'un channel après un arrêt : lit ses enregistrements
+ * depuis la dernière entrée d'index valide, coupe ce qu'une écriture interrompue
+ * a laissé après le dernier enregistrement complet, puis le rouvre en ajout.
+ * @param channel Le channel.
+ */
+void recover_active_segment(Channel *channel)
+{
+    SegmentInfo *active = &channel->segments[channel->segment_count - 1];
+    char log_path[256];
+    char index_path[256];
+    get_segment_file_path(channel->name, active->base, "log", log_path, sizeof(log_path));
+    get_segment_file_path(channel->name, active->base, "idx", index_path, sizeof(index_path));
+    channel->log_fd = open(log_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    channel->log_index_fd = open(index_path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (channel->log_fd == -1 || channel->log_index_fd == -1)
+    {
+        perror("Erreur lors de l'ouverture du segment actif");
+        return;
+    }
+
+    // Écarter les entrées d'index qui désignent un enregistrement absent du segment
+    struct stat st;
+    off_t entries = fstat(channel->log_index_fd, &st) == 0 ? st.st_size / (off_t)sizeof(SegmentIndexEntry) : 0;
+    SegmentIndexEntry entry = {.sequence = active->base, .timestamp = 0, .offset = 0};
+    while (entries > 0)
+    {
+        RecordHeader header;
+        int fd = open(log_path, O_RDONLY | O_CLOEXEC);
+        int valid = pread(channel->log_index_fd, &entry, sizeof(entry), (entries - 1) * (off_t)sizeof(entry)) == (ssize_t)sizeof(entry) &&
+                    fd != -1 && pread(fd, &header, sizeof(header), (off_t)entry.offset) == (ssize_t)sizeof(header) &&
+                    header.sequence == entry.sequence;
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        if (valid)
+        {
+            break;
+        }
+        entries--;
+        entry = (SegmentIndexEntry){.sequence = active->base, .timestamp = 0, .offset = 0};
+    }
+    if (ftruncate(channel->log_index_fd, entries * (off_t)sizeof(SegmentIndexEntry)) == -1)
+    {
+        perror("Erreur lors de la reprise de l'index");
+    }
+
+    HistoryCursor *cursor = open_history_cursor(channel, entry.sequence, UINT64_MAX);
+    if (cursor == NULL)
+    {
+        return;
+    }
+    RecordHeader header;
+    const char *sender;
+    const char *text;
+    while (next_history_record(cursor, &header, &sender, &text) == 1)
+    {
+        active->last_time = header.timestamp;
+    }
+    channel->last_sequence = cursor->next - 1;
+    off_t end = cursor->fd != -1 ? cursor->position : active->size;
+    close_history_cursor(cursor);
+
+    if (end < active->size)
+    {
+        printf("Channel '%s' : %lld octets incomplets retirés de la fin du journal\n", channel->name, (long long)(active->size - end));
+        if (ftruncate(channel->log_fd, end) == -1)
+        {
+            perror("Erreur lors de la reprise du journal");
+        }
+        active->size = end;
+    }
+}
+
+/**
+ * Importe l'ancien fichier texte d'un channel (une ligne par message) dans son
+ * premier segment, puis le supprime avec son index. Chaque ligne devient une
+ * notification datée du fichier ; les numéros de message (/history #K) sont conservés.
+ * @param channel Le channel.
+ * @return 0 si un ancien fichier a été importé, -1 s'il n'y en a pas.
+ */
+int import_legacy_history(Channel *channel)
+{
+    char path[256];
+    get_storage_file_path(channel->name, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    struct stat st;
+    int64_t timestamp = fstat(fileno(file), &st) == 0 ? (int64_t)st.st_mtime : (int64_t)time(NULL);
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    LogRecord *head = NULL;
+    LogRecord *tail = NULL;
+    int pending = 0;
+    while ((length = getline(&line, &capacity, file)) != -1)
+    {
+        if (length > 0 && line[length - 1] == '\n')
+        {
+            length--;
+        }
+        LogRecord *record = create_log_record(channel, channel->last_sequence + 1, timestamp, "", line, (size_t)length);
+        if (record == NULL)
+        {
+            break;
+        }
+        channel->last_sequence++;
+        if (tail != NULL)
+        {
+            tail->next = record;
+        }
+        else
+        {
+            head = record;
+        }
+        tail = record;
+        if (++pending == IOV_MAX)
+        {
+            store_log_records(channel, head);
+            head = tail = NULL;
+            pending = 0;
+        }
+    }
+    store_log_records(channel, head);
+    free(line);
+    fclose(file);
+
+    // L'ancien fichier n'est supprimé qu'une fois tout son contenu sur disque
+    if (channel->last_sequence > 0 && atomic_load(&channel->last_stored) != channel->last_sequence)
+    {
+        fprintf(stderr, "Channel '%s' : import de l'ancien historique incomplet, fichier conservé\n", channel->name);
+        return 0;
+    }
+    if (channel->log_fd != -1)
+    {
+        fdatasync(channel->log_fd);
+    }
+    unlink(path);
+    get_index_file_path(channel->name, path, sizeof(path));
+    unlink(path);
+    if (channel->last_sequence == 0)
+    {
+        return -1; // Fichier vide : le channel reçoit son message de bienvenue
+    }
+    printf("Channel '%s' : %llu lignes importées de l'ancien fichier texte\n", channel->name, (unsigned long long)channel->last_sequence);
+    return 0;
+}
+
+/**
+ * Écrit le message de bienvenue, premier message d'un nouveau channel.
+ * @param channel Le channel.
+ */
+void write_welcome_message(Channel *channel)
+{
+    char text[BUFFER_SIZE];
+    int length = snprintf(text, sizeof(text), "Bienvenue dans le channel '%s' !", channel->name);
+    LogRecord *record = create_log_record(channel, 1, (int64_t)time(NULL), "", text, (size_t)length);
+    if (record != NULL)
+    {
+        channel->last_sequence = 1;
+        store_log_records(channel, record);
+    }
+}
+
+/**
+ * Ouvre le journal segmenté d'un channel : liste ses segments et reprend le
+ * segment actif, ou crée le premier segment d'un nouveau channel (message de
+ * bienvenue, ou lignes de l'ancien fichier texte). Seuls le dossier et la fin du
+ * dernier segment sont lus, quel que soit l'âge du channel. Appelé à la création
+ * du channel, avant que l'écrivain ne puisse le voir.
+ * @param channel Le channel.
+ */
+void open_channel_log(Channel *channel)
+{
+    list_channel_segments(channel);
+    if (channel->segment_count > 0)
+    {
+        recover_active_segment(channel);
+    }
+    else if (import_legacy_history(channel) == -1)
+    {
+        write_welcome_message(channel);
+    }
+    // Les numéros de séquence reprennent après le dernier message du journal
+    atomic_store(&channel->last_stored, channel->last_sequence);
+}
+
+/**
+ * Ajoute une ligne à l'historique récent d'un channel, en écrasant la plus ancienne si l'anneau est plein.
+ * @param channel Le channel.
+ * @param sequence Le numéro du message (0 si inconnu).
+ * @param line La ligne formatée.
+ * @param length La taille de la ligne.
+ */
+void append_recent_history(Channel *channel, uint64_t sequence, const char *line, size_t length)
+{
+    pthread_mutex_lock(&channel->history_lock);
+    if (channel->history == NULL)
+    {
+        channel->history = calloc((size_t)history_lines, sizeof(HistoryLine));
+        if (channel->history == NULL)
+        {
+            pthread_mutex_unlock(&channel->history_lock);
+            return;
+        }
+    }
+
+    HistoryLine *slot;
+    if (channel->history_count < history_lines)
+    {
+        slot = &channel->history[(channel->history_start + channel->history_count) % history_lines];
+        channel->history_count++;
+    }
+    else
+    {
+        slot = &channel->history[channel->history_start];
+        channel->history_start = (channel->history_start + 1) % history_lines;
+        channel->history_bytes -= slot->length;
+    }
+
+    if (slot->capacity < length)
+    {
+        char *data = realloc(slot->data, length);
+        if (data == NULL)
+        {
+            slot->length = 0;
+            pthread_mutex_unlock(&channel->history_lock);
+            return;
+        }
+        slot->data = data;
+        slot->capacity = length;
+    }
+    memcpy(slot->data, line, length);
+    slot->length = length;
+    slot->sequence = sequence;
+    channel->history_bytes += length;
+    pthread_mutex_unlock(&channel->history_lock);
+}
+
+/**
+ * Copie l'historique récent d'un channel dans un seul buffer, pour le rejouer en un envoi.
+ * FRAME_HEADER_SIZE octets sont réservés en tête pour l'en-tête d'un client tramé.
+ * @param channel Le channel.
+ * @param length Reçoit la taille de l'historique (sans la réserve d'en-tête).
+ * @param first_sequence Reçoit le numéro du plus ancien message copié (0 si aucun),
+ *                       point de départ de /more.
+ * @return Le buffer alloué (à libérer par l'appelant), ou NULL si l'historique est vide.
+ */
+char *copy_recent_history(Channel *channel, size_t *length, uint64_t *first_sequence)
+{
+    *length = 0;
+    *first_sequence = 0;
+    pthread_mutex_lock(&channel->history_lock);
+    char *content = channel->history_bytes > 0 ? malloc(FRAME_HEADER_SIZE + channel->history_bytes) : NULL;
+    if (content != NULL)
+    {
+        for (int i = 0; i < channel->history_count; ++i)
+        {
+            HistoryLine *line = &channel->history[(channel->history_start + i) % history_lines];
+            memcpy(content + FRAME_HEADER_SIZE + *length, line->data, line->length);
+            *length += line->length;
+            // Deux expéditeurs concurrents peuvent ajouter leurs lignes dans le désordre : garder le plus petit
+            if (line->sequence != 0 && (*first_sequence == 0 || line->sequence < *first_sequence))
+            {
+                *first_sequence = line->sequence;
+            }
+        }
+    }
+    pthread_mutex_unlock(&channel->history_lock);
+    return content;
+}
+
+/**
+ * Remplit l'historique récent d'un channel avec ses derniers messages. Grâce à
+ * l'index clairsemé, seule la fin du journal est lue (history_lines messages au plus).
+ * @param channel Le channel.
+ */
+void seed_recent_history(Channel *channel)
+{
+    uint64_t last = channel->last_sequence;
+    if (last == 0)
+    {
+        return;
+    }
+    uint64_t first = last > (uint64_t)history_lines ? last - (uint64_t)history_lines + 1 : 1;
+    HistoryCursor *cursor = open_history_cursor(channel, first, last);
+    if (cursor == NULL)
+    {
+        return;
+    }
+
+    char line[RECORD_MAX_TEXT + 1];
+    RecordHeader header;
+    const char *sender;
+    const char *text;
+    while (next_history_record(cursor, &header, &sender, &text) == 1)
+    {
+        append_recent_history(channel, header.sequence, line, format_history_record(channel, &header, sender, text, line, sizeof(line)));
+    }
+    close_history_cursor(cursor);
+}
+
+/**
+ * Formate un message et le confie à l'écrivain du journal du channel.
+ * @param channel Le channel.
+ * @param sender Le nom de l'expéditeur.
+ * @param message Le message à logger.
+ * @param formatted_message Le buffer qui reçoit le message formaté.
+ * @param formatted_size La taille du buffer.
+ * @param sequence Reçoit le numéro du message dans l'historique du channel.
+ * @return 0 en cas de succès, -1 si le message n'a pas pu être soumis.
+ */
+int log_message(Channel *channel, const char *sender, const char *message, char *formatted_message, size_t formatted_size, uint64_t *sequence)
+{
+    // Le journal garde l'expéditeur et le message bruts : la ligne est reformatée à l'identique à la relecture
+    time_t now = time(NULL);
+    size_t length = format_chat_line(channel, now, sender, strlen(sender), message, strlen(message), formatted_message, formatted_size);
+
+    uint64_t number = 0;
+    if (submit_log_record(channel, (int64_t)now, sender, message, &number) == -1)
+    {
+        // Rien n'est mis dans l'historique récent : /history ne doit pas montrer un message absent du journal
+        return -1;
+    }
+    append_recent_history(channel, number, formatted_message, length);
+    atomic_fetch_add_explicit(&channel->message_count, 1, memory_order_relaxed);
+    metric_add(METRIC_MESSAGES, 1);
+    if (sequence != NULL)
+    {
+        *sequence = number;
+    }
+    return 0;
+}
+
+/**
+ * Calcule les messages demandés par /history : tout l'historique conservé
+ * (argument vide), les N derniers ("N") ou ceux depuis le numéro K inclus
+ * ("#K", 1 = premier message du channel). Les messages déjà effacés par la
+ * rétention sont sautés.
+ * @param channel Le channel.
+ * @param argument Ce qui suit "/history".
+ * @param first Reçoit le premier message.
+ * @param last Reçoit le dernier message (inclus).
+ * @return 1 s'il y a des messages à envoyer, 0 sinon.
+ */
+int resolve_history_range(Channel *channel, const char *argument, uint64_t *first, uint64_t *last)
+{
+    // Les messages encore chez l'écrivain doivent être dans le journal
+    wait_for_log_flush(channel);
+    *last = atomic_load(&channel->last_stored);
+
+    pthread_mutex_lock(&channel->segments_lock);
+    *first = channel->segment_count > 0 ? channel->segments[0].base : *last + 1;
+    pthread_mutex_unlock(&channel->segments_lock);
+
+    while (*argument == ' ')
+    {
+        argument++;
+    }
+    if (*argument == '#')
+    {
+        uint64_t from = strtoull(argument + 1, NULL, 10);
+        if (from > *first)
+        {
+            *first = from;
+        }
+    }
+    else if (*argument != '\0')
+    {
+        uint64_t count = strtoull(argument, NULL, 10);
+        if (count == 0)
+        {
+            return 0;
+        }
+        if (count < *last && *last - count + 1 > *first)
+        {
+            *first = *last - count + 1;
+        }
+    }
+    return *first >= 1 && *first <= *last;
+}
+
+/**
+ * Calcule la page de /more : les history_lines messages qui précèdent le plus
+ * ancien message déjà reçu par le client, sans remonter avant le plus ancien
+ * segment conservé.
+ * @param channel Le channel.
+ * @param cursor Le plus ancien message déjà reçu (0 si aucun).
+ * @param first Reçoit le premier message de la page.
+ * @param last Reçoit le dernier message de la page (inclus).
+ * @return 1 s'il y a une page à envoyer, 0 si le début de l'historique est atteint.
+ */
+int resolve_older_page(Channel *channel, uint64_t cursor, uint64_t *first, uint64_t *last)
+{
+    // Les messages de la page peuvent encore être chez l'écrivain
+    wait_for_log_flush(channel);
+
+    pthread_mutex_lock(&channel->segments_lock);
+    uint64_t oldest = channel->segment_count > 0 ? channel->segments[0].base : 0;
+    pthread_mutex_unlock(&channel->segments_lock);
+
+    if (cursor <= 1 || oldest == 0 || cursor <= oldest)
+    {
+        return 0;
+    }
+    *last = cursor - 1;
+    *first = *last >= (uint64_t)history_lines ? *last - (uint64_t)history_lines + 1 : 1;
+    if (*first < oldest)
+    {
+        *first = oldest;
+    }
+    return 1;
+}
+
+/**
+ * Formate l'avis qui précède une page de /more, ou signale le début de l'historique.
+ * @param channel Le channel.
+ * @param found 1 si une page suit, 0 sinon.
+ * @param first Le premier message de la page.
+ * @param last Le dernier message de la page.
+ * @param buffer Le buffer de sortie.
+ * @param buffer_size La taille du buffer.
+ */
+void format_page_notice(Channel *channel, int found, uint64_t first, uint64_t last, char *buffer, size_t buffer_size)
+{
+    if (found)
+    {
+        snprintf(buffer, buffer_size, "--- Messages n°%llu à %llu du channel '%s' ---\n", (unsigned long long)first, (unsigned long long)last, channel->name);
+    }
+    else
+    {
+        snprintf(buffer, buffer_size, "--- Début de l'historique du channel '%s' ---\n", channel->name);
+    }
+}
+
+/**
+ * Envoie à un client la page d'historique qui précède ce qu'il a déjà reçu (commande /more).
+ * @param client Le client.
+ * @param sub Son abonnement au channel courant.
+ */
+void send_older_page_to_client(ClientHandle *client, Subscription *sub)
+{
+    Channel *channel = sub->channel;
+    uint64_t first = 0, last = 0;
+    uint64_t started = monotonic_ns();
+    int found = resolve_older_page(channel, sub->history_cursor, &first, &last);
+
+    char notice[BUFFER_SIZE];
+    format_page_notice(channel, found, first, last, notice, sizeof(notice));
+    send_message_to_client(client, FRAME_NOTICE, channel, notice);
+    if (!found)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    if (!client->evicted)
+    {
+        outbound_send_history(&client->queue, client->socket, channel, first, last);
+    }
+    pthread_mutex_unlock(&client->lock);
+    sub->history_cursor = first;
+    metric_add(METRIC_HISTORY_REQUESTS, 1);
+    metric_record_since(HISTOGRAM_HISTORY, started);
+}
+
+/**
+ * Envoie à un client une plage de l'historique de son channel (commande /history).
+ * La plage est mise en file et lue sur disque par tranches, au rythme du client.
+ * @param client Le client.
+ * @param channel Le channel.
+ * @param argument Ce qui suit "/history".
+ */
+void send_history_to_client(ClientHandle *client, Channel *channel, const char *argument)
+{
+    uint64_t first, last;
+    uint64_t started = monotonic_ns();
+    if (!resolve_history_range(channel, argument, &first, &last))
+    {
+        return;
+    }
+
+    // Appelé depuis le thread du client : il surveillera POLLOUT tant que la file n'est pas vide
+    pthread_mutex_lock(&client->lock);
+    if (!client->evicted)
+    {
+        outbound_send_history(&client->queue, client->socket, channel, first, last);
+    }
+    pthread_mutex_unlock(&client->lock);
+    metric_add(METRIC_HISTORY_REQUESTS, 1);
+    metric_record_since(HISTOGRAM_HISTORY, started);
+}
+
+/**
+ * Calcule le hachage FNV-1a d'un nom de channel.
+ * @param name Le nom.
+ * @return Le hachage.
+ */
+uint32_t hash_channel_name(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; ++c)
+    {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Cherche un channel dans la table. Doit être appelé avec mutex verrouillé.
+ * @param channel_name Le nom du channel.
+ * @param hash Le hachage du nom.
+ * @return L'emplacement du channel, ou l'emplacement libre où l'insérer.
+ */
+Channel **lookup_channel_slot(const char *channel_name, uint32_t hash)
+{
+    size_t mask = channel_table_capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        Channel *channel = channel_table[i];
+        if (channel == NULL || (channel->name_hash == hash && strcmp(channel->name, channel_name) == 0))
+        {
+            return &channel_table[i];
+        }
+    }
+}
+
+/**
+ * Double la capacité de la table des channels (ou la crée). Doit être appelé avec mutex verrouillé.
+ * @return 0 en cas de succès, -1 si l'allocation échoue.
+ */
+int grow_channel_table()
+{
+    size_t capacity = channel_table_capacity ? channel_table_capacity * 2 : CHANNEL_TABLE_INITIAL_CAPACITY;
+    Channel **table = calloc(capacity, sizeof(Channel *));
+    if (table == NULL)
+    {
+        return -1;
+    }
+    Channel **old_table = channel_table;
+    size_t old_capacity = channel_table_capacity;
+    channel_table = table;
+    channel_table_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i)
+    {
+        if (old_table[i] != NULL)
+        {
+            *lookup_channel_slot(old_table[i]->name, old_table[i]->name_hash) = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+/**
+ * Alloue et initialise un channel, sans toucher au disque ni à la table.
+ * @param channel_name Le nom du channel.
+ * @param hash Le hachage du nom.
+ * @return Le channel, ou NULL si la mémoire manque.
+ */
+Channel *allocate_channel(const char *channel_name, uint32_t hash)
+{
+    Channel *channel = calloc(1, sizeof(Channel));
+    if (channel != NULL)
+    {
+        channel->shard_counts = calloc((size_t)reactor_count, sizeof(int));
+        channel->local_members = calloc((size_t)reactor_count, sizeof(Subscription *));
+    }
+    if (channel == NULL || channel->shard_counts == NULL || channel->local_members == NULL)
+    {
+        if (channel != NULL)
+        {
+            free(channel->shard_counts);
+            free(channel->local_members);
+            free(channel);
+        }
+        return NULL;
+    }
+
+    strncpy(channel->name, channel_name, sizeof(channel->name) - 1);
+    channel->name[sizeof(channel->name) - 1] = '\0';
+    channel->name_hash = hash;
+    atomic_init(&channel->client_count, 0);
+    channel->log_fd = -1;
+    channel->log_index_fd = -1;
+    pthread_mutex_init(&channel->lock, NULL);
+    pthread_mutex_init(&channel->history_lock, NULL);
+    pthread_mutex_init(&channel->segments_lock, NULL);
+    pthread_mutex_init(&channel->search_lock, NULL);
+    pthread_mutex_init(&channel->load_lock, NULL);
+    return channel;
+}
+
+/**
+ * Range un channel dans la table et la liste des channels. Doit être appelé avec
+ * mutex verrouillé, la table ayant de la place.
+ * @param channel Le channel.
+ * @param slot Son emplacement libre dans la table.
+ */
+void register_channel(Channel *channel, Channel **slot)
+{
+    channel->id = (uint32_t)channel_count + 1;
+    channel->owner = channel_count % reactor_count; // Répartition des channels entre réacteurs
+    *slot = channel;
+    channel_count++;
+    channel->next_created = atomic_load_explicit(&channel_list, memory_order_relaxed);
+    atomic_store_explicit(&channel_list, channel, memory_order_release);
+}
+
+/**
+ * Relit dans le journal les messages qui manquent à l'index du segment actif
+ * (thread d'indexation), par lots de SEARCH_CATCH_UP_BATCH sous search_lock.
+ * Le thread écrivain reprend la main dès que l'index rejoint last_stored.
+ * @param channel Le channel.
+ */
+void catch_up_search_index(Channel *channel)
+{
+    while (1)
+    {
+        pthread_mutex_lock(&channel->search_lock);
+        SearchIndex *index = channel->search;
+        uint64_t last = atomic_load(&channel->last_stored);
+        if (index == NULL || index->next > last)
+        {
+            channel->search_catch_up = 0;
+            pthread_mutex_unlock(&channel->search_lock);
+            return;
+        }
+        uint64_t base = index->base;
+        HistoryCursor *cursor = open_history_cursor(channel, index->next, last);
+        if (cursor == NULL)
+        {
+            channel->search_catch_up = 0;
+            pthread_mutex_unlock(&channel->search_lock);
+            return;
+        }
+        pthread_mutex_unlock(&channel->search_lock);
+
+        int result = 1;
+        while (result == 1)
+        {
+            pthread_mutex_lock(&channel->search_lock);
+            // Rotation entre deux lots : l'index a été fermé, recommencer avec le nouveau
+            if (channel->search != index || index->base != base)
+            {
+                pthread_mutex_unlock(&channel->search_lock);
+                break;
+            }
+            RecordHeader header;
+            const char *sender;
+            const char *text;
+            for (int i = 0; i < SEARCH_CATCH_UP_BATCH && (result = next_history_record(cursor, &header, &sender, &text)) == 1; ++i)
+            {
+                if (header.sequence > index->next)
+                {
+                    index->next = header.sequence; // Messages perdus avant celui-ci
+                }
+                index_search_record(index, &header, text);
+            }
+            if (result != 1 && index->next <= last)
+            {
+                index->next = last + 1; // Fin de la plage absente du journal
+            }
+            pthread_mutex_unlock(&channel->search_lock);
+        }
+        close_history_cursor(cursor);
+    }
+}
+
+/**
+ * Reconstruit depuis le journal l'index d'un segment fermé.
+ * @param channel Le channel.
+ * @param base Le numéro du premier message du segment.
+ * @return L'index, ou NULL si le segment n'existe plus ou si la mémoire manque.
+ */
+SearchIndex *build_search_index(Channel *channel, uint64_t base)
+{
+    uint64_t end = 0;
+    pthread_mutex_lock(&channel->segments_lock);
+    for (int i = 0; i + 1 < channel->segment_count; ++i)
+    {
+        if (channel->segments[i].base == base)
+        {
+            end = channel->segments[i + 1].base;
+        }
+    }
+    pthread_mutex_unlock(&channel->segments_lock);
+    if (end == 0)
+    {
+        return NULL;
+    }
+
+    SearchIndex *index = create_search_index(base);
+    HistoryCursor *cursor = index != NULL ? open_history_cursor(channel, base, end - 1) : NULL;
+    if (cursor == NULL)
+    {
+        free_search_index(index);
+        return NULL;
+    }
+    RecordHeader header;
+    const char *sender;
+    const char *text;
+    while (next_history_record(cursor, &header, &sender, &text) == 1)
+    {
+        if (header.sequence > index->next)
+        {
+            index->next = header.sequence;
+        }
+        index_search_record(index, &header, text);
+    }
+    close_history_cursor(cursor);
+    index->next = end;
+    return index;
+}
+
+/**
+ * Compare deux termes octet par octet (ordre des fichiers .fts).
+ * @return Négatif, nul ou positif, comme memcmp.
+ */
+int compare_term_bytes(const char *a, size_t a_length, const char *b, size_t b_length)
+{
+    int order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+    return order != 0 ? order : (a_length > b_length) - (a_length < b_length);
+}
+
+/**
+ * Compare deux termes d'un index en mémoire (qsort).
+ */
+int compare_search_terms(const void *a, const void *b)
+{
+    const SearchTerm *x = *(SearchTerm *const *)a;
+    const SearchTerm *y = *(SearchTerm *const *)b;
+    return compare_term_bytes(x->term, x->term_length, y->term, y->term_length);
+}
+
+/**
+ * Écrit l'index d'un segment fermé dans segment_<base>.fts, par un fichier
+ * temporaire synchronisé puis renommé une fois complet, le dossier étant
+ * synchronisé ensuite : après un arrêt brutal, le fichier est complet ou absent.
+ * Il n'est gardé que si le segment existe encore (la rétention efface les deux
+ * ensemble). Libère l'index.
+ * @param channel Le channel.
+ * @param index L'index complet du segment.
+ */
+void write_search_file(Channel *channel, SearchIndex *index)
+{
+    SearchTerm **terms = malloc((index->term_count > 0 ? index->term_count : 1) * sizeof(SearchTerm *));
+    if (terms == NULL)
+    {
+        free_search_index(index);
+        return;
+    }
+    size_t count = 0;
+    size_t names_size = 0;
+    size_t postings_size = 0;
+    for (size_t i = 0; i < index->bucket_count; ++i)
+    {
+        for (SearchTerm *term = index->buckets[i]; term != NULL; term = term->next)
+        {
+            if (term->count > 0)
+            {
+                terms[count++] = term;
+                names_size += term->term_length;
+                postings_size += term->length;
+            }
+        }
+    }
+    qsort(terms, count, sizeof(SearchTerm *), compare_search_terms);
+
+    size_t names_offset = sizeof(SearchFileHeader) + count * sizeof(SearchFileTerm);
+    size_t size = names_offset + names_size + postings_size;
+    char *data = calloc(1, size);
+    if (data != NULL)
+    {
+        SearchFileHeader *header = (SearchFileHeader *)data;
+        memcpy(header->magic, "MCPS", 4);
+        header->version = SEARCH_FILE_VERSION;
+        header->base = index->base;
+        header->next = index->next;
+        header->term_count = (uint32_t)count;
+        SearchFileTerm *entries = (SearchFileTerm *)(data + sizeof(SearchFileHeader));
+        size_t name = names_offset;
+        size_t postings = names_offset + names_size;
+        for (size_t i = 0; i < count; ++i)
+        {
+            entries[i] = (SearchFileTerm){.postings_offset = postings, .postings_length = terms[i]->length, .count = terms[i]->count,
+                                          .term_offset = (uint32_t)name, .term_length = terms[i]->term_length};
+            memcpy(data + name, terms[i]->term, terms[i]->term_length);
+            memcpy(data + postings, terms[i]->postings, terms[i]->length);
+            name += terms[i]->term_length;
+            postings += terms[i]->length;
+        }
+
+        // Un fichier temporaire par processus : l'ancien et le nouveau peuvent indexer ensemble (mise à jour à chaud)
+        char extension[32];
+        char temporary[256];
+        char path[256];
+        snprintf(extension, sizeof(extension), "fts.%d.tmp", (int)getpid());
+        get_segment_file_path(channel->name, index->base, extension, temporary, sizeof(temporary));
+        get_segment_file_path(channel->name, index->base, "fts", path, sizeof(path));
+        int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        size_t written = 0;
+        while (fd != -1 && written < size)
+        {
+            ssize_t result = write(fd, data + written, size - written);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (result <= 0)
+            {
+                break;
+            }
+            written += (size_t)result;
+        }
+        if (fd != -1)
+        {
+            if (written == size && fsync(fd) == -1)
+            {
+                perror("Erreur lors de la synchronisation de l'index de recherche");
+                written = 0;
+            }
+            close(fd);
+        }
+
+        int kept = 0;
+        pthread_mutex_lock(&channel->segments_lock);
+        for (int i = 0; i < channel->segment_count && written == size; ++i)
+        {
+            kept = kept || channel->segments[i].base == index->base;
+        }
+        if (kept && rename(temporary, path) == -1)
+        {
+            perror("Erreur lors de l'écriture de l'index de recherche");
+            kept = 0;
+        }
+        pthread_mutex_unlock(&channel->segments_lock);
+        if (!kept)
+        {
+            unlink(temporary);
+        }
+        else
+        {
+            // Le renommage lui-même doit survivre à un arrêt brutal
+            char directory[256];
+            get_channel_directory_path(channel->name, directory, sizeof(directory));
+            int directory_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (directory_fd != -1)
+            {
+                fsync(directory_fd);
+                close(directory_fd);
+            }
+        }
+        free(data);
+    }
+    free(terms);
+    free_search_index(index);
+}
+
+/**
+ * Thread d'indexation : écrit les index des segments fermés et reconstruit
+ * ceux qui manquent, hors du thread écrivain et des threads des clients.
+ * @param args Non utilisé.
+ * @return NULL.
+ */
+void *run_search_indexer(void *args)
+{
+    (void)args;
+    while (1)
+    {
+        pthread_mutex_lock(&search_jobs_mutex);
+        while (search_jobs_head == NULL)
+        {
+            pthread_cond_wait(&search_jobs_cond, &search_jobs_mutex);
+        }
+        SearchJob *job = search_jobs_head;
+        search_jobs_head = job->next;
+        if (search_jobs_head == NULL)
+        {
+            search_jobs_tail = NULL;
+        }
+        pthread_mutex_unlock(&search_jobs_mutex);
+
+        if (job->catch_up)
+        {
+            catch_up_search_index(job->channel);
+        }
+        else
+        {
+            SearchIndex *index = job->index != NULL ? job->index : build_search_index(job->channel, job->base);
+            if (index != NULL)
+            {
+                write_search_file(job->channel, index);
+            }
+        }
+        free(job);
+    }
+    return NULL;
+}
+
+/**
+ * Prépare la recherche dans un channel qui vient d'être chargé. L'index du
+ * segment actif est rebâti depuis le journal. Les segments fermés sans fichier
+ * .fts (journal d'une version précédente, arrêt avant son écriture) sont
+ * réindexés. Les deux sont faits par le thread d'indexation.
+ * @param channel Le channel.
+ */
+void open_search_index(Channel *channel)
+{
+    pthread_mutex_lock(&channel->segments_lock);
+    int count = channel->segment_count;
+    uint64_t *bases = count > 0 ? malloc((size_t)count * sizeof(uint64_t)) : NULL;
+    for (int i = 0; bases != NULL && i < count; ++i)
+    {
+        bases[i] = channel->segments[i].base;
+    }
+    pthread_mutex_unlock(&channel->segments_lock);
+    if (bases == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < count - 1; ++i)
+    {
+        char path[256];
+        get_segment_file_path(channel->name, bases[i], "fts", path, sizeof(path));
+        if (access(path, F_OK) == -1)
+        {
+            post_search_job(channel, 0, bases[i], NULL);
+        }
+    }
+    pthread_mutex_lock(&channel->search_lock);
+    channel->search = create_search_index(bases[count - 1]);
+    if (channel->search != NULL)
+    {
+        channel->search_catch_up = 1;
+        post_search_job(channel, 1, 0, NULL);
+    }
+    pthread_mutex_unlock(&channel->search_lock);
+    free(bases);
+}
+
+/**
+ * Décode une liste de messages d'un index.
+ * @param data La liste codée.
+ * @param length Sa taille.
+ * @param count Le nombre de messages.
+ * @param base La base du segment.
+ * @return Les numéros croissants (à libérer), ou NULL si la mémoire manque ou si la liste est invalide.
+ */
+uint64_t *decode_search_postings(const uint8_t *data, size_t length, uint32_t count, uint64_t base)
+{
+    uint64_t *sequences = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    if (sequences == NULL)
+    {
+        return NULL;
+    }
+    size_t position = 0;
+    uint64_t sequence = base;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint64_t gap = 0;
+        int shift = 0;
+        do
+        {
+            if (position == length || shift > 63)
+            {
+                free(sequences);
+                return NULL;
+            }
+            gap |= (uint64_t)(data[position] & 0x7f) << shift;
+            shift += 7;
+        } while (data[position++] & 0x80);
+        sequence += gap;
+        sequences[i] = sequence;
+    }
+    return sequences;
+}
+
+/**
+ * Indique si une liste croissante contient un numéro (dichotomie).
+ * @return 1 si oui, 0 sinon.
+ */
+int contains_sequence(const uint64_t *sequences, uint32_t count, uint64_t sequence)
+{
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (sequences[middle] < sequence)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low < count && sequences[low] == sequence;
+}
+
+/**
+ * Ajoute aux résultats d'une recherche les messages d'un segment qui
+ * contiennent tous ses termes, du plus récent au plus ancien : la plus courte
+ * des listes est parcourue à rebours, la présence dans les autres vérifiée par dichotomie.
+ * @param query La recherche.
+ * @param postings La liste codée de chaque terme.
+ * @param lengths Leurs tailles.
+ * @param counts Leurs nombres de messages.
+ * @param base La base du segment.
+ * @param bound Les messages à partir de celui-ci sont ignorés (déjà cherchés ailleurs).
+ */
+void collect_search_postings(SearchQuery *query, const uint8_t **postings, const size_t *lengths, const uint32_t *counts, uint64_t base, uint64_t bound)
+{
+    uint64_t *lists[SEARCH_MAX_TERMS] = {0};
+    int shortest = 0;
+    int decoded = 1;
+    for (int t = 0; t < query->term_count; ++t)
+    {
+        lists[t] = decode_search_postings(postings[t], lengths[t], counts[t], base);
+        decoded = decoded && lists[t] != NULL;
+        shortest = counts[t] < counts[shortest] ? t : shortest;
+    }
+    for (uint32_t k = decoded ? counts[shortest] : 0; k > 0 && query->result_count < SEARCH_MAX_RESULTS; --k)
+    {
+        uint64_t sequence = lists[shortest][k - 1];
+        int found = sequence < bound;
+        for (int t = 0; t < query->term_count && found; ++t)
+        {
+            found = t == shortest || contains_sequence(lists[t], counts[t], sequence);
+        }
+        if (found)
+        {
+            query->results[query->result_count++] = sequence;
+        }
+    }
+    for (int t = 0; t < query->term_count; ++t)
+    {
+        free(lists[t]);
+    }
+}
+
+/**
+ * Cherche dans l'index en mémoire du segment actif (search_lock tenu).
+ * @param query La recherche.
+ * @param index L'index.
+ * @param bound Les messages à partir de celui-ci sont ignorés.
+ */
+void search_memory_index(SearchQuery *query, const SearchIndex *index, uint64_t bound)
+{
+    const uint8_t *postings[SEARCH_MAX_TERMS];
+    size_t lengths[SEARCH_MAX_TERMS];
+    uint32_t counts[SEARCH_MAX_TERMS];
+    for (int t = 0; t < query->term_count; ++t)
+    {
+        SearchTerm *term = find_search_term(index, query->terms[t], query->lengths[t]);
+        if (term == NULL || term->count == 0)
+        {
+            return; // Un terme absent du segment : aucun message ne les contient tous
+        }
+        postings[t] = term->postings;
+        lengths[t] = term->length;
+        counts[t] = term->count;
+    }
+    collect_search_postings(query, postings, lengths, counts, index->base, bound);
+}
+
+/**
+ * Cherche dans le fichier .fts d'un segment fermé, projeté en mémoire.
+ * @param query La recherche.
+ * @param channel Le channel.
+ * @param base La base du segment.
+ * @return 0 si le fichier a été lu, -1 s'il manque ou s'il est invalide.
+ */
+int search_segment_file(SearchQuery *query, Channel *channel, uint64_t base)
+{
+    char path[256];
+    get_segment_file_path(channel->name, base, "fts", path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(SearchFileHeader))
+    {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    const SearchFileHeader *header = (const SearchFileHeader *)map;
+    const SearchFileTerm *entries = (const SearchFileTerm *)(map + sizeof(SearchFileHeader));
+    int valid = memcmp(header->magic, "MCPS", 4) == 0 && header->version == SEARCH_FILE_VERSION && header->base == base &&
+                header->term_count <= (size - sizeof(SearchFileHeader)) / sizeof(SearchFileTerm);
+    const uint8_t *postings[SEARCH_MAX_TERMS];
+    size_t lengths[SEARCH_MAX_TERMS];
+    uint32_t counts[SEARCH_MAX_TERMS];
+    int present = valid;
+    for (int t = 0; t < query->term_count && present && valid; ++t)
+    {
+        uint32_t low = 0;
+        uint32_t high = header->term_count;
+        present = 0;
+        while (low < high && valid)
+        {
+            uint32_t middle = low + (high - low) / 2;
+            const SearchFileTerm *entry = &entries[middle];
+            if ((size_t)entry->term_offset + entry->term_length > size || entry->postings_offset + entry->postings_length > size)
+            {
+                valid = 0;
+                break;
+            }
+            int order = compare_term_bytes(map + entry->term_offset, entry->term_length, query->terms[t], query->lengths[t]);
+            if (order == 0)
+            {
+                postings[t] = (const uint8_t *)map + entry->postings_offset;
+                lengths[t] = entry->postings_length;
+                counts[t] = entry->count;
+                present = 1;
+                break;
+            }
+            if (order < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+    }
+    if (valid && present)
+    {
+        collect_search_postings(query, postings, lengths, counts, base, UINT64_MAX);
+    }
+    munmap((void *)map, size);
+    return valid ? 0 : -1;
+}
+
+/**
+ * Cherche message par message dans une plage du journal sans index : segment
+ * dont le fichier .fts n'est pas encore écrit, fin du segment actif pas
+ * encore rattrapée par le thread d'indexation. Une recherche ne lit pas plus
+ * de SEARCH_SCAN_LIMIT messages hors index en tout ; au-delà, elle est
+ * marquée partielle.
+ * @param query La recherche.
+ * @param channel Le channel.
+ * @param first Le premier message de la plage.
+ * @param last Le dernier message (inclus).
+ */
+void scan_search_range(SearchQuery *query, Channel *channel, uint64_t first, uint64_t last)
+{
+    int wanted = SEARCH_MAX_RESULTS - query->result_count;
+    if (wanted > 0 && first <= last && query->scan_budget == 0)
+    {
+        query->partial = 1;
+        return;
+    }
+    HistoryCursor *cursor = wanted > 0 && first <= last ? open_history_cursor(channel, first, last) : NULL;
+    if (cursor == NULL)
+    {
+        return;
+    }
+    // Les wanted derniers messages trouvés, dans un anneau
+    uint64_t matches[SEARCH_MAX_RESULTS];
+    int seen = 0;
+    unsigned all_terms = (1u << query->term_count) - 1;
+    RecordHeader header;
+    const char *sender;
+    const char *text;
+    while (next_history_record(cursor, &header, &sender, &text) == 1)
+    {
+        if (query->scan_budget-- == 0)
+        {
+            query->scan_budget = 0;
+            query->partial = 1;
+            break;
+        }
+        if (header.sender_length == 0)
+        {
+            continue;
+        }
+        unsigned found = 0;
+        char term[SEARCH_TERM_MAX];
+        const char *end = text + header.length;
+        size_t length;
+        while (found != all_terms && (length = next_search_term(&text, end, term)) > 0)
+        {
+            for (int t = 0; t < query->term_count; ++t)
+            {
+                if (query->lengths[t] == length && memcmp(query->terms[t], term, length) == 0)
+                {
+                    found |= 1u << t;
+                }
+            }
+        }
+        if (found == all_terms)
+        {
+            matches[seen++ % wanted] = header.sequence;
+        }
+    }
+    close_history_cursor(cursor);
+    for (int k = 0; k < seen && k < wanted; ++k)
+    {
+        query->results[query->result_count++] = matches[(seen - 1 - k) % wanted];
+    }
+}
+
+/**
+ * Cherche les messages d'un channel qui contiennent tous les termes d'une
+ * recherche, du plus récent au plus ancien : la fin du segment actif pas encore
+ * indexée, l'index en mémoire du segment actif, puis les fichiers .fts des
+ * segments fermés. Un segment sans index est lu dans le journal. La recherche
+ * tourne sur le thread du client ou sur son réacteur : elle s'arrête après
+ * SEARCH_SEGMENT_LIMIT segments fermés, pour qu'un terme rare sur un très long
+ * historique n'ouvre pas des milliers de fichiers.
+ * @param query La recherche.
+ * @param channel Le channel.
+ */
+void run_search_query(SearchQuery *query, Channel *channel)
+{
+    uint64_t last = atomic_load(&channel->last_stored);
+    pthread_mutex_lock(&channel->segments_lock);
+    int count = channel->segment_count;
+    uint64_t *bases = count > 0 ? malloc((size_t)count * sizeof(uint64_t)) : NULL;
+    for (int i = 0; bases != NULL && i < count; ++i)
+    {
+        bases[i] = channel->segments[i].base;
+    }
+    pthread_mutex_unlock(&channel->segments_lock);
+    if (bases == NULL)
+    {
+        return;
+    }
+
+    uint64_t active_base = bases[count - 1];
+    pthread_mutex_lock(&channel->search_lock);
+    uint64_t indexed_end = channel->search != NULL && channel->search->base == active_base ? channel->search->next : active_base;
+    pthread_mutex_unlock(&channel->search_lock);
+    scan_search_range(query, channel, indexed_end, last);
+
+    pthread_mutex_lock(&channel->search_lock);
+    int indexed = channel->search != NULL && channel->search->base == active_base;
+    if (indexed && query->result_count < SEARCH_MAX_RESULTS)
+    {
+        search_memory_index(query, channel->search, indexed_end);
+    }
+    pthread_mutex_unlock(&channel->search_lock);
+    if (!indexed && indexed_end > active_base)
+    {
+        scan_search_range(query, channel, active_base, indexed_end - 1); // Fermé entre-temps
+    }
+
+    for (int i = count - 2; i >= 0 && query->result_count < SEARCH_MAX_RESULTS; --i)
+    {
+        if (count - 2 - i == SEARCH_SEGMENT_LIMIT)
+        {
+            query->truncated = 1;
+            break;
+        }
+        if (search_segment_file(query, channel, bases[i]) == -1)
+        {
+            scan_search_range(query, channel, bases[i], bases[i + 1] - 1);
+        }
+    }
+    free(bases);
+}
+
+/**
+ * Exécute /search dans un channel et formate les messages trouvés, du plus
+ * ancien au plus récent, chacun précédé de son numéro (celui de /history #K).
+ * @param text Le texte de la réponse.
+ * @param channel Le channel.
+ * @param argument Les termes cherchés.
+ */
+void format_search_results(TextBuffer *text, Channel *channel, const char *argument)
+{
+    uint64_t started = monotonic_ns();
+    SearchQuery *query = calloc(1, sizeof(SearchQuery));
+    char *line = malloc(RECORD_MAX_TEXT + 2);
+    if (query == NULL || line == NULL)
+    {
+        free(query);
+        free(line);
+        return;
+    }
+    while (*argument == ' ')
+    {
+        argument++;
+    }
+    const char *scan = argument;
+    const char *end = argument + strlen(argument);
+    while (query->term_count < SEARCH_MAX_TERMS && (query->lengths[query->term_count] = next_search_term(&scan, end, query->terms[query->term_count])) > 0)
+    {
+        query->term_count++;
+    }
+    if (query->term_count == 0)
+    {
+        text_printf(text, "Usage : /search <mots> (%d caractères au moins par mot)\n", SEARCH_TERM_MIN);
+        free(query);
+        free(line);
+        return;
+    }
+
+    query->scan_budget = SEARCH_SCAN_LIMIT;
+    run_search_query(query, channel);
+    text_printf(text, "--- Recherche '%.100s' dans '%s' : %d message(s) en %.1f ms ---\n", argument, channel->name, query->result_count,
+                (monotonic_ns() - started) / 1e6);
+    HistoryCursor *cursor = open_history_cursor(channel, 0, 0);
+    for (int k = query->result_count - 1; k >= 0 && cursor != NULL; --k)
+    {
+        if (cursor->fd != -1)
+        {
+            close(cursor->fd);
+            cursor->fd = -1;
+        }
+        cursor->next = cursor->last = query->results[k];
+        RecordHeader header;
+        const char *sender;
+        const char *record_text;
+        if (next_history_record(cursor, &header, &sender, &record_text) == 1 && header.sequence == query->results[k])
+        {
+            size_t length = format_history_record(channel, &header, sender, record_text, line, RECORD_MAX_TEXT + 2);
+            text_printf(text, "#%llu %.*s", (unsigned long long)header.sequence, (int)length, line);
+        }
+    }
+    if (cursor != NULL)
+    {
+        close_history_cursor(cursor);
+    }
+    if (query->truncated)
+    {
+        text_printf(text, "--- Fin de la recherche (partielle : %d segments les plus récents) ---\n", SEARCH_SEGMENT_LIMIT);
+    }
+    else
+    {
+        text_printf(text, query->partial ? "--- Fin de la recherche (partielle : index en construction) ---\n" : "--- Fin de la recherche ---\n");
+    }
+    free(query);
+    free(line);
+    metric_record_since(HISTOGRAM_SEARCH, started);
+}
+
+/**
+ * Charge un channel à son premier accès : crée son dossier, reprend son journal
+ * segmenté (ou le crée avec le message de bienvenue) et remplit son historique
+ * récent. Hors du verrou global : seuls les clients de ce channel attendent.
+ * @param channel Le channel.
+ */
+void load_channel(Channel *channel)
+{
+    if (atomic_load_explicit(&channel->loaded, memory_order_acquire))
+    {
+        return;
+    }
+    pthread_mutex_lock(&channel->load_lock);
+    if (!atomic_load_explicit(&channel->loaded, memory_order_relaxed))
+    {
+        ensure_channel_directory(channel->name);
+        open_channel_log(channel);
+        open_search_index(channel);
+        seed_recent_history(channel);
+        atomic_store_explicit(&channel->loaded, 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&channel->load_lock);
+}
+
+/**
+ * Trouve un channel ou l'enregistre dans la table, sans le charger (comme à la
+ * reprise) : une instance paire peut s'y intéresser avant qu'il ne soit ouvert ici.
+ * @param channel_name Le nom du channel.
+ * @return Le channel, ou NULL si la mémoire manque.
+ */
+Channel *find_or_register_channel(const char *channel_name)
+{
+    uint32_t hash = hash_channel_name(channel_name);
+    pthread_mutex_lock(&mutex);
+
+    if ((size_t)(channel_count + 1) * 2 > channel_table_capacity && grow_channel_table() == -1)
+    {
+        pthread_mutex_unlock(&mutex);
+        return NULL;
+    }
+    Channel **slot = lookup_channel_slot(channel_name, hash);
+    Channel *channel = *slot;
+    if (channel == NULL)
+    {
+        channel = allocate_channel(channel_name, hash);
+        if (channel == NULL)
+        {
+            pthread_mutex_unlock(&mutex);
+            return NULL;
+        }
+        register_channel(channel, slot);
+    }
+    pthread_mutex_unlock(&mutex);
+    return channel;
+}
+
+/**
+ * Trouve ou crée un channel, chargé et prêt à recevoir des membres.
+ * @param channel_name Le nom du channel.
+ * @return Le pointeur vers le channel trouvé ou créé, ou NULL si la mémoire manque.
+ */
+Channel *find_or_create_channel(const char *channel_name)
+{
+    Channel *channel = find_or_register_channel(channel_name);
+    if (channel != NULL)
+    {
+        load_channel(channel);
+    }
+    return channel;
+}
+
+/**
+ * Part des channels retrouvés au démarrage, préparée par un thread de reprise.
+ */
+typedef struct
+{
+    char (*names)[50];
+    int count;
+    int registered;
+} RecoveryBatch;
+
+/**
+ * Thread de reprise : alloue les channels de sa part sans verrou, puis les range
+ * tous dans la table en une seule prise du verrou global.
+ * @param args La part (RecoveryBatch).
+ * @return NULL.
+ */
+void *run_channel_recovery(void *args)
+{
+    RecoveryBatch *batch = args;
+    Channel **channels = malloc((size_t)batch->count * sizeof(Channel *));
+    if (channels == NULL)
+    {
+        return NULL;
+    }
+    for (int i = 0; i < batch->count; ++i)
+    {
+        channels[i] = allocate_channel(batch->names[i], hash_channel_name(batch->names[i]));
+    }
+
+    pthread_mutex_lock(&mutex);
+    for (int i = 0; i < batch->count; ++i)
+    {
+        if (channels[i] == NULL ||
+            ((size_t)(channel_count + 1) * 2 > channel_table_capacity && grow_channel_table() == -1))
+        {
+            continue;
+        }
+        Channel **slot = lookup_channel_slot(channels[i]->name, channels[i]->name_hash);
+        if (*slot == NULL)
+        {
+            register_channel(channels[i], slot);
+            batch->registered++;
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    free(channels);
+    return NULL;
+}
+
+/**
+ * Reprise au démarrage : enregistre dans la table un channel par dossier
+ * storage_server/storage_<nom>, réparti entre plusieurs threads. Aucun fichier
+ * de channel n'est ouvert : journal et historique récent sont chargés au premier
+ * accès (load_channel), le serveur accepte donc les connexions aussitôt.
+ */
+void recover_channels()
+{
+    uint64_t started = monotonic_ns();
+    DIR *dir = opendir("storage_server");
+    if (dir == NULL)
+    {
+        return; // Premier démarrage
+    }
+
+    char (*names)[50] = NULL;
+    int count = 0;
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        const char *name = entry->d_name + strlen("storage_");
+        if (strncmp(entry->d_name, "storage_", strlen("storage_")) != 0 || *name == '\0' || strlen(name) >= sizeof(names[0]) ||
+            (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN))
+        {
+            continue;
+        }
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            char(*grown)[50] = realloc(names, (size_t)capacity * sizeof(names[0]));
+            if (grown == NULL)
+            {
+                break;
+            }
+            names = grown;
+        }
+        strcpy(names[count++], name);
+    }
+    closedir(dir);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = count / RECOVERY_CHANNELS_PER_THREAD + 1;
+    if (thread_count > cpus)
+    {
+        thread_count = cpus > 0 ? (int)cpus : 1;
+    }
+    if (thread_count > RECOVERY_THREADS_MAX)
+    {
+        thread_count = RECOVERY_THREADS_MAX;
+    }
+
+    RecoveryBatch batches[RECOVERY_THREADS_MAX];
+    pthread_t threads[RECOVERY_THREADS_MAX];
+    int started_threads = 0;
+    for (int i = 0; i < thread_count; ++i)
+    {
+        int first = (int)((long)count * i / thread_count);
+        int last = (int)((long)count * (i + 1) / thread_count);
+        batches[i] = (RecoveryBatch){.names = names + first, .count = last - first, .registered = 0};
+        if (i == thread_count - 1 || pthread_create(&threads[i], NULL, run_channel_recovery, &batches[i]) != 0)
+        {
+            run_channel_recovery(&batches[i]); // Dernière part (ou thread impossible) : dans le thread principal
+            continue;
+        }
+        started_threads |= 1 << i;
+    }
+
+    int registered = 0;
+    for (int i = 0; i < thread_count; ++i)
+    {
+        if (started_threads & (1 << i))
+        {
+            pthread_join(threads[i], NULL);
+        }
+        registered += batches[i].registered;
+    }
+    free(names);
+    printf("%d channel(s) retrouvé(s) dans storage_server en %.1f ms\n", registered, (double)(monotonic_ns() - started) / 1e6);
+}
+
+/**
+ * Diffuse un message à tous les clients d'un channel. Les envois se font sur un
+ * instantané des membres, sans aucun verrou de channel : un membre lent ne
+ * bloque ni les join/leave ni les autres channels.
+ * Le message est préparé une seule fois et partagé par les files des membres.
+ * @param channel Le channel.
+ * @param type Le type de trame pour les clients tramés.
+ * @param sequence Le numéro du message (FRAME_CHAT), 0 sinon.
+ * @param message Le message à diffuser.
+ * @param sender Le client expéditeur (exclu de la diffusion), ou NULL.
+ */
+void broadcast_message(Channel *channel, FrameType type, uint64_t sequence, const char *message, ClientHandle *sender)
+{
+    uint64_t start = monotonic_ns();
+    MemberSnapshot *snapshot = acquire_member_snapshot(channel);
+    if (snapshot == NULL)
+    {
+        return;
+    }
+
+    BroadcastBuffer *buffer = create_broadcast_buffer(type, channel, sequence, message, strlen(message));
+    if (buffer == NULL)
+    {
+        release_member_snapshot(snapshot);
+        return;
+    }
+    unsigned long deliveries = 0;
+    for (int i = 0; i < snapshot->count; ++i)
+    {
+        ClientHandle *client = snapshot->clients[i];
+        if (client != sender)
+        {
+            send_broadcast_to_client(client, buffer);
+            deliveries++;
+        }
+    }
+
+    release_broadcast_buffer(buffer);
+    release_member_snapshot(snapshot);
+    metric_add(METRIC_DELIVERIES, deliveries);
+    metric_record_since(HISTOGRAM_BROADCAST, start);
+    trace_span("broadcast", start, channel, sequence);
+}
+
+/**
+ * Log un message dans le journal d'un channel et l'envoie à tous les clients.
+ * @param channel_name Le nom du channel.
+ * @param sender_name Le nom de l'expéditeur.
+ * @param message Le message à logger.
+ * @param channel Le channel auquel envoyer le message.
+ * @param sender Le client expéditeur.
+ */
+void log_and_broadcast_message(const char *channel_name, const char *sender_name, const char *message, Channel *channel, ClientHandle *sender)
+{
+    char formatted_message[BUFFER_SIZE];
+    uint64_t sequence;
+    uint64_t start = monotonic_ns();
+    (void)channel_name;
+    if (log_message(channel, sender_name, message, formatted_message, sizeof(formatted_message), &sequence) == -1)
+    {
+        return;
+    }
+
+    // Envoyer le message formaté à tous les clients du channel sauf l'expéditeur
+    broadcast_message(channel, FRAME_CHAT, sequence, formatted_message, sender);
+    relay_to_peers(channel, PEER_CHAT, sender_name, message);
+    metric_record_since(HISTOGRAM_LOG_AND_BROADCAST, start);
+    trace_span("log_and_broadcast", start, channel, sequence);
+}
+
+/**
+ * Cherche l'abonnement d'une connexion à un channel.
+ * @param list Les abonnements de la connexion.
+ * @param channel Le channel.
+ * @return L'abonnement, ou NULL si la connexion ne suit pas ce channel.
+ */
+Subscription *find_subscription(Subscription *list, Channel *channel)
+{
+    for (Subscription *sub = list; sub != NULL; sub = sub->next)
+    {
+        if (sub->channel == channel)
+        {
+            return sub;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Cherche l'abonnement d'une connexion à un channel d'après son nom.
+ * @param list Les abonnements de la connexion.
+ * @param channel_name Le nom du channel.
+ * @return L'abonnement, ou NULL si la connexion ne suit pas ce channel.
+ */
+Subscription *find_subscription_by_name(Subscription *list, const char *channel_name)
+{
+    for (Subscription *sub = list; sub != NULL; sub = sub->next)
+    {
+        if (strcmp(sub->channel->name, channel_name) == 0)
+        {
+            return sub;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Détache un abonnement de la liste d'une connexion.
+ * @param list La tête de la liste des abonnements.
+ * @param sub L'abonnement.
+ */
+void unlink_subscription(Subscription **list, Subscription *sub)
+{
+    for (Subscription **link = list; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == sub)
+        {
+            *link = sub->next;
+            sub->next = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * Fait d'un abonnement le channel courant de la connexion (tête de la liste).
+ * @param list La tête de la liste des abonnements.
+ * @param sub L'abonnement.
+ */
+void promote_subscription(Subscription **list, Subscription *sub)
+{
+    if (*list != sub)
+    {
+        unlink_subscription(list, sub);
+        sub->next = *list;
+        *list = sub;
+    }
+}
+
+/**
+ * Décrit les channels suivis par une connexion (commande /channels).
+ * @param list Les abonnements de la connexion, le courant en tête.
+ * @param buffer Le buffer de sortie.
+ * @param buffer_size La taille du buffer.
+ */
+void format_subscription_list(Subscription *list, char *buffer, size_t buffer_size)
+{
+    size_t length = (size_t)snprintf(buffer, buffer_size, "Channels suivis :");
+    for (Subscription *sub = list; sub != NULL && length < buffer_size; sub = sub->next)
+    {
+        length += (size_t)snprintf(buffer + length, buffer_size - length, sub == list ? " %s (courant)" : " %s", sub->channel->name);
+    }
+    if (length < buffer_size)
+    {
+        snprintf(buffer + length, buffer_size - length, "\n");
+    }
+}
+
+/**
+ * Ajoute un client à un channel, lui envoie l'historique et notifie les autres membres.
+ * Le nouvel abonnement devient le channel courant du client.
+ * @param client Le client.
+ * @param client_name Le nom du client.
+ * @param channel Le channel à rejoindre.
+ * @param notify 1 pour confirmer l'arrivée au client (/join, /switch).
+ * @return L'abonnement, ou NULL si la mémoire manque.
+ */
+Subscription *join_channel(ClientHandle *client, const char *client_name, Channel *channel, int notify)
+{
+    pthread_mutex_lock(&client_pool_mutex);
+    Subscription *sub = pool_alloc(&subscription_pool);
+    pthread_mutex_unlock(&client_pool_mutex);
+    if (sub == NULL)
+    {
+        return NULL;
+    }
+    sub->channel = channel;
+    sub->client = client;
+    sub->member_slot = -1;
+
+    // Ajouter le client au channel
+    pthread_mutex_lock(&channel->lock);
+    int inserted = insert_channel_member(channel, sub);
+    int current_count = atomic_load(&channel->client_count);
+    pthread_mutex_unlock(&channel->lock);
+    if (inserted == -1)
+    {
+        pthread_mutex_lock(&client_pool_mutex);
+        pool_free(&subscription_pool, sub);
+        pthread_mutex_unlock(&client_pool_mutex);
+        return NULL;
+    }
+    sub->next = client->subscriptions;
+    client->subscriptions = sub;
+    client->subscription_count++;
+
+    // Envoyer l'historique récent du channel au client, en un seul envoi
+    uint64_t start = monotonic_ns();
+    size_t history_length = 0;
+    char *history = copy_recent_history(channel, &history_length, &sub->history_cursor);
+    if (history != NULL)
+    {
+        // La réserve en tête du buffer reçoit l'en-tête de trame : un seul envoi dans les deux protocoles
+        if (client->queue.framed)
+        {
+            frame_encode_header((unsigned char *)history, FRAME_HISTORY, channel->id, 0, (uint32_t)history_length);
+            send_to_own_client(client, history, FRAME_HEADER_SIZE + history_length);
+        }
+        else
+        {
+            send_to_own_client(client, history + FRAME_HEADER_SIZE, history_length);
+        }
+        free(history);
+        metric_add(METRIC_HISTORY_REQUESTS, 1);
+        metric_record_since(HISTOGRAM_HISTORY, start);
+    }
+
+    // Notifier les autres clients que le nouveau client a rejoint le channel
+    char join_message[BUFFER_SIZE];
+    snprintf(join_message, sizeof(join_message), "%s a rejoint le channel '%s'... (%d/%d)\n", client_name, channel->name, current_count, max_clients);
+    broadcast_message(channel, FRAME_NOTICE, 0, join_message, client);
+    relay_to_peers(channel, PEER_NOTICE, NULL, join_message);
+
+    if (notify)
+    {
+        char notice[BUFFER_SIZE];
+        snprintf(notice, sizeof(notice), "Vous avez rejoint le channel '%s'\n", channel->name);
+        send_message_to_client(client, FRAME_NOTICE, channel, notice);
+    }
+    return sub;
+}
+
+/**
+ * Notifie les membres d'un channel du départ d'un client puis le retire du channel.
+ * @param client Le client.
+ * @param client_name Le nom du client.
+ * @param sub L'abonnement à quitter (libéré).
+ */
+void leave_channel(ClientHandle *client, const char *client_name, Subscription *sub)
+{
+    Channel *channel = sub->channel;
+    int remaining_clients = atomic_load(&channel->client_count) - 1;
+
+    char leave_message[BUFFER_SIZE];
+    snprintf(leave_message, sizeof(leave_message), "%s a quitter le channel '%s'... (%d/%d)\n", client_name, channel->name, remaining_clients, max_clients);
+    broadcast_message(channel, FRAME_NOTICE, 0, leave_message, client);
+    relay_to_peers(channel, PEER_NOTICE, NULL, leave_message);
+
+    pthread_mutex_lock(&channel->lock);
+    erase_channel_member(channel, sub);
+    pthread_mutex_unlock(&channel->lock);
+
+    unlink_subscription(&client->subscriptions, sub);
+    client->subscription_count--;
+    pthread_mutex_lock(&client_pool_mutex);
+    pool_free(&subscription_pool, sub);
+    pthread_mutex_unlock(&client_pool_mutex);
+}
+
+/**
+ * Confirme à un client le channel où partent désormais ses messages.
+ * @param client Le client.
+ */
+void send_current_channel_to_client(ClientHandle *client)
+{
+    char notice[BUFFER_SIZE];
+    snprintf(notice, sizeof(notice), "Channel courant : '%s'\n", client->subscriptions->channel->name);
+    send_message_to_client(client, FRAME_NOTICE, client->subscriptions->channel, notice);
+}
+
+/**
+ * Abonne un client à un ou plusieurs channels (commande /join) ; le dernier
+ * nommé devient son channel courant. Un channel déjà suivi redevient courant.
+ * @param client Le client.
+ * @param client_name Le nom du client.
+ * @param names Les noms des channels, séparés par des espaces.
+ * @return 0 si le client reste connecté, -1 s'il doit être déconnecté.
+ */
+int join_channels(ClientHandle *client, const char *client_name, char *names)
+{
+    char *saveptr = NULL;
+    for (char *name = strtok_r(names, " ", &saveptr); name != NULL; name = strtok_r(NULL, " ", &saveptr))
+    {
+        char channel_name[50];
+        snprintf(channel_name, sizeof(channel_name), "%s", name);
+        Subscription *sub = find_subscription_by_name(client->subscriptions, channel_name);
+        if (sub != NULL)
+        {
+            promote_subscription(&client->subscriptions, sub);
+            send_current_channel_to_client(client);
+            continue;
+        }
+        if (client->subscription_count >= MAX_SUBSCRIPTIONS)
+        {
+            char notice[BUFFER_SIZE];
+            snprintf(notice, sizeof(notice), "Erreur : %d channels suivis au plus, '%s' ignoré\n", MAX_SUBSCRIPTIONS, channel_name);
+            send_message_to_client(client, FRAME_NOTICE, NULL, notice);
+            continue;
+        }
+        Channel *channel = find_or_create_channel(channel_name);
+        if (channel == NULL || join_channel(client, client_name, channel, 1) == NULL)
+        {
+            send_message_to_client(client, FRAME_NOTICE, NULL, "Erreur : Impossible de rejoindre le nouveau channel\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Désabonne un client d'un ou plusieurs channels (commande /leave). Le dernier
+ * channel suivi ne peut pas être quitté ; si le channel courant l'est, le plus
+ * récemment rejoint des autres le remplace.
+ * @param client Le client.
+ * @param client_name Le nom du client.
+ * @param names Les noms des channels, séparés par des espaces.
+ */
+void leave_channels(ClientHandle *client, const char *client_name, char *names)
+{
+    char *saveptr = NULL;
+    for (char *name = strtok_r(names, " ", &saveptr); name != NULL; name = strtok_r(NULL, " ", &saveptr))
+    {
+        char notice[BUFFER_SIZE];
+        Subscription *sub = find_subscription_by_name(client->subscriptions, name);
+        if (sub == NULL)
+        {
+            snprintf(notice, sizeof(notice), "Erreur : Vous ne suivez pas le channel '%.49s'\n", name);
+            send_message_to_client(client, FRAME_NOTICE, NULL, notice);
+            continue;
+        }
+        if (client->subscription_count == 1)
+        {
+            send_message_to_client(client, FRAME_NOTICE, NULL, "Erreur : Impossible de quitter votre dernier channel\n");
+            continue;
+        }
+        int was_current = sub == client->subscriptions;
+        leave_channel(client, client_name, sub);
+        snprintf(notice, sizeof(notice), "Vous avez quitté le channel '%.49s'\n", name);
+        send_message_to_client(client, FRAME_NOTICE, NULL, notice);
+        if (was_current)
+        {
+            send_current_channel_to_client(client);
+        }
+    }
+}
+
+/**
+ * Fait passer un client de son channel courant à un nouveau channel (commande /switch).
+ * Les autres channels suivis sont conservés.
+ * @param client Le client.
+ * @param client_name Le nom du client.
+ * @param new_channel Le channel à rejoindre.
+ * @return 0 si le client reste connecté, -1 s'il doit être déconnecté.
+ */
+int switch_channel(ClientHandle *client, const char *client_name, Channel *new_channel)
+{
+    Subscription *current = client->subscriptions;
+    if (current->channel == new_channel)
+    {
+        // Rejoindre le channel courant : le quitter puis le rejoindre, historique compris
+        leave_channel(client, client_name, current);
+        return join_channel(client, client_name, new_channel, 1) != NULL ? 0 : -1;
+    }
+
+    Subscription *sub = find_subscription(client->subscriptions, new_channel);
+    if (sub != NULL)
+    {
+        promote_subscription(&client->subscriptions, sub);
+        send_current_channel_to_client(client);
+    }
+    else if (join_channel(client, client_name, new_channel, 1) == NULL)
+    {
+        return -1;
+    }
+    leave_channel(client, client_name, current);
+    return 0;
+}
+
+/**
+ * Attend qu'un message du client soit lisible, en vidant sa file de sortie
+ * quand le socket redevient inscriptible (mode thread).
+ * @param client Le client.
+ * @return 0 quand une lecture est possible, -1 si la connexion est perdue.
+ */
+int wait_for_client_input(ClientHandle *client)
+{
+    struct pollfd fds[2];
+    fds[0].fd = client->socket;
+    fds[1].fd = client->wake_fd;
+    fds[1].events = POLLIN;
+
+    while (1)
+    {
+        pthread_mutex_lock(&client->lock);
+        int pending = client->queue.head != NULL;
+        pthread_mutex_unlock(&client->lock);
+
+        fds[0].events = POLLIN | (pending ? POLLOUT : 0);
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t counter;
+            if (read(client->wake_fd, &counter, sizeof(counter)) == -1 && errno != EAGAIN)
+            {
+                return -1;
+            }
+        }
+        if (fds[0].revents & POLLOUT)
+        {
+            pthread_mutex_lock(&client->lock);
+            int result = flush_outbound_queue(&client->queue, client->socket);
+            pthread_mutex_unlock(&client->lock);
+            if (result == -1)
+            {
+                return -1;
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Prépare un lecteur de trames pour un recv() : les octets restants sont ramenés en tête.
+ * @param reader Le lecteur.
+ * @param capacity Reçoit la place libre.
+ * @return L'adresse où recevoir les octets suivants.
+ */
+char *frame_reader_space(FrameReader *reader, size_t *capacity)
+{
+    if (reader->start > 0)
+    {
+        memmove(reader->data, reader->data + reader->start, reader->length - reader->start);
+        reader->length -= reader->start;
+        reader->start = 0;
+    }
+    *capacity = sizeof(reader->data) - reader->length;
+    return reader->data + reader->length;
+}
+
+/**
+ * Extrait la prochaine trame complète d'un lecteur : plusieurs trames reçues en un
+ * recv() sont ainsi traitées sans rien relire.
+ * @param reader Le lecteur.
+ * @param header Reçoit l'en-tête.
+ * @param payload Reçoit les données, terminées par '\0' (au moins BUFFER_SIZE octets).
+ * @return 1 si une trame a été extraite, 0 s'il manque des octets, -1 si la trame est invalide.
+ */
+int frame_reader_next(FrameReader *reader, FrameHeader *header, char *payload)
+{
+    size_t available = reader->length - reader->start;
+    if (available < FRAME_HEADER_SIZE)
+    {
+        return 0;
+    }
+    const char *frame = reader->data + reader->start;
+    if (frame_decode_header((const unsigned char *)frame, header) == -1 || header->length > FRAME_MAX_CLIENT_PAYLOAD)
+    {
+        return -1;
+    }
+    if (available < FRAME_HEADER_SIZE + header->length)
+    {
+        return 0;
+    }
+
+    memcpy(payload, frame + FRAME_HEADER_SIZE, header->length);
+    payload[header->length] = '\0';
+    reader->start += FRAME_HEADER_SIZE + header->length;
+    if (reader->start == reader->length)
+    {
+        reader->start = reader->length = 0;
+    }
+    return 1;
+}
+
+/**
+ * Négocie le protocole tramé une fois la préface du client reçue dans le lecteur.
+ * @param socket_fd Le socket du client.
+ * @param reader Le lecteur contenant le début de la connexion.
+ * @return 1 si la négociation est faite, 0 si la préface est incomplète, -1 si elle est invalide.
+ */
+int negotiate_framed_protocol(int socket_fd, FrameReader *reader)
+{
+    if (reader->length - reader->start < PROTOCOL_PREFACE_SIZE + 1)
+    {
+        return 0;
+    }
+    const char *preface = reader->data + reader->start;
+    unsigned char version = (unsigned char)preface[PROTOCOL_PREFACE_SIZE];
+    if (memcmp(preface, PROTOCOL_PREFACE, PROTOCOL_PREFACE_SIZE) != 0 || version == 0)
+    {
+        return -1;
+    }
+    reader->start += PROTOCOL_PREFACE_SIZE + 1;
+
+    char reply[PROTOCOL_PREFACE_SIZE + 1];
+    memcpy(reply, PROTOCOL_PREFACE, PROTOCOL_PREFACE_SIZE);
+    reply[PROTOCOL_PREFACE_SIZE] = version < PROTOCOL_VERSION ? (char)version : PROTOCOL_VERSION;
+    return send(socket_fd, reply, sizeof(reply), MSG_NOSIGNAL) == (ssize_t)sizeof(reply) ? 1 : -1;
+}
+
+/**
+ * Lit le nom et le channel d'une trame de poignée de main ("nom\0channel").
+ * @param payload Les données de la trame.
+ * @param length La taille des données.
+ * @param client_name Reçoit le nom (50 octets).
+ * @param channel_name Reçoit le nom du channel (50 octets).
+ * @return 0 en cas de succès, -1 si la trame est mal formée.
+ */
+int parse_handshake_frame(const char *payload, size_t length, char *client_name, char *channel_name)
+{
+    const char *separator = memchr(payload, '\0', length);
+    if (separator == NULL)
+    {
+        return -1;
+    }
+    snprintf(client_name, 50, "%.*s", (int)(separator - payload), payload);
+    snprintf(channel_name, 50, "%.*s", (int)(payload + length - separator - 1), separator + 1);
+    return 0;
+}
+
+/**
+ * Reçoit la poignée de main d'un client (mode thread, socket encore bloquant).
+ * Un client texte envoie son nom puis son channel en deux recv() ; un client
+ * tramé envoie la préface puis une trame FRAME_HANDSHAKE.
+ * @param client_socket Le socket du client.
+ * @param reader Le lecteur de trames du client.
+ * @param framed Reçoit 1 si le client utilise le protocole tramé.
+ * @param client_name Reçoit le nom du client (50 octets).
+ * @param channel_name Reçoit le nom du channel (50 octets).
+ * @return 0 en cas de succès, -1 si la connexion est perdue ou invalide.
+ */
+int receive_client_handshake(int client_socket, FrameReader *reader, int *framed, char *client_name, char *channel_name)
+{
+    // ÉTAPE 8 : Recevoir le nom du client, ou le début de la préface du protocole tramé
+    ssize_t name_length = recv(client_socket, reader->data, 49, 0);
+    if (name_length <= 0)
+    {
+        return -1;
+    }
+
+    *framed = reader->data[0] == '\0';
+    if (!*framed)
+    {
+        memcpy(client_name, reader->data, (size_t)name_length);
+        client_name[name_length] = '\0';
+        // ÉTAPE 9 : Recevoir le nom du channel depuis la connexion
+        ssize_t channel_length = recv(client_socket, channel_name, 49, 0);
+        channel_name[channel_length > 0 ? channel_length : 0] = '\0';
+        return 0;
+    }
+
+    reader->length = (size_t)name_length;
+    int negotiated = 0;
+    while (1)
+    {
+        if (!negotiated && (negotiated = negotiate_framed_protocol(client_socket, reader)) == -1)
+        {
+            return -1;
+        }
+        if (negotiated)
+        {
+            FrameHeader header;
+            char payload[BUFFER_SIZE];
+            int result = frame_reader_next(reader, &header, payload);
+            if (result == -1 || (result == 1 && header.type != FRAME_HANDSHAKE))
+            {
+                return -1;
+            }
+            if (result == 1)
+            {
+                return parse_handshake_frame(payload, header.length, client_name, channel_name);
+            }
+        }
+
+        size_t capacity;
+        char *space = frame_reader_space(reader, &capacity);
+        ssize_t read_size = recv(client_socket, space, capacity, 0);
+        if (read_size <= 0)
+        {
+            return -1;
+        }
+        reader->length += (size_t)read_size;
+    }
+}
+
+/**
+ * Traite un message ou une commande d'un client en mode thread.
+ * Le channel courant est le premier abonnement du client.
+ * @param client Le client.
+ * @param client_name Le nom du client.
+ * @param message Le message, terminé par '\0'.
+ * @return 0 si le client reste connecté, -1 s'il doit être déconnecté.
+ */
+int process_client_message(ClientHandle *client, const char *client_name, char *message)
+{
+    Channel *channel = client->subscriptions->channel;
+
+    // Débit du client, commandes comprises (l'historique est lu sur disque)
+    if (!take_token(&client->send_bucket, &client_rate_limit))
+    {
+        const char *notice = throttle_notice(&client->throttled, METRIC_CLIENT_THROTTLED);
+        if (notice != NULL)
+        {
+            send_message_to_client(client, FRAME_NOTICE, channel, notice);
+        }
+        return 0;
+    }
+
+    // Abonnements à plusieurs channels sur la même connexion
+    if (strncmp(message, "/join ", 6) == 0)
+    {
+        return join_channels(client, client_name, message + 6);
+    }
+    if (strncmp(message, "/leave ", 7) == 0)
+    {
+        leave_channels(client, client_name, message + 7);
+        return 0;
+    }
+    if (strcmp(message, "/channels") == 0)
+    {
+        char notice[BUFFER_SIZE];
+        format_subscription_list(client->subscriptions, notice, sizeof(notice));
+        send_message_to_client(client, FRAME_NOTICE, channel, notice);
+        return 0;
+    }
+
+    // ÉTAPE 17 : Vérifier si le client demande de changer de channel
+    if (strncmp(message, "/switch ", 8) == 0)
+    {
+        // ÉTAPE 18 : Extraire le nouveau nom de channel
+        char new_channel_name[50];
+        if (sscanf(message + 8, "%49s", new_channel_name) != 1)
+        {
+            return 0;
+        }
+
+        // ÉTAPE 19 : Trouver ou créer le nouveau channel
+        Channel *new_channel = find_or_create_channel(new_channel_name);
+
+        if (new_channel == NULL)
+        {
+            send_message_to_client(client, FRAME_NOTICE, NULL, "Erreur : Impossible de rejoindre le nouveau channel\n");
+            return -1;
+        }
+
+        // ÉTAPE 20 à 26 : Quitter l'ancien channel, rejoindre le nouveau et confirmer au client
+        return switch_channel(client, client_name, new_channel);
+    }
+
+    // Recherche dans l'historique du channel courant, servie par ses index
+    if (strncmp(message, "/search", 7) == 0 && (message[7] == '\0' || message[7] == ' '))
+    {
+        TextBuffer text = {.arena = &client->arena};
+        format_search_results(&text, channel, message + 7);
+        if (text.data != NULL)
+        {
+            size_t length;
+            const char *data = finish_notice(&text, client->queue.framed, channel, &length);
+            send_to_own_client(client, data, length);
+        }
+        arena_reset(&client->arena);
+        return 0;
+    }
+
+    // Historique lu sur disque uniquement à la demande du client : tout, "N" derniers ou depuis "#K"
+    if (strncmp(message, "/history", 8) == 0 && (message[8] == '\0' || message[8] == ' '))
+    {
+        send_history_to_client(client, channel, message + 8);
+        return 0;
+    }
+
+    // Page précédente de l'historique, à partir du plus ancien message déjà reçu
+    if (strcmp(message, "/more") == 0)
+    {
+        send_older_page_to_client(client, client->subscriptions);
+        return 0;
+    }
+
+    // Métriques du serveur et du channel courant
+    if (strcmp(message, "/stats") == 0)
+    {
+        TextBuffer text = {.arena = &client->arena};
+        format_metrics_text(&text, channel);
+        if (text.data != NULL)
+        {
+            size_t length;
+            const char *data = finish_notice(&text, client->queue.framed, channel, &length);
+            send_to_own_client(client, data, length);
+        }
+        arena_reset(&client->arena);
+        return 0;
+    }
+
+    // Débit du channel, tous expéditeurs confondus : un message refusé n'est ni journalisé ni diffusé
+    if (!take_token(&channel->send_bucket, &channel_rate_limit))
+    {
+        const char *notice = throttle_notice(&client->throttled, METRIC_CHANNEL_THROTTLED);
+        if (notice != NULL)
+        {
+            send_message_to_client(client, FRAME_NOTICE, channel, notice);
+        }
+        return 0;
+    }
+    client->throttled = 0;
+
+    // ÉTAPE 27 : Message normal (pas une commande) -> enregistrer et diffuser
+    trace_begin_message(channel, client->socket);
+    log_and_broadcast_message(channel->name, client_name, message, channel, client);
+    trace_end_message();
+    return 0;
+}
+
+/**
+ * Gère les connexions des clients.
+ * @param args Les arguments passés à la fonction.
+ * @return NULL.
+ */
+void *handle_client(void *args)
+{
+    int client_socket = (int)(intptr_t)args;
+    uint64_t accepted_ns = monotonic_ns();
+
+    char buffer[BUFFER_SIZE];
+    char client_name[50];
+    char channel_name[50];
+    FrameReader reader = {0};
+    int framed = 0;
+
+    // ÉTAPE 8 et 9 : Recevoir le nom du client et le nom du channel
+    if (receive_client_handshake(client_socket, &reader, &framed, client_name, channel_name) == -1)
+    {
+        close(client_socket);
+        atomic_fetch_sub(&open_connections, 1);
+        return NULL;
+    }
+
+    // ÉTAPE 10 : Vérifier si le nombre maximum de clients est dépassé
+    int total_clients = count_total_clients();
+
+    if (total_clients >= max_clients)
+    {
+        metric_add(METRIC_SERVER_FULL, 1);
+        const char *notice = "Erreur : Le serveur est plein. Connexion refusée.\n";
+        size_t length = encode_message(buffer, framed, FRAME_NOTICE, NULL, 0, notice, strlen(notice));
+        send(client_socket, buffer, length, MSG_NOSIGNAL);
+        close(client_socket);
+        atomic_fetch_sub(&open_connections, 1);
+        return NULL;
+    }
+
+    // ÉTAPE 11 : Trouver ou créer le channel demandé
+    Channel *channel = find_or_create_channel(channel_name);
+    ClientHandle *client = channel ? create_client_handle(client_socket, client_name) : NULL;
+
+    if (client == NULL)
+    {
+        close(client_socket);
+        atomic_fetch_sub(&open_connections, 1);
+        return NULL;
+    }
+    client->queue.framed = framed;
+
+    // Après la poignée de main, toutes les écritures passent par la file de sortie :
+    // le socket devient non bloquant pour qu'aucun envoi ne bloque sous le verrou du client
+    set_nonblocking(client_socket);
+
+    // ÉTAPE 12 à 14 : Ajouter le client au channel, envoyer l'historique et notifier les autres clients
+    if (join_channel(client, client_name, channel, 0) == NULL)
+    {
+        shutdown(client_socket, SHUT_RDWR);
+        release_client_handle(client);
+        rcu_unregister_thread();
+        atomic_fetch_sub(&open_connections, 1);
+        return NULL;
+    }
+    atomic_fetch_add(&thread_client_count, 1);
+    metric_add(METRIC_HANDSHAKES, 1);
+    metric_record_since(HISTOGRAM_HANDSHAKE, accepted_ns);
+
+    // ÉTAPE 15 : Boucle principale de gestion des messages du client
+    while (1)
+    {
+        // ÉTAPE 16 : Recevoir un message du client (la file de sortie est vidée pendant l'attente)
+        if (wait_for_client_input(client) == -1)
+        {
+            break;
+        }
+
+        // Client texte : un recv() est un message. Client tramé : un recv() peut contenir plusieurs trames
+        size_t capacity = sizeof(buffer) - 1;
+        char *space = framed ? frame_reader_space(&reader, &capacity) : buffer;
+        uint64_t recv_start = trace_clock();
+        int read_size = recv(client_socket, space, capacity, 0);
+        trace_received(recv_start);
+        if (read_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            continue;
+        }
+        if (read_size <= 0)
+        {
+            // Connexion fermée ou erreur de réception
+            break;
+        }
+
+        int result = 0;
+        if (!framed)
+        {
+            buffer[read_size] = '\0';
+            result = process_client_message(client, client_name, buffer);
+        }
+        else
+        {
+            reader.length += (size_t)read_size;
+            FrameHeader header;
+            while (result == 0 && (result = frame_reader_next(&reader, &header, buffer)) == 1)
+            {
+                result = header.type == FRAME_TEXT ? process_client_message(client, client_name, buffer) : 0;
+            }
+        }
+        if (result == -1)
+        {
+            break;
+        }
+    }
+
+    // ÉTAPE 29 à 31 : Le client s'est déconnecté - notifier les autres clients et le retirer de ses channels
+    while (client->subscriptions != NULL)
+    {
+        leave_channel(client, client_name, client->subscriptions);
+    }
+    atomic_fetch_sub(&thread_client_count, 1);
+
+    // ÉTAPE 32 : Fermer la connexion et terminer le thread. Le numéro de socket
+    // n'est libéré qu'avec la dernière référence (instantanés encore parcourus).
+    shutdown(client_socket, SHUT_RDWR);
+    release_client_handle(client);
+    rcu_unregister_thread();
+    atomic_fetch_sub(&open_connections, 1);
+    return NULL;
+}
+
+/**
+ * Ajoute un message à la file d'un couple de réacteurs (côté producteur).
+ * @param queue La file.
+ * @param msg Le message.
+ * @return 0 en cas de succès, -1 si la file est pleine.
+ */
+int shard_queue_push(ShardQueue *queue, ShardMessage *msg)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head == SHARD_QUEUE_CAPACITY)
+    {
+        return -1;
+    }
+    queue->slots[tail & (SHARD_QUEUE_CAPACITY - 1)] = msg;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * Retire un message de la file d'un couple de réacteurs (côté consommateur).
+ * @param queue La file.
+ * @return Le message, ou NULL si la file est vide.
+ */
+ShardMessage *shard_queue_pop(ShardQueue *queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail)
+    {
+        return NULL;
+    }
+    ShardMessage *msg = queue->slots[head & (SHARD_QUEUE_CAPACITY - 1)];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return msg;
+}
+
+/**
+ * Alloue un message inter-réacteurs.
+ * @param type Le type du message.
+ * @param source Le réacteur émetteur.
+ * @param channel Le channel concerné.
+ * @param data Le texte à joindre (peut être NULL).
+ * @param length La taille du texte.
+ * @return Le message, ou NULL si l'allocation échoue.
+ */
+ShardMessage *create_shard_message(ShardMessageType type, int source, Channel *channel, const char *data, size_t length)
+{
+    ShardMessage *msg = block_alloc(sizeof(ShardMessage) + length + 1);
+    if (msg == NULL)
+    {
+        return NULL;
+    }
+    msg->type = type;
+    msg->source = source;
+    msg->channel = channel;
+    msg->connection_id = 0;
+    msg->client_socket = -1;
+    msg->client_name[0] = '\0';
+    msg->next = NULL;
+    msg->buffer = NULL;
+    msg->sequence = 0;
+    msg->trace_id = 0;
+    msg->length = length;
+    if (length > 0)
+    {
+        memcpy(msg->data, data, length);
+    }
+    msg->data[length] = '\0';
+    return msg;
+}
+
+void handle_shard_message(Reactor *reactor, ShardMessage *msg);
+
+/**
+ * Transmet un message au réacteur cible. Un message destiné au réacteur courant
+ * est traité immédiatement ; sinon il passe par la file SPSC du couple, ou par
+ * la file de débordement du producteur si celle-ci est pleine (l'ordre est conservé).
+ * @param reactor Le réacteur émetteur.
+ * @param target Le réacteur destinataire.
+ * @param msg Le message (la propriété est transférée).
+ */
+void post_shard_message(Reactor *reactor, int target, ShardMessage *msg)
+{
+    if (target == reactor->id)
+    {
+        handle_shard_message(reactor, msg);
+        return;
+    }
+
+    ShardQueue *queue = &shard_queues[reactor->id * reactor_count + target];
+    if (reactor->overflow_head[target] != NULL || shard_queue_push(queue, msg) == -1)
+    {
+        if (reactor->overflow_tail[target] != NULL)
+        {
+            reactor->overflow_tail[target]->next = msg;
+        }
+        else
+        {
+            reactor->overflow_head[target] = msg;
+        }
+        reactor->overflow_tail[target] = msg;
+    }
+    reactor->pending_wakeups |= (uint64_t)1 << target;
+}
+
+/**
+ * Vide les files de débordement dans les files SPSC et réveille les réacteurs
+ * à qui des messages ont été transmis pendant cette itération.
+ * @param reactor Le réacteur émetteur.
+ * @return 1 s'il reste des messages en débordement, 0 sinon.
+ */
+int flush_shard_messages(Reactor *reactor)
+{
+    int overflow_left = 0;
+    for (int target = 0; target < reactor_count; ++target)
+    {
+        ShardQueue *queue = &shard_queues[reactor->id * reactor_count + target];
+        while (reactor->overflow_head[target] != NULL)
+        {
+            ShardMessage *msg = reactor->overflow_head[target];
+            if (shard_queue_push(queue, msg) == -1)
+            {
+                overflow_left = 1;
+                break;
+            }
+            reactor->overflow_head[target] = msg->next;
+            msg->next = NULL;
+            // Le réveil de l'itération qui a débordé a pu être consommé avant ce message
+            reactor->pending_wakeups |= (uint64_t)1 << target;
+        }
+        if (reactor->overflow_head[target] == NULL)
+        {
+            reactor->overflow_tail[target] = NULL;
+        }
+
+        if (reactor->pending_wakeups & ((uint64_t)1 << target))
+        {
+            uint64_t one = 1;
+            if (write(reactors[target].wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            {
+                perror("Erreur lors du réveil d'un réacteur");
+            }
+        }
+    }
+    reactor->pending_wakeups = 0;
+    return overflow_left;
+}
+
+/**
+ * Traite tous les messages en attente dans les files destinées à un réacteur,
+ * puis ceux déposés par le thread de fédération.
+ * @param reactor Le réacteur destinataire.
+ */
+void drain_shard_queues(Reactor *reactor)
+{
+    uint64_t counter;
+    while (read(reactor->wake_fd, &counter, sizeof(counter)) > 0)
+    {
+    }
+
+    for (int source = 0; source < reactor_count; ++source)
+    {
+        ShardQueue *queue = &shard_queues[source * reactor_count + reactor->id];
+        ShardMessage *msg;
+        while ((msg = shard_queue_pop(queue)) != NULL)
+        {
+            handle_shard_message(reactor, msg);
+        }
+    }
+
+    pthread_mutex_lock(&reactor->remote_lock);
+    ShardMessage *remote = reactor->remote_head;
+    reactor->remote_head = reactor->remote_tail = NULL;
+    pthread_mutex_unlock(&reactor->remote_lock);
+    while (remote != NULL)
+    {
+        ShardMessage *next = remote->next;
+        handle_shard_message(reactor, remote);
+        remote = next;
+    }
+}
+
+/**
+ * Retrouve une connexion du réacteur à partir de son socket et de son identifiant.
+ * @param reactor Le réacteur.
+ * @param client_socket Le socket de la connexion.
+ * @param connection_id L'identifiant de la connexion.
+ * @return La connexion, ou NULL si elle a été fermée entre-temps.
+ */
+Connection *find_connection(Reactor *reactor, int client_socket, uint64_t connection_id)
+{
+    if (client_socket < 0 || client_socket >= reactor->connections_capacity)
+    {
+        return NULL;
+    }
+    Connection *conn = reactor->connections[client_socket];
+    return (conn != NULL && conn->id == connection_id) ? conn : NULL;
+}
+
+/**
+ * Livre un message partagé aux membres d'un channel gérés par ce réacteur.
+ * @param reactor Le réacteur.
+ * @param channel Le channel.
+ * @param buffer Le message partagé.
+ * @param exclude_id L'identifiant de la connexion à exclure (l'expéditeur), 0 si aucune.
+ */
+void deliver_to_local_members(Reactor *reactor, Channel *channel, BroadcastBuffer *buffer, uint64_t exclude_id)
+{
+    unsigned long deliveries = 0;
+    for (Subscription *member = channel->local_members[reactor->id]; member != NULL; member = member->next_member)
+    {
+        if (member->conn->id != exclude_id)
+        {
+            send_broadcast_to_connection(member->conn, buffer);
+            deliveries++;
+        }
+    }
+    metric_add(METRIC_DELIVERIES, deliveries);
+}
+
+/**
+ * Diffuse un message à tous les membres d'un channel (appelé par le propriétaire) :
+ * le message est préparé une fois, puis un DELIVER portant une référence est
+ * envoyé à chaque réacteur ayant des membres dans le channel.
+ * @param reactor Le réacteur propriétaire du channel.
+ * @param channel Le channel.
+ * @param type Le type de trame pour les clients tramés.
+ * @param sequence Le numéro du message (FRAME_CHAT), 0 sinon.
+ * @param data Le message.
+ * @param length La taille du message.
+ * @param exclude_id L'identifiant de la connexion à exclure, 0 si aucune.
+ */
+void fan_out_message(Reactor *reactor, Channel *channel, FrameType type, uint64_t sequence, const char *data, size_t length, uint64_t exclude_id)
+{
+    uint64_t start = monotonic_ns();
+    BroadcastBuffer *buffer = create_broadcast_buffer(type, channel, sequence, data, length);
+    if (buffer == NULL)
+    {
+        return;
+    }
+    for (int target = 0; target < reactor_count; ++target)
+    {
+        if (channel->shard_counts[target] == 0)
+        {
+            continue;
+        }
+        if (target == reactor->id)
+        {
+            deliver_to_local_members(reactor, channel, buffer, exclude_id);
+            continue;
+        }
+
+        ShardMessage *msg = create_shard_message(SHARD_DELIVER, reactor->id, channel, NULL, 0);
+        if (msg != NULL)
+        {
+            msg->connection_id = exclude_id;
+            msg->buffer = buffer;
+            msg->posted_ns = buffer->trace_id != 0 ? monotonic_ns() : 0;
+            atomic_fetch_add_explicit(&buffer->refcount, 1, memory_order_relaxed);
+            post_shard_message(reactor, target, msg);
+        }
+    }
+    release_broadcast_buffer(buffer);
+    metric_record_since(HISTOGRAM_BROADCAST, start);
+    trace_span("broadcast", start, channel, sequence);
+}
+
+/**
+ * Ajoute l'abonnement d'une connexion à la liste des membres locaux de son channel.
+ * @param sub L'abonnement.
+ */
+void link_local_member(Subscription *sub)
+{
+    Subscription **head = &sub->channel->local_members[sub->conn->reactor->id];
+    sub->prev_member = NULL;
+    sub->next_member = *head;
+    if (*head != NULL)
+    {
+        (*head)->prev_member = sub;
+    }
+    *head = sub;
+    sub->joined = 1;
+}
+
+/**
+ * Retire l'abonnement d'une connexion de la liste des membres locaux de son channel.
+ * @param sub L'abonnement.
+ */
+void unlink_local_member(Subscription *sub)
+{
+    if (sub->prev_member != NULL)
+    {
+        sub->prev_member->next_member = sub->next_member;
+    }
+    else
+    {
+        sub->channel->local_members[sub->conn->reactor->id] = sub->next_member;
+    }
+    if (sub->next_member != NULL)
+    {
+        sub->next_member->prev_member = sub->prev_member;
+    }
+    sub->prev_member = sub->next_member = NULL;
+    sub->joined = 0;
+}
+
+/**
+ * Traite un message reçu d'un autre réacteur (ou de soi-même).
+ * @param reactor Le réacteur destinataire.
+ * @param msg Le message (libéré ici).
+ */
+void handle_shard_message(Reactor *reactor, ShardMessage *msg)
+{
+    Channel *channel = msg->channel;
+    char message[BUFFER_SIZE];
+
+    switch (msg->type)
+    {
+    case SHARD_JOIN:
+    {
+        // Propriétaire : compter le membre, renvoyer l'historique puis notifier le channel
+        if (channel->client_count++ == 0)
+        {
+            federation_interest_changed(channel);
+        }
+        channel->shard_counts[msg->source]++;
+
+        // L'historique garde sa réserve d'en-tête : le réacteur du client la remplit s'il est tramé
+        size_t history_length = 0;
+        uint64_t first_sequence;
+        char *history = copy_recent_history(channel, &history_length, &first_sequence);
+        ShardMessage *replay = create_shard_message(SHARD_REPLAY, reactor->id, channel, history, history != NULL ? FRAME_HEADER_SIZE + history_length : 0);
+        free(history);
+        if (replay != NULL)
+        {
+            replay->sequence = first_sequence;
+            replay->connection_id = msg->connection_id;
+            replay->client_socket = msg->client_socket;
+            post_shard_message(reactor, msg->source, replay);
+        }
+
+        snprintf(message, sizeof(message), "%s a rejoint le channel '%s'... (%d/%d)\n", msg->client_name, channel->name, channel->client_count, max_clients);
+        fan_out_message(reactor, channel, FRAME_NOTICE, 0, message, strlen(message), msg->connection_id);
+        relay_to_peers(channel, PEER_NOTICE, NULL, message);
+        break;
+    }
+
+    case SHARD_LEAVE:
+        // Propriétaire : notifier le channel puis décompter le membre
+        snprintf(message, sizeof(message), "%s a quitter le channel '%s'... (%d/%d)\n", msg->client_name, channel->name, channel->client_count - 1, max_clients);
+        fan_out_message(reactor, channel, FRAME_NOTICE, 0, message, strlen(message), msg->connection_id);
+        relay_to_peers(channel, PEER_NOTICE, NULL, message);
+        if (--channel->client_count == 0)
+        {
+            federation_interest_changed(channel);
+        }
+        channel->shard_counts[msg->source]--;
+        break;
+
+    case SHARD_CHAT:
+    {
+        // Propriétaire : journaliser puis diffuser à tous les membres sauf l'expéditeur
+        uint64_t sequence;
+        uint64_t start = monotonic_ns();
+        trace_self.id = msg->trace_id;
+        trace_self.origin = msg->trace_origin;
+        if (msg->trace_id != 0)
+        {
+            trace_record("shard_queue", msg->trace_id, msg->posted_ns, start, channel, 0, msg->client_socket, 0);
+        }
+        if (log_message(channel, msg->client_name, msg->data, message, sizeof(message), &sequence) == 0)
+        {
+            fan_out_message(reactor, channel, FRAME_CHAT, sequence, message, strlen(message), msg->connection_id);
+            relay_to_peers(channel, PEER_CHAT, msg->client_name, msg->data);
+            metric_record_since(HISTOGRAM_LOG_AND_BROADCAST, start);
+            trace_span("log_and_broadcast", start, channel, sequence);
+        }
+        trace_end_message();
+        break;
+    }
+
+    case SHARD_REMOTE_CHAT:
+    {
+        // Propriétaire : message d'une instance paire, journalisé ici aussi mais jamais relayé à nouveau
+        uint64_t sequence;
+        if (log_message(channel, msg->client_name, msg->data, message, sizeof(message), &sequence) == 0)
+        {
+            fan_out_message(reactor, channel, FRAME_CHAT, sequence, message, strlen(message), 0);
+        }
+        break;
+    }
+
+    case SHARD_REMOTE_NOTICE:
+        fan_out_message(reactor, channel, FRAME_NOTICE, 0, msg->data, msg->length, 0);
+        break;
+
+    case SHARD_DELIVER:
+        if (msg->buffer->trace_id != 0)
+        {
+            trace_record("shard_queue", msg->buffer->trace_id, msg->posted_ns, monotonic_ns(), channel, 0, -1, 0);
+        }
+        deliver_to_local_members(reactor, channel, msg->buffer, msg->connection_id);
+        release_broadcast_buffer(msg->buffer);
+        break;
+
+    case SHARD_REPLAY:
+    {
+        // Réacteur du client : fin du join, sauf si le client est parti ou a quitté le channel entre-temps
+        Connection *conn = find_connection(reactor, msg->client_socket, msg->connection_id);
+        Subscription *sub = conn != NULL ? find_subscription(conn->subscriptions, channel) : NULL;
+        if (sub == NULL || sub->joined)
+        {
+            break;
+        }
+
+        // L'historique est un envoi ponctuel : il ne compte pas comme un retard du client
+        if (!conn->evicted && msg->length > FRAME_HEADER_SIZE)
+        {
+            uint64_t start = monotonic_ns();
+            size_t history_length = msg->length - FRAME_HEADER_SIZE;
+            if (conn->queue.framed)
+            {
+                frame_encode_header((unsigned char *)msg->data, FRAME_HISTORY, channel->id, 0, (uint32_t)history_length);
+                outbound_send(&conn->queue, conn->socket, msg->data, msg->length, 0);
+            }
+            else
+            {
+                outbound_send(&conn->queue, conn->socket, msg->data + FRAME_HEADER_SIZE, history_length, 0);
+            }
+            metric_add(METRIC_HISTORY_REQUESTS, 1);
+            metric_record_since(HISTOGRAM_HISTORY, start);
+        }
+        sub->history_cursor = msg->sequence;
+        link_local_member(sub);
+        if (conn->handshake_pending)
+        {
+            metric_add(METRIC_HANDSHAKES, 1);
+            metric_record_since(HISTOGRAM_HANDSHAKE, conn->accepted_ns);
+            conn->handshake_pending = 0;
+        }
+
+        if (sub->notify)
+        {
+            snprintf(message, sizeof(message), "Vous avez rejoint le channel '%s'\n", channel->name);
+            send_message_to_connection(conn, FRAME_NOTICE, channel, message);
+        }
+        break;
+    }
+    }
+
+    block_free(msg);
+}
+
+/**
+ * Envoie au propriétaire d'un channel un message concernant une connexion,
+ * avec la trace du message en cours s'il est tracé.
+ * @param conn La connexion.
+ * @param type Le type du message (JOIN, LEAVE ou CHAT).
+ * @param channel Le channel concerné.
+ * @param data Le texte à joindre (peut être NULL).
+ * @param length La taille du texte.
+ */
+void post_connection_message(Connection *conn, ShardMessageType type, Channel *channel, const char *data, size_t length)
+{
+    ShardMessage *msg = create_shard_message(type, conn->reactor->id, channel, data, length);
+    if (msg == NULL)
+    {
+        return;
+    }
+    msg->connection_id = conn->id;
+    msg->client_socket = conn->socket;
+    memcpy(msg->client_name, conn->client_name, sizeof(msg->client_name));
+    if (trace_self.id != 0)
+    {
+        msg->trace_id = trace_self.id;
+        msg->trace_origin = trace_self.origin;
+        msg->posted_ns = monotonic_ns();
+    }
+    post_shard_message(conn->reactor, channel->owner, msg);
+}
+
+/**
+ * Démarre le join d'un channel : l'abonnement devient le channel courant, et le
+ * propriétaire renverra l'historique (SHARD_REPLAY).
+ * @param conn La connexion.
+ * @param channel Le channel à rejoindre.
+ * @param notify 1 pour confirmer l'arrivée au client (/join, /switch), 0 sinon.
+ * @return L'abonnement, ou NULL si la mémoire manque.
+ */
+Subscription *begin_join(Connection *conn, Channel *channel, int notify)
+{
+    Subscription *sub = pool_alloc(&conn->reactor->subscription_pool);
+    if (sub == NULL)
+    {
+        return NULL;
+    }
+    sub->channel = channel;
+    sub->conn = conn;
+    sub->notify = notify;
+    sub->history_cursor = 0; // Fixé par l'historique rejoué (SHARD_REPLAY)
+    sub->next = conn->subscriptions;
+    conn->subscriptions = sub;
+    conn->subscription_count++;
+    post_connection_message(conn, SHARD_JOIN, channel, NULL, 0);
+    return sub;
+}
+
+/**
+ * Quitte un channel suivi par une connexion (départ notifié par le propriétaire).
+ * @param conn La connexion.
+ * @param sub L'abonnement (libéré).
+ */
+void leave_subscription(Connection *conn, Subscription *sub)
+{
+    if (sub->joined)
+    {
+        unlink_local_member(sub);
+    }
+    post_connection_message(conn, SHARD_LEAVE, sub->channel, NULL, 0);
+    unlink_subscription(&conn->subscriptions, sub);
+    conn->subscription_count--;
+    pool_free(&conn->reactor->subscription_pool, sub);
+}
+
+/**
+ * Confirme à une connexion le channel où partent désormais ses messages.
+ * @param conn La connexion.
+ */
+void send_current_channel_to_connection(Connection *conn)
+{
+    char notice[BUFFER_SIZE];
+    snprintf(notice, sizeof(notice), "Channel courant : '%s'\n", conn->subscriptions->channel->name);
+    send_message_to_connection(conn, FRAME_NOTICE, conn->subscriptions->channel, notice);
+}
+
+/**
+ * Abonne une connexion à un ou plusieurs channels (commande /join) ; le dernier
+ * nommé devient son channel courant. Un channel déjà suivi redevient courant.
+ * @param conn La connexion.
+ * @param names Les noms des channels, séparés par des espaces.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int join_connection_channels(Connection *conn, char *names)
+{
+    char *saveptr = NULL;
+    for (char *name = strtok_r(names, " ", &saveptr); name != NULL; name = strtok_r(NULL, " ", &saveptr))
+    {
+        char channel_name[50];
+        snprintf(channel_name, sizeof(channel_name), "%s", name);
+        Subscription *sub = find_subscription_by_name(conn->subscriptions, channel_name);
+        if (sub != NULL)
+        {
+            promote_subscription(&conn->subscriptions, sub);
+            send_current_channel_to_connection(conn);
+            continue;
+        }
+        if (conn->subscription_count >= MAX_SUBSCRIPTIONS)
+        {
+            char notice[BUFFER_SIZE];
+            snprintf(notice, sizeof(notice), "Erreur : %d channels suivis au plus, '%s' ignoré\n", MAX_SUBSCRIPTIONS, channel_name);
+            send_message_to_connection(conn, FRAME_NOTICE, NULL, notice);
+            continue;
+        }
+        Channel *channel = find_or_create_channel(channel_name);
+        if (channel == NULL || begin_join(conn, channel, 1) == NULL)
+        {
+            send_message_to_connection(conn, FRAME_NOTICE, NULL, "Erreur : Impossible de rejoindre le nouveau channel\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Désabonne une connexion d'un ou plusieurs channels (commande /leave). Le
+ * dernier channel suivi ne peut pas être quitté ; si le channel courant l'est,
+ * le plus récemment rejoint des autres le remplace.
+ * @param conn La connexion.
+ * @param names Les noms des channels, séparés par des espaces.
+ */
+void leave_connection_channels(Connection *conn, char *names)
+{
+    char *saveptr = NULL;
+    for (char *name = strtok_r(names, " ", &saveptr); name != NULL; name = strtok_r(NULL, " ", &saveptr))
+    {
+        char notice[BUFFER_SIZE];
+        Subscription *sub = find_subscription_by_name(conn->subscriptions, name);
+        if (sub == NULL)
+        {
+            snprintf(notice, sizeof(notice), "Erreur : Vous ne suivez pas le channel '%.49s'\n", name);
+            send_message_to_connection(conn, FRAME_NOTICE, NULL, notice);
+            continue;
+        }
+        if (conn->subscription_count == 1)
+        {
+            send_message_to_connection(conn, FRAME_NOTICE, NULL, "Erreur : Impossible de quitter votre dernier channel\n");
+            continue;
+        }
+        int was_current = sub == conn->subscriptions;
+        leave_subscription(conn, sub);
+        snprintf(notice, sizeof(notice), "Vous avez quitté le channel '%.49s'\n", name);
+        send_message_to_connection(conn, FRAME_NOTICE, NULL, notice);
+        if (was_current)
+        {
+            send_current_channel_to_connection(conn);
+        }
+    }
+}
+
+/**
+ * Fait passer une connexion de son channel courant à un nouveau channel
+ * (commande /switch). Les autres channels suivis sont conservés.
+ * @param conn La connexion.
+ * @param new_channel Le channel à rejoindre.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int switch_connection_channel(Connection *conn, Channel *new_channel)
+{
+    Subscription *current = conn->subscriptions;
+    Subscription *sub = find_subscription(conn->subscriptions, new_channel);
+    if (sub != NULL && sub != current)
+    {
+        promote_subscription(&conn->subscriptions, sub);
+        send_current_channel_to_connection(conn);
+    }
+    else if (begin_join(conn, new_channel, 1) == NULL)
+    {
+        return -1;
+    }
+    // Rejoindre le channel courant le quitte puis le rejoint : le JOIN précède le LEAVE
+    // dans la file du propriétaire, le membre n'y est donc jamais compté à zéro
+    leave_subscription(conn, current);
+    return 0;
+}
+
+/**
+ * Arme l'acceptation multishot sur le socket d'écoute d'un réacteur io_uring :
+ * une complétion par connexion acceptée, sans nouvelle soumission.
+ * @param reactor Le réacteur.
+ */
+void uring_arm_accept(Reactor *reactor)
+{
+    struct io_uring_sqe *sqe = io_ring_get_sqe(reactor->ring);
+    if (sqe == NULL)
+    {
+        fprintf(stderr, "Erreur : file io_uring pleine, acceptation non armée\n");
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor->listen_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = URING_ACCEPT;
+}
+
+/**
+ * Arme le poll multishot sur l'eventfd d'un réacteur io_uring (messages des autres réacteurs).
+ * @param reactor Le réacteur.
+ */
+void uring_arm_wake(Reactor *reactor)
+{
+    struct io_uring_sqe *sqe = io_ring_get_sqe(reactor->ring);
+    if (sqe == NULL)
+    {
+        fprintf(stderr, "Erreur : file io_uring pleine, réveil non armé\n");
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reactor->wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = URING_WAKE;
+}
+
+/**
+ * Arme la réception multishot d'une connexion : le noyau choisit un buffer libre
+ * parmi ceux du réacteur à chaque arrivée de données.
+ * @param conn La connexion.
+ * @return 0 en cas de succès, -1 si la file de soumission est pleine.
+ */
+int uring_arm_recv(Connection *conn)
+{
+    struct io_uring_sqe *sqe = io_ring_get_sqe(conn->reactor->ring);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_RECV;
+    conn->uring_pending++;
+    return 0;
+}
+
+/**
+ * Enregistre une nouvelle connexion dans la table des connexions du réacteur.
+ * @param reactor Le réacteur.
+ * @param client_socket Le socket du client (déjà non bloquant).
+ * @return La connexion créée, ou NULL en cas d'erreur.
+ */
+Connection *register_connection(Reactor *reactor, int client_socket)
+{
+    if (client_socket >= reactor->connections_capacity)
+    {
+        int new_capacity = reactor->connections_capacity ? reactor->connections_capacity : 1024;
+        while (new_capacity <= client_socket)
+        {
+            new_capacity *= 2;
+        }
+        Connection **new_table = realloc(reactor->connections, new_capacity * sizeof(Connection *));
+        if (new_table == NULL)
+        {
+            return NULL;
+        }
+        memset(new_table + reactor->connections_capacity, 0, (new_capacity - reactor->connections_capacity) * sizeof(Connection *));
+        reactor->connections = new_table;
+        reactor->connections_capacity = new_capacity;
+    }
+
+    Connection *conn = pool_alloc(&reactor->connection_pool);
+    if (conn == NULL)
+    {
+        return NULL;
+    }
+    conn->id = ((uint64_t)reactor->id << 56) | ++reactor->next_connection_id;
+    conn->socket = client_socket;
+    conn->accepted_ns = monotonic_ns();
+    conn->state = CONN_HANDSHAKE_NAME;
+    conn->reactor = reactor;
+    init_outbound_queue(&conn->queue, client_socket);
+
+    if (reactor->ring != NULL)
+    {
+        // Les envois passent par l'anneau ; la réception reste armée pour toute la connexion
+        conn->queue.submit_list = &reactor->send_pending;
+        if (uring_arm_recv(conn) == -1)
+        {
+            pool_free(&reactor->connection_pool, conn);
+            return NULL;
+        }
+    }
+    else
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1)
+        {
+            perror("Erreur lors de l'ajout du socket à epoll");
+            pool_free(&reactor->connection_pool, conn);
+            return NULL;
+        }
+        if (coalesce_bytes > 0)
+        {
+            conn->queue.flush_list = &reactor->flush_queues;
+        }
+    }
+
+    reactor->connections[client_socket] = conn;
+    atomic_fetch_add(&open_connections, 1);
+    return conn;
+}
+
+/**
+ * Libère une connexion fermée : sa file de sortie, son socket et son état.
+ * @param conn La connexion.
+ */
+void release_connection(Connection *conn)
+{
+    // Le noyau retire automatiquement le socket d'epoll lors du close()
+    clear_outbound_queue(&conn->queue);
+    close(conn->socket);
+    atomic_fetch_sub(&open_connections, 1);
+    pool_free(&conn->reactor->reader_pool, conn->input);
+    pool_free(&conn->reactor->connection_pool, conn);
+}
+
+/**
+ * Donne le lecteur de trames d'une connexion, pris dans le pool du réacteur
+ * s'il a été rendu.
+ * @param conn La connexion.
+ * @return Le lecteur, ou NULL si la mémoire manque.
+ */
+FrameReader *acquire_connection_reader(Connection *conn)
+{
+    if (conn->input == NULL)
+    {
+        conn->input = pool_alloc(&conn->reactor->reader_pool);
+    }
+    return conn->input;
+}
+
+/**
+ * Rend au pool le lecteur d'une connexion tramée sans trame partielle : un
+ * client inactif ne garde pas de buffer de réception.
+ * @param conn La connexion.
+ */
+void release_connection_reader(Connection *conn)
+{
+    if (conn->input != NULL && conn->input->start == conn->input->length && conn->state != CONN_NEGOTIATING)
+    {
+        pool_free(&conn->reactor->reader_pool, conn->input);
+        conn->input = NULL;
+    }
+}
+
+/**
+ * Libère une connexion io_uring fermée si plus aucune opération ne la désigne.
+ * @param conn La connexion.
+ */
+void release_uring_connection(Connection *conn)
+{
+    if (conn->uring_pending == 0 && !conn->queue.submitting)
+    {
+        release_connection(conn);
+    }
+}
+
+/**
+ * Ferme une connexion epoll : quitte son channel s'il y a lieu et libère son état.
+ * Avec io_uring, le socket est coupé et la connexion libérée à la dernière complétion.
+ * @param conn La connexion à fermer.
+ */
+void close_connection(Connection *conn)
+{
+    if (conn->state == CONN_CHAT)
+    {
+        while (conn->subscriptions != NULL)
+        {
+            leave_subscription(conn, conn->subscriptions);
+        }
+        atomic_fetch_sub(&reactor_client_count, 1);
+    }
+
+    conn->reactor->connections[conn->socket] = NULL;
+    unregister_outbound_queue(&conn->queue);
+    cancel_outbound_flush(&conn->queue);
+    if (conn->reactor->ring != NULL)
+    {
+        // La réception multishot et l'envoi en cours se terminent avec le shutdown()
+        conn->closing = 1;
+        shutdown(conn->socket, SHUT_RDWR);
+        release_uring_connection(conn);
+        return;
+    }
+    release_connection(conn);
+}
+
+/**
+ * Envoie à une connexion une plage de l'historique de son channel courant (commande /history).
+ * Lecture ponctuelle, demandée explicitement, faite par tranches au fil de l'envoi.
+ * @param conn La connexion.
+ * @param argument Ce qui suit "/history".
+ */
+void send_history_to_connection(Connection *conn, const char *argument)
+{
+    Channel *channel = conn->subscriptions->channel;
+    uint64_t first, last;
+    uint64_t started = monotonic_ns();
+    if (!resolve_history_range(channel, argument, &first, &last) || conn->evicted)
+    {
+        return;
+    }
+    outbound_send_history(&conn->queue, conn->socket, channel, first, last);
+    metric_add(METRIC_HISTORY_REQUESTS, 1);
+    metric_record_since(HISTOGRAM_HISTORY, started);
+}
+
+/**
+ * Envoie à une connexion la page d'historique du channel courant qui précède ce
+ * qu'elle a déjà reçu (commande /more).
+ * @param conn La connexion.
+ */
+void send_older_page_to_connection(Connection *conn)
+{
+    Subscription *sub = conn->subscriptions;
+    uint64_t first = 0, last = 0;
+    uint64_t started = monotonic_ns();
+    int found = resolve_older_page(sub->channel, sub->history_cursor, &first, &last);
+
+    char notice[BUFFER_SIZE];
+    format_page_notice(sub->channel, found, first, last, notice, sizeof(notice));
+    send_message_to_connection(conn, FRAME_NOTICE, sub->channel, notice);
+    if (!found || conn->evicted)
+    {
+        return;
+    }
+    outbound_send_history(&conn->queue, conn->socket, sub->channel, first, last);
+    sub->history_cursor = first;
+    metric_add(METRIC_HISTORY_REQUESTS, 1);
+    metric_record_since(HISTOGRAM_HISTORY, started);
+}
+
+/**
+ * Traite un message reçu sur une connexion epoll selon l'état de la connexion.
+ * Chaque recv() correspond à une unité de protocole, comme en mode thread.
+ * @param conn La connexion.
+ * @param data Le message reçu (terminé par '\0').
+ * @param length La taille du message.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int process_connection_message(Connection *conn, const char *data, size_t length)
+{
+    switch (conn->state)
+    {
+    case CONN_NEGOTIATING:
+        return 0; // Traité par process_framed_input
+
+    case CONN_HANDSHAKE_NAME:
+        strncpy(conn->client_name, data, sizeof(conn->client_name) - 1);
+        register_outbound_queue(&conn->queue, conn->client_name);
+        conn->state = CONN_HANDSHAKE_CHANNEL;
+        return 0;
+
+    case CONN_HANDSHAKE_CHANNEL:
+    {
+        if (atomic_fetch_add(&reactor_client_count, 1) >= max_clients)
+        {
+            atomic_fetch_sub(&reactor_client_count, 1);
+            metric_add(METRIC_SERVER_FULL, 1);
+            send_message_to_connection(conn, FRAME_NOTICE, NULL, "Erreur : Le serveur est plein. Connexion refusée.\n");
+            return -1;
+        }
+
+        // Le JOIN peut être traité aussitôt si ce réacteur est le propriétaire du channel
+        Channel *channel = find_or_create_channel(data);
+        conn->handshake_pending = 1;
+        if (channel == NULL || begin_join(conn, channel, 0) == NULL)
+        {
+            atomic_fetch_sub(&reactor_client_count, 1);
+            return -1;
+        }
+        conn->state = CONN_CHAT;
+        return 0;
+    }
+
+    case CONN_CHAT:
+    {
+        Channel *channel = conn->subscriptions->channel;
+        if (!take_token(&conn->send_bucket, &client_rate_limit))
+        {
+            const char *notice = throttle_notice(&conn->throttled, METRIC_CLIENT_THROTTLED);
+            if (notice != NULL)
+            {
+                send_message_to_connection(conn, FRAME_NOTICE, channel, notice);
+            }
+            return 0;
+        }
+
+        if (strncmp(data, "/join ", 6) == 0 || strncmp(data, "/leave ", 7) == 0)
+        {
+            char names[BUFFER_SIZE];
+            snprintf(names, sizeof(names), "%s", strchr(data, ' ') + 1);
+            if (data[1] == 'j')
+            {
+                return join_connection_channels(conn, names);
+            }
+            leave_connection_channels(conn, names);
+            return 0;
+        }
+
+        if (strcmp(data, "/channels") == 0)
+        {
+            char notice[BUFFER_SIZE];
+            format_subscription_list(conn->subscriptions, notice, sizeof(notice));
+            send_message_to_connection(conn, FRAME_NOTICE, channel, notice);
+            return 0;
+        }
+
+        if (strncmp(data, "/switch ", 8) == 0)
+        {
+            char new_channel_name[50];
+            if (sscanf(data + 8, "%49s", new_channel_name) != 1)
+            {
+                return 0;
+            }
+
+            Channel *new_channel = find_or_create_channel(new_channel_name);
+            if (new_channel == NULL)
+            {
+                send_message_to_connection(conn, FRAME_NOTICE, NULL, "Erreur : Impossible de rejoindre le nouveau channel\n");
+                // Le départ est notifié par close_connection
+                return -1;
+            }
+            return switch_connection_channel(conn, new_channel);
+        }
+
+        if (strncmp(data, "/search", 7) == 0 && (data[7] == '\0' || data[7] == ' '))
+        {
+            TextBuffer text = {.arena = &conn->arena};
+            format_search_results(&text, channel, data + 7);
+            if (text.data != NULL && !conn->evicted)
+            {
+                size_t search_length;
+                const char *search = finish_notice(&text, conn->queue.framed, channel, &search_length);
+                outbound_send(&conn->queue, conn->socket, search, search_length, 0);
+            }
+            arena_reset(&conn->arena);
+            return 0;
+        }
+
+        if (strncmp(data, "/history", 8) == 0 && (data[8] == '\0' || data[8] == ' '))
+        {
+            send_history_to_connection(conn, data + 8);
+            return 0;
+        }
+
+        if (strcmp(data, "/more") == 0)
+        {
+            send_older_page_to_connection(conn);
+            return 0;
+        }
+
+        if (strcmp(data, "/stats") == 0)
+        {
+            TextBuffer text = {.arena = &conn->arena};
+            format_metrics_text(&text, channel);
+            if (text.data != NULL && !conn->evicted)
+            {
+                size_t stats_length;
+                const char *stats = finish_notice(&text, conn->queue.framed, channel, &stats_length);
+                outbound_send(&conn->queue, conn->socket, stats, stats_length, 0);
+            }
+            arena_reset(&conn->arena);
+            return 0;
+        }
+
+        // Le seau du channel est partagé par les réacteurs : un message refusé ne part
+        // pas chez le propriétaire
+        if (!take_token(&channel->send_bucket, &channel_rate_limit))
+        {
+            const char *notice = throttle_notice(&conn->throttled, METRIC_CHANNEL_THROTTLED);
+            if (notice != NULL)
+            {
+                send_message_to_connection(conn, FRAME_NOTICE, channel, notice);
+            }
+            return 0;
+        }
+        conn->throttled = 0;
+
+        // Le propriétaire du channel journalise et diffuse ; l'ordre des messages
+        // d'un même client est garanti par la file FIFO entre les deux réacteurs
+        trace_begin_message(channel, conn->socket);
+        post_connection_message(conn, SHARD_CHAT, channel, data, length);
+        trace_end_message();
+        return 0;
+    }
+    }
+    return 0;
+}
+
+/**
+ * Traite les octets reçus d'un client tramé : préface, puis toutes les trames
+ * complètes, passées au même automate que les messages des clients texte.
+ * @param conn La connexion.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int process_framed_input(Connection *conn)
+{
+    if (conn->state == CONN_NEGOTIATING)
+    {
+        int negotiated = negotiate_framed_protocol(conn->socket, conn->input);
+        if (negotiated <= 0)
+        {
+            return negotiated;
+        }
+        conn->queue.framed = 1;
+        conn->state = CONN_HANDSHAKE_NAME;
+    }
+
+    FrameHeader header;
+    char payload[BUFFER_SIZE];
+    int result;
+    while ((result = frame_reader_next(conn->input, &header, payload)) == 1)
+    {
+        if (conn->state == CONN_HANDSHAKE_NAME)
+        {
+            // Nom et channel arrivent ensemble : plus de recv() qui se chevauchent
+            char client_name[50], channel_name[50];
+            if (header.type != FRAME_HANDSHAKE || parse_handshake_frame(payload, header.length, client_name, channel_name) == -1 ||
+                process_connection_message(conn, client_name, strlen(client_name)) == -1 ||
+                process_connection_message(conn, channel_name, strlen(channel_name)) == -1)
+            {
+                return -1;
+            }
+        }
+        else if (header.type == FRAME_TEXT && process_connection_message(conn, payload, header.length) == -1)
+        {
+            return -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * Traite un message reçu d'un client texte, ou le début d'une connexion tramée.
+ * @param conn La connexion.
+ * @param buffer Les octets reçus (au moins length + 1 octets, terminé ici par '\0').
+ * @param length Le nombre d'octets.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int process_text_input(Connection *conn, char *buffer, size_t length)
+{
+    // Un octet nul en tête de connexion annonce la préface du protocole tramé
+    if (conn->state == CONN_HANDSHAKE_NAME && buffer[0] == '\0')
+    {
+        if (acquire_connection_reader(conn) == NULL)
+        {
+            return -1;
+        }
+        memcpy(conn->input->data, buffer, length);
+        conn->input->length = length;
+        conn->state = CONN_NEGOTIATING;
+        return process_framed_input(conn);
+    }
+
+    buffer[length] = '\0';
+    return process_connection_message(conn, buffer, length);
+}
+
+/**
+ * Lit tout ce qui est disponible sur une connexion (edge-triggered : jusqu'à EAGAIN).
+ * @param conn La connexion.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int read_connection(Connection *conn)
+{
+    char buffer[BUFFER_SIZE];
+    while (1)
+    {
+        if (conn->queue.framed || conn->state == CONN_NEGOTIATING)
+        {
+            // Client tramé : les octets s'accumulent jusqu'à former des trames complètes
+            FrameReader *reader = acquire_connection_reader(conn);
+            if (reader == NULL)
+            {
+                return -1;
+            }
+            size_t capacity;
+            char *space = frame_reader_space(reader, &capacity);
+            uint64_t recv_start = trace_clock();
+            ssize_t read_size = recv(conn->socket, space, capacity, 0);
+            trace_received(recv_start);
+            if (read_size == 0)
+            {
+                return -1;
+            }
+            if (read_size < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                release_connection_reader(conn);
+                return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            }
+            reader->length += (size_t)read_size;
+            if (process_framed_input(conn) == -1)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        uint64_t recv_start = trace_clock();
+        ssize_t read_size = recv(conn->socket, buffer, sizeof(buffer) - 1, 0);
+        trace_received(recv_start);
+        if (read_size == 0)
+        {
+            return -1; // Connexion fermée par le client
+        }
+        if (read_size < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        if (process_text_input(conn, buffer, (size_t)read_size) == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+/**
+ * Traite les octets reçus en une fois par io_uring (buffer fourni au noyau) : ils
+ * sont découpés comme les recv() du mode epoll, en trames ou en messages texte
+ * d'au plus BUFFER_SIZE - 1 octets.
+ * @param conn La connexion.
+ * @param data Les octets reçus.
+ * @param length Le nombre d'octets.
+ * @return 0 si la connexion reste ouverte, -1 si elle doit être fermée.
+ */
+int receive_connection_data(Connection *conn, const char *data, size_t length)
+{
+    char buffer[BUFFER_SIZE];
+    while (length > 0)
+    {
+        size_t chunk;
+        if (conn->queue.framed || conn->state == CONN_NEGOTIATING)
+        {
+            FrameReader *reader = acquire_connection_reader(conn);
+            if (reader == NULL)
+            {
+                return -1;
+            }
+            size_t capacity;
+            char *space = frame_reader_space(reader, &capacity);
+            chunk = length < capacity ? length : capacity;
+            if (chunk == 0)
+            {
+                return -1; // Trame incomplète qui remplit tout le lecteur : invalide
+            }
+            memcpy(space, data, chunk);
+            reader->length += chunk;
+            if (process_framed_input(conn) == -1)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            chunk = length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1;
+            memcpy(buffer, data, chunk);
+            if (process_text_input(conn, buffer, chunk) == -1)
+            {
+                return -1;
+            }
+        }
+        data += chunk;
+        length -= chunk;
+    }
+    release_connection_reader(conn);
+    return 0;
+}
+
+/**
+ * Accepte toutes les connexions en attente sur le socket d'écoute du réacteur.
+ * @param reactor Le réacteur.
+ */
+void accept_connections(Reactor *reactor)
+{
+    while (1)
+    {
+        int client_socket = accept4(reactor->listen_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("Erreur lors de l'acceptation");
+            }
+            return;
+        }
+
+        metric_add(METRIC_ACCEPTED, 1);
+        if (admit_connection() == -1 || register_connection(reactor, client_socket) == NULL)
+        {
+            close(client_socket);
+        }
+    }
+}
+
+/**
+ * Soumet l'envoi des files confiées au réacteur pendant l'itération : un envoi
+ * vectorisé (IORING_OP_SENDMSG) par connexion, tous les destinataires d'une
+ * diffusion partant dans le même io_uring_enter. Une connexion n'a qu'un envoi
+ * en cours à la fois, ce qui garde l'ordre de ses messages. Si la file de
+ * soumission reste pleine, les files restantes attendent l'itération suivante.
+ * @param reactor Le réacteur.
+ */
+void submit_outbound_queues(Reactor *reactor)
+{
+    OutboundQueue *queue;
+    while ((queue = reactor->send_pending) != NULL)
+    {
+        reactor->send_pending = queue->submit_next;
+        queue->submit_next = NULL;
+        Connection *conn = (Connection *)((char *)queue - offsetof(Connection, queue));
+        if (conn->closing || conn->evicted || queue->head == NULL)
+        {
+            queue->submitting = 0;
+            if (conn->closing)
+            {
+                release_uring_connection(conn);
+            }
+            continue;
+        }
+
+        UringSend *send = reactor->free_sends;
+        if (send != NULL)
+        {
+            reactor->free_sends = send->next;
+        }
+        else if ((send = malloc(sizeof(UringSend))) == NULL)
+        {
+            perror("Erreur d'allocation d'un envoi io_uring");
+            queue->submitting = 0;
+            close_connection(conn);
+            continue;
+        }
+
+        struct io_uring_sqe *sqe = io_ring_get_sqe(reactor->ring);
+        if (sqe == NULL)
+        {
+            // Le noyau n'a rien pris (complétions à lire d'abord) : la file reste à envoyer
+            send->next = reactor->free_sends;
+            reactor->free_sends = send;
+            queue->submit_next = reactor->send_pending;
+            reactor->send_pending = queue;
+            break;
+        }
+
+        size_t requested;
+        int count = gather_outbound_iov(queue, send->iov, &requested);
+        send->header = (struct msghdr){.msg_iov = send->iov, .msg_iovlen = (size_t)count};
+        queue->pinned = count;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn->socket;
+        sqe->addr = (uint64_t)(uintptr_t)&send->header;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = (uint64_t)(uintptr_t)conn | URING_SEND;
+        conn->send = send;
+        conn->uring_pending++;
+        metric_add(METRIC_SOCKET_WRITES, 1);
+    }
+}
+
+/**
+ * Traite la fin d'un envoi io_uring : retire de la file ce qui est parti et
+ * relance l'envoi s'il reste des messages.
+ * @param conn La connexion.
+ * @param result Le nombre d'octets envoyés, ou -errno.
+ */
+void complete_uring_send(Connection *conn, int result)
+{
+    conn->send->next = conn->reactor->free_sends;
+    conn->reactor->free_sends = conn->send;
+    conn->send = NULL;
+    conn->uring_pending--;
+    conn->queue.pinned = 0;
+    conn->queue.submitting = 0;
+    if (conn->closing)
+    {
+        release_uring_connection(conn);
+        return;
+    }
+    if (conn->evict_deferred)
+    {
+        // Envoi interrompu par la déconnexion du client lent (échec attendu)
+        conn->evict_deferred = 0;
+        evict_slow_consumer(&conn->queue, conn->socket);
+        return;
+    }
+    if (result < 0)
+    {
+        close_connection(conn);
+        return;
+    }
+
+    consume_outbound_bytes(&conn->queue, (size_t)result);
+    if (conn->queue.head != NULL)
+    {
+        schedule_outbound_submit(&conn->queue);
+    }
+}
+
+/**
+ * Traite une complétion de la réception multishot d'une connexion : les données
+ * sont lues directement dans le buffer choisi par le noyau, qui lui est aussitôt rendu.
+ * @param conn La connexion.
+ * @param cqe La complétion.
+ */
+void complete_uring_recv(Connection *conn, const struct io_uring_cqe *cqe)
+{
+    Reactor *reactor = conn->reactor;
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    if (!more)
+    {
+        conn->uring_pending--;
+    }
+
+    int closing = conn->closing;
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!closing && cqe->res > 0)
+        {
+            // La réception est faite par le noyau : seule l'heure de sa complétion est connue
+            trace_received(trace_clock());
+            closing = receive_connection_data(conn, reactor->recv_buffers.buffers + (size_t)id * URING_RECV_BUFFER_SIZE, (size_t)cqe->res) == -1;
+        }
+        io_buffer_recycle(&reactor->recv_buffers, id);
+    }
+    else if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS))
+    {
+        closing = 1; // Fin de connexion ou erreur ; -ENOBUFS : tous les buffers pris, la réception est réarmée
+    }
+
+    if (conn->closing)
+    {
+        release_uring_connection(conn);
+    }
+    else if (closing)
+    {
+        close_connection(conn);
+    }
+    else if (!more && uring_arm_recv(conn) == -1)
+    {
+        close_connection(conn);
+    }
+}
+
+/**
+ * Écrit les files qui ont reçu des messages pendant la fenêtre de regroupement :
+ * une écriture vectorisée par connexion pour tous ses messages de la fenêtre.
+ * @param reactor Le réacteur.
+ */
+void flush_coalesced_queues(Reactor *reactor)
+{
+    OutboundQueue *queue;
+    while ((queue = reactor->flush_queues) != NULL)
+    {
+        reactor->flush_queues = queue->flush_next;
+        queue->flush_next = NULL;
+        queue->flush_pending = 0;
+        Connection *conn = (Connection *)((char *)queue - offsetof(Connection, queue));
+        if (!conn->evicted && flush_outbound_queue(queue, conn->socket) == -1)
+        {
+            close_connection(conn);
+        }
+    }
+    reactor->window_started = 0;
+}
+
+/**
+ * Ferme la fenêtre de regroupement d'un réacteur epoll s'il le faut. Elle reste
+ * ouverte tant que des événements arrivent, dans la limite de
+ * coalesce_window_us : au repos, le tour suivant ne trouve rien et les messages
+ * partent aussitôt ; sous charge, chaque connexion reçoit une rafale en une écriture.
+ * @param reactor Le réacteur.
+ * @param ready Le nombre d'événements du tour qui vient d'être traité.
+ */
+void close_coalescing_window(Reactor *reactor, int ready)
+{
+    if (reactor->flush_queues == NULL)
+    {
+        return;
+    }
+    uint64_t now = monotonic_ns();
+    if (reactor->window_started == 0)
+    {
+        reactor->window_started = now;
+    }
+    if (ready == 0 || now - reactor->window_started >= (uint64_t)coalesce_window_us * 1000)
+    {
+        flush_coalesced_queues(reactor);
+    }
+}
+
+/**
+ * Boucle d'un réacteur io_uring : un seul io_uring_enter par itération soumet les
+ * envois et réarmements préparés et attend les complétions suivantes.
+ * @param reactor Le réacteur.
+ */
+void run_uring_loop(Reactor *reactor)
+{
+    uring_arm_accept(reactor);
+    uring_arm_wake(reactor);
+
+    int overflow_left = 0;
+    while (1)
+    {
+        submit_outbound_queues(reactor);
+        // S'il reste des messages en débordement ou des envois pas encore soumis, on réessaie rapidement
+        if (io_ring_submit(reactor->ring, 1, overflow_left || reactor->send_pending != NULL ? 1000000L : -1) == -1)
+        {
+            perror("Erreur lors de io_uring_enter");
+            break;
+        }
+
+        struct io_uring_cqe cqe;
+        while (io_ring_next_cqe(reactor->ring, &cqe))
+        {
+            Connection *conn = (Connection *)(uintptr_t)(cqe.user_data & ~(uint64_t)URING_OPERATION_MASK);
+            int more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+            switch ((UringOperation)(cqe.user_data & URING_OPERATION_MASK))
+            {
+            case URING_ACCEPT:
+                if (cqe.res >= 0)
+                {
+                    metric_add(METRIC_ACCEPTED, 1);
+                    if (admit_connection() == -1 || register_connection(reactor, cqe.res) == NULL)
+                    {
+                        close(cqe.res);
+                    }
+                }
+                else if (cqe.res != -ECONNABORTED && cqe.res != -EINTR)
+                {
+                    fprintf(stderr, "Erreur lors de l'acceptation : %s\n", strerror(-cqe.res));
+                }
+                if (!more)
+                {
+                    uring_arm_accept(reactor);
+                }
+                break;
+
+            case URING_WAKE:
+                drain_shard_queues(reactor);
+                if (!more)
+                {
+                    uring_arm_wake(reactor);
+                }
+                break;
+
+            case URING_RECV:
+                complete_uring_recv(conn, &cqe);
+                break;
+
+            case URING_SEND:
+                complete_uring_send(conn, cqe.res);
+                break;
+            }
+        }
+
+        overflow_left = flush_shard_messages(reactor);
+    }
+}
+
+/**
+ * Arrête un réacteur pour une mise à jour à chaud. Les réacteurs échangent
+ * encore leurs messages en attente, par tours synchronisés, jusqu'à ce que le
+ * thread de mise à jour n'en voie plus ; ils attendent ensuite la fin de la
+ * reprise, et ne reprennent la main que si elle a échoué.
+ * @param reactor Le réacteur.
+ */
+void park_reactor(Reactor *reactor)
+{
+    while (1)
+    {
+        pthread_barrier_wait(&upgrade_barrier);
+        if (upgrade_quiet)
+        {
+            break;
+        }
+        drain_shard_queues(reactor);
+        flush_shard_messages(reactor);
+        pthread_barrier_wait(&upgrade_barrier);
+    }
+    pthread_barrier_wait(&upgrade_barrier);
+}
+
+/**
+ * Boucle principale d'un réacteur : gère ses connexions et les messages des autres réacteurs.
+ * @param args Le réacteur.
+ * @return NULL.
+ */
+void *run_reactor(void *args)
+{
+    Reactor *reactor = args;
+
+    // Un réacteur par cœur quand c'est possible
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count > 1)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(reactor->id % cpu_count, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+
+    if (reactor->ring != NULL)
+    {
+        run_uring_loop(reactor);
+        return NULL;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int overflow_left = 0;
+    while (1)
+    {
+        if (atomic_load_explicit(&upgrade_requested, memory_order_acquire))
+        {
+            flush_coalesced_queues(reactor);
+            park_reactor(reactor);
+            overflow_left = flush_shard_messages(reactor);
+        }
+
+        // Fenêtre de regroupement ouverte : on regarde seulement si d'autres événements sont prêts.
+        // S'il reste des messages en débordement, on réessaie rapidement
+        int timeout = reactor->flush_queues != NULL ? 0 : (overflow_left ? 1 : -1);
+        int ready = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, timeout);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Erreur lors de epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL)
+            {
+                accept_connections(reactor);
+                continue;
+            }
+            if (conn == (Connection *)reactor)
+            {
+                drain_shard_queues(reactor);
+                continue;
+            }
+
+            int closing = 0;
+            if (events[i].events & EPOLLIN)
+            {
+                closing = read_connection(conn) == -1;
+            }
+            if (!closing && (events[i].events & EPOLLOUT))
+            {
+                closing = flush_outbound_queue(&conn->queue, conn->socket) == -1;
+            }
+            if (!closing && (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)))
+            {
+                closing = 1;
+            }
+            if (closing)
+            {
+                close_connection(conn);
+            }
+        }
+
+        overflow_left = flush_shard_messages(reactor);
+        close_coalescing_window(reactor, ready);
+    }
+
+    return NULL;
+}
+
+/**
+ * Confie un événement au thread de fédération.
+ * @param event L'événement (la propriété est transférée).
+ */
+void post_federation_event(FederationEvent *event)
+{
+    event->next = NULL;
+    pthread_mutex_lock(&federation_mutex);
+    if (federation_tail != NULL)
+    {
+        federation_tail->next = event;
+    }
+    else
+    {
+        federation_head = event;
+    }
+    federation_tail = event;
+    pthread_mutex_unlock(&federation_mutex);
+
+    uint64_t one = 1;
+    if (write(federation_wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+    {
+        perror("Erreur lors du réveil du thread de fédération");
+    }
+}
+
+/**
+ * Signale que le channel vient de gagner son premier membre local ou de perdre
+ * le dernier : le thread de fédération l'annoncera aux instances pairs.
+ * @param channel Le channel.
+ */
+void federation_interest_changed(Channel *channel)
+{
+    if (!federation_enabled)
+    {
+        return;
+    }
+    FederationEvent *event = block_alloc(sizeof(FederationEvent));
+    if (event != NULL)
+    {
+        event->channel = channel;
+        event->length = 0;
+        post_federation_event(event);
+    }
+}
+
+/**
+ * Relaie un message né sur cette instance aux instances pairs qui ont des
+ * membres dans le channel. Sans pair intéressé, rien n'est préparé.
+ * @param channel Le channel.
+ * @param type PEER_CHAT (message à journaliser) ou PEER_NOTICE.
+ * @param sender L'expéditeur, NULL pour une notification.
+ * @param text Le texte brut du message.
+ */
+void relay_to_peers(Channel *channel, PeerFrameType type, const char *sender, const char *text)
+{
+    if (!federation_enabled || atomic_load_explicit(&channel->peer_interest, memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    if (sender == NULL)
+    {
+        sender = "";
+    }
+    size_t name_length = strlen(channel->name);
+    size_t sender_length = strnlen(sender, 49);
+    size_t text_length = strnlen(text, BUFFER_SIZE - 1);
+    size_t payload_length = name_length + 1 + sender_length + 1 + text_length;
+
+    FederationEvent *event = block_alloc(sizeof(FederationEvent) + FRAME_HEADER_SIZE + payload_length);
+    if (event == NULL)
+    {
+        return;
+    }
+    event->channel = channel;
+    event->length = FRAME_HEADER_SIZE + payload_length;
+    frame_encode_header((unsigned char *)event->data, type, 0, 0, (uint32_t)payload_length);
+    char *payload = event->data + FRAME_HEADER_SIZE;
+    memcpy(payload, channel->name, name_length + 1);
+    memcpy(payload + name_length + 1, sender, sender_length);
+    payload[name_length + 1 + sender_length] = '\0';
+    memcpy(payload + name_length + 1 + sender_length + 1, text, text_length);
+    post_federation_event(event);
+}
+
+/**
+ * Lit une adresse de fédération : "unix:CHEMIN" ou "HÔTE:PORT" (IPv4).
+ * @param address L'adresse.
+ * @param storage Reçoit l'adresse de socket.
+ * @param length Reçoit sa taille.
+ * @return 0 en cas de succès, -1 si l'adresse est invalide.
+ */
+int parse_peer_address(const char *address, struct sockaddr_storage *storage, socklen_t *length)
+{
+    memset(storage, 0, sizeof(*storage));
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        struct sockaddr_un *un = (struct sockaddr_un *)storage;
+        if (address[5] == '\0' || strlen(address + 5) >= sizeof(un->sun_path))
+        {
+            return -1;
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address + 5);
+        *length = sizeof(struct sockaddr_un);
+        return 0;
+    }
+
+    const char *colon = strrchr(address, ':');
+    char host[64];
+    if (colon == NULL || colon == address || (size_t)(colon - address) >= sizeof(host))
+    {
+        return -1;
+    }
+    memcpy(host, address, (size_t)(colon - address));
+    host[colon - address] = '\0';
+    int port = atoi(colon + 1);
+    struct sockaddr_in *in = (struct sockaddr_in *)storage;
+    in->sin_family = AF_INET;
+    in->sin_port = htons((uint16_t)port);
+    if (port < 1 || port > 65535 || inet_pton(AF_INET, host, &in->sin_addr) != 1)
+    {
+        return -1;
+    }
+    *length = sizeof(struct sockaddr_in);
+    return 0;
+}
+
+/**
+ * Occupe un emplacement de liaison pour un socket connecté à une instance paire.
+ * @param peer_socket Le socket.
+ * @return La liaison, ou NULL s'il n'y a plus d'emplacement (le socket est fermé).
+ */
+PeerLink *open_peer_link(int peer_socket)
+{
+    for (int i = 0; i < FEDERATION_MAX_LINKS; ++i)
+    {
+        PeerLink *link = &peer_links[i];
+        if (link->socket == -1)
+        {
+            set_nonblocking(peer_socket);
+            link->socket = peer_socket;
+            link->node_id = -1;
+            link->connect_node = -1;
+            link->input_length = 0;
+            init_outbound_queue(&link->queue, peer_socket);
+            return link;
+        }
+    }
+    fprintf(stderr, "Fédération : trop de liaisons ouvertes\n");
+    close(peer_socket);
+    return NULL;
+}
+
+/**
+ * Ferme une liaison : l'instance paire n'a plus d'intérêt enregistré ici, et
+ * la connexion sera retentée si c'est à nous de l'ouvrir.
+ * @param link La liaison.
+ */
+void close_peer_link(PeerLink *link)
+{
+    if (link->node_id >= 0 && links_by_node[link->node_id] == link)
+    {
+        links_by_node[link->node_id] = NULL;
+        unsigned long mask = ~(1UL << link->node_id);
+        for (Channel *channel = atomic_load_explicit(&channel_list, memory_order_acquire); channel != NULL; channel = channel->next_created)
+        {
+            atomic_fetch_and_explicit(&channel->peer_interest, mask, memory_order_relaxed);
+        }
+        for (int i = 0; i < peer_config_count; ++i)
+        {
+            if (peer_configs[i].node_id == link->node_id)
+            {
+                peer_configs[i].next_attempt_ns = monotonic_ns() + FEDERATION_RETRY_MS * 1000000ULL;
+            }
+        }
+        printf("Fédération : instance %d déconnectée\n", link->node_id);
+    }
+    unregister_outbound_queue(&link->queue);
+    clear_outbound_queue(&link->queue);
+    close(link->socket);
+    link->socket = -1;
+}
+
+/**
+ * Envoie une trame déjà encodée à une instance paire, par sa file de sortie.
+ * La politique client lent ne s'applique pas : une annonce jetée laisserait la
+ * table d'intérêt du pair fausse jusqu'à la prochaine connexion. Une liaison
+ * qui ne suit plus est donc fermée, et la reconnexion annonce à nouveau les
+ * channels des deux instances.
+ * @param link La liaison.
+ * @param data La trame.
+ * @param length Sa taille.
+ * @return 0 si la liaison reste ouverte, -1 si elle a été fermée.
+ */
+int send_peer_data(PeerLink *link, const char *data, size_t length)
+{
+    int result = enqueue_outbound(&link->queue, link->socket, data, length, NULL, 0);
+    size_t queued = atomic_load_explicit(&link->queue.queued_bytes, memory_order_relaxed);
+    if (result == 0 && queued > peer_queue_bytes)
+    {
+        printf("Fédération : liaison avec l'instance %d coupée (%zu octets en attente)\n", link->node_id, queued);
+        result = -1;
+    }
+    if (result != 0)
+    {
+        close_peer_link(link);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Envoie une trame de contrôle (présentation, abonnement) à une instance paire.
+ * @param link La liaison.
+ * @param type Le type de trame.
+ * @param sequence Le numéro porté par l'en-tête.
+ * @param payload Les données (peut être NULL).
+ * @param length Leur taille.
+ * @return 0 si la liaison reste ouverte, -1 si elle a été fermée.
+ */
+int send_peer_frame(PeerLink *link, PeerFrameType type, uint64_t sequence, const char *payload, size_t length)
+{
+    char frame[FRAME_HEADER_SIZE + 64];
+    frame_encode_header((unsigned char *)frame, type, 0, sequence, (uint32_t)length);
+    if (length > 0)
+    {
+        memcpy(frame + FRAME_HEADER_SIZE, payload, length);
+    }
+    return send_peer_data(link, frame, FRAME_HEADER_SIZE + length);
+}
+
+/**
+ * Associe une liaison à l'instance paire qu'elle relie et lui annonce les
+ * channels où cette instance a des membres.
+ * @param link La liaison.
+ * @param peer_node L'identifiant de l'instance paire.
+ */
+void bind_peer_link(PeerLink *link, int peer_node)
+{
+    if (links_by_node[peer_node] != NULL)
+    {
+        close_peer_link(links_by_node[peer_node]); // Reconnexion : l'ancienne liaison est morte
+    }
+    link->node_id = peer_node;
+    links_by_node[peer_node] = link;
+    char name[50];
+    snprintf(name, sizeof(name), "pair %d", peer_node);
+    register_outbound_queue(&link->queue, name);
+    printf("Fédération : instance %d connectée\n", peer_node);
+
+    for (Channel *channel = atomic_load_explicit(&channel_list, memory_order_acquire); channel != NULL; channel = channel->next_created)
+    {
+        if (channel->peer_advertised && send_peer_frame(link, PEER_SUBSCRIBE, 0, channel->name, strlen(channel->name)) == -1)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Annonce aux instances pairs que le channel a maintenant des membres locaux, ou
+ * n'en a plus. L'état est relu au moment de l'annonce : des changements
+ * rapprochés ne produisent que les annonces nécessaires.
+ * @param channel Le channel.
+ */
+void advertise_channel(Channel *channel)
+{
+    int wanted = atomic_load(&channel->client_count) > 0;
+    if (wanted == channel->peer_advertised)
+    {
+        return;
+    }
+    channel->peer_advertised = wanted;
+    for (int node = 0; node < FEDERATION_MAX_NODES; ++node)
+    {
+        if (links_by_node[node] != NULL)
+        {
+            send_peer_frame(links_by_node[node], wanted ? PEER_SUBSCRIBE : PEER_UNSUBSCRIBE, 0, channel->name, strlen(channel->name));
+        }
+    }
+}
+
+/**
+ * Traite les événements déposés pour le thread de fédération : annonces, et
+ * relais des messages vers les seules instances intéressées par leur channel.
+ */
+void handle_federation_events()
+{
+    uint64_t counter;
+    while (read(federation_wake_fd, &counter, sizeof(counter)) > 0)
+    {
+    }
+    pthread_mutex_lock(&federation_mutex);
+    FederationEvent *event = federation_head;
+    federation_head = federation_tail = NULL;
+    pthread_mutex_unlock(&federation_mutex);
+
+    while (event != NULL)
+    {
+        FederationEvent *next = event->next;
+        if (event->length == 0)
+        {
+            advertise_channel(event->channel);
+        }
+        else
+        {
+            unsigned long interest = atomic_load_explicit(&event->channel->peer_interest, memory_order_relaxed);
+            unsigned long relays = 0;
+            for (int node = 0; interest != 0; ++node, interest >>= 1)
+            {
+                if ((interest & 1) && links_by_node[node] != NULL && send_peer_data(links_by_node[node], event->data, event->length) == 0)
+                {
+                    relays++;
+                }
+            }
+            metric_add(METRIC_PEER_RELAYS, relays);
+        }
+        block_free(event);
+        event = next;
+    }
+}
+
+/**
+ * Livre aux membres locaux un message relayé par une instance paire : il est
+ * journalisé et diffusé comme un message local, mais jamais relayé à nouveau
+ * (chaque instance relaie elle-même ses messages à tous les pairs intéressés).
+ * Le message reçoit un numéro de cette instance : les numéros de /history #K
+ * sont propres à chaque instance, l'ordre d'arrivée des messages y diffère.
+ * Appelé par le thread de livraison (chargement du channel, journalisation).
+ * @param type PEER_CHAT ou PEER_NOTICE.
+ * @param channel_name Le channel.
+ * @param sender L'expéditeur (vide pour une notification).
+ * @param text Le texte, terminé par '\0'.
+ * @param text_length La taille du texte.
+ */
+void deliver_peer_message(PeerFrameType type, const char *channel_name, const char *sender, const char *text, size_t text_length)
+{
+    Channel *channel = find_or_create_channel(channel_name);
+    if (channel == NULL)
+    {
+        return;
+    }
+    metric_add(METRIC_PEER_RECEIVED, 1);
+
+    if (server_mode == MODE_EPOLL)
+    {
+        // Le propriétaire du channel journalise et diffuse, comme pour un message local
+        Reactor *owner = &reactors[channel->owner];
+        ShardMessage *msg = create_shard_message(type == PEER_CHAT ? SHARD_REMOTE_CHAT : SHARD_REMOTE_NOTICE, channel->owner, channel, text, text_length);
+        if (msg == NULL)
+        {
+            return;
+        }
+        strncpy(msg->client_name, sender, sizeof(msg->client_name) - 1);
+        msg->client_name[sizeof(msg->client_name) - 1] = '\0';
+        pthread_mutex_lock(&owner->remote_lock);
+        if (owner->remote_tail != NULL)
+        {
+            owner->remote_tail->next = msg;
+        }
+        else
+        {
+            owner->remote_head = msg;
+        }
+        owner->remote_tail = msg;
+        pthread_mutex_unlock(&owner->remote_lock);
+        uint64_t one = 1;
+        if (write(owner->wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        {
+            perror("Erreur lors du réveil d'un réacteur");
+        }
+        return;
+    }
+
+    if (type == PEER_CHAT)
+    {
+        char formatted_message[BUFFER_SIZE];
+        uint64_t sequence;
+        if (log_message(channel, sender, text, formatted_message, sizeof(formatted_message), &sequence) == 0)
+        {
+            broadcast_message(channel, FRAME_CHAT, sequence, formatted_message, NULL);
+        }
+    }
+    else
+    {
+        broadcast_message(channel, FRAME_NOTICE, 0, text, NULL);
+    }
+}
+
+/**
+ * Confie un message relayé par une instance paire au thread de livraison.
+ * @param type PEER_CHAT ou PEER_NOTICE.
+ * @param channel_name Le channel.
+ * @param sender L'expéditeur (vide pour une notification).
+ * @param text Le texte.
+ * @param text_length La taille du texte.
+ */
+void post_peer_delivery(PeerFrameType type, const char *channel_name, const char *sender, const char *text, size_t text_length)
+{
+    PeerDelivery *delivery = block_alloc(sizeof(PeerDelivery) + text_length + 1);
+    if (delivery == NULL)
+    {
+        return;
+    }
+    delivery->next = NULL;
+    delivery->type = type;
+    snprintf(delivery->channel_name, sizeof(delivery->channel_name), "%s", channel_name);
+    snprintf(delivery->sender, sizeof(delivery->sender), "%s", sender);
+    delivery->length = text_length;
+    memcpy(delivery->text, text, text_length);
+    delivery->text[text_length] = '\0';
+
+    pthread_mutex_lock(&peer_delivery_mutex);
+    if (peer_delivery_tail != NULL)
+    {
+        peer_delivery_tail->next = delivery;
+    }
+    else
+    {
+        peer_delivery_head = delivery;
+    }
+    peer_delivery_tail = delivery;
+    pthread_mutex_unlock(&peer_delivery_mutex);
+    pthread_cond_signal(&peer_delivery_cond);
+}
+
+/**
+ * Thread de livraison des messages des instances pairs, dans leur ordre d'arrivée.
+ * @param args Inutilisé.
+ * @return NULL.
+ */
+void *run_peer_delivery(void *args)
+{
+    (void)args;
+    while (1)
+    {
+        pthread_mutex_lock(&peer_delivery_mutex);
+        while (peer_delivery_head == NULL || peer_delivery_paused)
+        {
+            pthread_cond_wait(&peer_delivery_cond, &peer_delivery_mutex);
+        }
+        PeerDelivery *delivery = peer_delivery_head;
+        peer_delivery_head = peer_delivery_tail = NULL;
+        peer_delivery_busy = 1;
+        pthread_mutex_unlock(&peer_delivery_mutex);
+
+        while (delivery != NULL)
+        {
+            PeerDelivery *next = delivery->next;
+            deliver_peer_message((PeerFrameType)delivery->type, delivery->channel_name, delivery->sender, delivery->text, delivery->length);
+            block_free(delivery);
+            delivery = next;
+        }
+
+        pthread_mutex_lock(&peer_delivery_mutex);
+        peer_delivery_busy = 0;
+        pthread_mutex_unlock(&peer_delivery_mutex);
+        pthread_cond_broadcast(&peer_delivery_idle);
+    }
+    return NULL;
+}
+
+/**
+ * Suspend la livraison des messages des pairs avant l'arrêt des réacteurs :
+ * attend la fin du lot en cours, les suivants restent en file (transmis au
+ * nouveau processus par send_handover).
+ */
+void pause_peer_delivery()
+{
+    pthread_mutex_lock(&peer_delivery_mutex);
+    peer_delivery_paused = 1;
+    while (peer_delivery_busy)
+    {
+        pthread_cond_wait(&peer_delivery_idle, &peer_delivery_mutex);
+    }
+    pthread_mutex_unlock(&peer_delivery_mutex);
+}
+
+/**
+ * Reprend la livraison des messages des pairs (mise à jour à chaud interrompue).
+ */
+void resume_peer_delivery()
+{
+    pthread_mutex_lock(&peer_delivery_mutex);
+    peer_delivery_paused = 0;
+    pthread_mutex_unlock(&peer_delivery_mutex);
+    pthread_cond_signal(&peer_delivery_cond);
+}
+
+/**
+ * Traite une trame reçue d'une instance paire.
+ * @param link La liaison.
+ * @param header L'en-tête de la trame.
+ * @param payload Les données, suivies d'un '\0' ajouté.
+ * @return 0 en cas de succès, -1 si la trame est invalide.
+ */
+int process_peer_frame(PeerLink *link, const FrameHeader *header, char *payload)
+{
+    if (header->type == PEER_HELLO)
+    {
+        int peer_node = (int)header->sequence;
+        if (link->node_id != -1 || header->sequence >= FEDERATION_MAX_NODES || peer_node == node_id)
+        {
+            return -1;
+        }
+        bind_peer_link(link, peer_node);
+        return 0;
+    }
+    if (link->node_id == -1)
+    {
+        return -1; // Pas de trame avant la présentation
+    }
+
+    switch (header->type)
+    {
+    case PEER_SUBSCRIBE:
+    case PEER_UNSUBSCRIBE:
+    {
+        if (header->length == 0 || header->length >= 50 || memchr(payload, '\0', header->length) != NULL)
+        {
+            return -1;
+        }
+        Channel *channel = find_or_register_channel(payload);
+        if (channel == NULL)
+        {
+            return 0;
+        }
+        if (header->type == PEER_SUBSCRIBE)
+        {
+            atomic_fetch_or_explicit(&channel->peer_interest, 1UL << link->node_id, memory_order_relaxed);
+        }
+        else
+        {
+            atomic_fetch_and_explicit(&channel->peer_interest, ~(1UL << link->node_id), memory_order_relaxed);
+        }
+        return 0;
+    }
+
+    case PEER_CHAT:
+    case PEER_NOTICE:
+    {
+        // "channel\0expéditeur\0texte"
+        const char *end = payload + header->length;
+        const char *sender = memchr(payload, '\0', header->length);
+        const char *text = sender != NULL ? memchr(sender + 1, '\0', (size_t)(end - sender - 1)) : NULL;
+        if (text == NULL || sender - payload == 0 || sender - payload >= 50 || text - sender - 1 >= 50)
+        {
+            return -1;
+        }
+        sender++;
+        text++;
+        size_t text_length = (size_t)(end - text);
+        if (text_length == 0 || text_length >= BUFFER_SIZE || memchr(text, '\0', text_length) != NULL)
+        {
+            return -1;
+        }
+        post_peer_delivery((PeerFrameType)header->type, payload, sender, text, text_length);
+        return 0;
+    }
+
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Lit ce qui est disponible sur une liaison et traite les trames complètes.
+ * @param link La liaison.
+ * @return 0 si la liaison reste ouverte, -1 si elle doit être fermée.
+ */
+int read_peer_link(PeerLink *link)
+{
+    while (1)
+    {
+        ssize_t read_size = recv(link->socket, link->input + link->input_length, sizeof(link->input) - link->input_length, 0);
+        if (read_size == 0)
+        {
+            return -1;
+        }
+        if (read_size < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        link->input_length += (size_t)read_size;
+
+        size_t start = 0;
+        while (link->input_length - start >= FRAME_HEADER_SIZE)
+        {
+            FrameHeader header;
+            if (frame_decode_header((const unsigned char *)link->input + start, &header) == -1 || header.length > PEER_MAX_PAYLOAD)
+            {
+                return -1;
+            }
+            if (link->input_length - start < FRAME_HEADER_SIZE + header.length)
+            {
+                break;
+            }
+            char payload[PEER_MAX_PAYLOAD + 1];
+            memcpy(payload, link->input + start + FRAME_HEADER_SIZE, header.length);
+            payload[header.length] = '\0';
+            start += FRAME_HEADER_SIZE + header.length;
+            if (process_peer_frame(link, &header, payload) == -1)
+            {
+                return -1;
+            }
+            if (link->socket == -1)
+            {
+                return 0; // Liaison fermée pendant le traitement (envoi impossible)
+            }
+        }
+        memmove(link->input, link->input + start, link->input_length - start);
+        link->input_length -= start;
+    }
+}
+
+/**
+ * Termine l'ouverture d'une liaison vers une instance paire : présentation,
+ * puis association à l'instance.
+ * @param link La liaison connectée.
+ * @param peer_node L'instance jointe.
+ */
+void complete_peer_connect(PeerLink *link, int peer_node)
+{
+    link->connect_node = -1;
+    if (send_peer_frame(link, PEER_HELLO, (uint64_t)node_id, NULL, 0) == 0)
+    {
+        bind_peer_link(link, peer_node);
+    }
+}
+
+/**
+ * Cherche la connexion en cours vers une instance paire.
+ * @param peer_node L'instance.
+ * @return La liaison en cours de connexion, ou NULL.
+ */
+PeerLink *find_connecting_link(int peer_node)
+{
+    for (int i = 0; i < FEDERATION_MAX_LINKS; ++i)
+    {
+        if (peer_links[i].socket != -1 && peer_links[i].connect_node == peer_node)
+        {
+            return &peer_links[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Ouvre les liaisons manquantes vers les instances paires d'identifiant plus
+ * petit (les autres se connectent à nous), au plus une tentative par
+ * FEDERATION_RETRY_MS et par pair. Les connexions sont non bloquantes : un pair
+ * injoignable ne retarde pas les relais vers les autres. Elles sont terminées
+ * par la boucle du thread (POLLOUT), et abandonnées après FEDERATION_CONNECT_MS.
+ * @return 1 s'il reste une liaison à ouvrir ou en cours d'ouverture, 0 sinon.
+ */
+int connect_to_peers()
+{
+    int missing = 0;
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < peer_config_count; ++i)
+    {
+        PeerConfig *config = &peer_configs[i];
+        if (config->node_id >= node_id || links_by_node[config->node_id] != NULL)
+        {
+            continue;
+        }
+        PeerLink *pending = find_connecting_link(config->node_id);
+        if (pending != NULL)
+        {
+            if (now >= pending->connect_deadline_ns)
+            {
+                close_peer_link(pending); // Pair muet : retenté au prochain délai
+            }
+            missing = 1;
+            continue;
+        }
+        if (now < config->next_attempt_ns)
+        {
+            missing = 1;
+            continue;
+        }
+        config->next_attempt_ns = now + FEDERATION_RETRY_MS * 1000000ULL;
+
+        struct sockaddr_storage address;
+        socklen_t address_length;
+        parse_peer_address(config->address, &address, &address_length); // Validée à la lecture des options
+        int peer_socket = socket(address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int result = peer_socket == -1 ? -1 : connect(peer_socket, (struct sockaddr *)&address, address_length);
+        if (result == -1 && (peer_socket == -1 || errno != EINPROGRESS))
+        {
+            if (peer_socket != -1)
+            {
+                close(peer_socket);
+            }
+            missing = 1;
+            continue;
+        }
+        PeerLink *link = open_peer_link(peer_socket);
+        if (link == NULL)
+        {
+            missing = 1;
+            continue;
+        }
+        if (result == -1)
+        {
+            link->connect_node = config->node_id;
+            link->connect_deadline_ns = now + FEDERATION_CONNECT_MS * 1000000ULL;
+            missing = 1;
+            continue;
+        }
+        complete_peer_connect(link, config->node_id);
+    }
+    return missing;
+}
+
+/**
+ * Crée le socket où les instances paires se connectent.
+ * @return Le socket, ou -1 en cas d'erreur.
+ */
+int create_peer_listen_socket()
+{
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    parse_peer_address(peer_listen_address, &address, &address_length);
+    int listen_socket = socket(address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_socket == -1)
+    {
+        return -1;
+    }
+    if (address.ss_family == AF_UNIX)
+    {
+        unlink(((struct sockaddr_un *)&address)->sun_path); // Socket laissé par une instance précédente
+    }
+    else
+    {
+        int enable = 1;
+        setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    }
+    if (bind(listen_socket, (struct sockaddr *)&address, address_length) == -1 || listen(listen_socket, SOMAXCONN) == -1)
+    {
+        close(listen_socket);
+        return -1;
+    }
+    set_nonblocking(listen_socket);
+    return listen_socket;
+}
+
+/**
+ * Thread de fédération : tient les liaisons avec les instances pairs, leur
+ * annonce les channels où cette instance a des membres, relaie les messages
+ * locaux aux seules instances intéressées et livre localement les leurs.
+ * @param args Le socket d'écoute des pairs (int *), -1 si aucun.
+ * @return NULL.
+ */
+void *run_federation(void *args)
+{
+    int listen_socket = *(int *)args;
+    free(args);
+    struct pollfd fds[2 + FEDERATION_MAX_LINKS];
+    PeerLink *polled[2 + FEDERATION_MAX_LINKS];
+
+    while (1)
+    {
+        int missing = connect_to_peers();
+        int count = 0;
+        fds[count++] = (struct pollfd){.fd = federation_wake_fd, .events = POLLIN};
+        if (listen_socket != -1)
+        {
+            fds[count++] = (struct pollfd){.fd = listen_socket, .events = POLLIN};
+        }
+        int first_link = count;
+        for (int i = 0; i < FEDERATION_MAX_LINKS; ++i)
+        {
+            if (peer_links[i].socket != -1)
+            {
+                // Connexion en cours : seul POLLOUT (ou une erreur) en annonce la fin
+                short events = peer_links[i].connect_node != -1 ? POLLOUT : POLLIN | (peer_links[i].queue.head != NULL ? POLLOUT : 0);
+                polled[count] = &peer_links[i];
+                fds[count++] = (struct pollfd){.fd = peer_links[i].socket, .events = events};
+            }
+        }
+        if (poll(fds, (nfds_t)count, missing ? FEDERATION_RETRY_MS : -1) == -1 && errno != EINTR)
+        {
+            perror("Erreur lors de l'attente des liaisons de fédération");
+            return NULL;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            handle_federation_events();
+        }
+        if (listen_socket != -1 && (fds[1].revents & POLLIN))
+        {
+            int peer_socket;
+            while ((peer_socket = accept4(listen_socket, NULL, NULL, SOCK_CLOEXEC)) != -1)
+            {
+                open_peer_link(peer_socket); // Associée à son instance à la réception de PEER_HELLO
+            }
+        }
+        for (int i = first_link; i < count; ++i)
+        {
+            PeerLink *link = polled[i];
+            if (link->socket != fds[i].fd || fds[i].revents == 0)
+            {
+                continue; // Fermée (ou remplacée) pendant cette itération
+            }
+            if (link->connect_node != -1)
+            {
+                int error = 0;
+                socklen_t error_length = sizeof(error);
+                if (getsockopt(link->socket, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1 || error != 0)
+                {
+                    close_peer_link(link);
+                }
+                else
+                {
+                    complete_peer_connect(link, link->connect_node);
+                }
+                continue;
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && read_peer_link(link) == -1)
+            {
+                close_peer_link(link);
+                continue;
+            }
+            if (link->socket != -1 && (fds[i].revents & POLLOUT) && flush_outbound_queue(&link->queue, link->socket) == -1)
+            {
+                close_peer_link(link);
+            }
+        }
+    }
+}
+
+/**
+ * Démarre le thread de fédération si des instances paires sont configurées.
+ * Appelé une fois les réacteurs prêts : les messages relayés peuvent leur être confiés.
+ * @return 0 en cas de succès, -1 en cas d'erreur.
+ */
+int start_federation()
+{
+    if (!federation_enabled)
+    {
+        return 0;
+    }
+    for (int i = 0; i < FEDERATION_MAX_LINKS; ++i)
+    {
+        peer_links[i].socket = -1;
+    }
+    int *listen_socket = malloc(sizeof(int));
+    federation_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_socket == NULL || federation_wake_fd == -1)
+    {
+        perror("Erreur lors de l'initialisation de la fédération");
+        free(listen_socket);
+        return -1;
+    }
+    // Après une mise à jour à chaud, le socket d'écoute de l'ancien processus est repris tel quel
+    if (peer_listen_address != NULL && peer_listen_socket == -1)
+    {
+        peer_listen_socket = create_peer_listen_socket();
+        if (peer_listen_socket == -1)
+        {
+            perror("Erreur lors de l'écoute des instances pairs");
+            free(listen_socket);
+            return -1;
+        }
+    }
+    *listen_socket = peer_listen_socket;
+
+    // Les messages des pairs sont livrés par un thread à part, dans leur ordre d'arrivée
+    pthread_t delivery_thread;
+    if (pthread_create(&delivery_thread, NULL, run_peer_delivery, NULL) != 0)
+    {
+        perror("Erreur lors de la création du thread de livraison de la fédération");
+        free(listen_socket);
+        return -1;
+    }
+    pthread_detach(delivery_thread);
+
+    pthread_t federation_thread;
+    if (pthread_create(&federation_thread, NULL, run_federation, listen_socket) != 0)
+    {
+        perror("Erreur lors de la création du thread de fédération");
+        free(listen_socket);
+        return -1;
+    }
+    pthread_detach(federation_thread);
+    printf("Fédération : instance %d, %d pair(s)%s%s\n", node_id, peer_config_count,
+           peer_listen_address != NULL ? ", en écoute sur " : "", peer_listen_address != NULL ? peer_listen_address : "");
+    return 0;
+}
+
+/**
+ * Envoie un paquet de reprise, accompagné d'un socket s'il y a lieu (SCM_RIGHTS).
+ * @param socket_fd Le socket de reprise.
+ * @param header L'en-tête (length : taille de data).
+ * @param data Les données, ou NULL.
+ * @param fd Le socket à transmettre, -1 si aucun.
+ * @return 0 en cas de succès, -1 si le nouveau processus ne répond plus.
+ */
+int send_handover_packet(int socket_fd, HandoverHeader *header, const char *data, int fd)
+{
+    struct iovec iov[2] = {{header, sizeof(HandoverHeader)}, {(void *)data, header->length}};
+    union
+    {
+        struct cmsghdr align;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = header->length > 0 ? 2 : 1};
+    if (fd != -1)
+    {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof(control.space);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    return sent == -1 ? -1 : 0;
+}
+
+/**
+ * Transmet les abonnements d'une connexion, du plus ancien au channel courant :
+ * chacun est remis en tête à la reprise, ce qui rétablit l'ordre de la liste.
+ * @param socket_fd Le socket de reprise.
+ * @param sub Le premier abonnement de la liste.
+ * @return 0 en cas de succès, -1 si le nouveau processus ne répond plus.
+ */
+int send_subscription_handover(int socket_fd, Subscription *sub)
+{
+    if (sub == NULL)
+    {
+        return 0;
+    }
+    if (send_subscription_handover(socket_fd, sub->next) == -1)
+    {
+        return -1;
+    }
+    HandoverHeader header = {.type = HANDOVER_SUBSCRIPTION, .state = (uint32_t)sub->joined, .notify = (uint32_t)sub->notify,
+                             .first = sub->history_cursor};
+    memcpy(header.channel_name, sub->channel->name, sizeof(header.channel_name));
+    return send_handover_packet(socket_fd, &header, NULL, -1);
+}
+
+/**
+ * Transmet une connexion au nouveau processus : son socket et son état, ses
+ * abonnements, les octets reçus pas encore traités, puis sa file de sortie dans l'ordre. Le reste
+ * d'un historique lu sur disque n'est transmis que par sa plage de numéros.
+ * @param socket_fd Le socket de reprise.
+ * @param conn La connexion.
+ * @return 0 en cas de succès, -1 si le nouveau processus ne répond plus.
+ */
+int send_connection_handover(int socket_fd, Connection *conn)
+{
+    HandoverHeader header = {.type = HANDOVER_CONNECTION, .state = conn->state, .framed = (uint32_t)conn->queue.framed,
+                             .notify = (uint32_t)conn->handshake_pending};
+    memcpy(header.client_name, conn->client_name, sizeof(header.client_name));
+    if (send_handover_packet(socket_fd, &header, NULL, conn->socket) == -1 || send_subscription_handover(socket_fd, conn->subscriptions) == -1)
+    {
+        return -1;
+    }
+
+    if (conn->input != NULL)
+    {
+        header = (HandoverHeader){.type = HANDOVER_INPUT, .length = (uint32_t)(conn->input->length - conn->input->start)};
+        if (send_handover_packet(socket_fd, &header, conn->input->data + conn->input->start, -1) == -1)
+        {
+            return -1;
+        }
+    }
+
+    // Les messages consécutifs en mémoire sont regroupés en paquets de HANDOVER_CHUNK_SIZE octets
+    static char pending[HANDOVER_CHUNK_SIZE];
+    size_t pending_length = 0;
+    for (OutboundMessage *msg = conn->queue.head; msg != NULL; msg = msg->next)
+    {
+        const char *data = msg->data + msg->offset;
+        size_t remaining = msg->length - msg->offset;
+        while (remaining > 0)
+        {
+            size_t chunk = HANDOVER_CHUNK_SIZE - pending_length < remaining ? HANDOVER_CHUNK_SIZE - pending_length : remaining;
+            memcpy(pending + pending_length, data, chunk);
+            pending_length += chunk;
+            data += chunk;
+            remaining -= chunk;
+            if (pending_length == HANDOVER_CHUNK_SIZE || (remaining == 0 && (msg->cursor != NULL || msg->next == NULL)))
+            {
+                header = (HandoverHeader){.type = HANDOVER_PENDING, .length = (uint32_t)pending_length};
+                if (send_handover_packet(socket_fd, &header, pending, -1) == -1)
+                {
+                    return -1;
+                }
+                pending_length = 0;
+            }
+        }
+
+        if (msg->cursor != NULL && msg->cursor->next <= msg->cursor->last)
+        {
+            header = (HandoverHeader){.type = HANDOVER_HISTORY, .first = msg->cursor->next, .last = msg->cursor->last};
+            memcpy(header.channel_name, msg->cursor->channel->name, sizeof(header.channel_name));
+            if (send_handover_packet(socket_fd, &header, NULL, -1) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Vérifie qu'aucun message n'est plus en transit entre réacteurs (réacteurs arrêtés),
+ * ni en attente dans leur file des instances paires.
+ * @return 1 si toutes les files et tous les débordements sont vides, 0 sinon.
+ */
+int reactors_idle()
+{
+    for (int i = 0; i < reactor_count; ++i)
+    {
+        pthread_mutex_lock(&reactors[i].remote_lock);
+        int remote_pending = reactors[i].remote_head != NULL;
+        pthread_mutex_unlock(&reactors[i].remote_lock);
+        if (remote_pending)
+        {
+            return 0;
+        }
+        for (int target = 0; target < reactor_count; ++target)
+        {
+            ShardQueue *queue = &shard_queues[i * reactor_count + target];
+            if (reactors[i].overflow_head[target] != NULL || atomic_load(&queue->head) != atomic_load(&queue->tail))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Arrête tous les réacteurs (park_reactor) une fois les messages en transit
+ * entre eux livrés : joins terminés, messages journalisés et diffusés. La
+ * livraison des messages des pairs est suspendue d'abord : ceux déjà déposés
+ * aux réacteurs sont livrés pendant l'arrêt, les autres restent en file.
+ */
+void quiesce_reactors()
+{
+    pause_peer_delivery();
+    upgrade_quiet = 0;
+    atomic_store_explicit(&upgrade_requested, 1, memory_order_release);
+    for (int i = 0; i < reactor_count; ++i)
+    {
+        uint64_t one = 1;
+        if (write(reactors[i].wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        {
+            perror("Erreur lors du réveil d'un réacteur");
+        }
+    }
+
+    for (int round = 0;; ++round)
+    {
+        pthread_barrier_wait(&upgrade_barrier);
+        if (upgrade_quiet)
+        {
+            break;
+        }
+        pthread_barrier_wait(&upgrade_barrier);
+        upgrade_quiet = round + 1 >= HANDOVER_MAX_ROUNDS || reactors_idle();
+    }
+}
+
+/**
+ * Relance les réacteurs arrêtés par quiesce_reactors (reprise échouée).
+ */
+void resume_reactors()
+{
+    atomic_store_explicit(&upgrade_requested, 0, memory_order_release);
+    pthread_barrier_wait(&upgrade_barrier);
+    resume_peer_delivery();
+}
+
+/**
+ * Transmet au nouveau processus les messages des pairs pas encore livrés
+ * (livraison suspendue). En cas d'échec, ils sont remis en tête de file.
+ * @param socket_fd Le socket de reprise.
+ * @return 0 en cas de succès, -1 si le nouveau processus ne répond plus.
+ */
+int send_peer_deliveries(int socket_fd)
+{
+    pthread_mutex_lock(&peer_delivery_mutex);
+    PeerDelivery *head = peer_delivery_head;
+    PeerDelivery *tail = peer_delivery_tail;
+    peer_delivery_head = peer_delivery_tail = NULL;
+    pthread_mutex_unlock(&peer_delivery_mutex);
+
+    int result = 0;
+    for (PeerDelivery *delivery = head; delivery != NULL; delivery = delivery->next)
+    {
+        HandoverHeader header = {.type = HANDOVER_PEER_MESSAGE, .first = delivery->type, .length = (uint32_t)delivery->length};
+        memcpy(header.client_name, delivery->sender, sizeof(header.client_name));
+        memcpy(header.channel_name, delivery->channel_name, sizeof(header.channel_name));
+        if (send_handover_packet(socket_fd, &header, delivery->text, -1) == -1)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    if (result == -1)
+    {
+        // Reprise interrompue : la livraison reprendra dans ce processus, dans l'ordre
+        pthread_mutex_lock(&peer_delivery_mutex);
+        tail->next = peer_delivery_head;
+        if (peer_delivery_head == NULL)
+        {
+            peer_delivery_tail = tail;
+        }
+        peer_delivery_head = head;
+        pthread_mutex_unlock(&peer_delivery_mutex);
+        return -1;
+    }
+    while (head != NULL)
+    {
+        PeerDelivery *next = head->next;
+        block_free(head);
+        head = next;
+    }
+    return 0;
+}
+
+/**
+ * Transmet tout l'état du serveur au nouveau processus, réacteurs arrêtés et
+ * journal écrit : sockets d'écoute, puis chaque connexion. Les clients évincés
+ * (déjà coupés) ne sont pas transmis.
+ * @param socket_fd Le socket de reprise.
+ * @return Le nombre de connexions transmises, -1 si le nouveau processus ne répond plus.
+ */
+int send_handover(int socket_fd)
+{
+    HandoverHeader header = {.type = HANDOVER_LISTEN};
+    for (int i = 0; i < reactor_count; ++i)
+    {
+        if (send_handover_packet(socket_fd, &header, NULL, reactors[i].listen_socket) == -1)
+        {
+            return -1;
+        }
+    }
+    header.type = HANDOVER_PEER_LISTEN;
+    if (peer_listen_socket != -1 && send_handover_packet(socket_fd, &header, NULL, peer_listen_socket) == -1)
+    {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < reactor_count; ++i)
+    {
+        for (int fd = 0; fd < reactors[i].connections_capacity; ++fd)
+        {
+            Connection *conn = reactors[i].connections[fd];
+            if (conn == NULL || conn->evicted)
+            {
+                continue;
+            }
+            if (send_connection_handover(socket_fd, conn) == -1)
+            {
+                return -1;
+            }
+            count++;
+        }
+    }
+
+    if (send_peer_deliveries(socket_fd) == -1)
+    {
+        return -1;
+    }
+
+    header.type = HANDOVER_END;
+    return send_handover_packet(socket_fd, &header, NULL, -1) == -1 ? -1 : count;
+}
+
+/**
+ * Thread de mise à jour à chaud : attend qu'un nouveau processus se connecte au
+ * socket de reprise, lui transmet les sockets et l'état des connexions, puis
+ * arrête l'ancien processus. Si le nouveau disparaît en cours de route, les
+ * réacteurs reprennent le service comme si de rien n'était.
+ * @param args Le socket d'écoute de reprise (int *).
+ * @return NULL.
+ */
+void *run_upgrade_listener(void *args)
+{
+    int listen_socket = *(int *)args;
+    free(args);
+
+    while (1)
+    {
+        int peer = accept4(listen_socket, NULL, NULL, SOCK_CLOEXEC);
+        if (peer == -1)
+        {
+            continue;
+        }
+
+        HandoverHeader hello;
+        struct timeval timeout = {.tv_sec = 5};
+        setsockopt(peer, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (recv(peer, &hello, sizeof(hello), 0) != sizeof(hello) || hello.type != HANDOVER_HELLO || hello.first != HANDOVER_VERSION)
+        {
+            fprintf(stderr, "Mise à jour à chaud refusée : protocole de reprise incompatible\n");
+            close(peer);
+            continue;
+        }
+        printf("Mise à jour à chaud : arrêt des réacteurs\n");
+        quiesce_reactors();
+
+        // Le nouveau processus relit le journal : tout ce qui a été accepté doit y être
+        for (Channel *channel = atomic_load_explicit(&channel_list, memory_order_acquire); channel != NULL; channel = channel->next_created)
+        {
+            if (atomic_load(&channel->loaded))
+            {
+                wait_for_log_flush(channel);
+            }
+        }
+
+        int count = send_handover(peer);
+        HandoverHeader ack;
+        timeout.tv_sec = 0;
+        setsockopt(peer, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (count >= 0 && recv(peer, &ack, sizeof(ack), 0) == sizeof(ack) && ack.type == HANDOVER_ACK)
+        {
+            printf("Mise à jour à chaud : %d connexion(s) transmise(s), arrêt de l'ancien processus\n", count);
+            exit(EXIT_SUCCESS);
+        }
+
+        fprintf(stderr, "Mise à jour à chaud interrompue : le service continue\n");
+        close(peer);
+        resume_reactors();
+    }
+}
+
+/**
+ * Ouvre le socket de reprise (--upgrade-socket) pour la prochaine mise à jour à
+ * chaud. Appelé une fois les réacteurs prêts, avant leur démarrage.
+ * @return 0 en cas de succès, -1 en cas d'erreur.
+ */
+int start_upgrade_listener()
+{
+    if (upgrade_socket_path == NULL)
+    {
+        return 0;
+    }
+    int *listen_socket = malloc(sizeof(int));
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, upgrade_socket_path, sizeof(address.sun_path) - 1);
+    unlink(upgrade_socket_path); // Socket de l'ancien processus, ou laissé par un arrêt brutal
+    if (listen_socket == NULL || (*listen_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1 ||
+        bind(*listen_socket, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(*listen_socket, 1) == -1)
+    {
+        perror("Erreur lors de la création du socket de mise à jour à chaud");
+        free(listen_socket);
+        return -1;
+    }
+
+    pthread_barrier_init(&upgrade_barrier, NULL, (unsigned)reactor_count + 1);
+    pthread_t upgrade_thread;
+    if (pthread_create(&upgrade_thread, NULL, run_upgrade_listener, listen_socket) != 0)
+    {
+        perror("Erreur lors de la création du thread de mise à jour à chaud");
+        free(listen_socket);
+        return -1;
+    }
+    pthread_detach(upgrade_thread);
+    return 0;
+}
+
+/**
+ * Demande la reprise à un processus déjà en service sur le socket de reprise.
+ * Tout est reçu avant la lecture du journal (l'ancien processus l'a écrit
+ * entièrement) : sockets d'écoute, puis connexions, gardées dans handover_items
+ * jusqu'au démarrage des réacteurs.
+ * @return 1 si un processus a transmis son état, 0 s'il n'y en a pas, -1 si la reprise a échoué.
+ */
+int request_handover()
+{
+    int socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, upgrade_socket_path, sizeof(address.sun_path) - 1);
+    if (socket_fd == -1 || connect(socket_fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        if (socket_fd != -1)
+        {
+            close(socket_fd);
+        }
+        return 0; // Aucun processus en service : démarrage normal
+    }
+
+    HandoverHeader header = {.type = HANDOVER_HELLO, .first = HANDOVER_VERSION};
+    if (send_handover_packet(socket_fd, &header, NULL, -1) == -1)
+    {
+        close(socket_fd);
+        return -1;
+    }
+
+    static char packet[sizeof(HandoverHeader) + HANDOVER_CHUNK_SIZE];
+    HandoverItem **tail = &handover_items;
+    int connections = 0;
+    while (1)
+    {
+        union
+        {
+            struct cmsghdr align;
+            char space[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = {packet, sizeof(packet)};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.space, .msg_controllen = sizeof(control.space)};
+        ssize_t received = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+        if (received == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received < (ssize_t)sizeof(HandoverHeader) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+        {
+            fprintf(stderr, "Mise à jour à chaud : transmission interrompue\n");
+            close(socket_fd);
+            return -1;
+        }
+
+        memcpy(&header, packet, sizeof(header));
+        int fd = -1;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+
+        if (header.type == HANDOVER_END)
+        {
+            break;
+        }
+        if (header.type == HANDOVER_LISTEN && fd != -1 && inherited_listen_count < MAX_REACTORS)
+        {
+            inherited_listen_sockets[inherited_listen_count++] = fd;
+            continue;
+        }
+        if (header.type == HANDOVER_PEER_LISTEN && fd != -1 && peer_listen_address != NULL)
+        {
+            peer_listen_socket = fd;
+            continue;
+        }
+        if (header.type == HANDOVER_PEER_MESSAGE && federation_enabled && header.length < BUFFER_SIZE &&
+            header.length <= (size_t)received - sizeof(HandoverHeader))
+        {
+            // Livré par le thread de livraison de la fédération, avant les messages reçus ensuite
+            header.client_name[sizeof(header.client_name) - 1] = '\0';
+            header.channel_name[sizeof(header.channel_name) - 1] = '\0';
+            post_peer_delivery((PeerFrameType)header.first, header.channel_name, header.client_name, packet + sizeof(HandoverHeader),
+                               header.length);
+            continue;
+        }
+        if (header.type != HANDOVER_CONNECTION && header.type != HANDOVER_SUBSCRIPTION && header.type != HANDOVER_INPUT &&
+            header.type != HANDOVER_PENDING && header.type != HANDOVER_HISTORY)
+        {
+            if (fd != -1)
+            {
+                close(fd); // Socket sans emploi ici (fédération désactivée, trop de réacteurs)
+            }
+            continue;
+        }
+
+        HandoverItem *item = malloc(sizeof(HandoverItem) + header.length);
+        if (item == NULL || header.length > (size_t)received - sizeof(HandoverHeader))
+        {
+            fprintf(stderr, "Mise à jour à chaud : paquet de reprise invalide\n");
+            free(item);
+            close(socket_fd);
+            return -1;
+        }
+        item->next = NULL;
+        item->header = header;
+        item->fd = fd;
+        memcpy(item->data, packet + sizeof(HandoverHeader), header.length);
+        *tail = item;
+        tail = &item->next;
+        connections += header.type == HANDOVER_CONNECTION;
+    }
+
+    header = (HandoverHeader){.type = HANDOVER_ACK};
+    send_handover_packet(socket_fd, &header, NULL, -1);
+    close(socket_fd);
+    printf("Mise à jour à chaud : %d socket(s) d'écoute et %d connexion(s) reprises\n", inherited_listen_count, connections);
+    return 1;
+}
+
+/**
+ * Restaure une connexion reprise dans un réacteur. Ses channels suivent dans
+ * les paquets HANDOVER_SUBSCRIPTION.
+ * @param reactor Le réacteur.
+ * @param item Le paquet HANDOVER_CONNECTION.
+ * @return La connexion, ou NULL si elle n'a pas pu être restaurée (socket fermé).
+ */
+Connection *restore_connection(Reactor *reactor, HandoverItem *item)
+{
+    Connection *conn = item->fd != -1 ? register_connection(reactor, item->fd) : NULL;
+    if (conn == NULL)
+    {
+        if (item->fd != -1)
+        {
+            close(item->fd);
+        }
+        return NULL;
+    }
+    conn->state = (ConnectionState)item->header.state;
+    conn->queue.framed = (int)item->header.framed;
+    conn->handshake_pending = (int)item->header.notify;
+    memcpy(conn->client_name, item->header.client_name, sizeof(conn->client_name) - 1);
+    if (conn->state == CONN_HANDSHAKE_NAME || conn->state == CONN_NEGOTIATING)
+    {
+        return conn;
+    }
+    register_outbound_queue(&conn->queue, conn->client_name);
+    if (conn->state == CONN_CHAT)
+    {
+        atomic_fetch_add(&reactor_client_count, 1);
+    }
+    return conn;
+}
+
+/**
+ * Restaure un channel suivi par une connexion reprise. Un client déjà membre y
+ * est compté et ajouté aux membres locaux sans nouvelle notification ; un join
+ * inachevé est recommencé.
+ * @param conn La connexion.
+ * @param item Le paquet HANDOVER_SUBSCRIPTION.
+ */
+void restore_subscription(Connection *conn, HandoverItem *item)
+{
+    Channel *channel = find_or_create_channel(item->header.channel_name);
+    if (channel == NULL || conn->state != CONN_CHAT)
+    {
+        return;
+    }
+    if (!item->header.state)
+    {
+        begin_join(conn, channel, (int)item->header.notify);
+        return;
+    }
+
+    Subscription *sub = pool_alloc(&conn->reactor->subscription_pool);
+    if (sub == NULL)
+    {
+        return;
+    }
+    sub->channel = channel;
+    sub->conn = conn;
+    sub->history_cursor = item->header.first;
+    sub->next = conn->subscriptions;
+    conn->subscriptions = sub;
+    conn->subscription_count++;
+
+    // Les réacteurs ne tournent pas encore : les compteurs du propriétaire sont tenus ici
+    if (channel->client_count++ == 0)
+    {
+        federation_interest_changed(channel);
+    }
+    channel->shard_counts[conn->reactor->id]++;
+    link_local_member(sub);
+}
+
+/**
+ * Ferme une connexion reprise dans un channel dont aucun abonnement n'a pu être restauré.
+ * @param conn La connexion, ou NULL.
+ */
+void close_unsubscribed_connection(Connection *conn)
+{
+    if (conn != NULL && conn->state == CONN_CHAT && conn->subscriptions == NULL)
+    {
+        close_connection(conn);
+    }
+}
+
+/**
+ * Restaure dans les réacteurs les connexions reprises, réparties à tour de rôle,
+ * avec leurs octets en attente. Les connexions en attente sur les sockets
+ * d'écoute repris en trop (moins de réacteurs qu'avant) sont acceptées, puis
+ * ces sockets fermés.
+ */
+void restore_handover()
+{
+    int next_reactor = 0;
+    Connection *conn = NULL;
+    HandoverItem *item = handover_items;
+    handover_items = NULL;
+    while (item != NULL)
+    {
+        HandoverItem *next = item->next;
+        switch ((HandoverType)item->header.type)
+        {
+        case HANDOVER_CONNECTION:
+            close_unsubscribed_connection(conn);
+            conn = restore_connection(&reactors[next_reactor++ % reactor_count], item);
+            break;
+        case HANDOVER_SUBSCRIPTION:
+            if (conn != NULL)
+            {
+                restore_subscription(conn, item);
+            }
+            break;
+        case HANDOVER_INPUT:
+            if (conn != NULL && item->header.length <= sizeof(conn->input->data) && acquire_connection_reader(conn) != NULL)
+            {
+                memcpy(conn->input->data, item->data, item->header.length);
+                conn->input->length = item->header.length;
+            }
+            break;
+        case HANDOVER_PENDING:
+            if (conn != NULL && outbound_send(&conn->queue, conn->socket, item->data, item->header.length, 0) == -1)
+            {
+                close_connection(conn);
+                conn = NULL;
+            }
+            break;
+        case HANDOVER_HISTORY:
+        {
+            Channel *channel = conn != NULL ? find_or_create_channel(item->header.channel_name) : NULL;
+            if (channel != NULL && outbound_send_history(&conn->queue, conn->socket, channel, item->header.first, item->header.last) == -1)
+            {
+                close_connection(conn);
+                conn = NULL;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        free(item);
+        item = next;
+    }
+    close_unsubscribed_connection(conn);
+
+    for (int i = reactor_count; i < inherited_listen_count; ++i)
+    {
+        int client_socket;
+        set_nonblocking(inherited_listen_sockets[i]);
+        while ((client_socket = accept4(inherited_listen_sockets[i], NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+        {
+            metric_add(METRIC_ACCEPTED, 1);
+            if (admit_connection() == -1 || register_connection(&reactors[next_reactor++ % reactor_count], client_socket) == NULL)
+            {
+                close(client_socket);
+            }
+        }
+        close(inherited_listen_sockets[i]);
+    }
+}
+
+/**
+ * Crée le socket d'écoute du serveur.
+ * @param backlog La taille de la file d'attente des connexions.
+ * @param reuse_port 1 pour partager le port entre plusieurs sockets (SO_REUSEPORT).
+ * @return Le socket, ou -1 en cas d'erreur.
+ */
+int create_server_socket(int backlog, int reuse_port)
+{
+    struct sockaddr_in server_addr;
+
+    // ÉTAPE 1 : Créer le socket serveur
+    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_socket == -1)
+    {
+        perror("Erreur lors de la création du socket");
+        return -1;
+    }
+
+    // Redémarrer le serveur ne doit pas échouer à cause des connexions en TIME_WAIT
+    int enable = 1;
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0)
+    {
+        perror("Erreur lors de l'activation de SO_REUSEADDR");
+    }
+
+    if (reuse_port && setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0)
+    {
+        perror("Erreur lors de l'activation de SO_REUSEPORT");
+        close(server_socket);
+        return -1;
+    }
+
+    // ÉTAPE 2 : Configurer l'adresse du serveur (IP: 0.0.0.0 = toutes les interfaces, PORT: 12345 ou --port)
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(server_port);
+
+    // ÉTAPE 3 : Binder le socket à l'adresse et au port spécifiés
+    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        perror("Erreur lors du bind");
+        close(server_socket);
+        return -1;
+    }
+
+    // ÉTAPE 4 : Activer l'écoute sur le socket
+    if (listen(server_socket, backlog) < 0)
+    {
+        perror("Erreur lors de l'écoute");
+        close(server_socket);
+        return -1;
+    }
+
+    return server_socket;
+}
+
+/**
+ * Démarre le mode epoll : un réacteur par thread, chacun avec son propre socket
+ * d'écoute lié au même port grâce à SO_REUSEPORT (le noyau répartit les connexions).
+ * Le thread principal exécute le réacteur 0.
+ * @return 0 en cas de succès, -1 en cas d'erreur de démarrage.
+ */
+int run_epoll_server()
+{
+    reactors = calloc(reactor_count, sizeof(Reactor));
+    shard_queues = aligned_alloc(64, (size_t)reactor_count * reactor_count * sizeof(ShardQueue));
+    if (reactors == NULL || shard_queues == NULL)
+    {
+        perror("Erreur lors de l'allocation des réacteurs");
+        return -1;
+    }
+    memset(shard_queues, 0, (size_t)reactor_count * reactor_count * sizeof(ShardQueue));
+
+    for (int i = 0; i < reactor_count; ++i)
+    {
+        Reactor *reactor = &reactors[i];
+        reactor->id = i;
+        pthread_mutex_init(&reactor->remote_lock, NULL);
+        pool_init(&reactor->connection_pool, sizeof(Connection));
+        pool_init(&reactor->reader_pool, sizeof(FrameReader));
+        pool_init(&reactor->subscription_pool, sizeof(Subscription));
+        reactor->listen_socket = i < inherited_listen_count ? inherited_listen_sockets[i] : create_server_socket(SOMAXCONN, 1);
+        reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reactor->listen_socket == -1 || reactor->epoll_fd == -1 || reactor->wake_fd == -1)
+        {
+            perror("Erreur lors de l'initialisation d'un réacteur");
+            return -1;
         }
+        set_nonblocking(reactor->listen_socket);
 
-        // ÉTAPE 27 : Message normal (pas une commande) -> enregistrer et diffuser
-        char formatted_message[BUFFER_SIZE];
-        snprintf(formatted_message, sizeof(formatted_message), "%s : %s\n", client_name, buffer);
+        if (use_io_uring)
+        {
+            // Sans io_uring (noyau trop ancien, interdit par seccomp...), le réacteur garde epoll
+            reactor->ring = malloc(sizeof(IoRing));
+            if (reactor->ring == NULL || io_ring_init(reactor->ring, URING_ENTRIES) == -1)
+            {
+                fprintf(stderr, "io_uring indisponible (%s) : réacteur %d sur epoll\n", strerror(errno), i);
+                free(reactor->ring);
+                reactor->ring = NULL;
+            }
+            else if (io_buffer_ring_init(reactor->ring, &reactor->recv_buffers) == -1)
+            {
+                fprintf(stderr, "Buffers io_uring indisponibles (%s) : réacteur %d sur epoll\n", strerror(errno), i);
+                io_ring_destroy(reactor->ring);
+                free(reactor->ring);
+                reactor->ring = NULL;
+            }
+            if (reactor->ring != NULL)
+            {
+                continue;
+            }
+        }
 
-        // ÉTAPE 28 : Enregistrer le message dans le fichier et l'envoyer aux autres clients
-        log_and_broadcast_message(channel_name, client_name, buffer, channel, client_socket);
+        // data.ptr : NULL désigne le socket d'écoute, le réacteur lui-même son eventfd
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = NULL;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_socket, &event);
+        event.events = EPOLLIN;
+        event.data.ptr = reactor;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &event);
     }
 
-    // ÉTAPE 29 : Le client s'est déconnecté - notifier les autres clients
-    pthread_mutex_lock(&mutex);
-    int remaining_clients = channel->client_count - 1;
-    pthread_mutex_unlock(&mutex);
+    printf("Serveur en écoute sur le port %d (%d réacteur%s%s)...\n", server_port, reactor_count, reactor_count > 1 ? "s" : "",
+           reactors[0].ring != NULL ? ", io_uring" : "");
+    if (start_federation() == -1)
+    {
+        return -1;
+    }
+    restore_handover();
+    if (start_upgrade_listener() == -1)
+    {
+        return -1;
+    }
 
-    char leave_message[BUFFER_SIZE];
-    snprintf(leave_message, sizeof(leave_message), "%s a quitter le channel '%s'... (%d/%d)\n", client_name, channel_name, remaining_clients, MAX_CLIENTS);
+    for (int i = 1; i < reactor_count; ++i)
+    {
+        if (pthread_create(&reactors[i].thread, NULL, run_reactor, &reactors[i]) != 0)
+        {
+            perror("Erreur lors de la création du thread d'un réacteur");
+            return -1;
+        }
+    }
+    run_reactor(&reactors[0]);
+    return 0;
+}
 
-    // ÉTAPE 30 : Envoyer le message de départ aux autres clients
-    broadcast_message(channel, leave_message, client_socket);
+/**
+ * Affiche l'aide de la ligne de commande du serveur.
+ * @param program_name Le nom de l'exécutable.
+ */
+void print_usage(const char *program_name)
+{
+    printf("Usage : %s [--mode threads|epoll] [--reactors N]\n", program_name);
+    printf("  --mode threads : un thread par client (par défaut)\n");
+    printf("  --mode epoll   : boucles d'événements epoll\n");
+    printf("  --reactors N   : nombre de réacteurs en mode epoll (1 à %d, défaut 1)\n", MAX_REACTORS);
+    printf("  --max-clients N : nombre maximum de clients connectés (défaut %d)\n", max_clients);
+    printf("  --max-connections N : connexions ouvertes au plus, poignées de main comprises (défaut 2 × max-clients)\n");
+    printf("  --client-rate N[:RAFALE]  : messages par seconde d'un client (défaut %lu:%lu, 0 : illimité)\n", client_rate_limit.rate, client_rate_limit.burst);
+    printf("  --channel-rate N[:RAFALE] : messages par seconde d'un channel, tous expéditeurs confondus (défaut illimité)\n");
+    printf("  --accept-rate N[:RAFALE]  : nouvelles connexions par seconde (défaut illimité)\n");
+    printf("  --high-watermark OCTETS : seuil haut de la file de sortie d'un client (défaut %zu)\n", high_watermark);
+    printf("  --low-watermark OCTETS  : seuil bas visé après avoir jeté des messages (défaut %zu)\n", low_watermark);
+    printf("  --slow-policy drop|disconnect : client lent, jeter les plus anciens messages ou le déconnecter\n");
+    printf("  --coalesce-bytes OCTETS : mode epoll, octets en attente qui déclenchent l'écriture d'une file (défaut %zu, 0 : sans regroupement)\n", coalesce_bytes);
+    printf("  --coalesce-window US    : mode epoll, durée maximale d'une fenêtre de regroupement sous charge (défaut %ld)\n", coalesce_window_us);
+    printf("  --history-lines N : lignes récentes rejouées à l'arrivée dans un channel (défaut %d)\n", history_lines);
+    printf("  --log-sync none|periodic|batch : durabilité du journal (défaut none)\n");
+    printf("  --log-sync-interval MS  : période de fdatasync en mode periodic (défaut %d)\n", log_sync_interval_ms);
+    printf("  --admin-socket CHEMIN   : socket Unix d'administration (commande \"stats\", \"prometheus\" ou \"trace\")\n");
+    printf("  --segment-size OCTETS   : taille d'un segment du journal d'un channel (défaut %lld)\n", (long long)segment_bytes);
+    printf("  --retention-age SECONDES : efface les segments dont tous les messages sont plus vieux (défaut illimité)\n");
+    printf("  --retention-bytes OCTETS : taille maximale du journal d'un channel (défaut illimitée)\n");
+    printf("  --io-uring      : réacteurs (mode epoll) et écritures du journal par io_uring, epoll et writev sinon\n");
+    printf("  --port N        : port des clients (défaut %d)\n", PORT);
+    printf("  --node-id N     : identifiant de l'instance dans la fédération (0 à %d)\n", FEDERATION_MAX_NODES - 1);
+    printf("  --peer-listen ADRESSE : où les instances pairs se connectent (unix:CHEMIN ou HÔTE:PORT)\n");
+    printf("  --peer N@ADRESSE : instance de la fédération (répétable, la sienne est ignorée)\n");
+    printf("  --peer-queue-bytes OCTETS : file d'une liaison avec un pair, coupée au-delà (défaut %zu)\n", peer_queue_bytes);
+    printf("  --upgrade-socket CHEMIN : mise à jour à chaud, reprend les connexions du processus en service (mode epoll)\n");
+    printf("  --trace-sample N : trace un message sur N, de sa réception à sa livraison (défaut 0 : désactivé)\n");
+    printf("  --trace-file CHEMIN : fichier des traces au format Chrome trace (défaut %s)\n", trace_file_path);
+    printf("Envoyer SIGUSR1 au serveur affiche la profondeur des files de sortie, SIGUSR2 écrit les traces.\n");
+}
 
-    // ÉTAPE 31 : Supprimer le client du channel
-    remove_client_from_channel(channel, client_socket);
+/**
+ * Lit une limite de débit de la forme "N" ou "N:RAFALE" (rafale par défaut : N).
+ * @param text Le texte de l'option.
+ * @param limit La limite à remplir.
+ * @return 0 en cas de succès, -1 si le texte est invalide.
+ */
+int parse_rate_limit(const char *text, RateLimit *limit)
+{
+    char *end;
+    limit->rate = strtoul(text, &end, 10);
+    limit->burst = limit->rate;
+    if (*end == ':')
+    {
+        limit->burst = strtoul(end + 1, &end, 10);
+    }
+    return end == text || *end != '\0' || (limit->rate > 0 && limit->burst == 0) ? -1 : 0;
+}
 
-    // ÉTAPE 32 : Fermer le socket du client et terminer le thread
-    close(client_socket);
-    return NULL;
+/**
+ * Lit une taille en octets : un entier positif ou nul, sans signe ni suffixe.
+ * @param text Le texte de l'option.
+ * @param value Reçoit la taille (inchangée si le texte est invalide).
+ * @return 0 en cas de succès, -1 si le texte est invalide ou hors limites.
+ */
+int parse_byte_count(const char *text, size_t *value)
+{
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno == ERANGE || parsed > SIZE_MAX / 2)
+    {
+        return -1;
+    }
+    *value = (size_t)parsed;
+    return 0;
+}
+
+/**
+ * Calcule le délai entre deux jetons d'une limite de débit lue.
+ * @param limit La limite.
+ */
+void init_rate_limit(RateLimit *limit)
+{
+    limit->interval_ns = limit->rate > 0 ? 1000000000UL / limit->rate : 0;
+    if (limit->rate > 0 && limit->interval_ns == 0)
+    {
+        limit->interval_ns = 1;
+    }
 }
 
-int main()
+/**
+ * Lit les options de la ligne de commande.
+ * @param argc Le nombre d'arguments.
+ * @param argv Les arguments.
+ * @return 0 en cas de succès, -1 si les options sont invalides.
+ */
+int parse_arguments(int argc, char *argv[])
 {
-    int server_socket, client_socket, *new_sock;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addr_size;
+    static struct option long_options[] = {
+        {"mode", required_argument, NULL, 'm'},
+        {"reactors", required_argument, NULL, 'r'},
+        {"max-clients", required_argument, NULL, 'c'},
+        {"max-connections", required_argument, NULL, 'M'},
+        {"client-rate", required_argument, NULL, 'R'},
+        {"channel-rate", required_argument, NULL, 'K'},
+        {"accept-rate", required_argument, NULL, 'T'},
+        {"high-watermark", required_argument, NULL, 'H'},
+        {"low-watermark", required_argument, NULL, 'L'},
+        {"slow-policy", required_argument, NULL, 'p'},
+        {"coalesce-bytes", required_argument, NULL, 'C'},
+        {"coalesce-window", required_argument, NULL, 'W'},
+        {"history-lines", required_argument, NULL, 'n'},
+        {"log-sync", required_argument, NULL, 'S'},
+        {"log-sync-interval", required_argument, NULL, 'I'},
+        {"admin-socket", required_argument, NULL, 'A'},
+        {"segment-size", required_argument, NULL, 'g'},
+        {"retention-age", required_argument, NULL, 'a'},
+        {"retention-bytes", required_argument, NULL, 'b'},
+        {"io-uring", no_argument, NULL, 'u'},
+        {"port", required_argument, NULL, 'P'},
+        {"node-id", required_argument, NULL, 'N'},
+        {"peer-listen", required_argument, NULL, 'l'},
+        {"peer", required_argument, NULL, 'e'},
+        {"peer-queue-bytes", required_argument, NULL, 'Q'},
+        {"upgrade-socket", required_argument, NULL, 'U'},
+        {"trace-sample", required_argument, NULL, 't'},
+        {"trace-file", required_argument, NULL, 'f'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
 
-    // ÉTAPE 1 : Créer le socket serveur
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == -1)
+    int option;
+    while ((option = getopt_long(argc, argv, "m:r:c:M:R:K:T:H:L:p:C:W:n:S:I:A:g:a:b:uP:N:l:e:Q:U:t:f:h", long_options, NULL)) != -1)
     {
-        perror("Erreur lors de la création du socket");
+        switch (option)
+        {
+        case 'm':
+            if (strcmp(optarg, "threads") == 0)
+            {
+                server_mode = MODE_THREADS;
+            }
+            else if (strcmp(optarg, "epoll") == 0)
+            {
+                server_mode = MODE_EPOLL;
+            }
+            else
+            {
+                fprintf(stderr, "Mode inconnu : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            reactor_count = atoi(optarg);
+            if (reactor_count < 1 || reactor_count > MAX_REACTORS)
+            {
+                fprintf(stderr, "Nombre de réacteurs invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'c':
+            max_clients = atoi(optarg);
+            if (max_clients < 1)
+            {
+                fprintf(stderr, "Nombre maximum de clients invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'M':
+            max_connections = atoi(optarg);
+            if (max_connections < 1)
+            {
+                fprintf(stderr, "Nombre maximum de connexions invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'R':
+        case 'K':
+        case 'T':
+            if (parse_rate_limit(optarg, option == 'R' ? &client_rate_limit : option == 'K' ? &channel_rate_limit : &accept_rate_limit) == -1)
+            {
+                fprintf(stderr, "Limite de débit invalide (N ou N:RAFALE) : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'H':
+            // La file doit pouvoir tenir la plus grande trame, sans quoi le premier envoi partiel déclencherait la politique
+            if (parse_byte_count(optarg, &high_watermark) == -1 || high_watermark < FRAME_HEADER_SIZE + BUFFER_SIZE)
+            {
+                fprintf(stderr, "Seuil haut invalide (%d octets au moins) : %s\n", FRAME_HEADER_SIZE + BUFFER_SIZE, optarg);
+                return -1;
+            }
+            break;
+        case 'L':
+            if (parse_byte_count(optarg, &low_watermark) == -1)
+            {
+                fprintf(stderr, "Seuil bas invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'p':
+            if (strcmp(optarg, "drop") == 0)
+            {
+                slow_consumer_policy = SLOW_CONSUMER_DROP_OLDEST;
+            }
+            else if (strcmp(optarg, "disconnect") == 0)
+            {
+                slow_consumer_policy = SLOW_CONSUMER_DISCONNECT;
+            }
+            else
+            {
+                fprintf(stderr, "Politique client lent inconnue : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'C':
+            if (parse_byte_count(optarg, &coalesce_bytes) == -1)
+            {
+                fprintf(stderr, "Seuil de regroupement invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'W':
+            coalesce_window_us = atol(optarg);
+            if (coalesce_window_us < 0)
+            {
+                fprintf(stderr, "Fenêtre de regroupement invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'n':
+            history_lines = atoi(optarg);
+            if (history_lines < 1)
+            {
+                fprintf(stderr, "Nombre de lignes d'historique invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'S':
+            if (strcmp(optarg, "none") == 0)
+            {
+                log_sync_mode = LOG_SYNC_NONE;
+            }
+            else if (strcmp(optarg, "periodic") == 0)
+            {
+                log_sync_mode = LOG_SYNC_PERIODIC;
+            }
+            else if (strcmp(optarg, "batch") == 0)
+            {
+                log_sync_mode = LOG_SYNC_BATCH;
+            }
+            else
+            {
+                fprintf(stderr, "Durabilité du journal inconnue : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'I':
+            log_sync_interval_ms = atoi(optarg);
+            if (log_sync_interval_ms < 1)
+            {
+                fprintf(stderr, "Période de synchronisation invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'A':
+            admin_socket_path = optarg;
+            break;
+        case 'g':
+            segment_bytes = (off_t)strtoll(optarg, NULL, 10);
+            if (segment_bytes < 4096)
+            {
+                fprintf(stderr, "Taille de segment invalide (4096 octets au moins) : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'a':
+            retention_age = atol(optarg);
+            if (retention_age < 0)
+            {
+                fprintf(stderr, "Durée de rétention invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'b':
+            retention_bytes = (off_t)strtoll(optarg, NULL, 10);
+            if (retention_bytes < 0)
+            {
+                fprintf(stderr, "Taille de rétention invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'u':
+            use_io_uring = 1;
+            break;
+        case 'P':
+            server_port = atoi(optarg);
+            if (server_port < 1 || server_port > 65535)
+            {
+                fprintf(stderr, "Port invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'N':
+            node_id = atoi(optarg);
+            if (node_id < 0 || node_id >= FEDERATION_MAX_NODES)
+            {
+                fprintf(stderr, "Identifiant d'instance invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'l':
+        {
+            struct sockaddr_storage address;
+            socklen_t address_length;
+            if (parse_peer_address(optarg, &address, &address_length) == -1)
+            {
+                fprintf(stderr, "Adresse de fédération invalide : %s\n", optarg);
+                return -1;
+            }
+            peer_listen_address = optarg;
+            break;
+        }
+        case 'e':
+        {
+            struct sockaddr_storage address;
+            socklen_t address_length;
+            char *at = strchr(optarg, '@');
+            int peer_node = atoi(optarg);
+            if (at == NULL || at == optarg || peer_node < 0 || peer_node >= FEDERATION_MAX_NODES ||
+                strlen(at + 1) >= sizeof(peer_configs[0].address) || parse_peer_address(at + 1, &address, &address_length) == -1)
+            {
+                fprintf(stderr, "Instance paire invalide (N@ADRESSE) : %s\n", optarg);
+                return -1;
+            }
+            if (peer_config_count == FEDERATION_MAX_NODES)
+            {
+                fprintf(stderr, "Trop d'instances paires\n");
+                return -1;
+            }
+            peer_configs[peer_config_count].node_id = peer_node;
+            strcpy(peer_configs[peer_config_count].address, at + 1);
+            peer_config_count++;
+            break;
+        }
+        case 'Q':
+            // Une trame relayée doit toujours pouvoir attendre dans la file
+            if (parse_byte_count(optarg, &peer_queue_bytes) == -1 || peer_queue_bytes < FRAME_HEADER_SIZE + PEER_MAX_PAYLOAD)
+            {
+                fprintf(stderr, "Taille de file de liaison invalide (%d octets au moins) : %s\n", FRAME_HEADER_SIZE + PEER_MAX_PAYLOAD, optarg);
+                return -1;
+            }
+            break;
+        case 'U':
+            if (strlen(optarg) >= sizeof(((struct sockaddr_un *)NULL)->sun_path))
+            {
+                fprintf(stderr, "Chemin du socket de mise à jour trop long : %s\n", optarg);
+                return -1;
+            }
+            upgrade_socket_path = optarg;
+            break;
+        case 't':
+            trace_sample_rate = atoi(optarg);
+            if (trace_sample_rate < 0)
+            {
+                fprintf(stderr, "Taux d'échantillonnage des traces invalide : %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'f':
+            trace_file_path = optarg;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (low_watermark > high_watermark)
+    {
+        fprintf(stderr, "Le seuil bas doit être inférieur au seuil haut\n");
+        return -1;
+    }
+    // Place pour les poignées de main en cours : les clients en trop reçoivent encore l'avis « serveur plein »
+    if (max_connections == 0)
+    {
+        max_connections = 2 * max_clients;
+    }
+    init_rate_limit(&client_rate_limit);
+    init_rate_limit(&channel_rate_limit);
+    init_rate_limit(&accept_rate_limit);
+    // Les connexions io_uring ont des opérations en vol dans le noyau : seul epoll sait les transmettre
+    if (upgrade_socket_path != NULL && (server_mode != MODE_EPOLL || use_io_uring))
+    {
+        fprintf(stderr, "La mise à jour à chaud demande le mode epoll sans io_uring\n");
+        return -1;
+    }
+    federation_enabled = peer_listen_address != NULL || peer_config_count > 0;
+    if (federation_enabled && node_id < 0)
+    {
+        fprintf(stderr, "La fédération demande un identifiant d'instance (--node-id)\n");
+        return -1;
+    }
+    // Toutes les instances peuvent recevoir la même liste : chacune s'y retire
+    int kept = 0;
+    for (int i = 0; i < peer_config_count; ++i)
+    {
+        if (peer_configs[i].node_id != node_id)
+        {
+            peer_configs[kept++] = peer_configs[i];
+        }
+    }
+    peer_config_count = kept;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int server_socket, client_socket;
+    struct sockaddr_in client_addr;
+    socklen_t addr_size = sizeof(client_addr);
+
+    if (parse_arguments(argc, argv) == -1)
+    {
+        print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // ÉTAPE 2 : Configurer l'adresse du serveur (IP: 0.0.0.0 = toutes les interfaces, PORT: 12345)
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    // Un client qui ferme sa connexion ne doit pas tuer le serveur pendant un send()
+    signal(SIGPIPE, SIG_IGN);
+    clock_gettime(CLOCK_MONOTONIC, &server_start_time);
+    pool_init(&client_pool, sizeof(ClientHandle));
+    pool_init(&subscription_pool, sizeof(Subscription));
 
-    // ÉTAPE 3 : Binder le socket à l'adresse et au port spécifiés
-    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    // Étapes tracées gardées dans un anneau, écrites à la demande
+    if (trace_sample_rate > 0)
+    {
+        trace_ring = calloc(TRACE_RING_SPANS, sizeof(TraceSlot));
+        if (trace_ring == NULL)
+        {
+            perror("Erreur lors de l'allocation de l'anneau des traces");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // SIGUSR1 et SIGUSR2 sont traités par un thread dédié : ils sont bloqués dans tous les autres
+    static sigset_t supervised_signals;
+    sigemptyset(&supervised_signals);
+    sigaddset(&supervised_signals, SIGUSR1);
+    sigaddset(&supervised_signals, SIGUSR2);
+    if (use_io_uring)
+    {
+        sigaddset(&supervised_signals, SIGTERM);
+        sigaddset(&supervised_signals, SIGINT);
+    }
+    pthread_sigmask(SIG_BLOCK, &supervised_signals, NULL);
+    pthread_t signal_thread;
+    if (pthread_create(&signal_thread, NULL, run_signal_thread, &supervised_signals) == 0)
+    {
+        pthread_detach(signal_thread);
+    }
+
+    if (use_io_uring)
+    {
+        log_ring = malloc(sizeof(IoRing));
+        if (log_ring == NULL || io_ring_init(log_ring, URING_LOG_WRITES) == -1)
+        {
+            fprintf(stderr, "io_uring indisponible (%s) : journal écrit par writev\n", strerror(errno));
+            free(log_ring);
+            log_ring = NULL;
+        }
+    }
+
+    // Mise à jour à chaud : l'état de l'instance en service est repris avant la lecture du journal
+    if (upgrade_socket_path != NULL && request_handover() == -1)
     {
-        perror("Erreur lors du bind");
-        close(server_socket);
         exit(EXIT_FAILURE);
     }
 
-    // ÉTAPE 4 : Activer l'écoute sur le socket avec une file d'attente de 3 connexions
-    if (listen(server_socket, 3) < 0)
+    // Toutes les écritures du journal passent par un thread écrivain dédié
+    pthread_t log_writer_thread;
+    if (pthread_create(&log_writer_thread, NULL, run_log_writer, NULL) != 0)
+    {
+        perror("Erreur lors de la création du thread écrivain du journal");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(log_writer_thread);
+
+    // Index de recherche : les segments fermés sont écrits et les index manquants reconstruits à part
+    pthread_t search_indexer_thread;
+    if (pthread_create(&search_indexer_thread, NULL, run_search_indexer, NULL) != 0)
+    {
+        perror("Erreur lors de la création du thread d'indexation");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(search_indexer_thread);
+
+    // Channels déjà présents sur disque : enregistrés tout de suite, chargés à leur premier accès
+    recover_channels();
+
+    // Métriques consultables sur un socket Unix local, hors du chemin des messages
+    if (admin_socket_path != NULL)
+    {
+        pthread_t admin_thread;
+        if (pthread_create(&admin_thread, NULL, run_admin_server, NULL) == 0)
+        {
+            pthread_detach(admin_thread);
+        }
+    }
+
+    // En mode epoll, chaque réacteur crée son propre socket d'écoute
+    if (server_mode == MODE_EPOLL)
+    {
+        exit(run_epoll_server() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // ÉTAPES 1 à 4 : Créer le socket serveur et l'écouter. La file d'attente est
+    // celle du système : c'est l'admission après accept() qui refuse les connexions
+    server_socket = create_server_socket(SOMAXCONN, 0);
+    if (server_socket == -1)
     {
-        perror("Erreur lors de l'écoute");
-        close(server_socket);
         exit(EXIT_FAILURE);
     }
 
     // ÉTAPE 5 : Le serveur est prêt et en attente de connexions clients
-    printf("Serveur en écoute sur le port %d...\n", PORT);
+    printf("Serveur en écoute sur le port %d...\n", server_port);
+    if (start_federation() == -1)
+    {
+        exit(EXIT_FAILURE);
+    }
 
     // ÉTAPE 6 : Accepter les connexions entrantes et créer un thread pour chaque client
-    while ((client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addr_size)))
+    while (1)
     {
+        addr_size = sizeof(client_addr);
+        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addr_size);
+        if (client_socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            perror("Erreur lors de l'acceptation");
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                // Plus de descripteurs ou de mémoire : la connexion attend dans la file d'écoute
+                struct timespec pause = {.tv_nsec = 100 * 1000000L};
+                nanosleep(&pause, NULL);
+                continue;
+            }
+            break;
+        }
+
         pthread_t thread_id;
-        new_sock = malloc(sizeof(int));
-        *new_sock = client_socket;
+        metric_add(METRIC_ACCEPTED, 1);
+
+        // Admission avant de créer le thread du client ; il rend sa place en se terminant
+        if (admit_connection() == -1)
+        {
+            close(client_socket);
+            continue;
+        }
+        atomic_fetch_add(&open_connections, 1);
 
-        // ÉTAPE 7 : Créer un thread pour gérer ce client
-        if (pthread_create(&thread_id, NULL, handle_client, (void *)new_sock) < 0)
+        // ÉTAPE 7 : Créer un thread pour gérer ce client (le socket passe dans l'argument lui-même)
+        if (pthread_create(&thread_id, NULL, handle_client, (void *)(intptr_t)client_socket) != 0)
         {
             perror("Erreur lors de la création du thread");
-            free(new_sock);
             close(client_socket);
+            atomic_fetch_sub(&open_connections, 1);
+            continue;
         }
 
         // Le thread est détaché (les ressources seront libérées automatiquement)
         pthread_detach(thread_id);
     }
 
-    if (client_socket < 0)
-    {
-        perror("Erreur lors de l'acceptation");
-    }
-
     close(server_socket);
     return 0;
 }
@@ -0,0 +1,220 @@
+"""
+Outils communs aux tests : lancement d'un serveur dans un dossier temporaire
+et clients texte ou tramés (voir protocol.h).
+"""
+
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+SERVER = os.environ.get("CHAT_SERVER", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "server"))
+CLIENT = os.environ.get("CHAT_CLIENT", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "client"))
+MODES = os.environ.get("CHAT_MODES", "threads epoll").split()
+OPTIONS = os.environ.get("CHAT_OPTIONS", "").split()  # Options ajoutées à chaque serveur, avant celles du test
+
+PREFACE = b"\0MCP"
+HEADER = struct.Struct(">IBBHIQ")  # longueur, version, type, réservé, channel, séquence
+FRAME_HANDSHAKE, FRAME_TEXT, FRAME_CHAT, FRAME_NOTICE, FRAME_HISTORY = 1, 2, 3, 4, 5
+FRAME_MAX_CLIENT_PAYLOAD = 1023
+
+
+def fail(message):
+    print("ÉCHEC : " + message)
+    sys.exit(1)
+
+
+def check(condition, message):
+    if not condition:
+        fail(message)
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+class Server:
+    """Un serveur lancé dans son propre dossier (storage_server/ y est créé)."""
+
+    def __init__(self, mode, *options, directory=None):
+        self.owned = directory is None
+        self.directory = directory or tempfile.mkdtemp(prefix="chat-test-")
+        self.port = free_port()
+        self.admin = os.path.join(self.directory, "admin.sock")
+        self.start(mode, *options)
+
+    def start(self, mode, *options):
+        command = [SERVER, "--mode", mode, "--port", str(self.port), "--admin-socket", self.admin] + OPTIONS + list(options)
+        self.log = open(os.path.join(self.directory, "server.log"), "ab")
+        self.process = subprocess.Popen(command, cwd=self.directory, stdout=self.log, stderr=subprocess.STDOUT)
+        deadline = time.time() + 5
+        while time.time() < deadline:
+            check(self.process.poll() is None, "le serveur s'est arrêté au démarrage (%s)" % " ".join(command))
+            try:
+                socket.create_connection(("127.0.0.1", self.port), timeout=0.2).close()
+                return
+            except OSError:
+                time.sleep(0.05)
+        fail("le serveur n'écoute pas sur le port %d" % self.port)
+
+    def stop(self):
+        self.process.terminate()
+        self.process.wait()
+        self.log.close()
+
+    def stats(self):
+        """Renvoie la réponse de la socket d'administration à la commande stats."""
+        return self.command("stats")
+
+    def command(self, name):
+        """Envoie une commande à la socket d'administration et renvoie sa réponse."""
+        with socket.socket(socket.AF_UNIX) as s:
+            s.connect(self.admin)
+            s.sendall(name.encode() + b"\n")
+            s.shutdown(socket.SHUT_WR)
+            data = b""
+            while True:
+                chunk = s.recv(65536)
+                if not chunk:
+                    break
+                data += chunk
+        return data.decode(errors="replace")
+
+    def counter(self, label):
+        """Renvoie la valeur d'un compteur de stats, repéré par son libellé."""
+        for line in self.stats().splitlines():
+            if line.startswith(label + " : "):
+                return int(line[len(label) + 3:].split()[0])
+        fail("compteur '%s' absent des stats" % label)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.stop()
+        if self.owned:
+            shutil.rmtree(self.directory, ignore_errors=True)
+
+
+class TextClient:
+    """Client du protocole texte d'origine : un send() = un message."""
+
+    def __init__(self, port, name, channel):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.sock.sendall(name.encode())
+        time.sleep(0.05)
+        self.sock.sendall(channel.encode())
+        self.data = b""
+
+    def send(self, text):
+        self.sock.sendall(text.encode())
+
+    def read_until(self, predicate, timeout=5):
+        """Lit jusqu'à ce que predicate(texte reçu) soit vrai ; renvoie tout le texte reçu."""
+        deadline = time.time() + timeout
+        self.sock.settimeout(0.1)
+        while not predicate(self.data.decode(errors="replace")) and time.time() < deadline:
+            try:
+                chunk = self.sock.recv(65536)
+            except socket.timeout:
+                continue
+            if not chunk:
+                break
+            self.data += chunk
+        return self.data.decode(errors="replace")
+
+    def close(self):
+        self.sock.close()
+
+
+class FramedClient:
+    """Client du protocole tramé : préface, poignée de main puis trames."""
+
+    def __init__(self, port, name, channel, version=1, receive_buffer=0):
+        self.sock = socket.socket()
+        # Sans TCP_NODELAY, les envois rapprochés du test attendraient l'acquittement retardé du serveur
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        if receive_buffer > 0:
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, receive_buffer)
+        self.sock.connect(("127.0.0.1", port))
+        self.sock.sendall(PREFACE + bytes([version]))
+        self.buffer = b""
+        self.version = None
+        self.frames = []
+        self.closed = False
+        self.send_frame(FRAME_HANDSHAKE, name.encode() + b"\0" + channel.encode())
+
+    def send_frame(self, frame_type, payload, channel_id=0, sequence=0):
+        self.sock.sendall(HEADER.pack(len(payload), 1, frame_type, 0, channel_id, sequence) + payload)
+
+    def send(self, text):
+        self.send_frame(FRAME_TEXT, text.encode())
+
+    def receive(self, timeout):
+        """Lit ce qui arrive pendant au plus timeout secondes et découpe les trames complètes."""
+        self.sock.settimeout(timeout)
+        try:
+            chunk = self.sock.recv(65536)
+        except socket.timeout:
+            return
+        except ConnectionResetError:
+            chunk = b""
+        if not chunk:
+            self.closed = True
+            return
+        self.buffer += chunk
+        if self.version is None and len(self.buffer) >= len(PREFACE) + 1:
+            check(self.buffer.startswith(PREFACE), "préface du serveur invalide : %r" % self.buffer[:5])
+            self.version = self.buffer[len(PREFACE)]
+            self.buffer = self.buffer[len(PREFACE) + 1:]
+        while self.version is not None and len(self.buffer) >= HEADER.size:
+            length, version, frame_type, _, channel_id, sequence = HEADER.unpack_from(self.buffer)
+            check(version == 1, "version de trame inattendue : %d" % version)
+            if len(self.buffer) < HEADER.size + length:
+                break
+            payload = self.buffer[HEADER.size:HEADER.size + length].decode(errors="replace")
+            self.frames.append((frame_type, channel_id, sequence, payload))
+            self.buffer = self.buffer[HEADER.size + length:]
+
+    def wait_for(self, predicate, timeout=5):
+        """
+        Renvoie la première trame (type, channel, séquence, texte) reçue qui vérifie
+        predicate et la retire ; les autres restent pour les attentes suivantes,
+        les channels d'une connexion n'étant pas ordonnés entre eux.
+        """
+        deadline = time.time() + timeout
+        while True:
+            for index, frame in enumerate(self.frames):
+                if predicate(frame):
+                    del self.frames[index]
+                    return frame
+            if self.closed or time.time() >= deadline:
+                return None
+            self.receive(min(0.1, max(deadline - time.time(), 0.01)))
+
+    def drain(self, duration=0.3):
+        """Lit tout ce qui arrive pendant duration secondes et renvoie les trames reçues."""
+        deadline = time.time() + duration
+        while not self.closed and time.time() < deadline:
+            self.receive(0.05)
+        frames, self.frames = self.frames, []
+        return frames
+
+    def close(self):
+        self.sock.close()
+
+
+def join(port, name, channel, **options):
+    """
+    Connecte un client tramé et attend l'historique du channel, envoyé une fois le
+    client membre : l'ordre des arrivées n'est pas garanti en mode thread.
+    """
+    client = FramedClient(port, name, channel, **options)
+    check(client.wait_for(lambda f: f[0] == FRAME_HISTORY) is not None, "%s n'a pas rejoint '%s'" % (name, channel))
+    return client
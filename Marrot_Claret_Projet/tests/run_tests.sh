@@ -0,0 +1,25 @@
+#!/bin/sh
+# Compile le serveur et le client sans aucun avertissement, puis lance chaque test
+# contre le serveur compilé, dans les deux modes (CHAT_MODES pour n'en garder qu'un),
+# et repasse ceux du mode epoll sur des réacteurs io_uring.
+set -e
+cd "$(dirname "$0")"
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+gcc -Wall -Wextra -Werror -O2 -pthread -o "$build/server" ../server.c
+gcc -Wall -Wextra -Werror -O2 -o "$build/client" ../client.c
+
+export CHAT_SERVER="$build/server" CHAT_CLIENT="$build/client" PYTHONDONTWRITEBYTECODE=1
+status=0
+run_tests() {
+    for test in test_*.py; do
+        echo "== $test${CHAT_OPTIONS:+ ($CHAT_OPTIONS)}"
+        timeout 300 python3 "$test" || status=1
+    done
+}
+run_tests
+case " ${CHAT_MODES:-epoll} " in
+*" epoll "*) CHAT_MODES=epoll CHAT_OPTIONS="${CHAT_OPTIONS:+$CHAT_OPTIONS }--reactors 2 --io-uring" run_tests ;;
+esac
+exit $status
@@ -0,0 +1,41 @@
+"""
+Mode bench du client : rapport complet, tous les messages attendus reçus, y
+compris quand le serveur ferme une partie des connexions.
+"""
+
+import re
+
+from chat import *
+
+
+def bench(port, connections):
+    command = [CLIENT, "--bench", "--port", str(port), "--connections", str(connections), "--channels", "4", "--rate", "2000", "--duration", "2"]
+    result = subprocess.run(command, capture_output=True, text=True, timeout=60)
+    check(result.returncode == 0, "bench en échec (%d) : %s" % (result.returncode, result.stderr))
+    report = result.stdout
+    for label in ("Établissement", "Rejeu d'historique", "Latence de diffusion"):
+        check(re.search(label + r" +: n=\d+ p50=[\d.]+ ms p99=[\d.]+ ms p99.9=[\d.]+ ms max=[\d.]+ ms", report), "ligne '%s' absente : %s" % (label, report))
+    opened, total, closed = map(int, re.search(r"Connexions ouvertes +: (\d+)/(\d+) en .*, (\d+) fermées par le serveur", report).groups())
+    sent = int(re.search(r"Messages envoyés +: (\d+) ", report).group(1))
+    received, expected = map(int, re.search(r"Messages reçus +: (\d+)/(\d+) attendus", report).groups())
+    check(opened == total == connections, "%d connexions ouvertes sur %d" % (opened, connections))
+    check(sent > 3000, "%d messages envoyés en 2 s à 2000/s" % sent)
+    check(received == expected and expected > 0, "%d messages reçus pour %d attendus" % (received, expected))
+    return closed, sent
+
+
+def run(mode):
+    with Server(mode, "--client-rate", "0") as server:
+        closed, sent = bench(server.port, 20)
+        check(closed == 0, "%d connexions fermées par le serveur" % closed)
+        check(server.counter("Messages") == sent, "le serveur n'a pas journalisé les %d messages envoyés" % sent)
+
+    # Les connexions refusées par le serveur ne sont plus attendues
+    with Server(mode, "--client-rate", "0", "--max-clients", "15") as server:
+        closed, sent = bench(server.port, 20)
+        check(closed == 5, "%d connexions fermées par le serveur au lieu de 5" % closed)
+
+
+for mode in MODES:
+    run(mode)
+    print("OK bench (%s)" % mode)
@@ -0,0 +1,64 @@
+"""
+Plusieurs channels sur une connexion : /join, /channels, /leave et /switch,
+messages reçus de chaque channel suivi et envoyés dans le channel courant.
+"""
+
+from chat import *
+
+
+def notice(client, command):
+    client.send(command)
+    return "".join(f[3] for f in client.drain(0.5) if f[0] == FRAME_NOTICE)
+
+
+def chat_from(client, text):
+    return client.wait_for(lambda f: f[0] == FRAME_CHAT and f[3].endswith(text + "\n"), 2)
+
+
+def run(mode):
+    with Server(mode, "--client-rate", "0") as server:
+        alice = join(server.port, "alice", "nord")
+        bob = join(server.port, "bob", "sud")
+        carol = join(server.port, "carol", "est")
+
+        reply = notice(alice, "/join sud est")
+        check("Vous avez rejoint le channel 'sud'" in reply and "Vous avez rejoint le channel 'est'" in reply, "/join : %r" % reply)
+        check(notice(alice, "/channels") == "Channels suivis : est (courant) sud nord\n", "/channels après /join")
+
+        # Les messages de chaque channel suivi arrivent, avec l'identifiant de leur channel
+        bob.send("du sud")
+        carol.send("de l'est")
+        south = chat_from(alice, "bob : du sud")
+        east = chat_from(alice, "carol : de l'est")
+        check(south is not None and south[3].startswith("[sud] "), "message du sud non reçu")
+        check(east is not None and east[3].startswith("[est] "), "message de l'est non reçu")
+        check(south[1] != east[1] and south[1] != 0 and east[1] != 0, "identifiants de channel %d et %d" % (south[1], east[1]))
+
+        # Un message part dans le channel courant seulement
+        bob.drain()
+        alice.send("vers l'est")
+        check(chat_from(carol, "alice : vers l'est") is not None, "carol n'a pas reçu le message du channel courant")
+        check(chat_from(bob, "alice : vers l'est") is None, "message reçu hors du channel courant")
+
+        # Quitter le channel courant rend courant le plus récemment rejoint des autres
+        reply = notice(alice, "/leave est")
+        check("Vous avez quitté le channel 'est'" in reply and "Channel courant : 'sud'" in reply, "/leave : %r" % reply)
+        carol.send("plus suivi")
+        alice.send("vers le sud")
+        check(chat_from(bob, "alice : vers le sud") is not None, "bob n'a pas reçu le message après /leave")
+        check(chat_from(alice, "carol : plus suivi") is None, "message reçu d'un channel quitté")
+
+        # Rejoindre un channel déjà suivi le rend courant ; le dernier ne peut pas être quitté
+        check("Channel courant : 'nord'" in notice(alice, "/join nord"), "/join d'un channel suivi")
+        check(notice(alice, "/channels") == "Channels suivis : nord (courant) sud\n", "/channels après /join nord")
+        notice(alice, "/leave sud")
+        check("Impossible de quitter votre dernier channel" in notice(alice, "/leave nord"), "dernier channel quitté")
+
+        # /switch remplace le channel courant
+        notice(alice, "/switch ouest")
+        check(notice(alice, "/channels") == "Channels suivis : ouest (courant)\n", "/channels après /switch")
+
+
+for mode in MODES:
+    run(mode)
+    print("OK channels (%s)" % mode)
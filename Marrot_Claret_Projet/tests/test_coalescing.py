@@ -0,0 +1,48 @@
+"""
+Regroupement des écritures (mode epoll) : une rafale diffusée à un channel
+nombreux coûte bien moins d'écritures qu'avec --coalesce-bytes 0, et un
+message isolé part sans attendre la fin de la fenêtre.
+"""
+
+from chat import *
+
+MEMBERS = 20
+BURST = 300
+
+
+def burst_writes(*options):
+    """Diffuse une rafale à MEMBERS membres et renvoie les écritures qu'elle a coûté."""
+    with Server("epoll", "--client-rate", "0", *options) as server:
+        members = [join(server.port, "m%d" % i, "rafale") for i in range(MEMBERS)]
+        alice = join(server.port, "alice", "rafale")
+        for member in members:
+            member.drain(0.1)
+        before = server.counter("Écritures sur les sockets")
+
+        # Toute la rafale en un envoi : le réacteur la lit pendant une seule fenêtre
+        alice.sock.sendall(b"".join(HEADER.pack(len(p), 1, FRAME_TEXT, 0, 0, 0) + p for p in (b"rafale %d" % i for i in range(BURST))))
+        for member in members:
+            check(member.wait_for(lambda f: f[3].endswith("alice : rafale %d\n" % (BURST - 1))) is not None, "rafale incomplète")
+        return server.counter("Écritures sur les sockets") - before
+
+
+def idle_latency():
+    # Une fenêtre de 2 s : un message qui l'attendrait serait vu
+    with Server("epoll", "--coalesce-window", "2000000") as server:
+        alice = join(server.port, "alice", "calme")
+        bob = join(server.port, "bob", "calme")
+        alice.drain(0.1)
+        start = time.time()
+        bob.send("seul")
+        check(alice.wait_for(lambda f: f[3].endswith("bob : seul\n"), 1) is not None, "message isolé retenu par la fenêtre")
+        check(time.time() - start < 0.5, "message isolé reçu en %.3f s" % (time.time() - start))
+
+
+# Le regroupement n'existe qu'en mode epoll ; io_uring soumet déjà les envois par itération
+if "epoll" in MODES and "--io-uring" not in OPTIONS:
+    coalesced = burst_writes()
+    direct = burst_writes("--coalesce-bytes", "0")
+    check(direct >= MEMBERS * BURST, "%d écritures sans regroupement pour %d livraisons" % (direct, MEMBERS * BURST))
+    check(coalesced * 10 <= direct, "%d écritures regroupées contre %d sans regroupement" % (coalesced, direct))
+    idle_latency()
+    print("OK coalescing (%d écritures au lieu de %d)" % (coalesced, direct))
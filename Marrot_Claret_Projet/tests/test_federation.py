@@ -0,0 +1,114 @@
+"""
+Fédération de trois instances : arrivées, messages et départs relayés aux seules
+instances qui ont des membres du channel, puis reprise après le redémarrage
+d'une instance. Une liaison bloquée est coupée sans perdre d'annonce.
+"""
+
+import signal
+
+from chat import *
+
+
+def chat_line(client, text, timeout=2):
+    return client.wait_for(lambda f: f[0] == FRAME_CHAT and f[3].endswith(text + "\n"), timeout)
+
+
+def relay(sender, receiver, text):
+    """Renvoie text jusqu'à ce qu'il soit relayé : les instances se connectent entre elles en arrière-plan."""
+    deadline = time.time() + 10
+    while chat_line(receiver, text, 0.5) is None:
+        check(time.time() < deadline, "'%s' n'est pas relayé" % text)
+        sender.send(text)
+
+
+def run(mode):
+    directory = tempfile.mkdtemp(prefix="chat-test-")
+    listens = ["unix:%s/pair0.sock" % directory, "unix:%s/pair1.sock" % directory, "127.0.0.1:%d" % free_port()]
+    peers = sum((["--peer", "%d@%s" % (i, listen)] for i, listen in enumerate(listens)), [])
+    nodes = []
+    for i, listen in enumerate(listens):
+        os.mkdir(os.path.join(directory, "n%d" % i))
+        options = ["--client-rate", "0", "--node-id", str(i), "--peer-listen", listen] + peers
+        nodes.append(Server(mode, *options, directory=os.path.join(directory, "n%d" % i)))
+    try:
+        alice = join(nodes[0].port, "alice", "commun")
+        bob = join(nodes[1].port, "bob", "commun")
+        carol = join(nodes[2].port, "carol", "autre")
+        relay(alice, bob, "liaison établie")
+        dave = join(nodes[1].port, "dave", "commun")
+        check(alice.wait_for(lambda f: "dave a rejoint le channel 'commun'" in f[3]) is not None, "arrivée de dave non relayée")
+        dave.close()
+
+        alice.send("bonjour de n0")
+        check(chat_line(bob, "alice : bonjour de n0") is not None, "message de n0 non relayé vers n1")
+        bob.send("réponse de n1")
+        check(chat_line(alice, "bob : réponse de n1") is not None, "message de n1 non relayé vers n0")
+        check(chat_line(carol, "bonjour de n0", 0.5) is None, "message relayé hors de son channel")
+        check(nodes[2].counter("Reçus des pairs") == 0, "n2 a reçu des messages d'un channel sans membre")
+
+        # Chaque instance journalise les messages relayés
+        bob.send("/history")
+        replay = bob.wait_for(lambda f: f[0] == FRAME_HISTORY)
+        check(replay is not None and "alice : bonjour de n0\n" in replay[3] and "bob : réponse de n1\n" in replay[3],
+              "historique de n1 : %r" % (replay and replay[3]))
+
+        bob.close()
+        check(alice.wait_for(lambda f: "bob a quitter le channel 'commun'" in f[3]) is not None, "départ de bob non relayé")
+
+        # Une instance redémarrée est reconnectée par ses pairs
+        nodes[1].stop()
+        nodes[1].start(mode, *(["--client-rate", "0", "--node-id", "1", "--peer-listen", listens[1]] + peers))
+        bob = join(nodes[1].port, "bob", "commun")
+        relay(alice, bob, "après redémarrage")
+    finally:
+        for node in nodes:
+            node.stop()
+    shutil.rmtree(directory, ignore_errors=True)
+
+
+def stalled(mode):
+    """
+    n1 cesse de lire (SIGSTOP) pendant que n0 lui relaie un flot et lui annonce un
+    nouveau channel : la liaison dépasse --peer-queue-bytes et est coupée plutôt
+    que de jeter des trames, puis la reconnexion rétablit l'intérêt des deux côtés.
+    """
+    directory = tempfile.mkdtemp(prefix="chat-test-")
+    listens = ["unix:%s/pair0.sock" % directory, "unix:%s/pair1.sock" % directory]
+    peers = sum((["--peer", "%d@%s" % (i, listen)] for i, listen in enumerate(listens)), [])
+    nodes = []
+    for i, listen in enumerate(listens):
+        os.mkdir(os.path.join(directory, "n%d" % i))
+        options = ["--client-rate", "0", "--high-watermark", "65536", "--low-watermark", "16384", "--peer-queue-bytes", "65536",
+                   "--node-id", str(i), "--peer-listen", listen] + peers
+        nodes.append(Server(mode, *options, directory=os.path.join(directory, "n%d" % i)))
+    try:
+        alice = join(nodes[0].port, "alice", "flot")
+        bob = join(nodes[1].port, "bob", "flot")
+        relay(alice, bob, "liaison établie")
+
+        nodes[1].process.send_signal(signal.SIGSTOP)
+        filler = "f" * 900
+        for i in range(1500):
+            alice.send("%d %s" % (i, filler))
+        carol = join(nodes[0].port, "carol", "tardif")
+        for i in range(1500, 3000):
+            alice.send("%d %s" % (i, filler))
+        alice.send("/stats")
+        check(alice.wait_for(lambda f: "Serveur actif" in f[3], 20) is not None, "flot non traité par n0")
+        nodes[1].process.send_signal(signal.SIGCONT)
+
+        # L'annonce de 'tardif' n'a pas été jetée : n1 relaie ce channel à n0
+        dave = join(nodes[1].port, "dave", "tardif")
+        relay(dave, carol, "après le blocage")
+        relay(alice, bob, "flot rétabli")
+    finally:
+        nodes[1].process.send_signal(signal.SIGCONT)
+        for node in nodes:
+            node.stop()
+    shutil.rmtree(directory, ignore_errors=True)
+
+
+for mode in MODES:
+    run(mode)
+    stalled(mode)
+    print("OK federation (%s)" % mode)
@@ -0,0 +1,73 @@
+"""
+Protocole tramé : négociation, aller-retour des messages entre clients tramés
+et texte, numéros de séquence, trames coupées ou regroupées, trames invalides.
+"""
+
+from chat import *
+
+
+def is_chat(text):
+    return lambda frame: frame[0] == FRAME_CHAT and text in frame[3]
+
+
+def run(mode):
+    with Server(mode, "--client-rate", "0") as server:
+        # Une version inconnue est ramenée à celle du serveur
+        alice = FramedClient(server.port, "alice", "trames", version=7)
+        check(alice.wait_for(lambda f: "Bienvenue" in f[3]) is not None, "pas de bienvenue pour alice")
+        check(alice.version == 1, "version négociée %r au lieu de 1" % alice.version)
+        bob = join(server.port, "bob", "trames")
+        carol = TextClient(server.port, "carol", "trames")
+        check(alice.wait_for(lambda f: f[0] == FRAME_NOTICE and "carol a rejoint" in f[3]) is not None, "carol n'est pas annoncée")
+        bob.drain()
+
+        # Tramé -> tramé et texte : une trame FRAME_CHAT numérotée, une ligne de texte
+        alice.send("bonjour é à ü")
+        first = bob.wait_for(is_chat("bonjour é à ü"))
+        check(first is not None, "bob n'a pas reçu le message d'alice")
+        check("] (" in first[3] and "alice : bonjour é à ü\n" in first[3], "ligne de chat inattendue : %r" % first[3])
+        check(first[2] > 0, "message sans numéro de séquence")
+        check("alice : bonjour é à ü" in carol.read_until(lambda t: "bonjour" in t), "carol n'a pas reçu le message d'alice")
+
+        # Texte -> tramé : le message suivant porte le numéro suivant
+        carol.send("salut de carol")
+        second = bob.wait_for(is_chat("carol : salut de carol"))
+        check(second is not None and second[2] == first[2] + 1, "numéro %r après %d" % (second and second[2], first[2]))
+
+        # Plusieurs trames dans un seul send(), puis une trame envoyée octet par octet
+        payloads = [("lot %d" % i).encode() for i in range(5)]
+        alice.sock.sendall(b"".join(HEADER.pack(len(p), 1, FRAME_TEXT, 0, 0, 0) + p for p in payloads))
+        sequences = []
+        for p in payloads:
+            frame = bob.wait_for(is_chat("alice : " + p.decode() + "\n"))
+            check(frame is not None, "message %r perdu" % p)
+            sequences.append(frame[2])
+        check(sequences == list(range(second[2] + 1, second[2] + 6)), "numéros du lot : %r" % sequences)
+        split = b"morceaux"
+        for byte in HEADER.pack(len(split), 1, FRAME_TEXT, 0, 0, 0) + split:
+            alice.sock.sendall(bytes([byte]))
+            time.sleep(0.002)
+        check(bob.wait_for(is_chat("alice : morceaux")) is not None, "trame envoyée octet par octet perdue")
+
+        # /history #K renvoie le message K dans une trame d'historique
+        bob.send("/history #%d" % first[2])
+        history = ""
+        while "morceaux" not in history:
+            frame = bob.wait_for(lambda f: f[0] == FRAME_HISTORY)
+            check(frame is not None, "historique incomplet : %r" % history)
+            history += frame[3]
+        check(history.startswith(first[3]), "l'historique ne commence pas au message #%d : %r" % (first[2], history[:80]))
+
+        # Une trame trop grande ou d'une autre version ferme la connexion
+        alice.sock.sendall(HEADER.pack(FRAME_MAX_CLIENT_PAYLOAD + 1, 1, FRAME_TEXT, 0, 0, 0))
+        alice.drain(1)
+        check(alice.closed, "trame trop grande acceptée")
+        bob.sock.sendall(HEADER.pack(2, 9, FRAME_TEXT, 0, 0, 0) + b"xx")
+        bob.drain(1)
+        check(bob.closed, "trame de version 9 acceptée")
+        carol.close()
+
+
+for mode in MODES:
+    run(mode)
+    print("OK framing (%s)" % mode)
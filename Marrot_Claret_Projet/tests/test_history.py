@@ -0,0 +1,80 @@
+"""
+Historique : page rejouée à l'arrivée, pages précédentes avec /more, /history
+N et #K, puis les mêmes réponses et la suite de la numérotation après un
+redémarrage sur le même stockage.
+"""
+
+from chat import *
+
+PAGE = 10
+
+
+def history_lines(client, command=None, until=None):
+    """Envoie command (ou attend le rejeu de l'arrivée) et renvoie les messages des trames d'historique reçues."""
+    if command is not None:
+        client.send(command)
+    frames = client.drain(0.5)
+    if until is not None:
+        while not any(until in f[3] for f in frames):
+            more = client.drain(0.5)
+            check(more, "pas de '%s' après %r" % (until, command))
+            frames += more
+    text = "".join(f[3] for f in frames if f[0] == FRAME_HISTORY)
+    return [line.split(" : ", 1)[1] for line in text.splitlines() if " : " in line]
+
+
+def check_pages(client, messages):
+    check(history_lines(client) == messages[-PAGE:], "le rejeu de l'arrivée n'est pas la dernière page")
+    pages = [messages[-PAGE:]]
+    while True:
+        client.send("/more")
+        frames = client.drain(0.5)
+        check(frames and frames[0][0] == FRAME_NOTICE, "pas d'avis avant la page de /more")
+        if "Début de l'historique" in frames[0][3]:
+            break
+        text = "".join(f[3] for f in frames if f[0] == FRAME_HISTORY)
+        pages.insert(0, [line.split(" : ", 1)[1] for line in text.splitlines() if " : " in line])
+        check(len(pages[0]) <= PAGE, "page de %d messages" % len(pages[0]))
+    check(sum(pages, []) == messages, "les pages de /more ne redonnent pas tout l'historique")
+
+
+def run(mode):
+    directory = tempfile.mkdtemp(prefix="chat-test-")
+    options = ("--client-rate", "0", "--history-lines", str(PAGE), "--segment-size", "4096")
+    messages = ["message %d" % i for i in range(95)]
+
+    with Server(mode, *options, directory=directory) as server:
+        alice = join(server.port, "alice", "pages")
+        bob = join(server.port, "bob", "pages")
+        sequences = []
+        for message in messages:
+            alice.send(message)
+            frame = bob.wait_for(lambda f: f[0] == FRAME_CHAT and f[3].endswith(" : %s\n" % message))
+            check(frame is not None, "bob n'a pas reçu %r" % message)
+            sequences.append(frame[2])
+        check(sequences == list(range(sequences[0], sequences[0] + len(messages))), "numéros non consécutifs")
+
+        carol = FramedClient(server.port, "carol", "pages")
+        check_pages(carol, messages)
+        check(history_lines(carol, "/history 5") == messages[-5:], "/history 5")
+        check(history_lines(carol, "/history #%d" % sequences[40], until=messages[-1]) == messages[40:], "/history #K")
+        text = TextClient(server.port, "dave", "pages")
+        replay = text.read_until(lambda t: t.endswith(" : %s\n" % messages[-1]))
+        check([line.split(" : ", 1)[1] for line in replay.splitlines()] == messages[-PAGE:], "rejeu d'un client texte")
+        text.close()
+
+    # Au redémarrage, le channel est relu depuis storage_server/ et la numérotation continue
+    with Server(mode, *options, directory=directory) as server:
+        erin = FramedClient(server.port, "erin", "pages")
+        check_pages(erin, messages)
+        check(history_lines(erin, "/history", until=messages[-1])[-len(messages):] == messages, "/history après redémarrage")
+        frank = join(server.port, "frank", "pages")
+        frank.send("après redémarrage")
+        frame = erin.wait_for(lambda f: f[0] == FRAME_CHAT and "après redémarrage" in f[3])
+        check(frame is not None and frame[2] == sequences[-1] + 1, "numéro %r après %d" % (frame and frame[2], sequences[-1]))
+    shutil.rmtree(directory, ignore_errors=True)
+
+
+for mode in MODES:
+    run(mode)
+    print("OK history (%s)" % mode)
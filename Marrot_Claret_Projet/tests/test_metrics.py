@@ -0,0 +1,85 @@
+"""
+Commande prometheus du socket d'administration : texte d'exposition relu après
+du trafic (types déclarés, histogrammes cumulés avec _sum et _count, noms de
+channels échappés, compteurs égaux au trafic envoyé).
+"""
+
+import re
+
+from chat import *
+
+CHANNELS = {"simple": 7, 'gu"ill\\emets': 5}
+SAMPLE = re.compile(r'^([a-z_]+)(?:\{((?:[a-z_]+="(?:[^"\\]|\\.)*",?)*)\})? (\S+)$')
+LABEL = re.compile(r'([a-z_]+)="((?:[^"\\]|\\.)*)"')
+
+
+def parse(text):
+    """Renvoie les types déclarés et les échantillons (nom, étiquettes, valeur), dans l'ordre."""
+    types, samples = {}, []
+    for line in text.splitlines():
+        if line.startswith("# TYPE "):
+            _, _, name, kind = line.split(" ")
+            check(name not in types, "type de '%s' déclaré deux fois" % name)
+            types[name] = kind
+            continue
+        match = SAMPLE.match(line)
+        check(match is not None, "ligne d'exposition invalide : %r" % line)
+        labels = {k: re.sub(r"\\(.)", r"\1", v) for k, v in LABEL.findall(match.group(2) or "")}
+        samples.append((match.group(1), labels, float(match.group(3))))
+    return types, samples
+
+
+def family(types, name):
+    """Retrouve la famille déclarée d'un échantillon (suffixes des histogrammes retirés)."""
+    for suffix in ("", "_bucket", "_sum", "_count"):
+        if suffix and name.endswith(suffix) and types.get(name[:-len(suffix)]) == "histogram":
+            return name[:-len(suffix)]
+        if not suffix and name in types:
+            return name
+    fail("échantillon '%s' sans # TYPE" % name)
+
+
+def check_histogram(name, samples):
+    buckets = [(labels["le"], value) for sample, labels, value in samples if sample == name + "_bucket"]
+    check(len(buckets) > 1 and buckets[-1][0] == "+Inf", "%s : pas de seau +Inf en dernier" % name)
+    bounds = [float(le) for le, _ in buckets]
+    check(bounds == sorted(set(bounds)), "%s : bornes le non croissantes" % name)
+    counts = [value for _, value in buckets]
+    check(counts == sorted(counts), "%s : seaux non cumulés %r" % (name, counts))
+    sums = [value for sample, _, value in samples if sample == name + "_sum"]
+    totals = [value for sample, _, value in samples if sample == name + "_count"]
+    check(len(sums) == 1 and len(totals) == 1, "%s : _sum ou _count absent" % name)
+    check(totals[0] == counts[-1], "%s : _count %d différent du seau +Inf %d" % (name, totals[0], counts[-1]))
+    check(sums[0] >= 0 and (totals[0] == 0) == (sums[0] == 0), "%s : _sum %r pour %d mesures" % (name, sums[0], totals[0]))
+    return totals[0]
+
+
+def run(mode):
+    with Server(mode, "--client-rate", "0") as server:
+        for channel, count in CHANNELS.items():
+            alice = join(server.port, "alice", channel)
+            bob = join(server.port, "bob", channel)
+            for i in range(count):
+                alice.send("message %d" % i)
+            check(bob.wait_for(lambda f: f[3].endswith("alice : message %d\n" % (count - 1))) is not None, "message perdu dans '%s'" % channel)
+            alice.close()
+            bob.close()
+
+        types, samples = parse(server.command("prometheus"))
+        for sample, _, _ in samples:
+            family(types, sample)
+        counts = {name: check_histogram(name, samples) for name, kind in types.items() if kind == "histogram"}
+        check(counts.get("chat_log_and_broadcast_seconds") == sum(CHANNELS.values()), "histogramme log_and_broadcast : %r" % counts)
+
+        values = {(name, tuple(sorted(labels.items()))): value for name, labels, value in samples}
+        check(types.get("chat_messages_total") == "counter", "chat_messages_total non déclaré comme compteur")
+        total = values.get(("chat_messages_total", ()))
+        check(total == sum(CHANNELS.values()), "chat_messages_total à %r au lieu de %d" % (total, sum(CHANNELS.values())))
+        for channel, count in CHANNELS.items():
+            found = values.get(("chat_channel_messages_total", (("channel", channel),)))
+            check(found == count, "chat_channel_messages_total de %r à %r au lieu de %d" % (channel, found, count))
+
+
+for mode in MODES:
+    run(mode)
+    print("OK metrics (%s)" % mode)
@@ -0,0 +1,102 @@
+"""
+Limites de débit : seau d'un client, seau d'un channel, contrôle d'admission
+des connexions (débit d'acceptation et nombre de connexions ouvertes).
+"""
+
+from chat import *
+
+
+def flood(sender, count, prefix):
+    for i in range(count):
+        sender.send("%s %d" % (prefix, i))
+
+
+def received(client, prefix):
+    return [f for f in client.drain(0.5) if f[0] == FRAME_CHAT and " : " + prefix + " " in f[3]]
+
+
+def notices(frames, text):
+    return sum(1 for f in frames if f[0] == FRAME_NOTICE and text in f[3])
+
+
+def check_message_rates(mode):
+    with Server(mode, "--client-rate", "5:5", "--channel-rate", "0") as server:
+        alice = join(server.port, "alice", "debit")
+        bob = join(server.port, "bob", "debit")
+
+        # Une rafale de 30 messages : la rafale du seau passe, le reste est refusé avec un seul avis
+        flood(alice, 30, "rafale")
+        accepted = len(received(bob, "rafale"))
+        check(5 <= accepted <= 7, "%d messages de la rafale diffusés pour un seau de 5" % accepted)
+        warnings = notices(alice.drain(), "Trop de messages envoyés")
+        check(1 <= warnings <= accepted - 4, "%d avis de refus pour %d messages acceptés" % (warnings, accepted))
+        refused = server.counter("Messages refusés (débit du client)")
+        check(refused == 30 - accepted, "compteur de refus à %d au lieu de %d" % (refused, 30 - accepted))
+
+        # Le seau se remplit : une seconde plus tard, l'expéditeur est de nouveau admis
+        time.sleep(1.2)
+        alice.send("après pause")
+        check(bob.wait_for(lambda f: "alice : après pause" in f[3]) is not None, "message refusé après la pause")
+
+    with Server(mode, "--client-rate", "0", "--channel-rate", "8:8") as server:
+        alice = join(server.port, "alice", "debit")
+        carol = join(server.port, "carol", "debit")
+        bob = join(server.port, "bob", "debit")
+
+        # Deux expéditeurs se partagent le seau du channel
+        flood(alice, 10, "canal")
+        flood(carol, 10, "canal")
+        accepted = len(received(bob, "canal"))
+        check(8 <= accepted <= 10, "%d messages diffusés pour un seau de channel de 8" % accepted)
+        warnings = notices(alice.drain() + carol.drain(), "Trop de messages dans ce channel")
+        check(warnings >= 1, "aucun avis de refus du channel")
+        refused = server.counter("Messages refusés (débit du channel)")
+        check(refused == 20 - accepted, "compteur de refus à %d au lieu de %d" % (refused, 20 - accepted))
+
+
+def open_connections(port, count):
+    sockets = [socket.create_connection(("127.0.0.1", port)) for _ in range(count)]
+    time.sleep(0.5)
+    closed = []
+    for s in sockets:
+        s.settimeout(0.05)
+        try:
+            if s.recv(16) == b"":
+                closed.append(s)
+        except socket.timeout:
+            pass
+        except ConnectionResetError:
+            closed.append(s)
+    return sockets, closed
+
+
+def check_admission(mode):
+    with Server(mode, "--accept-rate", "5:5") as server:
+        time.sleep(1.2)  # Le seau reprend le jeton de la connexion de démarrage
+        sockets, closed = open_connections(server.port, 20)
+        check(14 <= len(closed) <= 15, "%d connexions fermées sur 20 pour un seau de 5" % len(closed))
+        refused = server.counter("Connexions refusées (débit d'acceptation)")
+        check(refused == len(closed), "compteur de refus à %d pour %d connexions fermées" % (refused, len(closed)))
+        for s in sockets:
+            s.close()
+
+    with Server(mode, "--max-connections", "5") as server:
+        time.sleep(0.3)  # La connexion de démarrage est refermée
+        sockets, closed = open_connections(server.port, 8)
+        check(len(closed) == 3, "%d connexions fermées sur 8 pour 5 ouvertes au plus" % len(closed))
+        check(server.counter("Connexions refusées (trop de connexions ouvertes)") == 3, "compteur de connexions refusées")
+
+        # Une place libérée est reprise par la connexion suivante
+        next(s for s in sockets if s not in closed).close()
+        time.sleep(0.3)
+        client = TextClient(server.port, "dave", "admis")
+        check("Bienvenue" in client.read_until(lambda t: "Bienvenue" in t), "connexion refusée après une fermeture")
+        for s in sockets:
+            s.close()
+        client.close()
+
+
+for mode in MODES:
+    check_message_rates(mode)
+    check_admission(mode)
+    print("OK rate limit (%s)" % mode)
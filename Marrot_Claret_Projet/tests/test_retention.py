@@ -0,0 +1,84 @@
+"""
+Rétention du journal segmenté : par taille, puis par âge après un redémarrage,
+avec un segment illisible qui n'est pas effacé par la rétention par âge.
+"""
+
+import glob
+
+from chat import *
+
+SEGMENT = 4096
+LIMIT = 16384
+
+
+def segments(directory):
+    files = glob.glob(os.path.join(directory, "storage_server", "storage_garde", "segment_*"))
+    logs = sorted((f for f in files if f.endswith(".log")), key=lambda f: int(f[-24:-4]))
+    return logs, files
+
+
+def history(client):
+    client.send("/history")
+    text = ""
+    while not text.endswith(" : fin\n"):
+        frame = client.wait_for(lambda f: f[0] == FRAME_HISTORY)
+        check(frame is not None, "/history incomplet : %r" % text[-200:])
+        text += frame[3]
+    return [line.split(" : ", 1)[1] for line in text.splitlines() if " : " in line]
+
+
+def check_suffix(lines, messages):
+    check(lines[-1] == "fin" and len(lines) > 1, "/history vide")
+    kept = lines[:-1]
+    check(kept == messages[len(messages) - len(kept):], "/history n'est pas une suite des derniers messages")
+    return len(kept)
+
+
+def run(mode):
+    directory = tempfile.mkdtemp(prefix="chat-test-")
+    options = ("--client-rate", "0", "--segment-size", str(SEGMENT))
+    messages = ["message %03d %s" % (i, "r" * 150) for i in range(300)]
+
+    # Par taille : le journal reste sous la limite plus un segment
+    with Server(mode, *options, "--retention-bytes", str(LIMIT), directory=directory) as server:
+        alice = join(server.port, "alice", "garde")
+        for message in messages:
+            alice.send(message)
+        alice.send("fin")
+        time.sleep(2.5)
+        logs, files = segments(directory)
+        total = sum(os.path.getsize(f) for f in logs)
+        check(total <= LIMIT + 2 * SEGMENT, "%d octets de journal pour une limite de %d" % (total, LIMIT))
+        stems = {f.rsplit(".", 1)[0] for f in logs}
+        check(all(f.rsplit(".", 1)[0] in stems for f in files), "index laissé sans son segment")
+        kept = check_suffix(history(alice), messages)
+        check(kept < len(messages), "aucun message effacé par la rétention par taille")
+
+    # Par âge : tout est effacé sauf le segment en cours... et un segment illisible
+    logs, _ = segments(directory)
+    check(len(logs) >= 3, "%d segments restants" % len(logs))
+    size = os.path.getsize(logs[0])
+    with open(logs[0], "wb") as file:
+        file.write(b"\xff" * size)
+    time.sleep(1.5)
+    with Server(mode, *options, "--retention-age", "1", directory=directory) as server:
+        bob = join(server.port, "bob", "garde")
+        time.sleep(2.5)
+        remaining, _ = segments(directory)
+        check(logs[0] in remaining, "segment illisible effacé par la rétention par âge")
+        check(remaining == [logs[0], logs[-1]], "segments restants : %r" % [os.path.basename(f) for f in remaining])
+        check_suffix(history(bob), messages)
+        for _ in range(len(messages)):
+            bob.send("/more")
+            frame = bob.wait_for(lambda f: f[0] == FRAME_NOTICE and f[3].startswith("---"))
+            check(frame is not None, "pas de réponse à /more")
+            if "Début de l'historique" in frame[3]:
+                break
+        else:
+            fail("/more n'atteint pas le début de l'historique conservé")
+    shutil.rmtree(directory, ignore_errors=True)
+
+
+for mode in MODES:
+    run(mode)
+    print("OK retention (%s)" % mode)
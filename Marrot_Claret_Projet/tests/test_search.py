@@ -0,0 +1,105 @@
+"""
+/search : résultats comparés à une recherche naïve sur les messages envoyés,
+à travers plusieurs segments indexés, avant et après un redémarrage, puis
+limite du nombre de segments lus par une recherche.
+"""
+
+import glob
+import random
+import re
+
+from chat import *
+
+WORDS = ["alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "kilo", "été", "Zulu"]
+QUERIES = ["alpha bravo", "ZULU été", "kilo golf hotel", "n7", "delta n%d", "absent", "alpha nulle part"]
+
+
+def terms(text):
+    return {t.lower() for t in re.findall(r"[0-9A-Za-z\u0080-\U0010ffff]+", text) if len(t.encode()) >= 2}
+
+
+def search(client, query, end="--- Fin de la recherche ---"):
+    client.send("/search " + query)
+    text = ""
+    while "--- Fin de la recherche" not in text:
+        frame = client.wait_for(lambda f: f[0] == FRAME_NOTICE, 10)
+        check(frame is not None, "réponse à '/search %s' incomplète : %r" % (query, text))
+        text += frame[3]
+    lines = text.splitlines()
+    check(lines[0].startswith("--- Recherche '%s'" % query), "en-tête inattendu : %r" % lines[0])
+    check(end is None or lines[-1] == end, "'/search %s' terminée par %r au lieu de %r" % (query, lines[-1], end))
+    return [int(re.search(r" n(\d+)$", line).group(1)) for line in lines[1:-1]]
+
+
+def check_queries(client, messages):
+    for query in QUERIES:
+        if "%d" in query:
+            query %= len(messages) - 1
+        wanted = terms(query)
+        expected = [i for i, m in enumerate(messages) if wanted <= terms(m)][-20:]
+        found = search(client, query)
+        check(found == expected, "'/search %s' : %r au lieu de %r" % (query, found, expected))
+
+
+def run(mode):
+    directory = tempfile.mkdtemp(prefix="chat-test-")
+    options = ("--client-rate", "0", "--segment-size", "4096")
+    random.seed(24)
+    messages = [" ".join(random.choice(WORDS) for _ in range(3)) + " n%d" % i for i in range(600)]
+
+    with Server(mode, *options, directory=directory) as server:
+        alice = join(server.port, "alice", "cherche")
+        for message in messages:
+            alice.send(message)
+        # /search ne voit que les messages déjà écrits par le thread écrivain
+        deadline = time.time() + 20
+        while (found := search(alice, "n%d" % (len(messages) - 1))) != [len(messages) - 1]:
+            check(time.time() < deadline, "dernier message jamais trouvé par /search : %r" % found)
+            time.sleep(0.1)
+        check_queries(alice, messages)
+
+        # Mots trop courts : l'usage est rappelé
+        alice.send("/search a")
+        check(alice.wait_for(lambda f: f[3].startswith("Usage : /search")) is not None, "pas d'usage pour un mot d'un caractère")
+
+    # Les segments tournés ont leur index sur disque, relu après le redémarrage
+    indexes = glob.glob(os.path.join(directory, "storage_server", "storage_cherche", "*.fts"))
+    check(len(indexes) >= 5, "%d fichiers .fts après plusieurs rotations" % len(indexes))
+    with Server(mode, *options, directory=directory) as server:
+        bob = join(server.port, "bob", "cherche")
+        check_queries(bob, messages)
+    shutil.rmtree(directory, ignore_errors=True)
+
+
+def segment_limit(mode):
+    """
+    Un mot présent seulement dans le plus ancien de la centaine de segments n'est pas
+    cherché au-delà des 64 plus récents.
+    """
+    with Server(mode, "--client-rate", "0", "--segment-size", "4096") as server:
+        alice = join(server.port, "alice", "long")
+        alice.send("rarissime au début")
+        last = 8000
+        for i in range(1, last + 1):
+            alice.send("remplissage n%d" % i)
+        deadline = time.time() + 30
+        while (found := search(alice, "n%d" % last, None)) != [last]:
+            check(time.time() < deadline, "dernier message jamais trouvé par /search : %r" % found)
+            time.sleep(0.1)
+        directory = os.path.join(server.directory, "storage_server", "storage_long")
+        check(len(glob.glob(os.path.join(directory, "*.log"))) > 66, "trop peu de segments pour la limite")
+        # Les .fts sont écrits par le thread d'indexation : sans eux, la lecture du journal serait partielle aussi
+        while len(glob.glob(os.path.join(directory, "*.fts"))) < len(glob.glob(os.path.join(directory, "*.log"))) - 1:
+            check(time.time() < deadline, "index des segments fermés jamais écrits")
+            time.sleep(0.1)
+        partial = "--- Fin de la recherche (partielle : 64 segments les plus récents) ---"
+        check(search(alice, "rarissime", partial) == [], "segment au-delà de la limite lu")
+        check(search(alice, "n%d" % (last - 2000), partial) == [last - 2000], "message des segments récents non trouvé")
+        # 20 résultats trouvés dans les segments récents : rien n'est laissé de côté
+        check(search(alice, "remplissage") == list(range(last - 19, last + 1)), "20 derniers messages non trouvés")
+
+
+for mode in MODES:
+    run(mode)
+    segment_limit(mode)
+    print("OK search (%s)" % mode)
@@ -0,0 +1,61 @@
+"""
+Clients lents : un client qui ne lit plus ne freine pas les autres membres du
+channel ; selon --slow-policy, ses plus anciens messages sont jetés ou il est
+déconnecté.
+"""
+
+from chat import *
+
+COUNT = 6000
+FILLER = "x" * 900
+
+
+def flood(alice, bob):
+    """Envoie COUNT messages par lots et vérifie que bob, qui lit chaque lot, les reçoit tous dans l'ordre."""
+    for first in range(0, COUNT, 20):
+        for i in range(first, first + 20):
+            alice.send("%d %s" % (i, FILLER))
+        for i in range(first, first + 20):
+            frame = bob.wait_for(lambda f: f[0] == FRAME_CHAT, 10)
+            check(frame is not None and " : %d x" % i in frame[3], "bob a perdu le message %d" % i)
+
+
+def numbers(frames):
+    return [int(f[3].split(" : ", 1)[1].split()[0]) for f in frames if f[0] == FRAME_CHAT]
+
+
+def run(mode):
+    watermarks = ("--client-rate", "0", "--high-watermark", "65536", "--low-watermark", "16384")
+    with Server(mode, *watermarks, "--slow-policy", "drop") as server:
+        alice = join(server.port, "alice", "lent")
+        bob = join(server.port, "bob", "lent")
+        carol = join(server.port, "carol", "lent", receive_buffer=4096)
+        flood(alice, bob)
+        dropped = server.counter("Messages jetés")
+        check(dropped > 0, "aucun message jeté pour un client qui ne lit pas")
+
+        # Les messages restants arrivent dans l'ordre, jusqu'au dernier
+        received = numbers(carol.drain(2))
+        check(received and received[-1] == COUNT - 1, "carol n'a pas reçu le dernier message")
+        check(received == sorted(received) and len(set(received)) == len(received), "messages de carol désordonnés")
+        check(len(received) + dropped == COUNT, "%d reçus + %d jetés pour %d envoyés" % (len(received), dropped, COUNT))
+        check(not carol.closed, "carol déconnectée avec la politique drop")
+
+    with Server(mode, *watermarks, "--slow-policy", "disconnect") as server:
+        alice = join(server.port, "alice", "lent")
+        bob = join(server.port, "bob", "lent")
+        carol = join(server.port, "carol", "lent", receive_buffer=4096)
+        flood(alice, bob)
+        check(server.counter("Clients lents déconnectés") == 1, "carol n'a pas été déconnectée")
+        carol.drain(2)
+        check(carol.closed, "connexion de carol encore ouverte")
+
+    # Seuils invalides : le serveur refuse de démarrer
+    for option in (("--high-watermark", "0"), ("--high-watermark", "100"), ("--high-watermark", "12k"), ("--low-watermark", "-1")):
+        result = subprocess.run([SERVER, "--mode", mode, "--port", str(free_port())] + list(option), capture_output=True, timeout=5)
+        check(result.returncode != 0, "%s %s accepté" % option)
+
+
+for mode in MODES:
+    run(mode)
+    print("OK slow consumer (%s)" % mode)
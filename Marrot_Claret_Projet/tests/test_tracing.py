@@ -0,0 +1,80 @@
+"""
+Traçage : un message sur N est suivi de sa réception à sa livraison au dernier
+membre, et l'anneau est écrit au format Chrome trace par la commande trace ou
+par SIGUSR2.
+"""
+
+import collections
+import json
+import signal
+
+from chat import *
+
+SAMPLE = 5
+MESSAGES = 60
+STEPS = ("recv", "log_and_broadcast", "log_submit", "log_queue", "log_write", "broadcast", "message")
+
+
+def spans(path):
+    with open(path) as file:
+        events = json.load(file)["traceEvents"]
+    traces = collections.defaultdict(list)
+    for event in events:
+        if event["ph"] == "X":
+            traces[event["args"]["trace"]].append(event)
+    return events, traces
+
+
+def run(mode):
+    with Server(mode, "--client-rate", "0", "--trace-sample", str(SAMPLE), "--trace-file", "trace.json") as server:
+        path = os.path.join(server.directory, "trace.json")
+        members = [join(server.port, "membre%d" % i, "trace") for i in range(4)]
+        for k in range(MESSAGES):
+            members[k % 4].send("message %d" % k)
+        for member in members:
+            received = 0
+            while received < MESSAGES * 3 // 4:
+                check(member.wait_for(lambda f: f[0] == FRAME_CHAT, 5) is not None, "messages perdus")
+                received += 1
+        time.sleep(0.3)
+
+        reply = server.command("trace")
+        check("étapes tracées écrites" in reply, "commande trace : %r" % reply)
+        events, traces = spans(path)
+        # Un message sur SAMPLE, compté par thread : en mode thread, chacun des 4 expéditeurs a le sien
+        check(MESSAGES // SAMPLE - 4 <= len(traces) <= MESSAGES // SAMPLE + 4, "%d messages tracés sur %d" % (len(traces), MESSAGES))
+        for trace, steps in traces.items():
+            names = collections.Counter(step["name"] for step in steps)
+            check(all(names[step] == 1 for step in STEPS), "trace %d incomplète : %r" % (trace, dict(names)))
+            check(names["deliver"] == 3, "trace %d : %d livraisons pour 3 destinataires" % (trace, names["deliver"]))
+            whole = next(step for step in steps if step["name"] == "message")
+            end = whole["ts"] + whole["dur"] + 1
+            for step in steps:
+                # Le message se termine à la libération par son dernier destinataire : avant le retour de la
+                # diffusion, et parfois avant l'écriture du journal, qui ne retient pas la diffusion
+                check(whole["ts"] <= step["ts"] + 1, "étape '%s' avant la réception de la trace %d" % (step["name"], trace))
+                if step["name"] in ("deliver", "send"):
+                    check(step["ts"] + step["dur"] <= end, "livraison après la fin de la trace %d" % trace)
+        check(any(event["ph"] == "s" for event in events) and any(event["ph"] == "f" for event in events), "flèches absentes")
+
+        os.remove(path)
+        server.process.send_signal(signal.SIGUSR2)
+        deadline = time.time() + 5
+        while not os.path.exists(path) or os.path.getsize(path) == 0 or not open(path).read().rstrip().endswith("}"):
+            check(time.time() < deadline, "SIGUSR2 n'a pas écrit les traces")
+            time.sleep(0.1)
+        check(len(spans(path)[1]) == len(traces), "traces différentes après SIGUSR2")
+
+    # Sans --trace-sample, rien n'est tracé
+    with Server(mode, "--trace-file", "trace.json") as server:
+        alice = join(server.port, "alice", "trace")
+        bob = join(server.port, "bob", "trace")
+        alice.send("non tracé")
+        check(bob.wait_for(lambda f: f[0] == FRAME_CHAT) is not None, "message perdu")
+        check(server.command("trace").startswith("Traçage désactivé"), "traçage actif sans --trace-sample")
+        check(not os.path.exists(os.path.join(server.directory, "trace.json")), "traces écrites sans --trace-sample")
+
+
+for mode in MODES:
+    run(mode)
+    print("OK tracing (%s)" % mode)
@@ -0,0 +1,56 @@
+"""
+Mise à jour à chaud (mode epoll) : un nouveau processus reprend les sockets et
+l'état des clients de l'ancien, qui s'arrête, sans couper aucune connexion.
+"""
+
+from chat import *
+
+
+def channels(client):
+    client.send("/channels")
+    frame = client.wait_for(lambda f: f[0] == FRAME_NOTICE and f[3].startswith("Channels suivis"))
+    return frame and frame[3]
+
+
+def run(reactors):
+    directory = tempfile.mkdtemp(prefix="chat-test-")
+    options = ["--client-rate", "0", "--reactors", str(reactors), "--history-lines", "5", "--upgrade-socket", os.path.join(directory, "upgrade.sock")]
+    with Server("epoll", *options, directory=directory) as server:
+        alice = join(server.port, "alice", "un")
+        bob = join(server.port, "bob", "deux")
+        dave = join(server.port, "dave", "deux")
+        carol = TextClient(server.port, "carol", "trois")
+        for i in range(12):
+            bob.send("avant %d" % i)
+        last = dave.wait_for(lambda f: f[0] == FRAME_CHAT and f[3].endswith("bob : avant 11\n"))
+        check(last is not None, "messages de bob perdus avant la mise à jour")
+        alice.send("/join trois deux")
+        check(alice.wait_for(lambda f: "Vous avez rejoint le channel 'deux'" in f[3]) is not None, "/join avant la mise à jour")
+        alice.send("/more")
+        check(alice.wait_for(lambda f: f[3].startswith("--- Messages")) is not None, "/more avant la mise à jour")
+        before = channels(alice)
+
+        old = server.process
+        server.start("epoll", *options)
+        check(old.wait(timeout=10) == 0, "l'ancien processus ne s'est pas arrêté proprement")
+
+        # Mêmes connexions, mêmes abonnements, même curseur /more, numérotation continue
+        check(channels(alice) == before, "abonnements perdus : %r au lieu de %r" % (channels(alice), before))
+        bob.send("après")
+        frame = dave.wait_for(lambda f: f[0] == FRAME_CHAT and f[3].endswith("bob : après\n"))
+        check(frame is not None and frame[2] == last[2] + 1, "numéro %r après %d" % (frame and frame[2], last[2]))
+        check(alice.wait_for(lambda f: f[0] == FRAME_CHAT and f[3].endswith("bob : après\n")) is not None, "alice ne suit plus 'deux'")
+        carol.send("texte après")
+        check(alice.wait_for(lambda f: f[0] == FRAME_CHAT and "carol : texte après" in f[3]) is not None, "client texte perdu")
+        alice.send("/more")
+        page = alice.wait_for(lambda f: f[3].startswith("--- "))
+        check(page is not None and page[3].startswith("--- Messages n°1 à 3 "), "curseur /more perdu : %r" % (page and page[3]))
+        check(not alice.closed and not bob.closed and not dave.closed, "connexion coupée par la mise à jour")
+        carol.close()
+    shutil.rmtree(directory, ignore_errors=True)
+
+
+# La mise à jour à chaud n'existe qu'en mode epoll, sans io_uring
+for reactors in (1, 3) if "epoll" in MODES and "--io-uring" not in OPTIONS else ():
+    run(reactors)
+    print("OK upgrade (%d réacteurs)" % reactors)